@@ -18,6 +18,97 @@
 #include <stdio.h>
 #include <pillbig/file.h>
 
+/**
+ *  Audio stream object.
+ */
+typedef struct _PillBigAudioStream *PillBigAudioStream;
+
+/**
+ *  Audio fingerprint index object.
+ */
+typedef struct _PillBigAudioFingerprintIndex *PillBigAudioFingerprintIndex;
+
+/**
+ *  Codec implementation variants, from the most portable to the fastest.
+ */
+typedef enum
+{
+	PillBigAudioCodecVariant_Auto,      /**< Fastest variant supported by the CPU. */
+	PillBigAudioCodecVariant_Scalar,    /**< Portable C. */
+	PillBigAudioCodecVariant_SSE4,      /**< x86 SSE4.1 instructions. */
+	PillBigAudioCodecVariant_AVX2,      /**< x86 AVX2 instructions. */
+}
+PillBigAudioCodecVariant;
+
+/**
+ *  Waveform overview point.
+ */
+typedef struct
+{
+	short             min;    /**< Minimum sample value. */
+	short             max;    /**< Maximum sample value. */
+	unsigned short    rms;    /**< Root mean square of the samples. */
+}
+PillBigAudioWaveformPoint;
+
+/**
+ *  Waveform overview level.
+ */
+typedef struct
+{
+	int                           samples_per_point;    /**< Audio samples summarized by each point. */
+	int                           points_count;         /**< Count of points. */
+	PillBigAudioWaveformPoint    *points;               /**< Points. */
+}
+PillBigAudioWaveformLevel;
+
+/**
+ *  Waveform overview of an audio file, as a pyramid of levels.
+ */
+typedef struct
+{
+	int                           samples_count;    /**< Audio samples count. */
+	int                           levels_count;     /**< Count of levels, from the finest to the coarsest. */
+	PillBigAudioWaveformLevel    *levels;           /**< Levels. */
+}
+PillBigAudioWaveform;
+
+/**
+ *  Audio statistics. Levels are relative to the full scale,
+ *  -HUGE_VAL when the audio is silent.
+ */
+typedef struct
+{
+	int       samples_count;    /**< Audio samples count. */
+	double    peak;             /**< Peak level, in dBFS. */
+	double    rms;              /**< Root mean square level, in dBFS. */
+	double    loudness;         /**< Integrated loudness, in LUFS. */
+	double    dc_offset;        /**< Mean sample value, relative to the full scale. */
+	int       clipped_count;    /**< Count of samples at full scale. */
+}
+PillBigAudioAnalysis;
+
+/**
+ *  Audio fingerprint hash: a pair of spectral peaks close in time.
+ */
+typedef struct
+{
+	unsigned int    hash;    /**< Frequencies of both peaks and their distance. */
+	int             time;    /**< Frame of the first peak. */
+}
+PillBigAudioFingerprintHash;
+
+/**
+ *  Audio fingerprint.
+ */
+typedef struct
+{
+	int                            samples_count;    /**< Audio samples count. */
+	int                            hashes_count;     /**< Count of hashes. */
+	PillBigAudioFingerprintHash   *hashes;           /**< Hashes, sorted by time. */
+}
+PillBigAudioFingerprint;
+
 
 
 BEGIN_C_DECLS
@@ -41,6 +132,29 @@ pillbig_audio_extract(
 	PillBig pillbig, int index, FILE *output,
 	PillBigAudioFormat output_format);
 
+/**
+ *  Extracts and converts a pill.big audio file into a sink.
+ *
+ *  @remarks
+ *  	The RIFF WAVE header is patched in place when the sink is
+ *  	seekable.
+ *
+ *  @param pillbig
+ *  	PillBig object.
+ *  @param index
+ *  	pill.big audio file index to be extracted and converted.
+ *  @param output
+ *  	Sink where the pill.big file will be extracted and converted.
+ *  @param output_format
+ *  	Conversion format.
+ *  @return
+ *  	Operation result.
+ */
+PillBigError
+pillbig_audio_extract_to_sink(
+	PillBig pillbig, int index, PillBigSink output,
+	PillBigAudioFormat output_format);
+
 /**
  *  Extracts and converts a pill.big audio file into a file.
  *
@@ -60,6 +174,473 @@ pillbig_audio_extract_to_filename(
 	PillBig pillbig, int index, const char *filename,
     PillBigAudioFormat output_format);
 
+/**
+ *  Extracts and converts the beginning of a pill.big audio file into
+ *  a stream.
+ *
+ *  @remarks
+ *  	Reading and decoding stop as soon as max_samples samples are
+ *  	written. The RIFF WAVE header announces the samples actually
+ *  	written.
+ *
+ *  @param pillbig
+ *  	PillBig object.
+ *  @param index
+ *  	pill.big audio file index to be extracted and converted.
+ *  @param output
+ *  	Stream where the preview will be written.
+ *  @param output_format
+ *  	Conversion format. Either PillBigAudioFormat_PCM or
+ *  	PillBigAudioFormat_WAVE.
+ *  @param max_samples
+ *  	Maximum count of samples, at the current sample rate. For a
+ *  	duration use milliseconds * pillbig_audio_get_sample_rate() / 1000.
+ *  @return
+ *  	Operation result.
+ */
+PillBigError
+pillbig_audio_extract_preview(PillBig pillbig, int index, FILE *output,
+	PillBigAudioFormat output_format, int max_samples);
+
+/**
+ *  Extracts and converts the beginning of a pill.big audio file into
+ *  a sink.
+ *
+ *  @param pillbig
+ *  	PillBig object.
+ *  @param index
+ *  	pill.big audio file index to be extracted and converted.
+ *  @param output
+ *  	Sink where the preview will be written.
+ *  @param output_format
+ *  	Conversion format. Either PillBigAudioFormat_PCM or
+ *  	PillBigAudioFormat_WAVE.
+ *  @param max_samples
+ *  	Maximum count of samples, at the current sample rate.
+ *  @return
+ *  	Operation result.
+ *  @see pillbig_audio_extract_preview()
+ */
+PillBigError
+pillbig_audio_extract_preview_to_sink(PillBig pillbig, int index, PillBigSink output,
+	PillBigAudioFormat output_format, int max_samples);
+
+/**
+ *  Extracts and converts several pill.big audio files into streams.
+ *
+ *  @remarks
+ *  	Files sharing the same audio format are decoded in parallel,
+ *  	several files at once. Results are the same than calling
+ *  	pillbig_audio_extract() for each file.
+ *
+ *  @param pillbig
+ *  	PillBig object.
+ *  @param indices
+ *  	pill.big audio file indices to be extracted and converted.
+ *  @param outputs
+ *  	Streams where each pill.big file will be extracted and converted.
+ *  @param count
+ *  	Count of indices and outputs.
+ *  @param output_format
+ *  	Conversion format.
+ *  @param results
+ *  	On return, operation result of each file, NULL if not needed.
+ *  	Files not extracted yet when the batch stopped are set to
+ *  	PillBigError_UnknownError.
+ *  @return
+ *  	Operation result. Extraction stops at the first failing file.
+ */
+PillBigError
+pillbig_audio_extract_batch(
+	PillBig pillbig, const int *indices, FILE **outputs, int count,
+	PillBigAudioFormat output_format, PillBigError *results);
+
+/**
+ *  Extracts and converts several pill.big audio files into sinks.
+ *
+ *  @param pillbig
+ *  	PillBig object.
+ *  @param indices
+ *  	pill.big audio file indices to be extracted and converted.
+ *  @param outputs
+ *  	Sinks where each pill.big file will be extracted and converted.
+ *  @param count
+ *  	Count of indices and outputs.
+ *  @param output_format
+ *  	Conversion format.
+ *  @param results
+ *  	On return, operation result of each file, NULL if not needed.
+ *  @return
+ *  	Operation result. Extraction stops at the first failing file.
+ *  @see pillbig_audio_extract_batch()
+ */
+PillBigError
+pillbig_audio_extract_batch_to_sinks(
+	PillBig pillbig, const int *indices, PillBigSink *outputs, int count,
+	PillBigAudioFormat output_format, PillBigError *results);
+
+/**
+ *  Builds a seek index for a pill.big audio file.
+ *
+ *  @remarks
+ *  	The decoder state is recorded every interval samples, so
+ *  	pillbig_audio_decode_range() doesn't need to decode the file
+ *  	from its start and can decode long ranges in parallel.
+ *  	The index is kept until the PillBig object is closed.
+ *
+ *  @param pillbig
+ *  	PillBig object.
+ *  @param index
+ *  	pill.big audio file index.
+ *  @param interval
+ *  	Samples between checkpoints, rounded up to the audio format
+ *  	block size. 0 for the default interval.
+ *  @return
+ *  	Operation result.
+ */
+PillBigError
+pillbig_audio_build_seek_index(PillBig pillbig, int index, int interval);
+
+/**
+ *  Decodes a range of samples of a pill.big audio file into PCM.
+ *
+ *  @remarks
+ *  	Without a seek index the file is decoded from its start.
+ *
+ *  @param pillbig
+ *  	PillBig object.
+ *  @param index
+ *  	pill.big audio file index.
+ *  @param first_sample
+ *  	First sample to decode.
+ *  @param samples_count
+ *  	Count of samples to decode.
+ *  @param output
+ *  	Buffer for samples_count 16 bits PCM samples.
+ *  @return
+ *  	Decoded samples count if successful, lesser than samples_count if
+ *  	the audio ends before. -1 otherwise.
+ */
+int
+pillbig_audio_decode_range(PillBig pillbig, int index,
+	int first_sample, int samples_count, short *output);
+
+/**
+ *  Gets the sample rate of extracted and replacement audio.
+ *
+ *  @param pillbig
+ *  	PillBig object.
+ *  @return
+ *  	Sample rate if successful. -1 otherwise.
+ */
+int
+pillbig_audio_get_sample_rate(PillBig pillbig);
+
+/**
+ *  Sets the sample rate of extracted and replacement audio.
+ *
+ *  @remarks
+ *  	pill.big audio files are sampled at 11025 Hz. Other rates are
+ *  	resampled while converting.
+ *
+ *  @param pillbig
+ *  	PillBig object.
+ *  @param sample_rate
+ *  	Sample rate, between 4000 and 192000 Hz.
+ */
+void
+pillbig_audio_set_sample_rate(PillBig pillbig, int sample_rate);
+
+/**
+ *  Resamples a 16 bits mono PCM audio.
+ *
+ *  @param input
+ *  	Input PCM stream.
+ *  @param output
+ *  	Output PCM stream.
+ *  @param input_rate
+ *  	Input sample rate.
+ *  @param output_rate
+ *  	Output sample rate.
+ *  @return
+ *  	Operation result.
+ */
+PillBigError
+pillbig_audio_resample(FILE *input, FILE *output,
+	int input_rate, int output_rate);
+
+/**
+ *  Gets the codec variant in use.
+ *
+ *  @return
+ *  	Codec variant, never PillBigAudioCodecVariant_Auto.
+ */
+PillBigAudioCodecVariant
+pillbig_audio_get_codec_variant();
+
+/**
+ *  Forces a codec variant for every codec.
+ *
+ *  @remarks
+ *  	By default the fastest variant supported by the CPU is used.
+ *  	Codecs lacking the given variant use their fastest slower one.
+ *  	Every variant produces exactly the same output, forcing one is
+ *  	only useful for testing and benchmarking. It must not be forced
+ *  	while audio files are being decoded in other threads.
+ *
+ *  @param variant
+ *  	Codec variant. PillBigAudioCodecVariant_Auto to restore the default.
+ *  @return
+ *  	Operation result. PillBigError_InvalidCodecVariant if the CPU
+ *  	doesn't support the variant.
+ */
+PillBigError
+pillbig_audio_set_codec_variant(PillBigAudioCodecVariant variant);
+
+/**
+ *  Gets the waveform overview of a pill.big audio file.
+ *
+ *  @remarks
+ *  	Every level summarizes 4 times more samples per point than the
+ *  	previous one, the finest level summarizes 64 samples per point.
+ *  	All levels are computed in a single decoding pass. If a waveform
+ *  	cache is set, waveforms are read from it when available and
+ *  	stored on it otherwise.
+ *
+ *  @param pillbig
+ *  	PillBig object.
+ *  @param index
+ *  	pill.big audio file index.
+ *  @return
+ *  	Waveform if successful, it must be freed with
+ *  	pillbig_audio_waveform_free(). NULL otherwise.
+ */
+PillBigAudioWaveform *
+pillbig_audio_get_waveform(PillBig pillbig, int index);
+
+/**
+ *  Frees a waveform overview.
+ *
+ *  @param waveform
+ *  	Waveform to be freed.
+ */
+void
+pillbig_audio_waveform_free(PillBigAudioWaveform *waveform);
+
+/**
+ *  Sets the directory where waveform overviews are cached.
+ *
+ *  @remarks
+ *  	Cached waveforms are keyed by the file hashname and size.
+ *
+ *  @param pillbig
+ *  	PillBig object.
+ *  @param directory
+ *  	Existing directory. NULL to disable the cache.
+ */
+void
+pillbig_audio_set_waveform_cache(PillBig pillbig, const char *directory);
+
+/**
+ *  Analyzes a pill.big audio file.
+ *
+ *  @remarks
+ *  	Statistics are computed while decoding, at the original
+ *  	sample rate and without extracting the file.
+ *
+ *  @param pillbig
+ *  	PillBig object.
+ *  @param index
+ *  	pill.big audio file index.
+ *  @param analysis
+ *  	On return, audio statistics.
+ *  @return
+ *  	Operation result.
+ */
+PillBigError
+pillbig_audio_analyze(PillBig pillbig, int index, PillBigAudioAnalysis *analysis);
+
+/**
+ *  Analyzes several pill.big audio files at once.
+ *
+ *  @remarks
+ *  	Files of the same audio format are decoded together, in lanes.
+ *  	Analysis stops at the first failure.
+ *
+ *  @param pillbig
+ *  	PillBig object.
+ *  @param indices
+ *  	pill.big audio file indices.
+ *  @param analyses
+ *  	On return, audio statistics of each file.
+ *  @param count
+ *  	Count of indices and analyses.
+ *  @return
+ *  	Operation result.
+ */
+PillBigError
+pillbig_audio_analyze_batch(
+	PillBig pillbig, const int *indices, PillBigAudioAnalysis *analyses, int count);
+
+/**
+ *  Computes the fingerprint of a pill.big audio file.
+ *
+ *  @remarks
+ *  	Fingerprints depend on the spectral peaks of the audio only, so
+ *  	the same audio encoded in different formats, as in the PC and
+ *  	PlayStation pill.big files, gets nearly the same hashes.
+ *
+ *  @param pillbig
+ *  	PillBig object.
+ *  @param index
+ *  	pill.big audio file index.
+ *  @return
+ *  	Fingerprint if successful, it must be freed with
+ *  	pillbig_audio_fingerprint_free(). NULL otherwise.
+ */
+PillBigAudioFingerprint *
+pillbig_audio_get_fingerprint(PillBig pillbig, int index);
+
+/**
+ *  Frees a fingerprint.
+ *
+ *  @param fingerprint
+ *  	Fingerprint to be freed.
+ */
+void
+pillbig_audio_fingerprint_free(PillBigAudioFingerprint *fingerprint);
+
+/**
+ *  Creates an empty fingerprint index.
+ *
+ *  @return
+ *  	Fingerprint index if successful. NULL otherwise.
+ */
+PillBigAudioFingerprintIndex
+pillbig_audio_fingerprint_index_new();
+
+/**
+ *  Frees a fingerprint index.
+ *
+ *  @param index
+ *  	Fingerprint index to be freed.
+ */
+void
+pillbig_audio_fingerprint_index_free(PillBigAudioFingerprintIndex index);
+
+/**
+ *  Adds a fingerprint to an index.
+ *
+ *  @param index
+ *  	Fingerprint index.
+ *  @param id
+ *  	Identifier returned when the fingerprint matches, usually a
+ *  	pill.big file index. Not negative.
+ *  @param fingerprint
+ *  	Fingerprint to be added. Hashes are copied.
+ *  @return
+ *  	Operation result.
+ */
+PillBigError
+pillbig_audio_fingerprint_index_add(PillBigAudioFingerprintIndex index, int id,
+	const PillBigAudioFingerprint *fingerprint);
+
+/**
+ *  Finds the fingerprint of an index best matching a given one.
+ *
+ *  @remarks
+ *  	Only the hashes of the given fingerprint are looked up, each one
+ *  	by binary search, so matching time grows logarithmically with the
+ *  	count of indexed fingerprints.
+ *
+ *  @param index
+ *  	Fingerprint index.
+ *  @param fingerprint
+ *  	Fingerprint to be matched.
+ *  @param score
+ *  	On return, if not NULL, fraction of hashes matching with the same
+ *  	time offset, from 0 to 1.
+ *  @return
+ *  	Identifier of the best matching fingerprint. -1 if none matches.
+ */
+int
+pillbig_audio_fingerprint_index_match(PillBigAudioFingerprintIndex index,
+	const PillBigAudioFingerprint *fingerprint, double *score);
+
+/**
+ *  Opens a pill.big audio file for incremental decoding.
+ *
+ *  @remarks
+ *  	Audio is decoded on demand by pillbig_audio_stream_read(), only
+ *  	the encoded data needed is read. The stream keeps a fixed size
+ *  	state allocated when it is opened.
+ *
+ *  @param pillbig
+ *  	PillBig object.
+ *  @param index
+ *  	pill.big audio file index.
+ *  @param output_format
+ *  	Decoded audio format. Only PillBigAudioFormat_PCM is supported.
+ *  @return
+ *  	Audio stream if successful. NULL otherwise.
+ */
+PillBigAudioStream
+pillbig_audio_stream_open(PillBig pillbig, int index,
+	PillBigAudioFormat output_format);
+
+/**
+ *  Decodes the next frames of an audio stream.
+ *
+ *  @param stream
+ *  	Audio stream.
+ *  @param buffer
+ *  	Buffer for frames 16 bits PCM samples.
+ *  @param frames
+ *  	Maximum frames to decode.
+ *  @return
+ *  	Decoded frames count if successful, 0 at the end of the audio.
+ *  	-1 otherwise.
+ */
+int
+pillbig_audio_stream_read(PillBigAudioStream stream, short *buffer, int frames);
+
+/**
+ *  Moves an audio stream to a given frame.
+ *
+ *  @remarks
+ *  	Seeking backwards decodes from the start of the audio unless a seek
+ *  	index was built with pillbig_audio_build_seek_index().
+ *
+ *  @param stream
+ *  	Audio stream.
+ *  @param frame
+ *  	Frame to move to.
+ *  @return
+ *  	Operation result.
+ */
+PillBigError
+pillbig_audio_stream_seek(PillBigAudioStream stream, int frame);
+
+/**
+ *  Gets the current frame of an audio stream.
+ *
+ *  @param stream
+ *  	Audio stream.
+ *  @return
+ *  	Next frame to be decoded if successful. -1 otherwise.
+ */
+int
+pillbig_audio_stream_tell(PillBigAudioStream stream);
+
+/**
+ *  Closes an audio stream.
+ *
+ *  @param stream
+ *  	Audio stream to be closed.
+ */
+void
+pillbig_audio_stream_close(PillBigAudioStream stream);
+
 /**
  *  Replaces the contents of a pill.big file from external audio data.
  *
@@ -133,6 +714,23 @@ pillbig_audio_replace_from_filename(
 PillBigAudioFormat
 pillbig_audio_get_format(PillBig pillbig, int index);
 
+/**
+ *  Gets the duration of an audio file.
+ *
+ *  @remarks
+ *  	VAG files must be read completely to know it, unless
+ *  	pillbig_probe_entries() or pillbig_db_generate() already did.
+ *
+ *  @param pillbig
+ *  	PillBig object.
+ *  @param index
+ *  	pill.big file index.
+ *  @return
+ *  	Duration in seconds if known. -1 otherwise.
+ */
+double
+pillbig_audio_get_duration(PillBig pillbig, int index);
+
 END_C_DECLS
 
 #endif
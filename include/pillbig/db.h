@@ -16,6 +16,8 @@
 #define __PILLBIG_DB_H__
 
 #include <pillbig/common.h>
+#include <pillbig/error.h>
+#include <pillbig/indexset.h>
 
 typedef struct
 {
@@ -32,6 +34,9 @@ typedef struct
 	PillBigDBAudioSpeech    *speeches;          /**< Speeches list. */
 	PillBigAudioFormat       format;
 	int                      rate;
+	int                      samples_count;     /**< Samples count. 0 if unknown. */
+	int                      header_size;       /**< Bytes of header before the audio data. */
+	unsigned int             checksum;          /**< Checksum of the file ends, see pillbig_db_generate(). 0 if unknown. */
 
 }
 PillBigDBAudioEntry;
@@ -61,6 +66,43 @@ PillBigDBEntry;
  */
 typedef struct _PillBigDB *PillBigDB;
 
+/**
+ *  Language ID standing for the language preferred by the locale.
+ */
+#define DB_LANGUAGE_PREFERRED -1
+
+/**
+ *  @brief
+ *  	Database entry metadata columns.
+ */
+typedef enum
+{
+	PillBigDBColumn_Hash,         /**< File hash. */
+	PillBigDBColumn_Offset,       /**< File offset. */
+	PillBigDBColumn_Size,         /**< File size. */
+	PillBigDBColumn_FileType,     /**< File type. */
+	PillBigDBColumn_Used,         /**< 1 if the file is used. 0 otherwise. */
+	PillBigDBColumn_Format,       /**< Audio format. PillBigAudioFormat_Unknown for other files. */
+	PillBigDBColumn_Rate,         /**< Audio sample rate. 0 for other files. */
+	PillBigDBColumn_Character,    /**< Character ID of audio files. -1 if none. */
+}
+PillBigDBColumn;
+
+/**
+ *  @brief
+ *  	Comparisons of metadata values with a filter value.
+ */
+typedef enum
+{
+	PillBigDBCompare_Equal,           /**< Values equal to the filter one. */
+	PillBigDBCompare_NotEqual,        /**< Values not equal to the filter one. */
+	PillBigDBCompare_Less,            /**< Values lower than the filter one. */
+	PillBigDBCompare_LessEqual,       /**< Values not greater than the filter one. */
+	PillBigDBCompare_Greater,         /**< Values greater than the filter one. */
+	PillBigDBCompare_GreaterEqual,    /**< Values not lower than the filter one. */
+}
+PillBigDBCompare;
+
 
 
 BEGIN_C_DECLS
@@ -116,6 +158,26 @@ pillbig_db_get_entry(PillBigDB db, int index);
 int
 pillbig_db_get_entry_index_by_hash(PillBigDB db, PillBigFileHash hash);
 
+/**
+ *  Gets the indices of several database files looking for their
+ *  hashnames.
+ *
+ *  @param db
+ *  	PillBigDB object.
+ *  @param hashes
+ *  	File hashnames.
+ *  @param count
+ *  	Count of hashnames.
+ *  @param indices
+ *  	On return, the file index of each hashname. -1 for those not
+ *  	found.
+ *  @return
+ *  	Operation result.
+ */
+PillBigError
+pillbig_db_get_entry_indices_by_hash(PillBigDB db, const PillBigFileHash *hashes,
+	int count, int *indices);
+
 /**
  *  Gets the index of a database file looking for its position.
  *
@@ -130,6 +192,240 @@ pillbig_db_get_entry_index_by_hash(PillBigDB db, PillBigFileHash hash);
 int
 pillbig_db_get_entry_index_by_position(PillBigDB db, int position);
 
+/**
+ *  Gets the indices of several database files looking for their
+ *  positions.
+ *
+ *  @param db
+ *  	PillBigDB object.
+ *  @param positions
+ *  	File entry positions.
+ *  @param count
+ *  	Count of positions.
+ *  @param indices
+ *  	On return, the file index at each position. -1 for those
+ *  	without an entry.
+ *  @return
+ *  	Operation result.
+ */
+PillBigError
+pillbig_db_get_entry_indices_by_position(PillBigDB db, const int *positions,
+	int count, int *indices);
+
+/**
+ *  Gets the index of a database file looking for its name.
+ *
+ *  @param db
+ *  	PillBigDB object.
+ *  @param filename
+ *  	Filename, as in the database (e.g. GAME\\AV0001.FAG). Case
+ *  	is ignored.
+ *  @return
+ *  	File index if found. -1 otherwise.
+ */
+int
+pillbig_db_get_entry_index_by_filename(PillBigDB db, const char *filename);
+
+/**
+ *  Finds the database files whose name starts with a prefix.
+ *
+ *  @param db
+ *  	PillBigDB object.
+ *  @param prefix
+ *  	Filename prefix (e.g. GAME\\). Case is ignored.
+ *  @return
+ *  	Set of file indices if successful, to be freed with
+ *  	pillbig_index_set_free(). NULL otherwise.
+ */
+PillBigIndexSet
+pillbig_db_find_by_prefix(PillBigDB db, const char *prefix);
+
+/**
+ *  Finds the database files whose name matches a pattern.
+ *
+ *  @remarks
+ *  	Patterns are looked up by their longest literal prefix or
+ *  	suffix, so only names sharing it are matched one by one.
+ *
+ *  @param db
+ *  	PillBigDB object.
+ *  @param pattern
+ *  	Filename pattern, where * matches any characters and ? any
+ *  	single character (e.g. *.VAG). Case is ignored.
+ *  @return
+ *  	Set of file indices if successful, to be freed with
+ *  	pillbig_index_set_free(). NULL otherwise.
+ */
+PillBigIndexSet
+pillbig_db_find_by_pattern(PillBigDB db, const char *pattern);
+
+/**
+ *  Searches the speeches of the database files.
+ *
+ *  @remarks
+ *  	Speeches and query are split in terms, runs of letters and
+ *  	digits compared ignoring case and Latin-1 diacritics (e.g.
+ *  	circulo matches Círculo). A file matches when a speech language
+ *  	has every term of the query. Files are ranked by the frequency
+ *  	of the terms in their speeches, weighted by their rarity among
+ *  	the speeches of that language.
+ *
+ *  @param db
+ *  	PillBigDB object.
+ *  @param query
+ *  	Terms to search, in UTF-8.
+ *  @param language
+ *  	Language of the speeches to search (e.g. en). NULL for any.
+ *  @param character
+ *  	Character who utters the speeches. NULL for any.
+ *  @param indices
+ *  	On return, the file indices found, best ranked first.
+ *  @param max_count
+ *  	Size of indices. Files beyond it are counted but not stored.
+ *  @return
+ *  	Count of files found. -1 on error.
+ */
+int
+pillbig_db_search_speeches(PillBigDB db, const char *query, const char *language,
+	const char *character, int *indices, int max_count);
+
+/**
+ *  Gets the count of languages of the database speeches.
+ *
+ *  @param db
+ *  	PillBigDB object.
+ *  @return
+ *  	Count of languages. -1 on error.
+ */
+int
+pillbig_db_get_languages_count(PillBigDB db);
+
+/**
+ *  Gets a language of the database speeches.
+ *
+ *  @param db
+ *  	PillBigDB object.
+ *  @param language
+ *  	Language ID, from 0 to the count of languages.
+ *  @return
+ *  	Language (e.g. en) if successful. NULL otherwise.
+ */
+const char *
+pillbig_db_get_language(PillBigDB db, int language);
+
+/**
+ *  Gets the ID of a language of the database speeches.
+ *
+ *  @param db
+ *  	PillBigDB object.
+ *  @param language
+ *  	Language (e.g. en).
+ *  @return
+ *  	Language ID if there are speeches in it. -1 otherwise.
+ */
+int
+pillbig_db_get_language_id(PillBigDB db, const char *language);
+
+/**
+ *  Sets the locales whose languages are preferred for the speeches.
+ *
+ *  @remarks
+ *  	Until set, the locales are taken from the LANGUAGE environment
+ *  	variable and then from LC_ALL, LC_MESSAGES or LANG.
+ *
+ *  @param db
+ *  	PillBigDB object.
+ *  @param locales
+ *  	Locales by preference, separated by colons (e.g.
+ *  	es_ES.UTF-8:en). NULL for the ones of the environment.
+ *  @return
+ *  	Operation result.
+ */
+PillBigError
+pillbig_db_set_locale(PillBigDB db, const char *locales);
+
+/**
+ *  Gets the speech of a database file in a language.
+ *
+ *  @remarks
+ *  	Speeches are looked up in a table by file and language, built
+ *  	once along with the locale preference.
+ *
+ *  @param db
+ *  	PillBigDB object.
+ *  @param index
+ *  	File index.
+ *  @param language
+ *  	Language ID. DB_LANGUAGE_PREFERRED for the best ranked language
+ *  	the file has a speech text in, or else the first speech with
+ *  	text.
+ *  @return
+ *  	Speech if the file has one in the language. NULL otherwise.
+ */
+const PillBigDBAudioSpeech *
+pillbig_db_get_speech(PillBigDB db, int index, int language);
+
+/**
+ *  Gets the ID of a character of the database audio files.
+ *
+ *  @param db
+ *  	PillBigDB object.
+ *  @param character
+ *  	Character (e.g. Kain).
+ *  @return
+ *  	Character ID, as in PillBigDBColumn_Character. -1 if no file
+ *  	has it.
+ */
+int
+pillbig_db_get_character_id(PillBigDB db, const char *character);
+
+/**
+ *  Gets a metadata column of the database entries.
+ *
+ *  @param db
+ *  	PillBigDB object.
+ *  @param column
+ *  	Column.
+ *  @return
+ *  	Values of the column by file index, as many as the highest
+ *  	index plus one, if successful. NULL otherwise. Indices with no
+ *  	entry have undefined values.
+ */
+const int *
+pillbig_db_get_column(PillBigDB db, PillBigDBColumn column);
+
+/**
+ *  Finds the database entries whose metadata satisfies a comparison.
+ *
+ *  @remarks
+ *  	Columns are compared several values at once with SIMD
+ *  	instructions where available. Hashes are compared as unsigned
+ *  	values. Sets can be combined with pillbig_index_set_and(),
+ *  	pillbig_index_set_or() and pillbig_index_set_not().
+ *
+ *  @code
+ *  set = pillbig_db_filter(db, PillBigDBColumn_Size, PillBigDBCompare_Greater, 102400);
+ *  kain = pillbig_db_filter(db, PillBigDBColumn_Character, PillBigDBCompare_Equal,
+ *  	pillbig_db_get_character_id(db, "Kain"));
+ *  pillbig_index_set_and(set, kain);
+ *  @endcode
+ *
+ *  @param db
+ *  	PillBigDB object.
+ *  @param column
+ *  	Column.
+ *  @param compare
+ *  	Comparison of the column values with value.
+ *  @param value
+ *  	Filter value.
+ *  @return
+ *  	Set of file indices with an entry satisfying the comparison if
+ *  	successful, to be freed with pillbig_index_set_free(). NULL
+ *  	otherwise.
+ */
+PillBigIndexSet
+pillbig_db_filter(PillBigDB db, PillBigDBColumn column, PillBigDBCompare compare, int value);
+
 /**
  *  Checks either a file entry exists in the database.
  *
@@ -144,6 +440,38 @@ pillbig_db_get_entry_index_by_position(PillBigDB db, int position);
 int
 pillbig_db_has_entry(PillBigDB db, int index);
 
+/**
+ *  Writes a database as a compiled image.
+ *
+ *  @remarks
+ *  	pillbig_db_open() maps compiled images instead of parsing them,
+ *  	either given directly or named as the XML document with a .bin
+ *  	extension and not older than it. Images are only valid on hosts
+ *  	with the same byte order.
+ *
+ *  @param db
+ *  	PillBigDB object.
+ *  @param filename
+ *  	Image filename.
+ *  @return
+ *  	Operation result.
+ */
+PillBigError
+pillbig_db_compile(PillBigDB db, const char *filename);
+
+/**
+ *  Writes a database as an XML document following pillbig.dtd.
+ *
+ *  @param db
+ *  	PillBigDB object.
+ *  @param filename
+ *  	Document filename.
+ *  @return
+ *  	Operation result.
+ */
+PillBigError
+pillbig_db_save(PillBigDB db, const char *filename);
+
 /**
  *  Closes a database.
  *
@@ -22,11 +22,14 @@ typedef enum
 	PillBigError_SystemError,                   /**< A system error occured. */
 	PillBigError_NotImplemented,                /**< Current function isn't implemented yet. */
 	PillBigError_UnsupportedFormat,             /**< Unsupported format. */
+	PillBigError_BufferTooSmall,                /**< The output buffer is too small. */
 
 	PillBigError_InvalidPillBigObject = 32,     /**< Invalid PillBig object. */
 	PillBigError_InvalidStream,                 /**< Invalid stream. */
 	PillBigError_InvalidReplaceMode,            /**< Invalid replacement mode. */
 	PillBigError_InvalidFilename,               /**< Provided filename was invalid. */
+	PillBigError_InvalidSampleRate,             /**< Invalid audio sample rate. */
+	PillBigError_InvalidCodecVariant,           /**< Codec variant not supported by the CPU. */
 
 	PillBigError_FileIndexOutOfRange = 64,      /**< File index out of range. */
 	PillBigError_ExternalFileShorter,           /**< The replacement file was shorter than expected. */
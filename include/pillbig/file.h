@@ -19,6 +19,8 @@
 #include <stdio.h>
 #include <pillbig/common.h>
 #include <pillbig/error.h>
+#include <pillbig/sink.h>
+#include <pillbig/source.h>
 #include <pillbig/db.h>
 
 
@@ -79,6 +81,23 @@ pillbig_open(FILE *input);
 PillBig
 pillbig_open_from_filename(const char *filename);
 
+/**
+ *  Opens a pill.big file from an input source.
+ *
+ *  @remarks
+ *  	Every read goes through the source, so pill.big files in memory
+ *  	don't need to be written to a file first.
+ *
+ *  @param source
+ *  	Input source. It must outlive the PillBig object and isn't
+ *  	freed by pillbig_close().
+ *  @return
+ *  	PillBig object if successful.
+ *  	NULL otherwise.
+ */
+PillBig
+pillbig_open_from_source(PillBigSource source);
+
 /**
  *  Gets the platform for the Blood Omen's pill.big metafile.
  *
@@ -202,6 +221,79 @@ pillbig_set_db(PillBig pillbig, PillBigDB db);
 PillBigFileType
 pillbig_file_get_type(PillBig pillbig, int index);
 
+/**
+ *  Gets the type of every pill.big file.
+ *
+ *  @remarks
+ *  	Files missing from the database, or every file if there is no
+ *  	database, are classified from their first bytes, reading pill.big
+ *  	sequentially in a single pass. Only bitmaps and audio files are
+ *  	recognized this way.
+ *
+ *  @param pillbig
+ *  	PillBig object.
+ *  @param filetypes
+ *  	Array of, at least, pillbig_get_files_count() elements where
+ *  	the file types will be stored.
+ *  @return
+ *  	Operation result.
+ */
+PillBigError
+pillbig_file_get_types(PillBig pillbig, PillBigFileType *filetypes);
+
+/**
+ *  Probes the metadata of every pill.big file in a single pass.
+ *
+ *  @remarks
+ *  	Files are visited in offset order so pill.big is read sequentially.
+ *  	The probed metadata is cached by the PillBig object, later calls to
+ *  	pillbig_file_get_type(), pillbig_audio_get_format() or
+ *  	pillbig_audio_extract() won't probe the files again.
+ *
+ *  @param pillbig
+ *  	PillBig object.
+ *  @param count_samples
+ *  	1 if the samples count of the audio files must be probed too.
+ *  	VAG files must be read completely to know it.
+ *  @return
+ *  	Operation result.
+ */
+PillBigError
+pillbig_probe_entries(PillBig pillbig, int count_samples);
+
+/**
+ *  Generates a database by scanning every pill.big file.
+ *
+ *  @remarks
+ *  	Files are classified and the format and samples count of audio
+ *  	files probed like pillbig_probe_entries() does, split among
+ *  	threads reading contiguous runs of files in offset order.
+ *  	Streams, file descriptors and memory are read concurrently,
+ *  	other sources from a single thread. The attached database, if
+ *  	any, is ignored.
+ *
+ *  	Audio entries get their samples count, header size and the
+ *  	FNV-1a checksum of the first and last 256 bytes of the file.
+ *  	Audio functions trust those of an attached database instead of
+ *  	scanning the file when its size and checksum match.
+ *
+ *  @param pillbig
+ *  	PillBig object.
+ *  @param names
+ *  	Candidate filenames. Those whose hash matches a file name it.
+ *  	May be NULL.
+ *  @param names_count
+ *  	Count of candidate filenames.
+ *  @param threads_count
+ *  	Count of threads. 0 for one per online processor.
+ *  @return
+ *  	PillBigDB object, to be closed by the caller, if successful.
+ *  	NULL otherwise.
+ */
+PillBigDB
+pillbig_db_generate(PillBig pillbig, const char **names, int names_count,
+	int threads_count);
+
 /**
  *  Dumps the contents of a pill.big file into a stream.
  *
@@ -217,6 +309,21 @@ pillbig_file_get_type(PillBig pillbig, int index);
 PillBigError
 pillbig_file_extract(PillBig pillbig, int index, FILE *output);
 
+/**
+ *  Dumps the contents of a pill.big file into a sink.
+ *
+ *  @param pillbig
+ *  	PillBig object.
+ *  @param index
+ *  	pill.big file index to be dumped.
+ *  @param output
+ *  	Sink where the pill.big file will be dumped.
+ *  @return
+ *  	Operation result.
+ */
+PillBigError
+pillbig_file_extract_to_sink(PillBig pillbig, int index, PillBigSink output);
+
 /**
  * Dumps the contents of a pill.big file into a file.
  *
@@ -0,0 +1,171 @@
+/*
+ *  libpillbig
+ *  A library to deal with Blood Omen: Legacy of Kain pill.big files.
+ */
+
+/**
+ *  @file
+ *  @brief
+ *  	Sets of file indices.
+ *
+ *  @author  Alfonso Ruzafa <superruzafa@gmail.com>
+ *  @version $Id$
+ */
+
+#ifndef __PILLBIG_INDEXSET_H__
+#define __PILLBIG_INDEXSET_H__
+
+#include <pillbig/common.h>
+#include <pillbig/error.h>
+
+/**
+ *  Set of file indices, from 0 to a fixed capacity.
+ */
+typedef struct _PillBigIndexSet *PillBigIndexSet;
+
+
+
+BEGIN_C_DECLS
+
+/**
+ *  Creates an empty index set.
+ *
+ *  @param capacity
+ *  	Indices allowed in the set are lower than this.
+ *  @return
+ *  	PillBigIndexSet if successful. NULL otherwise.
+ */
+PillBigIndexSet
+pillbig_index_set_new(int capacity);
+
+/**
+ *  Frees an index set.
+ *
+ *  @param set
+ *  	Index set.
+ */
+void
+pillbig_index_set_free(PillBigIndexSet set);
+
+/**
+ *  Adds an index to a set.
+ *
+ *  @param set
+ *  	Index set.
+ *  @param index
+ *  	Index, lower than the set capacity.
+ *  @return
+ *  	Operation result.
+ */
+PillBigError
+pillbig_index_set_add(PillBigIndexSet set, int index);
+
+/**
+ *  Checks whether an index belongs to a set.
+ *
+ *  @param set
+ *  	Index set.
+ *  @param index
+ *  	Index.
+ *  @return
+ *  	1 if the index is in the set. 0 otherwise.
+ */
+int
+pillbig_index_set_contains(PillBigIndexSet set, int index);
+
+/**
+ *  Gets the count of indices of a set.
+ *
+ *  @param set
+ *  	Index set.
+ *  @return
+ *  	Count of indices. -1 on error.
+ */
+int
+pillbig_index_set_get_count(PillBigIndexSet set);
+
+/**
+ *  Gets the capacity of a set.
+ *
+ *  @param set
+ *  	Index set.
+ *  @return
+ *  	Capacity. -1 on error.
+ */
+int
+pillbig_index_set_get_capacity(PillBigIndexSet set);
+
+/**
+ *  Gets the next index of a set, to walk it in ascending order.
+ *
+ *  @code
+ *  for (i = pillbig_index_set_next(set, 0); i != -1; i = pillbig_index_set_next(set, i + 1))
+ *  @endcode
+ *
+ *  @param set
+ *  	Index set.
+ *  @param index
+ *  	Lowest index to return.
+ *  @return
+ *  	First index of the set not lower than index. -1 if there is none.
+ */
+int
+pillbig_index_set_next(PillBigIndexSet set, int index);
+
+/**
+ *  Gets the indices of a set in ascending order, as taken by the
+ *  batch functions.
+ *
+ *  @param set
+ *  	Index set.
+ *  @param indices
+ *  	On return, the indices of the set.
+ *  @param max_count
+ *  	Size of indices. The following indices are left out.
+ *  @return
+ *  	Count of indices stored. -1 on error.
+ */
+int
+pillbig_index_set_get_indices(PillBigIndexSet set, int *indices, int max_count);
+
+/**
+ *  Intersects a set with another one.
+ *
+ *  @param set
+ *  	Index set, keeping only the indices also in other.
+ *  @param other
+ *  	Index set with the same capacity.
+ *  @return
+ *  	Operation result.
+ */
+PillBigError
+pillbig_index_set_and(PillBigIndexSet set, PillBigIndexSet other);
+
+/**
+ *  Joins a set with another one.
+ *
+ *  @param set
+ *  	Index set, adding the indices in other.
+ *  @param other
+ *  	Index set with the same capacity.
+ *  @return
+ *  	Operation result.
+ */
+PillBigError
+pillbig_index_set_or(PillBigIndexSet set, PillBigIndexSet other);
+
+/**
+ *  Complements a set.
+ *
+ *  @param set
+ *  	Index set, getting the indices lower than its capacity it
+ *  	hadn't.
+ *  @return
+ *  	Operation result.
+ */
+PillBigError
+pillbig_index_set_not(PillBigIndexSet set);
+
+END_C_DECLS
+
+#endif
@@ -17,8 +17,11 @@
 
 #include <pillbig/common.h>
 #include <pillbig/error.h>
+#include <pillbig/sink.h>
+#include <pillbig/source.h>
 #include <pillbig/file.h>
 #include <pillbig/audio.h>
+#include <pillbig/indexset.h>
 #include <pillbig/db.h>
 
 #endif
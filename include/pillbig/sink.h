@@ -0,0 +1,251 @@
+/*
+ *  libpillbig
+ *  A library to deal with Blood Omen: Legacy of Kain pill.big files.
+ */
+
+/**
+ *  @file
+ *  @brief
+ *  	Output sinks.
+ *
+ *  @author  Alfonso Ruzafa <superruzafa@gmail.com>
+ *  @version $Id$
+ */
+
+#ifndef __PILLBIG_SINK_H__
+#define __PILLBIG_SINK_H__
+
+#include <stdio.h>
+#include <pillbig/common.h>
+#include <pillbig/error.h>
+
+/**
+ *  Output sink object.
+ */
+typedef struct _PillBigSink *PillBigSink;
+
+/**
+ *  Callback writing data into a user defined output.
+ *
+ *  @param data
+ *  	Data to be written.
+ *  @param size
+ *  	Data size.
+ *  @param user_data
+ *  	User data given when the sink was created.
+ *  @return
+ *  	Count of bytes written. -1 on error.
+ */
+typedef
+int
+(*PillBigSinkWriteCallback)(const void *data, int size, void *user_data);
+
+/**
+ *  Callback moving the position of a user defined output.
+ *
+ *  @param position
+ *  	Absolute position, in bytes.
+ *  @param user_data
+ *  	User data given when the sink was created.
+ *  @return
+ *  	0 if successful. -1 otherwise.
+ */
+typedef
+int
+(*PillBigSinkSeekCallback)(long position, void *user_data);
+
+/**
+ *  Block of data for vectored writes.
+ */
+typedef struct
+{
+	const void    *data;    /**< Data to be written. */
+	int            size;    /**< Data size. */
+}
+PillBigSinkVector;
+
+
+
+BEGIN_C_DECLS
+
+/**
+ *  Creates a sink writing into a stream.
+ *
+ *  @remarks
+ *  	Positions are the stream ones. The sink is seekable if the
+ *  	stream is.
+ *
+ *  @param file
+ *  	Output stream. It isn't closed by the sink.
+ *  @return
+ *  	Sink if successful. NULL otherwise.
+ */
+PillBigSink
+pillbig_sink_new_from_file(FILE *file);
+
+/**
+ *  Creates a sink writing into a file descriptor.
+ *
+ *  @remarks
+ *  	Positions are the file descriptor ones. The sink is seekable
+ *  	if the file descriptor is.
+ *
+ *  @param fd
+ *  	Output file descriptor. It isn't closed by the sink.
+ *  @return
+ *  	Sink if successful. NULL otherwise.
+ */
+PillBigSink
+pillbig_sink_new_from_fd(int fd);
+
+/**
+ *  Creates a sink writing into a memory buffer grown as needed.
+ *
+ *  @return
+ *  	Sink if successful. NULL otherwise.
+ */
+PillBigSink
+pillbig_sink_new_memory();
+
+/**
+ *  Creates a sink writing into a caller buffer.
+ *
+ *  @remarks
+ *  	Writes past the end of the buffer fail with
+ *  	PillBigError_BufferTooSmall and nothing is written.
+ *
+ *  @param buffer
+ *  	Output buffer. It must outlive the sink.
+ *  @param size
+ *  	Buffer size.
+ *  @return
+ *  	Sink if successful. NULL otherwise.
+ */
+PillBigSink
+pillbig_sink_new_from_buffer(void *buffer, int size);
+
+/**
+ *  Creates a sink writing through user callbacks.
+ *
+ *  @param write
+ *  	Write callback.
+ *  @param seek
+ *  	Seek callback. NULL if the output isn't seekable.
+ *  @param user_data
+ *  	User data passed to the callbacks.
+ *  @return
+ *  	Sink if successful. NULL otherwise.
+ */
+PillBigSink
+pillbig_sink_new_from_callback(PillBigSinkWriteCallback write,
+	PillBigSinkSeekCallback seek, void *user_data);
+
+/**
+ *  Flushes and frees a sink.
+ *
+ *  @remarks
+ *  	The error state is kept as it was, a failed final flush is not
+ *  	reported. Call pillbig_sink_flush() first to check it.
+ *
+ *  @param sink
+ *  	Sink to be freed.
+ */
+void
+pillbig_sink_free(PillBigSink sink);
+
+/**
+ *  Writes data into a sink.
+ *
+ *  @remarks
+ *  	Small writes are gathered in the sink buffer and written
+ *  	at once when it fills up or the sink is flushed.
+ *
+ *  @param sink
+ *  	Sink.
+ *  @param data
+ *  	Data to be written.
+ *  @param size
+ *  	Data size.
+ *  @return
+ *  	Operation result.
+ */
+PillBigError
+pillbig_sink_write(PillBigSink sink, const void *data, int size);
+
+/**
+ *  Writes several blocks of data into a sink.
+ *
+ *  @param sink
+ *  	Sink.
+ *  @param vectors
+ *  	Blocks to be written, in order.
+ *  @param count
+ *  	Count of blocks.
+ *  @return
+ *  	Operation result.
+ */
+PillBigError
+pillbig_sink_writev(PillBigSink sink, const PillBigSinkVector *vectors, int count);
+
+/**
+ *  Writes the buffered data into the sink output.
+ *
+ *  @param sink
+ *  	Sink.
+ *  @return
+ *  	Operation result.
+ */
+PillBigError
+pillbig_sink_flush(PillBigSink sink);
+
+/**
+ *  Checks whether a sink allows seeking.
+ *
+ *  @param sink
+ *  	Sink.
+ *  @return
+ *  	1 if sink is seekable. 0 otherwise.
+ */
+int
+pillbig_sink_is_seekable(PillBigSink sink);
+
+/**
+ *  Gets the current position of a sink.
+ *
+ *  @param sink
+ *  	Sink.
+ *  @return
+ *  	Position, buffered data included. -1 on error.
+ */
+long
+pillbig_sink_tell(PillBigSink sink);
+
+/**
+ *  Moves the current position of a seekable sink.
+ *
+ *  @param sink
+ *  	Sink.
+ *  @param position
+ *  	Absolute position, as returned by pillbig_sink_tell().
+ *  @return
+ *  	Operation result.
+ */
+PillBigError
+pillbig_sink_seek(PillBigSink sink, long position);
+
+/**
+ *  Gets the data written into a memory or a caller buffer sink.
+ *
+ *  @param sink
+ *  	Sink.
+ *  @param size
+ *  	On return, size of the data written.
+ *  @return
+ *  	Data written, owned by the sink. NULL for other sinks.
+ */
+const void *
+pillbig_sink_get_data(PillBigSink sink, int *size);
+
+END_C_DECLS
+
+#endif
@@ -0,0 +1,206 @@
+/*
+ *  libpillbig
+ *  A library to deal with Blood Omen: Legacy of Kain pill.big files.
+ */
+
+/**
+ *  @file
+ *  @brief
+ *  	Input sources.
+ *
+ *  @author  Alfonso Ruzafa <superruzafa@gmail.com>
+ *  @version $Id$
+ */
+
+#ifndef __PILLBIG_SOURCE_H__
+#define __PILLBIG_SOURCE_H__
+
+#include <stdio.h>
+#include <pillbig/common.h>
+#include <pillbig/error.h>
+
+/**
+ *  Input source object.
+ */
+typedef struct _PillBigSource *PillBigSource;
+
+/**
+ *  Callback reading data at a given position of a user defined input.
+ *
+ *  @param buffer
+ *  	Buffer where data will be read.
+ *  @param size
+ *  	Count of bytes to read.
+ *  @param offset
+ *  	Absolute position of the data, in bytes.
+ *  @param user_data
+ *  	User data given when the source was created.
+ *  @return
+ *  	Count of bytes read, 0 past the end of the input. -1 on error.
+ */
+typedef
+int
+(*PillBigSourceReadCallback)(void *buffer, int size, long offset, void *user_data);
+
+
+
+BEGIN_C_DECLS
+
+/**
+ *  Creates a source reading from a stream.
+ *
+ *  @remarks
+ *  	Reads move the stream position.
+ *
+ *  @param file
+ *  	Input stream. It must be seekable and isn't closed by the source.
+ *  @return
+ *  	Source if successful. NULL otherwise.
+ */
+PillBigSource
+pillbig_source_new_from_file(FILE *file);
+
+/**
+ *  Creates a source reading from a file descriptor.
+ *
+ *  @remarks
+ *  	Reads don't move the file descriptor position, so the source
+ *  	can be shared by several readers.
+ *
+ *  @param fd
+ *  	Input file descriptor. It must be seekable and isn't closed
+ *  	by the source.
+ *  @return
+ *  	Source if successful. NULL otherwise.
+ */
+PillBigSource
+pillbig_source_new_from_fd(int fd);
+
+/**
+ *  Creates a source reading from a file descriptor mapped in memory.
+ *
+ *  @param fd
+ *  	Input file descriptor of a regular file. It isn't closed by the
+ *  	source but may be closed once the source is created.
+ *  @return
+ *  	Source if successful. NULL otherwise.
+ */
+PillBigSource
+pillbig_source_new_mapped(int fd);
+
+/**
+ *  Creates a source reading from memory.
+ *
+ *  @param data
+ *  	Input data. It isn't copied, so it must outlive the source.
+ *  @param size
+ *  	Data size.
+ *  @return
+ *  	Source if successful. NULL otherwise.
+ */
+PillBigSource
+pillbig_source_new_from_memory(const void *data, long size);
+
+/**
+ *  Creates a source reading through a user callback.
+ *
+ *  @param read
+ *  	Read callback.
+ *  @param size
+ *  	Input size. -1 if unknown.
+ *  @param user_data
+ *  	User data passed to the callback.
+ *  @return
+ *  	Source if successful. NULL otherwise.
+ */
+PillBigSource
+pillbig_source_new_from_callback(PillBigSourceReadCallback read, long size,
+	void *user_data);
+
+/**
+ *  Creates a source reading byte ranges through a user callback,
+ *  for remote inputs where each request is expensive.
+ *
+ *  @remarks
+ *  	Data is fetched in fixed size blocks kept in a cache. Missing
+ *  	blocks of a read are fetched in a single request.
+ *
+ *  @param read
+ *  	Range read callback.
+ *  @param size
+ *  	Input size. -1 if unknown.
+ *  @param block_size
+ *  	Size of the cached blocks. 0 for the default.
+ *  @param blocks_count
+ *  	Count of cached blocks. 0 for the default.
+ *  @param user_data
+ *  	User data passed to the callback.
+ *  @return
+ *  	Source if successful. NULL otherwise.
+ */
+PillBigSource
+pillbig_source_new_ranged(PillBigSourceReadCallback read, long size,
+	int block_size, int blocks_count, void *user_data);
+
+/**
+ *  Frees a source.
+ *
+ *  @param source
+ *  	Source to be freed.
+ */
+void
+pillbig_source_free(PillBigSource source);
+
+/**
+ *  Reads data at a given position of a source.
+ *
+ *  @param source
+ *  	Source.
+ *  @param buffer
+ *  	Buffer where data will be read.
+ *  @param size
+ *  	Count of bytes to read.
+ *  @param offset
+ *  	Absolute position of the data.
+ *  @return
+ *  	Count of bytes read, less than size only at the end of the
+ *  	source. -1 on error.
+ */
+int
+pillbig_source_read_at(PillBigSource source, void *buffer, int size, long offset);
+
+/**
+ *  Announces data that will be read soon.
+ *
+ *  @remarks
+ *  	Ranged sources fetch the missing blocks at once, as many as
+ *  	half the cache, and later reads of the range fetch the rest
+ *  	together. File descriptors are advised to the system. Other
+ *  	sources ignore it.
+ *
+ *  @param source
+ *  	Source.
+ *  @param offset
+ *  	Absolute position of the data.
+ *  @param size
+ *  	Data size.
+ *  @return
+ *  	Operation result.
+ */
+PillBigError
+pillbig_source_prefetch(PillBigSource source, long offset, int size);
+
+/**
+ *  Gets the size of a source.
+ *
+ *  @param source
+ *  	Source.
+ *  @return
+ *  	Source size. -1 if unknown.
+ */
+long
+pillbig_source_get_size(PillBigSource source);
+
+END_C_DECLS
+
+#endif
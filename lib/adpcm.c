@@ -43,6 +43,8 @@ OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include <malloc.h>
 #include "adpcm.h"
 #include "error_internal.h"
+#include "common_internal.h"
+#include "pillbig_internal.h"
 
 struct adpcm_state
 {
@@ -71,24 +73,40 @@ int stepsizeTable[] = {
 static void
 adpcm_coder(short *indata, char *outdata, int len, struct adpcm_state *state);
 
-static void
+AUDIO_CODEC_KERNEL void
 adpcm_decoder(char *indata, short *outdata, int len, struct adpcm_state *state);
 
 
 
 PillBigError
-pillbig_audio_adpcm_decode(FILE *input, FILE *output, PillBigAudioParameters *parameters)
+pillbig_audio_adpcm_prepare(PillBig pillbig, int index, int exact, long *offset,
+	PillBigAudioParameters *parameters)
+{
+	/* There are 2 IMA ADPCM samples for each byte. */
+	parameters->samples_count   = pillbig->entries[index].size * 2;
+	parameters->sample_rate     = AUDIO_SAMPLE_RATE;
+	parameters->channels_count  = 1;
+	parameters->bits_per_sample = 16;
+
+	return PillBigError_Success;
+}
+
+/*
+ * Stream decoder body, inlined in every instruction set variant.
+ */
+AUDIO_CODEC_KERNEL PillBigError
+pillbig_audio_adpcm_decode_kernel(PillBigSource input, long offset, PillBigSink output,
+	PillBigAudioParameters *parameters)
 {
 	pillbig_error_clear();
 	SET_RETURN_ERROR_IF_FAIL(input != NULL, PillBigError_InvalidStream);
 	SET_RETURN_ERROR_IF_FAIL(output != NULL, PillBigError_InvalidStream);
 	SET_RETURN_ERROR_IF_FAIL(parameters != NULL, PillBigError_UnknownError);
 
-	int remaining_bytes, remaining_shorts;
-	int read_bytes, written_bytes;
-	char  *input_buffer,  *input_buffer_ptr;
-	short *output_buffer, *output_buffer_ptr;
-	struct adpcm_state status;
+	int input_size, read_bytes;
+	char  *input_buffer;
+	short *output_buffer;
+	struct adpcm_state status = { 0, 0 };
 
 	input_buffer  = (char *) calloc(parameters->samples_count, sizeof(char));
 	SET_ERROR_IF_FAIL(input_buffer != NULL, PillBigError_SystemError);
@@ -97,29 +115,21 @@ pillbig_audio_adpcm_decode(FILE *input, FILE *output, PillBigAudioParameters *pa
 
 	if (pillbig_no_error())
 	{
-		remaining_bytes = parameters->samples_count / 2;
- 		input_buffer_ptr = input_buffer;
-		while (!feof(input) && remaining_bytes > 0 && pillbig_no_error())
+		/*
+		 * Data cut by the end of pill.big decodes as silence.
+		 */
+		input_size = parameters->samples_count / 2;
+		if (input_size > 0)
 		{
-			read_bytes = fread(input_buffer_ptr, sizeof(char), remaining_bytes, input);
+			read_bytes = pillbig_source_read_at(input, input_buffer, input_size, offset);
 			SET_ERROR_IF_FAIL(read_bytes > 0, PillBigError_SystemError);
-			input_buffer_ptr += read_bytes;
-			remaining_bytes -= read_bytes;
 		}
 
 		if (pillbig_no_error())
 		{
 			adpcm_decoder(input_buffer, output_buffer, parameters->samples_count, &status);
-
-			remaining_shorts = parameters->samples_count;
-			output_buffer_ptr = output_buffer;
-			while (remaining_shorts > 0 && pillbig_no_error())
-			{
-				written_bytes = fwrite(output_buffer_ptr, sizeof(short), remaining_shorts, output);
-				SET_ERROR_IF_FAIL(written_bytes > 0, PillBigError_SystemError);
-				output_buffer_ptr += written_bytes;
-				remaining_shorts -= written_bytes;
-			}
+			pillbig_sink_write(output, output_buffer,
+				parameters->samples_count * sizeof(short));
 		}
 	}
 
@@ -135,6 +145,242 @@ pillbig_audio_adpcm_decode(FILE *input, FILE *output, PillBigAudioParameters *pa
 	return pillbig_error_get();
 }
 
+PillBigError
+pillbig_audio_adpcm_decode(PillBigSource input, long offset, PillBigSink output,
+	PillBigAudioParameters *parameters)
+{
+	return pillbig_audio_adpcm_decode_kernel(input, offset, output, parameters);
+}
+
+#ifdef AUDIO_CODEC_X86_VARIANTS
+
+AUDIO_CODEC_TARGET("sse4.1") PillBigError
+pillbig_audio_adpcm_decode_sse4(PillBigSource input, long offset, PillBigSink output,
+	PillBigAudioParameters *parameters)
+{
+	return pillbig_audio_adpcm_decode_kernel(input, offset, output, parameters);
+}
+
+AUDIO_CODEC_TARGET("avx2") PillBigError
+pillbig_audio_adpcm_decode_avx2(PillBigSource input, long offset, PillBigSink output,
+	PillBigAudioParameters *parameters)
+{
+	return pillbig_audio_adpcm_decode_kernel(input, offset, output, parameters);
+}
+
+#endif
+
+/*
+ * Lanes decoder body, inlined in every instruction set variant.
+ */
+AUDIO_CODEC_KERNEL void
+pillbig_audio_adpcm_decode_lanes_kernel(PillBigAudioLanes *lanes)
+{
+	unsigned char deltas[AUDIO_LANES_CHUNK][AUDIO_LANES];
+	short         pcm[AUDIO_LANES_CHUNK][AUDIO_LANES];
+	int           valpred[AUDIO_LANES];
+	int           index[AUDIO_LANES];
+	int           step[AUDIO_LANES];
+	int           samples_count[AUDIO_LANES];
+	int           max_samples_count = 0;
+	int           first, count, lane, t, byte, sample;
+	int           delta, sign, vpdiff;
+
+	for (lane = 0; lane < AUDIO_LANES; lane++)
+	{
+		valpred[lane] = lanes->start[lane].valprev;
+		index[lane]   = lanes->start[lane].index;
+		step[lane]    = stepsizeTable[index[lane]];
+		samples_count[lane] = (lanes->input[lane] == NULL) ? 0 :
+			MIN(lanes->samples_count[lane],
+			    MAX(lanes->input_size[lane] * 2 - lanes->start[lane].sample, 0));
+		max_samples_count = MAX(max_samples_count, samples_count[lane]);
+	}
+
+	for (first = 0; first < max_samples_count; first += AUDIO_LANES_CHUNK)
+	{
+		count = MIN(AUDIO_LANES_CHUNK, max_samples_count - first);
+
+		/*
+		 * Gather the deltas of every lane so lanes are contiguous.
+		 * Lanes already finished decode zero deltas that are discarded.
+		 */
+		for (lane = 0; lane < AUDIO_LANES; lane++)
+		{
+			for (t = 0; t < count; t++)
+			{
+				if (first + t < samples_count[lane])
+				{
+					sample = lanes->start[lane].sample + first + t;
+					byte = lanes->input[lane][sample >> 1];
+					deltas[t][lane] = (sample & 1) ? (byte & 0x0f) : ((byte >> 4) & 0x0f);
+				}
+				else
+				{
+					deltas[t][lane] = 0;
+				}
+			}
+		}
+
+		/*
+		 * Same steps than adpcm_decoder(), lane-wise and branchless.
+		 */
+		for (t = 0; t < count; t++)
+		{
+			for (lane = 0; lane < AUDIO_LANES; lane++)
+			{
+				delta = deltas[t][lane];
+
+				index[lane] += indexTable[delta];
+				index[lane] = MIN(MAX(index[lane], 0), 88);
+
+				sign  = delta & 8;
+				delta = delta & 7;
+
+				vpdiff = (step[lane] >> 3)
+				       + ((delta & 4) ? step[lane] : 0)
+				       + ((delta & 2) ? step[lane] >> 1 : 0)
+				       + ((delta & 1) ? step[lane] >> 2 : 0);
+
+				valpred[lane] += sign ? -vpdiff : vpdiff;
+				valpred[lane] = MIN(MAX(valpred[lane], -32768), 32767);
+
+				step[lane] = stepsizeTable[index[lane]];
+				pcm[t][lane] = valpred[lane];
+			}
+		}
+
+		/*
+		 * Scatter the decoded samples back to every lane.
+		 */
+		for (lane = 0; lane < AUDIO_LANES; lane++)
+		{
+			for (t = 0; t < count && first + t < samples_count[lane]; t++)
+			{
+				lanes->output[lane][first + t] = pcm[t][lane];
+			}
+		}
+	}
+
+	for (lane = 0; lane < AUDIO_LANES; lane++)
+	{
+		lanes->samples_count[lane] = samples_count[lane];
+	}
+}
+
+void
+pillbig_audio_adpcm_decode_lanes(PillBigAudioLanes *lanes)
+{
+	pillbig_audio_adpcm_decode_lanes_kernel(lanes);
+}
+
+#ifdef AUDIO_CODEC_X86_VARIANTS
+
+AUDIO_CODEC_TARGET("sse4.1") void
+pillbig_audio_adpcm_decode_lanes_sse4(PillBigAudioLanes *lanes)
+{
+	pillbig_audio_adpcm_decode_lanes_kernel(lanes);
+}
+
+AUDIO_CODEC_TARGET("avx2") void
+pillbig_audio_adpcm_decode_lanes_avx2(PillBigAudioLanes *lanes)
+{
+	pillbig_audio_adpcm_decode_lanes_kernel(lanes);
+}
+
+#endif
+
+/*
+ * Resuming decoder body, inlined in every instruction set variant.
+ */
+AUDIO_CODEC_KERNEL int
+pillbig_audio_adpcm_decode_from_kernel(const unsigned char *input, int input_size,
+	PillBigAudioCheckpoint *state, short *output, int samples_count)
+{
+	int decoded = 0;
+	int delta, sign, vpdiff;
+	int valpred = state->valprev;
+	int index   = state->index;
+	int step    = stepsizeTable[index];
+	int sample  = state->sample;
+
+	/*
+	 * Same steps than adpcm_decoder() but the state can start and stop
+	 * at any nibble.
+	 */
+	while (decoded < samples_count && (sample >> 1) < input_size)
+	{
+		delta = input[sample >> 1];
+		delta = (sample & 1) ? (delta & 0x0f) : ((delta >> 4) & 0x0f);
+
+		index += indexTable[delta];
+		index = MIN(MAX(index, 0), 88);
+
+		sign  = delta & 8;
+		delta = delta & 7;
+
+		vpdiff = step >> 3;
+		if (delta & 4)
+		{
+			vpdiff += step;
+		}
+		if (delta & 2)
+		{
+			vpdiff += step >> 1;
+		}
+		if (delta & 1)
+		{
+			vpdiff += step >> 2;
+		}
+
+		valpred += sign ? -vpdiff : vpdiff;
+		valpred = MIN(MAX(valpred, -32768), 32767);
+
+		step = stepsizeTable[index];
+
+		if (output != NULL)
+		{
+			output[decoded] = valpred;
+		}
+		decoded++;
+		sample++;
+	}
+
+	state->sample  = sample;
+	state->offset  = sample >> 1;
+	state->valprev = valpred;
+	state->index   = index;
+
+	return decoded;
+}
+
+int
+pillbig_audio_adpcm_decode_from(const unsigned char *input, int input_size,
+	PillBigAudioCheckpoint *state, short *output, int samples_count)
+{
+	return pillbig_audio_adpcm_decode_from_kernel(input, input_size, state, output, samples_count);
+}
+
+#ifdef AUDIO_CODEC_X86_VARIANTS
+
+AUDIO_CODEC_TARGET("sse4.1") int
+pillbig_audio_adpcm_decode_from_sse4(const unsigned char *input, int input_size,
+	PillBigAudioCheckpoint *state, short *output, int samples_count)
+{
+	return pillbig_audio_adpcm_decode_from_kernel(input, input_size, state, output, samples_count);
+}
+
+AUDIO_CODEC_TARGET("avx2") int
+pillbig_audio_adpcm_decode_from_avx2(const unsigned char *input, int input_size,
+	PillBigAudioCheckpoint *state, short *output, int samples_count)
+{
+	return pillbig_audio_adpcm_decode_from_kernel(input, input_size, state, output, samples_count);
+}
+
+#endif
+
+
+
 static void
 adpcm_coder(short *indata, char *outdata, int len, struct adpcm_state *state)
 {
@@ -263,7 +509,7 @@ adpcm_coder(short *indata, char *outdata, int len, struct adpcm_state *state)
 	state->index = index;
 }
 
-static void
+AUDIO_CODEC_KERNEL void
 adpcm_decoder(char *indata, short *outdata, int len, struct adpcm_state *state)
 {
 	signed char *inp;    /* Input buffer pointer */
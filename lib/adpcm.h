@@ -45,6 +45,7 @@ OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include <stdio.h>
 #include <pillbig/pillbig.h>
 #include "audio_internal.h"
+#include "codec.h"
 
 BEGIN_C_DECLS
 
@@ -64,22 +65,132 @@ PillBigError
 pillbig_audio_adpcm_encode(FILE *input, FILE *output,
 	PillBigAudioParameters *parameters);
 
+/**
+ *  Sets the parameters of an IMA ADPCM pill.big file up for decoding.
+ *  @remarks
+ *  	IMA ADPCM files are headerless and hold 2 samples for each byte,
+ *  	the samples count is always exact.
+ *  @param pillbig
+ *  	PillBig object.
+ *  @param index
+ *  	pill.big file index.
+ *  @param exact
+ *  	Unused.
+ *  @param offset
+ *  	Position of the file in the source. Unchanged.
+ *  @param parameters
+ *  	Audio parameters of the file, filled on return.
+ *  @return
+ *  	Operation result.
+ */
+PillBigError
+pillbig_audio_adpcm_prepare(PillBig pillbig, int index, int exact, long *offset,
+	PillBigAudioParameters *parameters);
+
 /**
  *  Decodes an IMA ADPCM audio into PCM.
  *
  *  @param input
- *  	Input ADPCM stream.
+ *  	Input ADPCM source.
+ *  @param offset
+ *  	Position of the ADPCM data in the source.
  *  @param output
- *  	Output PCM stream.
+ *  	Output PCM sink.
  *  @param parameters
  *  	Audio parameters.
  *  @return
  *  	Operation result.
  */
 PillBigError
-pillbig_audio_adpcm_decode(FILE *input, FILE *output,
+pillbig_audio_adpcm_decode(PillBigSource input, long offset, PillBigSink output,
 	PillBigAudioParameters *parameters);
 
+#ifdef AUDIO_CODEC_X86_VARIANTS
+
+/**
+ *  pillbig_audio_adpcm_decode() built for SSE4.1.
+ */
+PillBigError
+pillbig_audio_adpcm_decode_sse4(PillBigSource input, long offset, PillBigSink output,
+	PillBigAudioParameters *parameters);
+
+/**
+ *  pillbig_audio_adpcm_decode() built for AVX2.
+ */
+PillBigError
+pillbig_audio_adpcm_decode_avx2(PillBigSource input, long offset, PillBigSink output,
+	PillBigAudioParameters *parameters);
+
+#endif
+
+/**
+ *  Decodes several IMA ADPCM audios at once, one per lane.
+ *
+ *  @remarks
+ *  	Output is bit-exact with pillbig_audio_adpcm_decode(). Lanes can
+ *  	start at any sample.
+ *
+ *  @param lanes
+ *  	Lanes to be decoded.
+ */
+void
+pillbig_audio_adpcm_decode_lanes(PillBigAudioLanes *lanes);
+
+#ifdef AUDIO_CODEC_X86_VARIANTS
+
+/**
+ *  pillbig_audio_adpcm_decode_lanes() built for SSE4.1.
+ */
+void
+pillbig_audio_adpcm_decode_lanes_sse4(PillBigAudioLanes *lanes);
+
+/**
+ *  pillbig_audio_adpcm_decode_lanes() built for AVX2.
+ */
+void
+pillbig_audio_adpcm_decode_lanes_avx2(PillBigAudioLanes *lanes);
+
+#endif
+
+/**
+ *  Decodes IMA ADPCM data from memory resuming from a decoder state.
+ *
+ *  @param input
+ *  	Encoded data, from the start of the stream.
+ *  @param input_size
+ *  	Encoded data size.
+ *  @param state
+ *  	Decoder state to start from. On return, the state after the last
+ *  	decoded sample.
+ *  @param output
+ *  	Decoded PCM samples. NULL to only advance the state.
+ *  @param samples_count
+ *  	Maximum samples to decode.
+ *  @return
+ *  	Decoded samples count.
+ */
+int
+pillbig_audio_adpcm_decode_from(const unsigned char *input, int input_size,
+	PillBigAudioCheckpoint *state, short *output, int samples_count);
+
+#ifdef AUDIO_CODEC_X86_VARIANTS
+
+/**
+ *  pillbig_audio_adpcm_decode_from() built for SSE4.1.
+ */
+int
+pillbig_audio_adpcm_decode_from_sse4(const unsigned char *input, int input_size,
+	PillBigAudioCheckpoint *state, short *output, int samples_count);
+
+/**
+ *  pillbig_audio_adpcm_decode_from() built for AVX2.
+ */
+int
+pillbig_audio_adpcm_decode_from_avx2(const unsigned char *input, int input_size,
+	PillBigAudioCheckpoint *state, short *output, int samples_count);
+
+#endif
+
 END_C_DECLS
 
 #endif
@@ -0,0 +1,318 @@
+/*
+ *  libpillbig
+ *  A library to deal with Blood Omen: Legacy of Kain pill.big files.
+ */
+
+/**
+ *  @file
+ *  @brief
+ *  	PCM audio analyzer. Implementation file.
+ *
+ *  @author  Alfonso Ruzafa <superruzafa@gmail.com>
+ *  @version SVN $Id$
+ *  @remarks
+ *  	Loudness is measured as in ITU-R BS.1770: K-weighted power over
+ *  	400 ms blocks overlapped by 75%, gated at -70 LUFS and then 10 LU
+ *  	below the ungated loudness. Audios shorter than a block are
+ *  	measured as a single block.
+ */
+
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "error_internal.h"
+#include "common_internal.h"
+#include "analysis.h"
+
+#define FULL_SCALE 32768.0
+
+#define LOUDNESS_ABSOLUTE_GATE -70.0
+#define LOUDNESS_RELATIVE_GATE -10.0
+#define LOUDNESS_BLOCK_STEPS 4
+
+
+
+/**
+ *  Computes the K-weighting filter stages for a sample rate.
+ *
+ *  @param analyzer
+ *  	Analyzer.
+ *  @param sample_rate
+ *  	Sample rate.
+ */
+static void
+pillbig_audio_analyzer_build_filter(PillBigAudioAnalyzer *analyzer, int sample_rate);
+
+/**
+ *  Stores the power of the current gating step.
+ *
+ *  @param analyzer
+ *  	Analyzer.
+ *  @return
+ *  	Operation result.
+ */
+static PillBigError
+pillbig_audio_analyzer_push_step(PillBigAudioAnalyzer *analyzer);
+
+/**
+ *  Converts a mean square power into loudness units.
+ */
+static double
+pillbig_audio_analyzer_loudness(double power);
+
+
+
+PillBigAudioAnalyzer *
+pillbig_audio_analyzer_new(int sample_rate)
+{
+	SET_ERROR_RETURN_VALUE_IF_FAIL(sample_rate > 0, PillBigError_InvalidSampleRate, NULL);
+
+	PillBigAudioAnalyzer *analyzer;
+
+	analyzer = (PillBigAudioAnalyzer *)malloc(sizeof(PillBigAudioAnalyzer));
+	SET_ERROR_RETURN_VALUE_IF_FAIL(analyzer != NULL, PillBigError_SystemError, NULL);
+	memset(analyzer, 0, sizeof(PillBigAudioAnalyzer));
+
+	analyzer->step_size = MAX(sample_rate / AUDIO_ANALYZER_STEPS_PER_SECOND, 1);
+	pillbig_audio_analyzer_build_filter(analyzer, sample_rate);
+
+	return analyzer;
+}
+
+void
+pillbig_audio_analyzer_free(PillBigAudioAnalyzer *analyzer)
+{
+	if (analyzer != NULL)
+	{
+		free(analyzer->steps);
+		free(analyzer);
+	}
+}
+
+PillBigError
+pillbig_audio_analyzer_process(PillBigAudioAnalyzer *analyzer,
+	const short *samples, int samples_count)
+{
+	long long sums[AUDIO_ANALYZER_PARTIALS], squares[AUDIO_ANALYZER_PARTIALS];
+	int peaks[AUDIO_ANALYZER_PARTIALS], clipped[AUDIO_ANALYZER_PARTIALS];
+	PillBigAudioAnalyzerBiquad *shelf = &analyzer->shelf;
+	PillBigAudioAnalyzerBiquad *highpass = &analyzer->highpass;
+	double x, y;
+	int i, k, value, count;
+
+	/*
+	 * Independent partial accumulators so the loop can be vectorized.
+	 */
+	for (k = 0; k < AUDIO_ANALYZER_PARTIALS; k++)
+	{
+		sums[k] = squares[k] = 0;
+		peaks[k] = clipped[k] = 0;
+	}
+
+	count = samples_count / AUDIO_ANALYZER_PARTIALS * AUDIO_ANALYZER_PARTIALS;
+	for (i = 0; i < count; i += AUDIO_ANALYZER_PARTIALS)
+	{
+		for (k = 0; k < AUDIO_ANALYZER_PARTIALS; k++)
+		{
+			value = samples[i + k];
+			sums[k]    += value;
+			squares[k] += value * value;
+			peaks[k]    = MAX(peaks[k], (value < 0) ? -value : value);
+			clipped[k] += (value >= 32767) | (value <= -32768);
+		}
+	}
+
+	for (i = count; i < samples_count; i++)
+	{
+		value = samples[i];
+		sums[0]    += value;
+		squares[0] += value * value;
+		peaks[0]    = MAX(peaks[0], (value < 0) ? -value : value);
+		clipped[0] += (value >= 32767) | (value <= -32768);
+	}
+
+	for (k = 0; k < AUDIO_ANALYZER_PARTIALS; k++)
+	{
+		analyzer->sum            += sums[k];
+		analyzer->squares        += squares[k];
+		analyzer->peak            = MAX(analyzer->peak, peaks[k]);
+		analyzer->clipped_count  += clipped[k];
+	}
+	analyzer->samples_count += samples_count;
+
+	/*
+	 * The K-weighting filter is recursive, it runs sample by sample.
+	 */
+	for (i = 0; i < samples_count; i++)
+	{
+		x = samples[i] / FULL_SCALE;
+
+		y = shelf->b0 * x + shelf->z1;
+		shelf->z1 = shelf->b1 * x - shelf->a1 * y + shelf->z2;
+		shelf->z2 = shelf->b2 * x - shelf->a2 * y;
+
+		x = y;
+		y = highpass->b0 * x + highpass->z1;
+		highpass->z1 = highpass->b1 * x - highpass->a1 * y + highpass->z2;
+		highpass->z2 = highpass->b2 * x - highpass->a2 * y;
+
+		analyzer->step_power += y * y;
+		if (++analyzer->step_count == analyzer->step_size)
+		{
+			SET_RETURN_ERROR_IF_FAIL(pillbig_audio_analyzer_push_step(analyzer) ==
+				PillBigError_Success, pillbig_error_get());
+		}
+	}
+
+	return PillBigError_Success;
+}
+
+void
+pillbig_audio_analyzer_finish(PillBigAudioAnalyzer *analyzer,
+	PillBigAudioAnalysis *analysis)
+{
+	double power, gate, gated_power;
+	int blocks_count, gated_count, pass, i, j;
+
+	memset(analysis, 0, sizeof(PillBigAudioAnalysis));
+	analysis->samples_count = analyzer->samples_count;
+	analysis->clipped_count = analyzer->clipped_count;
+	analysis->peak     = -HUGE_VAL;
+	analysis->rms      = -HUGE_VAL;
+	analysis->loudness = -HUGE_VAL;
+
+	if (analyzer->samples_count == 0)
+	{
+		return;
+	}
+
+	analysis->dc_offset = analyzer->sum / (double)analyzer->samples_count / FULL_SCALE;
+	if (analyzer->peak > 0)
+	{
+		analysis->peak = 20.0 * log10(analyzer->peak / FULL_SCALE);
+		analysis->rms  = 10.0 * log10(analyzer->squares /
+			(double)analyzer->samples_count / (FULL_SCALE * FULL_SCALE));
+	}
+
+	/*
+	 * Short audios are a single block, partial step included.
+	 */
+	blocks_count = analyzer->steps_count - LOUDNESS_BLOCK_STEPS + 1;
+	if (blocks_count <= 0)
+	{
+		power = analyzer->step_power;
+		for (j = 0; j < analyzer->steps_count; j++)
+		{
+			power += analyzer->steps[j];
+		}
+		power /= analyzer->samples_count;
+		if (pillbig_audio_analyzer_loudness(power) > LOUDNESS_ABSOLUTE_GATE)
+		{
+			analysis->loudness = pillbig_audio_analyzer_loudness(power);
+		}
+		return;
+	}
+
+	/*
+	 * First pass applies the absolute gate only, second pass
+	 * the relative gate computed from the first one.
+	 */
+	gate = LOUDNESS_ABSOLUTE_GATE;
+	for (pass = 0; pass < 2; pass++)
+	{
+		gated_power = 0.0;
+		gated_count = 0;
+		for (i = 0; i < blocks_count; i++)
+		{
+			power = 0.0;
+			for (j = i; j < i + LOUDNESS_BLOCK_STEPS; j++)
+			{
+				power += analyzer->steps[j];
+			}
+			power /= LOUDNESS_BLOCK_STEPS * analyzer->step_size;
+
+			if (pillbig_audio_analyzer_loudness(power) > gate &&
+			    pillbig_audio_analyzer_loudness(power) > LOUDNESS_ABSOLUTE_GATE)
+			{
+				gated_power += power;
+				gated_count++;
+			}
+		}
+
+		if (gated_count == 0)
+		{
+			return;
+		}
+
+		gate = pillbig_audio_analyzer_loudness(gated_power / gated_count) +
+			LOUDNESS_RELATIVE_GATE;
+	}
+
+	analysis->loudness = pillbig_audio_analyzer_loudness(gated_power / gated_count);
+}
+
+
+
+static void
+pillbig_audio_analyzer_build_filter(PillBigAudioAnalyzer *analyzer, int sample_rate)
+{
+	PillBigAudioAnalyzerBiquad *shelf = &analyzer->shelf;
+	PillBigAudioAnalyzerBiquad *highpass = &analyzer->highpass;
+	double f0, gain, q, k, vh, vb, a0;
+
+	/*
+	 * BS.1770 filter stages designed for any sample rate
+	 * through the bilinear transform.
+	 */
+	f0   = 1681.974450955533;
+	gain = 3.999843853973347;
+	q    = 0.7071752369554196;
+	k    = tan(M_PI * MIN(f0, 0.49 * sample_rate) / sample_rate);
+	vh   = pow(10.0, gain / 20.0);
+	vb   = pow(vh, 0.4996667741545416);
+	a0   = 1.0 + k / q + k * k;
+	shelf->b0 = (vh + vb * k / q + k * k) / a0;
+	shelf->b1 = 2.0 * (k * k - vh) / a0;
+	shelf->b2 = (vh - vb * k / q + k * k) / a0;
+	shelf->a1 = 2.0 * (k * k - 1.0) / a0;
+	shelf->a2 = (1.0 - k / q + k * k) / a0;
+
+	f0 = 38.13547087602444;
+	q  = 0.5003270373238773;
+	k  = tan(M_PI * f0 / sample_rate);
+	a0 = 1.0 + k / q + k * k;
+	highpass->b0 = 1.0;
+	highpass->b1 = -2.0;
+	highpass->b2 = 1.0;
+	highpass->a1 = 2.0 * (k * k - 1.0) / a0;
+	highpass->a2 = (1.0 - k / q + k * k) / a0;
+}
+
+static PillBigError
+pillbig_audio_analyzer_push_step(PillBigAudioAnalyzer *analyzer)
+{
+	double *steps;
+
+	if (analyzer->steps_count == analyzer->steps_size)
+	{
+		steps = (double *)realloc(analyzer->steps,
+			(analyzer->steps_size * 2 + 64) * sizeof(double));
+		SET_RETURN_ERROR_IF_FAIL(steps != NULL, PillBigError_SystemError);
+		analyzer->steps = steps;
+		analyzer->steps_size = analyzer->steps_size * 2 + 64;
+	}
+
+	analyzer->steps[analyzer->steps_count++] = analyzer->step_power;
+	analyzer->step_power = 0.0;
+	analyzer->step_count = 0;
+
+	return PillBigError_Success;
+}
+
+static double
+pillbig_audio_analyzer_loudness(double power)
+{
+	return (power > 0.0) ? -0.691 + 10.0 * log10(power) : -HUGE_VAL;
+}
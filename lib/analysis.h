@@ -0,0 +1,115 @@
+/*
+ *  libpillbig
+ *  A library to deal with Blood Omen: Legacy of Kain pill.big files.
+ */
+
+/**
+ *  @file
+ *  @brief
+ *  	PCM audio analyzer: peak, RMS, loudness, DC offset and clipping.
+ *
+ *  @author  Alfonso Ruzafa <superruzafa@gmail.com>
+ *  @version SVN $Id$
+ */
+
+#ifndef __PILLBIG_AUDIO_ANALYSIS_H__
+#define __PILLBIG_AUDIO_ANALYSIS_H__
+
+#include <pillbig/common.h>
+#include <pillbig/audio.h>
+
+/**
+ *  Partial accumulators, so the sums can be vectorized.
+ */
+#define AUDIO_ANALYZER_PARTIALS 8
+
+/**
+ *  Loudness gating step, in 1/x seconds. Gating blocks are 4 steps long.
+ */
+#define AUDIO_ANALYZER_STEPS_PER_SECOND 10
+
+/**
+ *  Loudness filter biquad stage state.
+ */
+typedef struct
+{
+	double    b0, b1, b2;    /**< Numerator coefficients. */
+	double    a1, a2;        /**< Denominator coefficients. */
+	double    z1, z2;        /**< Delay line. */
+}
+PillBigAudioAnalyzerBiquad;
+
+/**
+ *  Analyzer state.
+ */
+typedef struct
+{
+	long long                     samples_count;     /**< Samples processed. */
+	long long                     sum;               /**< Sum of samples. */
+	long long                     squares;           /**< Sum of squared samples. */
+	int                           peak;              /**< Maximum absolute sample value. */
+	int                           clipped_count;     /**< Full scale samples. */
+	PillBigAudioAnalyzerBiquad    shelf;             /**< K-weighting high shelf stage. */
+	PillBigAudioAnalyzerBiquad    highpass;          /**< K-weighting high pass stage. */
+	int                           step_size;         /**< Samples per gating step. */
+	int                           step_count;        /**< Samples in the current gating step. */
+	double                        step_power;        /**< K-weighted power of the current gating step. */
+	double                       *steps;             /**< K-weighted power of every completed step. */
+	int                           steps_count;       /**< Count of completed steps. */
+	int                           steps_size;        /**< Allocated steps. */
+}
+PillBigAudioAnalyzer;
+
+BEGIN_C_DECLS
+
+/**
+ *  Creates an analyzer.
+ *
+ *  @param sample_rate
+ *  	Sample rate of the audio to be analyzed.
+ *  @return
+ *  	Analyzer if successful. NULL otherwise.
+ */
+PillBigAudioAnalyzer *
+pillbig_audio_analyzer_new(int sample_rate);
+
+/**
+ *  Frees an analyzer.
+ *
+ *  @param analyzer
+ *  	Analyzer to be freed.
+ */
+void
+pillbig_audio_analyzer_free(PillBigAudioAnalyzer *analyzer);
+
+/**
+ *  Accumulates a block of PCM samples.
+ *
+ *  @param analyzer
+ *  	Analyzer.
+ *  @param samples
+ *  	PCM samples.
+ *  @param samples_count
+ *  	Count of samples.
+ *  @return
+ *  	Operation result.
+ */
+PillBigError
+pillbig_audio_analyzer_process(PillBigAudioAnalyzer *analyzer,
+	const short *samples, int samples_count);
+
+/**
+ *  Computes the statistics of every sample accumulated so far.
+ *
+ *  @param analyzer
+ *  	Analyzer.
+ *  @param analysis
+ *  	On return, audio statistics.
+ */
+void
+pillbig_audio_analyzer_finish(PillBigAudioAnalyzer *analyzer,
+	PillBigAudioAnalysis *analysis);
+
+END_C_DECLS
+
+#endif
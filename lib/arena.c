@@ -0,0 +1,237 @@
+/*
+ *  libpillbig
+ *  A library to deal with Blood Omen: Legacy of Kain pill.big files.
+ */
+
+/**
+ *  @file
+ *  @brief
+ *  	Arena allocator with string interning. Implementation file.
+ *
+ *  @author  Alfonso Ruzafa <superruzafa@gmail.com>
+ *  @version SVN $Id$
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "pillbig_internal.h"
+#include "arena.h"
+
+/**
+ *  Block of memory allocations are carved from.
+ */
+typedef struct _PillBigArenaChunk
+{
+	struct _PillBigArenaChunk  *next;    /**< Previously filled chunk. */
+	size_t                      size;    /**< Size of data. */
+	size_t                      used;    /**< Bytes of data allocated. */
+	unsigned char               data[];  /**< Allocations. */
+}
+PillBigArenaChunk;
+
+struct _PillBigArena
+{
+	size_t               chunk_size;       /**< Size of new chunks. */
+	PillBigArenaChunk   *chunks;           /**< Current chunk, then the previous ones. */
+	char               **strings;          /**< Interned strings table. NULL slots are empty. */
+	unsigned int         strings_size;     /**< Slots of the table, a power of two. */
+	unsigned int         strings_count;    /**< Interned strings. */
+};
+
+/**
+ *  Adds a chunk to an arena.
+ *
+ *  @param arena
+ *  	Arena.
+ *  @param size
+ *  	Minimum size of the chunk.
+ *  @return
+ *  	Operation result.
+ */
+static PillBigError
+pillbig_arena_add_chunk(PillBigArena arena, size_t size);
+
+/**
+ *  Doubles the interned strings table.
+ *
+ *  @param arena
+ *  	Arena.
+ *  @return
+ *  	Operation result.
+ */
+static PillBigError
+pillbig_arena_grow_strings(PillBigArena arena);
+
+/**
+ *  Gets the first slot to probe for a string.
+ *
+ *  @param string
+ *  	String.
+ *  @param size
+ *  	Slots of the table, a power of two.
+ *  @return
+ *  	Slot.
+ */
+static unsigned int
+pillbig_arena_get_slot(const char *string, unsigned int size);
+
+
+
+PillBigArena
+pillbig_arena_new(size_t chunk_size)
+{
+	PillBigArena arena = (PillBigArena)malloc(sizeof(struct _PillBigArena));
+	SET_ERROR_RETURN_VALUE_IF_FAIL(arena != NULL, PillBigError_SystemError, NULL);
+
+	memset(arena, 0, sizeof(struct _PillBigArena));
+	arena->chunk_size = (chunk_size > 0) ? chunk_size : ARENA_CHUNK_SIZE;
+
+	return arena;
+}
+
+void
+pillbig_arena_free(PillBigArena arena)
+{
+	PillBigArenaChunk *chunk;
+
+	RETURN_IF_FAIL(arena != NULL);
+
+	while (arena->chunks != NULL)
+	{
+		chunk = arena->chunks;
+		arena->chunks = chunk->next;
+		free(chunk);
+	}
+
+	if (arena->strings != NULL) free(arena->strings);
+	free(arena);
+}
+
+void *
+pillbig_arena_alloc(PillBigArena arena, size_t size)
+{
+	void *data;
+
+	size = (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+
+	if (arena->chunks == NULL || arena->chunks->used + size > arena->chunks->size)
+	{
+		RETURN_VALUE_IF_FAIL(pillbig_arena_add_chunk(arena, size) == PillBigError_Success, NULL);
+	}
+
+	data = &arena->chunks->data[arena->chunks->used];
+	arena->chunks->used += size;
+	memset(data, 0, size);
+
+	return data;
+}
+
+char *
+pillbig_arena_strdup(PillBigArena arena, const char *string)
+{
+	size_t size = strlen(string) + 1;
+	char *copy = (char *)pillbig_arena_alloc(arena, size);
+
+	if (copy != NULL)
+	{
+		memcpy(copy, string, size);
+	}
+
+	return copy;
+}
+
+char *
+pillbig_arena_intern(PillBigArena arena, const char *string)
+{
+	unsigned int slot;
+	char *copy;
+
+	/* Half full at most, so probe sequences stay short */
+	if (2 * (arena->strings_count + 1) > arena->strings_size)
+	{
+		RETURN_VALUE_IF_FAIL(pillbig_arena_grow_strings(arena) == PillBigError_Success, NULL);
+	}
+
+	slot = pillbig_arena_get_slot(string, arena->strings_size);
+	while (arena->strings[slot] != NULL)
+	{
+		if (strcmp(arena->strings[slot], string) == 0)
+		{
+			return arena->strings[slot];
+		}
+		slot = (slot + 1) & (arena->strings_size - 1);
+	}
+
+	copy = pillbig_arena_strdup(arena, string);
+	if (copy != NULL)
+	{
+		arena->strings[slot] = copy;
+		arena->strings_count++;
+	}
+
+	return copy;
+}
+
+
+
+static PillBigError
+pillbig_arena_add_chunk(PillBigArena arena, size_t size)
+{
+	PillBigArenaChunk *chunk;
+
+	/* Allocations larger than a chunk get one of their own */
+	size = MAX(size, arena->chunk_size);
+
+	chunk = (PillBigArenaChunk *)malloc(sizeof(PillBigArenaChunk) + size);
+	SET_RETURN_ERROR_IF_FAIL(chunk != NULL, PillBigError_SystemError);
+
+	chunk->size = size;
+	chunk->used = 0;
+	chunk->next = arena->chunks;
+	arena->chunks = chunk;
+
+	return PillBigError_Success;
+}
+
+static PillBigError
+pillbig_arena_grow_strings(PillBigArena arena)
+{
+	unsigned int size = MAX(arena->strings_size * 2, 64);
+	unsigned int i, slot;
+	char **strings;
+
+	strings = (char **)calloc(size, sizeof(char *));
+	SET_RETURN_ERROR_IF_FAIL(strings != NULL, PillBigError_SystemError);
+
+	for (i = 0; i < arena->strings_size; i++)
+	{
+		if (arena->strings[i] != NULL)
+		{
+			slot = pillbig_arena_get_slot(arena->strings[i], size);
+			while (strings[slot] != NULL)
+			{
+				slot = (slot + 1) & (size - 1);
+			}
+			strings[slot] = arena->strings[i];
+		}
+	}
+
+	if (arena->strings != NULL) free(arena->strings);
+	arena->strings = strings;
+	arena->strings_size = size;
+
+	return PillBigError_Success;
+}
+
+static unsigned int
+pillbig_arena_get_slot(const char *string, unsigned int size)
+{
+	unsigned int hash = 2166136261u;
+
+	while (*string != '\0')
+	{
+		hash = (hash ^ (unsigned char)*string++) * 16777619u;
+	}
+
+	return hash & (size - 1);
+}
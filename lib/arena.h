@@ -0,0 +1,100 @@
+/*
+ *  libpillbig
+ *  A library to deal with Blood Omen: Legacy of Kain pill.big files.
+ */
+
+/**
+ *  @file
+ *  @brief
+ *  	Arena allocator with string interning.
+ *
+ *  @author  Alfonso Ruzafa <superruzafa@gmail.com>
+ *  @version SVN $Id$
+ */
+
+#ifndef __PILLBIG_ARENA_H__
+#define __PILLBIG_ARENA_H__
+
+#include <stddef.h>
+#include <pillbig/common.h>
+
+/**
+ *  Default size of arena chunks.
+ */
+#define ARENA_CHUNK_SIZE 65536
+
+/**
+ *  Alignment of arena allocations.
+ */
+#define ARENA_ALIGNMENT 8
+
+/**
+ *  Arena object. Allocations live until the arena is freed.
+ */
+typedef struct _PillBigArena *PillBigArena;
+
+BEGIN_C_DECLS
+
+/**
+ *  Creates an arena.
+ *
+ *  @param chunk_size
+ *  	Size of the chunks allocated at once. 0 for ARENA_CHUNK_SIZE.
+ *  @return
+ *  	Arena if successful. NULL otherwise.
+ */
+PillBigArena
+pillbig_arena_new(size_t chunk_size);
+
+/**
+ *  Frees an arena and every allocation made from it.
+ *
+ *  @param arena
+ *  	Arena.
+ */
+void
+pillbig_arena_free(PillBigArena arena);
+
+/**
+ *  Allocates memory from an arena, zero filled.
+ *
+ *  @param arena
+ *  	Arena.
+ *  @param size
+ *  	Size of the allocation.
+ *  @return
+ *  	Memory aligned to ARENA_ALIGNMENT if successful. NULL otherwise.
+ */
+void *
+pillbig_arena_alloc(PillBigArena arena, size_t size);
+
+/**
+ *  Copies a string into an arena.
+ *
+ *  @param arena
+ *  	Arena.
+ *  @param string
+ *  	String.
+ *  @return
+ *  	Copy if successful. NULL otherwise.
+ */
+char *
+pillbig_arena_strdup(PillBigArena arena, const char *string);
+
+/**
+ *  Copies a string into an arena once, later calls with an equal
+ *  string getting the same copy.
+ *
+ *  @param arena
+ *  	Arena.
+ *  @param string
+ *  	String.
+ *  @return
+ *  	Shared copy if successful. NULL otherwise.
+ */
+char *
+pillbig_arena_intern(PillBigArena arena, const char *string);
+
+END_C_DECLS
+
+#endif
@@ -15,49 +15,276 @@
 
 
 #include <stdio.h>
+#include <string.h>
 #include <malloc.h>
 #include <pillbig/pillbig.h>
 #include "pillbig_internal.h"
+#include "filetype_internal.h"
 
 #include "adpcm.h"
 #include "vag.h"
+#include "resample.h"
+#include "analysis.h"
+#include "codec.h"
+
 
 
 /**
- *  Callback for codecs.
+ *  Builds a RIFF WAVE header.
+ *
+ *  @param header
+ *  	On return, the header. At least AUDIO_WAVE_HEADER_SIZE bytes long.
+ *  @param parameters
+ *  	Audio parameters.
  */
-typedef
-PillBigError
-(*PillBigAudioConverterCallback)(
-	FILE *input, FILE *output, PillBigAudioParameters *parameters);
+static void
+pillbig_audio_make_wave_header(unsigned char *header, PillBigAudioParameters *parameters);
 
+/**
+ *  Writes a RIFF WAVE header.
+ *
+ *  @param output
+ *  	Output sink.
+ *  @param parameters
+ *  	Audio parameters.
+ *  @return
+ *  	Operation result.
+ */
+static PillBigError
+pillbig_audio_write_wave_header(PillBigSink output, PillBigAudioParameters *parameters);
 
+/**
+ *  Patches the sizes of an already written RIFF WAVE header.
+ *
+ *  @param output
+ *  	Output sink. It must be seekable.
+ *  @param header_position
+ *  	Position of the header in the output sink.
+ *  @param parameters
+ *  	Audio parameters with the final samples count.
+ *  @return
+ *  	Operation result.
+ */
+static PillBigError
+pillbig_audio_patch_wave_header(PillBigSink output, long header_position,
+	PillBigAudioParameters *parameters);
 
 /**
- *  Writes a RIFF WAVE header.
+ *  Writes silence samples.
  *
  *  @param output
- *  	Output stream.
+ *  	Output sink.
+ *  @param samples_count
+ *  	Count of silence samples to be written.
  *  @param parameters
  *  	Audio parameters.
  *  @return
  *  	Operation result.
  */
 static PillBigError
-pillbig_audio_write_wave_header(FILE *output, PillBigAudioParameters *parameters);
+pillbig_audio_write_silence(PillBigSink output, int samples_count,
+	PillBigAudioParameters *parameters);
+
+/**
+ *  Sets the operation result of several files of a batch.
+ *
+ *  @param results
+ *  	Operation results of the batch files. NULL if not needed.
+ *  @param positions
+ *  	Positions of the files in the batch.
+ *  @param count
+ *  	Count of positions.
+ *  @param result
+ *  	Operation result of all the files.
+ */
+static void
+pillbig_audio_set_batch_results(PillBigError *results, const int *positions, int count,
+	PillBigError result);
+
+/**
+ *  Decodes and writes a group of pill.big audio files of the same format
+ *  decoding all them at once.
+ *
+ *  @param pillbig
+ *  	PillBig object.
+ *  @param input_format
+ *  	Audio format of every file in the group.
+ *  @param indices
+ *  	pill.big file indices. At most AUDIO_LANES.
+ *  @param outputs
+ *  	Output sinks. NULL to only analyze the files.
+ *  @param analyzers
+ *  	Analyzers fed with the decoded samples. NULL to only extract the files.
+ *  @param count
+ *  	Count of indices, outputs and analyzers.
+ *  @param output_format
+ *  	Conversion format.
+ *  @return
+ *  	Operation result.
+ */
+static PillBigError
+pillbig_audio_extract_lanes(PillBig pillbig, PillBigAudioFormat input_format,
+	const int *indices, PillBigSink *outputs, PillBigAudioAnalyzer **analyzers, int count,
+	PillBigAudioFormat output_format);
+
+/**
+ *  Reads a whole pill.big audio file into memory.
+ *
+ *  @param pillbig
+ *  	PillBig object.
+ *  @param index
+ *  	pill.big file index.
+ *  @param header_size
+ *  	On return, size of the audio header found at the start of the data.
+ *  @return
+ *  	File contents if successful, it must be freed by the caller.
+ *  	NULL otherwise.
+ */
+static unsigned char *
+pillbig_audio_read_entry(PillBig pillbig, int index, int *header_size);
+
+/**
+ *  Decodes audio data from memory resuming from a decoder state.
+ *
+ *  @param format
+ *  	Audio format of the data.
+ *  @param input
+ *  	Encoded data without header, from the start of the stream.
+ *  @param input_size
+ *  	Encoded data size.
+ *  @param state
+ *  	Decoder state to start from. On return, the state after the last
+ *  	decoded sample.
+ *  @param output
+ *  	Decoded PCM samples. NULL to only advance the state.
+ *  @param samples_count
+ *  	Maximum samples to decode.
+ *  @return
+ *  	Decoded samples count.
+ */
+static int
+pillbig_audio_decode_from(PillBigAudioFormat format,
+	const unsigned char *input, int input_size,
+	PillBigAudioCheckpoint *state, short *output, int samples_count);
+
+/**
+ *  Decodes a range of samples in parallel lanes, each one starting
+ *  at a different seek index checkpoint.
+ *
+ *  @param format
+ *  	Audio format of the data.
+ *  @param input
+ *  	Encoded data without header, from the start of the stream.
+ *  @param input_size
+ *  	Encoded data size.
+ *  @param seek_index
+ *  	Seek index of the data.
+ *  @param first
+ *  	First checkpoint to decode from.
+ *  @param end_sample
+ *  	Sample where decoding stops.
+ *  @param output
+ *  	Decoded PCM samples, starting at the first checkpoint sample.
+ *  @return
+ *  	Decoded samples count.
+ */
+static int
+pillbig_audio_decode_checkpoints(PillBigAudioFormat format,
+	const unsigned char *input, int input_size,
+	PillBigAudioSeekIndex *seek_index, int first, int end_sample,
+	short *output);
+
+/**
+ *  Decodes the next samples of an audio stream, refilling its window
+ *  of encoded data as needed.
+ *
+ *  @param stream
+ *  	Audio stream.
+ *  @param output
+ *  	Decoded PCM samples. NULL to only advance the stream.
+ *  @param frames
+ *  	Maximum samples to decode.
+ *  @return
+ *  	Decoded samples count if successful. -1 otherwise.
+ */
+static int
+pillbig_audio_stream_decode(PillBigAudioStream stream, short *output, int frames);
+
+/**
+ *  Decodes a pill.big audio file block by block, resampling it if needed.
+ *
+ *  @param pillbig
+ *  	PillBig object.
+ *  @param index
+ *  	pill.big audio file index.
+ *  @param output
+ *  	Output PCM sink.
+ *  @param parameters
+ *  	Output audio parameters. On return, samples_count holds the count
+ *  	of samples written.
+ *  @param max_samples
+ *  	Maximum count of samples to write. -1 for no limit.
+ *  @param decoded_count
+ *  	On return, count of samples decoded from the pill.big file or -1
+ *  	if decoding stopped before the end of the file.
+ *  @return
+ *  	Operation result.
+ */
+static PillBigError
+pillbig_audio_extract_streamed(PillBig pillbig, int index, PillBigSink output,
+	PillBigAudioParameters *parameters, int max_samples, int *decoded_count);
+
+/**
+ *  Makes the RIFF WAVE header and the written samples agree once the
+ *  decoding is done.
+ *
+ *  @param output
+ *  	Output sink.
+ *  @param output_format
+ *  	Conversion format. Nothing is done unless it is
+ *  	PillBigAudioFormat_WAVE.
+ *  @param header_position
+ *  	Position of the header in the output sink. -1 if the sink
+ *  	isn't seekable.
+ *  @param announced_samples_count
+ *  	Samples count written in the header.
+ *  @param parameters
+ *  	Audio parameters with the count of samples written.
+ *  @return
+ *  	Operation result.
+ */
+static PillBigError
+pillbig_audio_finish_wave(PillBigSink output, PillBigAudioFormat output_format,
+	long header_position, int announced_samples_count,
+	PillBigAudioParameters *parameters);
 
 /**
  *  Writes a PSX VAG header.
  *
  *  @param output
- *  	Output stream.
+ *  	Output sink.
  *  @param parameters
  *  	Audio parameters.
  *  @return
  *  	Operation result.
  */
 static PillBigError
-pillbig_audio_write_vag_header(FILE *output, PillBigAudioParameters *parameters);
+pillbig_audio_write_vag_header(PillBigSink output, PillBigAudioParameters *parameters);
+
+/**
+ *  Takes the metadata of an audio file from the attached database,
+ *  once its entry is known to match the file.
+ *
+ *  @param pillbig
+ *  	PillBig object.
+ *  @param index
+ *  	pill.big file index.
+ *  @return
+ *  	1 if the format, header size and samples count were taken.
+ *  	0 otherwise.
+ */
+static int
+pillbig_audio_load_db_info(PillBig pillbig, int index);
 
 
 
@@ -66,14 +293,35 @@ pillbig_audio_extract(PillBig pillbig, int index, FILE *output,
                       PillBigAudioFormat output_format)
 {
 	pillbig_error_clear();
+
+	PillBigSink sink = (output != NULL) ? pillbig_sink_new_from_file(output) : NULL;
+	if (pillbig_audio_extract_to_sink(pillbig, index, sink, output_format) ==
+		PillBigError_Success)
+	{
+		pillbig_sink_flush(sink);
+	}
+	pillbig_sink_free(sink);
+
+	return pillbig_error_get();
+}
+
+PillBigError
+pillbig_audio_extract_to_sink(PillBig pillbig, int index, PillBigSink output,
+	PillBigAudioFormat output_format)
+{
+	pillbig_error_clear();
 	SET_RETURN_ERROR_IF_FAIL(pillbig != NULL, PillBigError_InvalidPillBigObject);
 	SET_RETURN_ERROR_IF_FAIL(0 <= index && index < pillbig->files_count,
 		PillBigError_FileIndexOutOfRange);
 	SET_RETURN_ERROR_IF_FAIL(output != NULL, PillBigError_InvalidStream);
 
-	PillBigAudioConverterCallback callback = NULL;
+	const PillBigAudioCodec *codec = NULL;
 	PillBigAudioParameters parameters;
-	int result;
+	PillBigEntryInfo *info;
+	int announced_samples_count, decoded_count;
+	int seekable = pillbig_sink_is_seekable(output);
+	long header_position = seekable ? pillbig_sink_tell(output) : -1;
+	long offset = pillbig->entries[index].offset;
 
 	/*
 	 * FIX: Input format should be autodetected or queried to a database.
@@ -82,61 +330,61 @@ pillbig_audio_extract(PillBig pillbig, int index, FILE *output,
 
 	if (input_format == output_format)
 	{
-		pillbig_file_extract(pillbig, index, output);
+		pillbig_file_extract_to_sink(pillbig, index, output);
 	}
 	else
 	{
-		result = fseek(pillbig->pillbig, pillbig->entries[index].offset, SEEK_SET);
-		SET_RETURN_ERROR_IF_FAIL(result == 0, PillBigError_SystemError);
-
-		switch (input_format)
+		/*
+		 * The header and length of each format are set up by the codec.
+		 * VAG lengths are only exact after a scan, which is needed when
+		 * the WAVE header cannot be patched later.
+		 */
+		codec = pillbig_audio_codec_find(input_format, output_format);
+		if (codec != NULL)
 		{
-			case PillBigAudioFormat_ADPCM:
-				/* There are 2 IMA ADPCM samples for each byte. */
-				parameters.samples_count   = pillbig->entries[index].size * 2;
-				parameters.sample_rate     = 11025;
-				parameters.channels_count  = 1;
-				parameters.bits_per_sample = 16;
-
-				callback = pillbig_audio_adpcm_decode;
-				break;
-
-			case PillBigAudioFormat_VAG:
-				/*
-				 * VAG audio files from the PSX version of Blood Omen
-				 * has a non-standard headerless format. The lenght of the
-				 * audio must be calculated on-the-fly.
-				 */
-				parameters.samples_count   =
-					pillbig_audio_vag_get_samples_count(pillbig->pillbig,
-					pillbig->entries[index].size);
-				parameters.sample_rate     = 11025;
-				parameters.channels_count  = 1;
-				parameters.bits_per_sample = 16;
-
-				callback = pillbig_audio_vag_decode;
-
-				/*
-				 * If this file has a header then skip it.
-				 */
-				if (pillbig_audio_vag_has_header(pillbig->pillbig))
-				{
-					result = fseek(pillbig->pillbig, 64, SEEK_CUR);
-					SET_RETURN_ERROR_IF_FAIL(result == 0, PillBigError_SystemError);
-				}
-				break;
+			pillbig_error_set(codec->prepare(pillbig, index,
+				output_format == PillBigAudioFormat_WAVE && !seekable,
+				&offset, &parameters));
 		}
 	}
 
-	if (callback != NULL)
+	if (codec != NULL && pillbig_no_error())
 	{
+		if (pillbig->sample_rate != parameters.sample_rate)
+		{
+			parameters.samples_count = pillbig_audio_resampler_get_output_count(
+				parameters.sample_rate, pillbig->sample_rate, parameters.samples_count);
+			parameters.sample_rate = pillbig->sample_rate;
+		}
+
 		if (output_format == PillBigAudioFormat_WAVE)
 		{
 			pillbig_audio_write_wave_header(output, &parameters);
 		}
-		pillbig_error_set(callback(pillbig->pillbig, output, &parameters));
+
+		announced_samples_count = parameters.samples_count;
+		if (parameters.sample_rate != AUDIO_SAMPLE_RATE)
+		{
+			pillbig_audio_extract_streamed(pillbig, index, output,
+				&parameters, -1, &decoded_count);
+		}
+		else
+		{
+			pillbig_error_set(codec->convert(pillbig->source, offset, output, &parameters));
+			decoded_count = parameters.samples_count;
+		}
+
+		if (pillbig_no_error())
+		{
+			info = &pillbig->infos[index];
+			info->samples_count = decoded_count;
+			info->known |= PillBigEntryInfo_SamplesCount;
+
+			pillbig_audio_finish_wave(output, output_format, header_position,
+				announced_samples_count, &parameters);
+		}
 	}
-	else
+	else if (codec == NULL)
 	{
 		pillbig_error_set(PillBigError_NotImplemented);
 	}
@@ -144,6 +392,109 @@ pillbig_audio_extract(PillBig pillbig, int index, FILE *output,
 	return pillbig_error_get();
 }
 
+PillBigError
+pillbig_audio_extract_preview(PillBig pillbig, int index, FILE *output,
+	PillBigAudioFormat output_format, int max_samples)
+{
+	pillbig_error_clear();
+
+	PillBigSink sink = (output != NULL) ? pillbig_sink_new_from_file(output) : NULL;
+	if (pillbig_audio_extract_preview_to_sink(pillbig, index, sink, output_format,
+		max_samples) == PillBigError_Success)
+	{
+		pillbig_sink_flush(sink);
+	}
+	pillbig_sink_free(sink);
+
+	return pillbig_error_get();
+}
+
+PillBigError
+pillbig_audio_extract_preview_to_sink(PillBig pillbig, int index, PillBigSink output,
+	PillBigAudioFormat output_format, int max_samples)
+{
+	pillbig_error_clear();
+	SET_RETURN_ERROR_IF_FAIL(pillbig != NULL, PillBigError_InvalidPillBigObject);
+	SET_RETURN_ERROR_IF_FAIL(0 <= index && index < pillbig->files_count,
+		PillBigError_FileIndexOutOfRange);
+	SET_RETURN_ERROR_IF_FAIL(output != NULL, PillBigError_InvalidStream);
+	SET_RETURN_ERROR_IF_FAIL(max_samples >= 0, PillBigError_UnknownError);
+	SET_RETURN_ERROR_IF_FAIL(output_format == PillBigAudioFormat_PCM ||
+		output_format == PillBigAudioFormat_WAVE, PillBigError_NotImplemented);
+
+	const PillBigFileEntry *entry = &pillbig->entries[index];
+	PillBigEntryInfo *info = &pillbig->infos[index];
+	PillBigAudioParameters parameters;
+	PillBigAudioFormat input_format;
+	int seekable = pillbig_sink_is_seekable(output);
+	long header_position = seekable ? pillbig_sink_tell(output) : -1;
+	int announced_samples_count, decoded_count;
+	int samples_count;
+
+	input_format = pillbig_audio_get_format(pillbig, index);
+	SET_RETURN_ERROR_IF_FAIL(pillbig_no_error(), pillbig_error_get());
+	SET_RETURN_ERROR_IF_FAIL(input_format == PillBigAudioFormat_ADPCM ||
+		input_format == PillBigAudioFormat_VAG, PillBigError_NotImplemented);
+
+	/*
+	 * Upper bound of the audio length. VAG files are only scanned when
+	 * the header could not be patched later, and just up to the preview.
+	 */
+	if (info->known & PillBigEntryInfo_SamplesCount)
+	{
+		samples_count = info->samples_count;
+	}
+	else if (input_format == PillBigAudioFormat_ADPCM)
+	{
+		/* There are 2 IMA ADPCM samples for each byte. */
+		samples_count = entry->size * 2;
+	}
+	else if (output_format == PillBigAudioFormat_WAVE && !seekable)
+	{
+		samples_count = pillbig_audio_vag_get_samples_count(pillbig->source,
+			entry->offset, entry->size,
+			pillbig_audio_resampler_get_input_count(AUDIO_SAMPLE_RATE,
+			pillbig->sample_rate, max_samples));
+		SET_RETURN_ERROR_IF_FAIL(samples_count != -1, PillBigError_SystemError);
+	}
+	else
+	{
+		samples_count = VAG_MAX_SAMPLES_COUNT(
+			entry->size - info->header_size);
+	}
+
+	parameters.sample_rate     = pillbig->sample_rate;
+	parameters.channels_count  = 1;
+	parameters.bits_per_sample = 16;
+	parameters.samples_count   = MIN(max_samples,
+		pillbig_audio_resampler_get_output_count(AUDIO_SAMPLE_RATE,
+		pillbig->sample_rate, samples_count));
+
+	if (output_format == PillBigAudioFormat_WAVE)
+	{
+		pillbig_audio_write_wave_header(output, &parameters);
+		SET_RETURN_ERROR_IF_FAIL(pillbig_no_error(), pillbig_error_get());
+	}
+
+	announced_samples_count = parameters.samples_count;
+	pillbig_audio_extract_streamed(pillbig, index, output, &parameters,
+		announced_samples_count, &decoded_count);
+
+	if (pillbig_no_error())
+	{
+		if (decoded_count != -1)
+		{
+			info->samples_count = decoded_count;
+			info->known |= PillBigEntryInfo_SamplesCount;
+		}
+
+		pillbig_audio_finish_wave(output, output_format, header_position,
+			announced_samples_count, &parameters);
+	}
+
+	return pillbig_error_get();
+}
+
 PillBigError
 pillbig_audio_extract_to_filename(
 	PillBig pillbig, int index, const char *filename,
@@ -158,97 +509,899 @@ pillbig_audio_extract_to_filename(
 	FILE *output = fopen(filename, "wb");
 	SET_RETURN_ERROR_IF_FAIL(output != NULL, PillBigError_SystemError);
 	pillbig_audio_extract(pillbig, index, output, output_format);
-	fclose(output);
+	if (fclose(output) != 0 && pillbig_no_error())
+	{
+		pillbig_error_set(PillBigError_SystemError);
+	}
 
 	return pillbig_error_get();
 }
 
 PillBigError
-pillbig_audio_replace(
-	PillBig pillbig, int index, FILE *input,
-	PillBigAudioFormat input_format)
+pillbig_audio_extract_batch(
+	PillBig pillbig, const int *indices, FILE **outputs, int count,
+	PillBigAudioFormat output_format, PillBigError *results)
 {
-	pillbig_error_set(PillBigError_NotImplemented);
-	return pillbig_error_get();
-}
+	pillbig_error_clear();
+	SET_RETURN_ERROR_IF_FAIL(pillbig != NULL, PillBigError_InvalidPillBigObject);
+	SET_RETURN_ERROR_IF_FAIL(indices != NULL && outputs != NULL,
+		PillBigError_InvalidStream);
+	SET_RETURN_ERROR_IF_FAIL(count >= 0, PillBigError_UnknownError);
 
-PillBigError
-pillbig_audio_replace_from_filename(
-	PillBig pillbig, int index, const char *filename,
-	PillBigAudioFormat input_format)
-{
-	pillbig_error_set(PillBigError_NotImplemented);
-	return pillbig_error_get();
-}
+	PillBigSink *sinks;
+	PillBigError error;
+	int i;
 
-PillBigAudioFormat
-pillbig_audio_get_format(PillBig pillbig, int index)
-{
-	PillBigAudioFormat format = PillBigAudioFormat_Unknown;
+	for (i = 0; results != NULL && i < count; i++)
+	{
+		results[i] = PillBigError_UnknownError;
+	}
 
-	int result;
-	int magic32, magic16;
+	sinks = (PillBigSink *)calloc(MAX(count, 1), sizeof(PillBigSink));
+	SET_RETURN_ERROR_IF_FAIL(sinks != NULL, PillBigError_SystemError);
 
-	result = fseek(pillbig->pillbig, pillbig->entries[index].offset, SEEK_SET);
-	SET_ERROR_RETURN_VALUE_IF_FAIL(result == 0, PillBigError_SystemError, format);
-	result = fread(&magic32, 4, 1, pillbig->pillbig);
-	SET_ERROR_RETURN_VALUE_IF_FAIL(result == 1, PillBigError_SystemError, result);
+	for (i = 0; i < count && pillbig_no_error(); i++)
+	{
+		SET_ERROR_IF_FAIL(outputs[i] != NULL, PillBigError_InvalidStream);
+		if (outputs[i] != NULL)
+		{
+			sinks[i] = pillbig_sink_new_from_file(outputs[i]);
+		}
+	}
 
-	magic16 = (magic32 & 0xffff);
+	if (pillbig_no_error())
+	{
+		pillbig_audio_extract_batch_to_sinks(pillbig, indices, sinks, count,
+			output_format, results);
+	}
 
-	switch (pillbig->platform)
+	/*
+	 * Files extracted before a failure are kept, so every sink is flushed.
+	 */
+	error = pillbig_error_get();
+	for (i = 0; i < count; i++)
 	{
-		case PillBigPlatform_PC:
-			if (magic16 == 0x0000)
-			{
-				format = PillBigAudioFormat_ADPCM;
-			}
-			else if (magic16 == 0x0200 || magic32 == VAG_MAGIC_ID)
-			{
-				format = PillBigAudioFormat_VAG;
-			}
-			else if (magic32 == RIFF_MAGIC_ID)
+		if (sinks[i] != NULL && pillbig_sink_flush(sinks[i]) != PillBigError_Success)
+		{
+			if (results != NULL && results[i] == PillBigError_Success)
 			{
-				format = PillBigAudioFormat_WAVE;
+				results[i] = pillbig_error_get();
 			}
-			break;
-		case PillBigPlatform_PSX:
-			if (magic16 == 0x0200 || magic16 == 0x0000 || magic32 == VAG_MAGIC_ID)
+			if (error == PillBigError_Success)
 			{
-				format = PillBigAudioFormat_VAG;
+				error = pillbig_error_get();
 			}
-			break;
-		default:
-			/* TODO: add assert */
-			break;
+		}
 	}
+	pillbig_error_set(error);
 
-	return format;
+	for (i = 0; i < count; i++)
+	{
+		pillbig_sink_free(sinks[i]);
+	}
+	free(sinks);
+
+	return pillbig_error_get();
 }
 
+PillBigError
+pillbig_audio_extract_batch_to_sinks(
+	PillBig pillbig, const int *indices, PillBigSink *outputs, int count,
+	PillBigAudioFormat output_format, PillBigError *results)
+{
+	pillbig_error_clear();
+	SET_RETURN_ERROR_IF_FAIL(pillbig != NULL, PillBigError_InvalidPillBigObject);
+	SET_RETURN_ERROR_IF_FAIL(indices != NULL && outputs != NULL,
+		PillBigError_InvalidStream);
+	SET_RETURN_ERROR_IF_FAIL(count >= 0, PillBigError_UnknownError);
 
+	int          adpcm_indices[AUDIO_LANES], vag_indices[AUDIO_LANES];
+	int          adpcm_positions[AUDIO_LANES], vag_positions[AUDIO_LANES];
+	PillBigSink  adpcm_outputs[AUDIO_LANES], vag_outputs[AUDIO_LANES];
+	int          adpcm_count = 0, vag_count = 0;
+	int          i, index;
+	PillBigAudioFormat input_format;
 
-static PillBigError
-pillbig_audio_write_wave_header(FILE *output, PillBigAudioParameters *parameters)
-{
-	#define WAVE 0x45564157
-	#define fmt  0x20746D66
-	#define data 0x61746164
+	for (i = 0; results != NULL && i < count; i++)
+	{
+		results[i] = PillBigError_UnknownError;
+	}
 
-	#define WRITE_WAVE_FIELD_2(v) {value = v; value = fwrite(&value, 2, 1, output); SET_RETURN_ERROR_IF_FAIL(value == 1, PillBigError_SystemError);}
-	#define WRITE_WAVE_FIELD_4(v) {value = v; value = fwrite(&value, 4, 1, output); SET_RETURN_ERROR_IF_FAIL(value == 1, PillBigError_SystemError);}
+	for (i = 0; i < count && pillbig_no_error(); i++)
+	{
+		index = indices[i];
+		if (!(0 <= index && index < pillbig->files_count))
+		{
+			pillbig_error_set(PillBigError_FileIndexOutOfRange);
+		}
+		else if (outputs[i] == NULL)
+		{
+			pillbig_error_set(PillBigError_InvalidStream);
+		}
+		else
+		{
+			input_format = pillbig_audio_get_format(pillbig, index);
+		}
 
-	int value;
-	int bytes_per_sample = parameters->bits_per_sample / 8;
+		if (pillbig_any_error())
+		{
+			pillbig_audio_set_batch_results(results, &i, 1, pillbig_error_get());
+			break;
+		}
 
-	/* RIFF chunk Id */
-	WRITE_WAVE_FIELD_4(RIFF_MAGIC_ID);
-	/* All chunks size starting next field */
-	WRITE_WAVE_FIELD_4(36 + parameters->samples_count * bytes_per_sample);
-	/* WAVE Id */
-	WRITE_WAVE_FIELD_4(WAVE);
+		/*
+		 * Only decodings to PCM at the original rate can run in lanes.
+		 */
+		if (input_format == output_format ||
+		    pillbig->sample_rate != AUDIO_SAMPLE_RATE ||
+		    (output_format != PillBigAudioFormat_PCM &&
+		     output_format != PillBigAudioFormat_WAVE))
+		{
+			input_format = PillBigAudioFormat_Unknown;
+		}
 
-	/* Format chunk Id */
+		switch (input_format)
+		{
+			case PillBigAudioFormat_ADPCM:
+				adpcm_indices[adpcm_count]   = index;
+				adpcm_positions[adpcm_count] = i;
+				adpcm_outputs[adpcm_count]   = outputs[i];
+				if (++adpcm_count == AUDIO_LANES)
+				{
+					pillbig_audio_set_batch_results(results, adpcm_positions, adpcm_count,
+						pillbig_audio_extract_lanes(pillbig, input_format,
+						adpcm_indices, adpcm_outputs, NULL, adpcm_count, output_format));
+					adpcm_count = 0;
+				}
+				break;
+
+			case PillBigAudioFormat_VAG:
+				vag_indices[vag_count]   = index;
+				vag_positions[vag_count] = i;
+				vag_outputs[vag_count]   = outputs[i];
+				if (++vag_count == AUDIO_LANES)
+				{
+					pillbig_audio_set_batch_results(results, vag_positions, vag_count,
+						pillbig_audio_extract_lanes(pillbig, input_format,
+						vag_indices, vag_outputs, NULL, vag_count, output_format));
+					vag_count = 0;
+				}
+				break;
+
+			default:
+				pillbig_audio_set_batch_results(results, &i, 1,
+					pillbig_audio_extract_to_sink(pillbig, index, outputs[i], output_format));
+				break;
+		}
+	}
+
+	if (pillbig_no_error() && adpcm_count > 0)
+	{
+		pillbig_audio_set_batch_results(results, adpcm_positions, adpcm_count,
+			pillbig_audio_extract_lanes(pillbig, PillBigAudioFormat_ADPCM,
+			adpcm_indices, adpcm_outputs, NULL, adpcm_count, output_format));
+	}
+
+	if (pillbig_no_error() && vag_count > 0)
+	{
+		pillbig_audio_set_batch_results(results, vag_positions, vag_count,
+			pillbig_audio_extract_lanes(pillbig, PillBigAudioFormat_VAG,
+			vag_indices, vag_outputs, NULL, vag_count, output_format));
+	}
+
+	return pillbig_error_get();
+}
+
+PillBigError
+pillbig_audio_analyze(PillBig pillbig, int index, PillBigAudioAnalysis *analysis)
+{
+	pillbig_error_clear();
+	SET_RETURN_ERROR_IF_FAIL(pillbig != NULL, PillBigError_InvalidPillBigObject);
+	SET_RETURN_ERROR_IF_FAIL(analysis != NULL, PillBigError_UnknownError);
+
+	PillBigAudioAnalyzer *analyzer;
+	PillBigAudioStream stream;
+	PillBigError error;
+	short samples[AUDIO_STREAM_BUFFER_SIZE];
+	int read_count;
+
+	stream = pillbig_audio_stream_open(pillbig, index, PillBigAudioFormat_PCM);
+	SET_RETURN_ERROR_IF_FAIL(stream != NULL, pillbig_error_get());
+
+	analyzer = pillbig_audio_analyzer_new(AUDIO_SAMPLE_RATE);
+	SET_ERROR_IF_FAIL(analyzer != NULL, pillbig_error_get());
+
+	/*
+	 * Decoded blocks are analyzed as they are pulled from the stream.
+	 */
+	while (pillbig_no_error())
+	{
+		read_count = pillbig_audio_stream_read(stream, samples, AUDIO_STREAM_BUFFER_SIZE);
+		if (read_count <= 0)
+		{
+			break;
+		}
+		pillbig_audio_analyzer_process(analyzer, samples, read_count);
+	}
+
+	if (pillbig_no_error())
+	{
+		pillbig_audio_analyzer_finish(analyzer, analysis);
+		pillbig->infos[index].samples_count = analysis->samples_count;
+		pillbig->infos[index].known |= PillBigEntryInfo_SamplesCount;
+	}
+
+	pillbig_audio_analyzer_free(analyzer);
+
+	error = pillbig_error_get();
+	pillbig_audio_stream_close(stream);
+	pillbig_error_set(error);
+
+	return error;
+}
+
+PillBigError
+pillbig_audio_analyze_batch(
+	PillBig pillbig, const int *indices, PillBigAudioAnalysis *analyses, int count)
+{
+	pillbig_error_clear();
+	SET_RETURN_ERROR_IF_FAIL(pillbig != NULL, PillBigError_InvalidPillBigObject);
+	SET_RETURN_ERROR_IF_FAIL(indices != NULL && analyses != NULL,
+		PillBigError_UnknownError);
+	SET_RETURN_ERROR_IF_FAIL(count >= 0, PillBigError_UnknownError);
+
+	PillBigAudioAnalyzer *analyzers[AUDIO_LANES];
+	int lanes_indices[AUDIO_LANES];
+	int positions[AUDIO_LANES];
+	int first, lanes_count, i, lane, pass;
+	PillBigAudioFormat formats[] = { PillBigAudioFormat_ADPCM, PillBigAudioFormat_VAG };
+	PillBigAudioFormat input_format;
+
+	for (i = 0; i < count && pillbig_no_error(); i++)
+	{
+		SET_RETURN_ERROR_IF_FAIL(0 <= indices[i] && indices[i] < pillbig->files_count,
+			PillBigError_FileIndexOutOfRange);
+	}
+
+	/*
+	 * One pass per lane decodable format, files of other formats
+	 * are analyzed on their own.
+	 */
+	for (pass = 0; pass < 3 && pillbig_no_error(); pass++)
+	{
+		for (first = 0; first < count && pillbig_no_error(); first = i)
+		{
+			lanes_count = 0;
+			for (i = first; i < count && lanes_count < AUDIO_LANES && pillbig_no_error(); i++)
+			{
+				input_format = pillbig_audio_get_format(pillbig, indices[i]);
+				if (pass == 2 && input_format != formats[0] && input_format != formats[1])
+				{
+					pillbig_audio_analyze(pillbig, indices[i], &analyses[i]);
+				}
+				else if (pass < 2 && input_format == formats[pass])
+				{
+					lanes_indices[lanes_count] = indices[i];
+					positions[lanes_count] = i;
+					analyzers[lanes_count] = pillbig_audio_analyzer_new(AUDIO_SAMPLE_RATE);
+					SET_ERROR_IF_FAIL(analyzers[lanes_count] != NULL, PillBigError_SystemError);
+					lanes_count++;
+				}
+			}
+
+			if (pillbig_no_error() && lanes_count > 0)
+			{
+				pillbig_audio_extract_lanes(pillbig, formats[pass], lanes_indices,
+					NULL, analyzers, lanes_count, PillBigAudioFormat_PCM);
+			}
+
+			for (lane = 0; lane < lanes_count; lane++)
+			{
+				if (pillbig_no_error())
+				{
+					pillbig_audio_analyzer_finish(analyzers[lane], &analyses[positions[lane]]);
+				}
+				pillbig_audio_analyzer_free(analyzers[lane]);
+			}
+		}
+	}
+
+	return pillbig_error_get();
+}
+
+PillBigError
+pillbig_audio_build_seek_index(PillBig pillbig, int index, int interval)
+{
+	pillbig_error_clear();
+	SET_RETURN_ERROR_IF_FAIL(pillbig != NULL, PillBigError_InvalidPillBigObject);
+	SET_RETURN_ERROR_IF_FAIL(0 <= index && index < pillbig->files_count,
+		PillBigError_FileIndexOutOfRange);
+	SET_RETURN_ERROR_IF_FAIL(interval >= 0, PillBigError_UnknownError);
+
+	PillBigEntryInfo *info = &pillbig->infos[index];
+	PillBigAudioSeekIndex *seek_index = NULL;
+	PillBigAudioCheckpoint state;
+	PillBigAudioFormat format;
+	unsigned char *input = NULL;
+	int header_size, input_size;
+	int samples_count, decoded;
+
+	format = pillbig_audio_get_format(pillbig, index);
+	SET_RETURN_ERROR_IF_FAIL(pillbig_no_error(), pillbig_error_get());
+	SET_RETURN_ERROR_IF_FAIL(format == PillBigAudioFormat_ADPCM ||
+		format == PillBigAudioFormat_VAG, PillBigError_NotImplemented);
+
+	samples_count = pillbig_audio_get_samples_count(pillbig, index);
+	SET_RETURN_ERROR_IF_FAIL(samples_count != -1, PillBigError_SystemError);
+
+	/*
+	 * Checkpoints must fall at the start of a byte (ADPCM)
+	 * or at the start of a block (VAG).
+	 */
+	interval = (interval == 0) ? AUDIO_SEEK_INTERVAL : interval;
+	if (format == PillBigAudioFormat_ADPCM)
+	{
+		interval = (interval + 1) / 2 * 2;
+	}
+	else
+	{
+		interval = (interval + 27) / 28 * 28;
+	}
+
+	input = pillbig_audio_read_entry(pillbig, index, &header_size);
+	if (input == NULL)
+	{
+		return pillbig_error_get();
+	}
+	input_size = pillbig->entries[index].size - header_size;
+
+	seek_index = (PillBigAudioSeekIndex *)malloc(sizeof(PillBigAudioSeekIndex));
+	SET_ERROR_IF_FAIL(seek_index != NULL, PillBigError_SystemError);
+	if (pillbig_no_error())
+	{
+		seek_index->interval = interval;
+		seek_index->count = 0;
+		seek_index->checkpoints = (PillBigAudioCheckpoint *)malloc(
+			(samples_count / interval + 1) * sizeof(PillBigAudioCheckpoint));
+		SET_ERROR_IF_FAIL(seek_index->checkpoints != NULL, PillBigError_SystemError);
+	}
+
+	if (pillbig_no_error())
+	{
+		memset(&state, 0, sizeof(PillBigAudioCheckpoint));
+		do
+		{
+			seek_index->checkpoints[seek_index->count++] = state;
+			decoded = pillbig_audio_decode_from(format, input + header_size,
+				input_size, &state, NULL,
+				MIN(interval, samples_count - state.sample));
+		}
+		while (decoded == interval && state.sample < samples_count);
+
+		pillbig_audio_free_seek_index(info->seek_index);
+		info->seek_index = seek_index;
+	}
+	else if (seek_index != NULL)
+	{
+		free(seek_index);
+	}
+
+	free(input);
+
+	return pillbig_error_get();
+}
+
+int
+pillbig_audio_decode_range(PillBig pillbig, int index,
+	int first_sample, int samples_count, short *output)
+{
+	pillbig_error_clear();
+	SET_ERROR_RETURN_VALUE_IF_FAIL(pillbig != NULL,
+		PillBigError_InvalidPillBigObject, -1);
+	SET_ERROR_RETURN_VALUE_IF_FAIL(0 <= index && index < pillbig->files_count,
+		PillBigError_FileIndexOutOfRange, -1);
+	SET_ERROR_RETURN_VALUE_IF_FAIL(first_sample >= 0 && samples_count >= 0,
+		PillBigError_UnknownError, -1);
+	SET_ERROR_RETURN_VALUE_IF_FAIL(output != NULL || samples_count == 0,
+		PillBigError_UnknownError, -1);
+
+	PillBigAudioSeekIndex *seek_index = pillbig->infos[index].seek_index;
+	PillBigAudioCheckpoint state;
+	PillBigAudioFormat format;
+	unsigned char *input;
+	short *buffer;
+	int header_size, input_size;
+	int total_samples, end_sample;
+	int first, last, decoded = 0;
+
+	format = pillbig_audio_get_format(pillbig, index);
+	SET_ERROR_RETURN_VALUE_IF_FAIL(pillbig_no_error(), pillbig_error_get(), -1);
+	SET_ERROR_RETURN_VALUE_IF_FAIL(format == PillBigAudioFormat_ADPCM ||
+		format == PillBigAudioFormat_VAG, PillBigError_NotImplemented, -1);
+
+	total_samples = pillbig_audio_get_samples_count(pillbig, index);
+	SET_ERROR_RETURN_VALUE_IF_FAIL(total_samples != -1, PillBigError_SystemError, -1);
+
+	end_sample = MIN(total_samples, first_sample + samples_count);
+	if (first_sample >= end_sample)
+	{
+		return 0;
+	}
+
+	input = pillbig_audio_read_entry(pillbig, index, &header_size);
+	if (input == NULL)
+	{
+		return -1;
+	}
+	input_size = pillbig->entries[index].size - header_size;
+
+	memset(&state, 0, sizeof(PillBigAudioCheckpoint));
+	first = last = 0;
+	if (seek_index != NULL)
+	{
+		first = MIN(first_sample / seek_index->interval, seek_index->count - 1);
+		last  = MIN((end_sample - 1) / seek_index->interval, seek_index->count - 1);
+		state = seek_index->checkpoints[first];
+	}
+
+	if (last > first)
+	{
+		/*
+		 * The range spans several checkpoints,
+		 * decode them in parallel from the first one.
+		 */
+		buffer = (short *)malloc((end_sample - state.sample) * sizeof(short));
+		SET_ERROR_IF_FAIL(buffer != NULL, PillBigError_SystemError);
+		if (buffer != NULL)
+		{
+			decoded = pillbig_audio_decode_checkpoints(format,
+				input + header_size, input_size, seek_index, first,
+				end_sample, buffer);
+			decoded = MAX(decoded - (first_sample - state.sample), 0);
+			memcpy(output, buffer + (first_sample - state.sample),
+				decoded * sizeof(short));
+			free(buffer);
+		}
+	}
+	else if (pillbig_audio_decode_from(format, input + header_size, input_size,
+		&state, NULL, first_sample - state.sample) == first_sample - state.sample)
+	{
+		decoded = pillbig_audio_decode_from(format, input + header_size,
+			input_size, &state, output, end_sample - first_sample);
+	}
+
+	free(input);
+
+	return pillbig_no_error() ? decoded : -1;
+}
+
+int
+pillbig_audio_get_sample_rate(PillBig pillbig)
+{
+	pillbig_error_clear();
+	SET_ERROR_RETURN_VALUE_IF_FAIL(pillbig != NULL,
+		PillBigError_InvalidPillBigObject, -1);
+
+	return pillbig->sample_rate;
+}
+
+void
+pillbig_audio_set_sample_rate(PillBig pillbig, int sample_rate)
+{
+	pillbig_error_clear();
+	SET_ERROR_RETURN_IF_FAIL(pillbig != NULL, PillBigError_InvalidPillBigObject);
+	SET_ERROR_RETURN_IF_FAIL(4000 <= sample_rate && sample_rate <= 192000,
+		PillBigError_InvalidSampleRate);
+
+	pillbig->sample_rate = sample_rate;
+}
+
+PillBigError
+pillbig_audio_resample(FILE *input, FILE *output,
+	int input_rate, int output_rate)
+{
+	pillbig_error_clear();
+	SET_RETURN_ERROR_IF_FAIL(input != NULL, PillBigError_InvalidStream);
+	SET_RETURN_ERROR_IF_FAIL(output != NULL, PillBigError_InvalidStream);
+	SET_RETURN_ERROR_IF_FAIL(4000 <= input_rate && input_rate <= 192000,
+		PillBigError_InvalidSampleRate);
+	SET_RETURN_ERROR_IF_FAIL(4000 <= output_rate && output_rate <= 192000,
+		PillBigError_InvalidSampleRate);
+
+	PillBigAudioResampler *resampler;
+	short  input_buffer[AUDIO_RESAMPLER_BLOCK];
+	short *output_buffer;
+	int read_count, count, result;
+
+	resampler = pillbig_audio_resampler_new(input_rate, output_rate);
+	SET_RETURN_ERROR_IF_FAIL(resampler != NULL, pillbig_error_get());
+
+	output_buffer = (short *)malloc(pillbig_audio_resampler_get_max_output(
+		resampler, AUDIO_RESAMPLER_BLOCK) * sizeof(short));
+	SET_ERROR_IF_FAIL(output_buffer != NULL, PillBigError_SystemError);
+
+	do
+	{
+		read_count = fread(input_buffer, sizeof(short), AUDIO_RESAMPLER_BLOCK, input);
+		SET_ERROR_IF_FAIL(read_count > 0 || !ferror(input), PillBigError_SystemError);
+		if (pillbig_any_error())
+		{
+			break;
+		}
+
+		count = pillbig_audio_resampler_process(resampler,
+			(read_count > 0) ? input_buffer : NULL, read_count, output_buffer);
+		result = fwrite(output_buffer, sizeof(short), count, output);
+		SET_ERROR_IF_FAIL(result == count, PillBigError_SystemError);
+	}
+	while (read_count > 0 && pillbig_no_error());
+
+	free(output_buffer);
+	pillbig_audio_resampler_free(resampler);
+
+	return pillbig_error_get();
+}
+
+PillBigAudioStream
+pillbig_audio_stream_open(PillBig pillbig, int index,
+	PillBigAudioFormat output_format)
+{
+	pillbig_error_clear();
+	SET_ERROR_RETURN_VALUE_IF_FAIL(pillbig != NULL,
+		PillBigError_InvalidPillBigObject, NULL);
+	SET_ERROR_RETURN_VALUE_IF_FAIL(0 <= index && index < pillbig->files_count,
+		PillBigError_FileIndexOutOfRange, NULL);
+	SET_ERROR_RETURN_VALUE_IF_FAIL(output_format == PillBigAudioFormat_PCM,
+		PillBigError_NotImplemented, NULL);
+
+	const PillBigFileEntry *entry = &pillbig->entries[index];
+	const PillBigEntryInfo *info  = &pillbig->infos[index];
+	PillBigAudioStream stream;
+	PillBigAudioFormat input_format;
+	int header_size;
+
+	input_format = pillbig_audio_get_format(pillbig, index);
+	SET_ERROR_RETURN_VALUE_IF_FAIL(pillbig_no_error(), pillbig_error_get(), NULL);
+	SET_ERROR_RETURN_VALUE_IF_FAIL(input_format == PillBigAudioFormat_ADPCM ||
+		input_format == PillBigAudioFormat_VAG, PillBigError_NotImplemented, NULL);
+
+	stream = (PillBigAudioStream)malloc(sizeof(struct _PillBigAudioStream));
+	SET_ERROR_RETURN_VALUE_IF_FAIL(stream != NULL, PillBigError_SystemError, NULL);
+	memset(stream, 0, sizeof(struct _PillBigAudioStream));
+
+	header_size = (input_format == PillBigAudioFormat_VAG) ?
+		MIN(info->header_size, entry->size) : 0;
+
+	stream->pillbig       = pillbig;
+	stream->index         = index;
+	stream->input_format  = input_format;
+	stream->output_format = output_format;
+	stream->data_offset   = entry->offset + header_size;
+	stream->data_size     = entry->size - header_size;
+
+	/*
+	 * Don't scan VAG files for their samples count, the decoder stops
+	 * at the end flag anyway.
+	 */
+	if (info->known & PillBigEntryInfo_SamplesCount)
+	{
+		stream->samples_limit = info->samples_count;
+	}
+	else if (input_format == PillBigAudioFormat_VAG)
+	{
+		stream->samples_limit = VAG_MAX_SAMPLES_COUNT(stream->data_size);
+	}
+	else
+	{
+		/* There are 2 IMA ADPCM samples for each byte. */
+		stream->samples_limit = stream->data_size * 2;
+	}
+
+	return stream;
+}
+
+int
+pillbig_audio_stream_read(PillBigAudioStream stream, short *buffer, int frames)
+{
+	pillbig_error_clear();
+	SET_ERROR_RETURN_VALUE_IF_FAIL(stream != NULL, PillBigError_InvalidStream, -1);
+	SET_ERROR_RETURN_VALUE_IF_FAIL(buffer != NULL || frames == 0,
+		PillBigError_UnknownError, -1);
+	SET_ERROR_RETURN_VALUE_IF_FAIL(frames >= 0, PillBigError_UnknownError, -1);
+
+	return pillbig_audio_stream_decode(stream, buffer, frames);
+}
+
+PillBigError
+pillbig_audio_stream_seek(PillBigAudioStream stream, int frame)
+{
+	pillbig_error_clear();
+	SET_RETURN_ERROR_IF_FAIL(stream != NULL, PillBigError_InvalidStream);
+	SET_RETURN_ERROR_IF_FAIL(frame >= 0, PillBigError_UnknownError);
+
+	PillBigAudioSeekIndex *seek_index =
+		stream->pillbig->infos[stream->index].seek_index;
+	PillBigAudioCheckpoint *checkpoint;
+
+	/*
+	 * Restart from the nearest checkpoint behind the frame,
+	 * unless the current position is nearer.
+	 */
+	if (seek_index != NULL)
+	{
+		checkpoint = &seek_index->checkpoints[
+			MIN(frame / seek_index->interval, seek_index->count - 1)];
+		if (frame < stream->state.sample || checkpoint->sample > stream->state.sample)
+		{
+			stream->state = *checkpoint;
+			stream->finished = 0;
+		}
+	}
+	else if (frame < stream->state.sample)
+	{
+		memset(&stream->state, 0, sizeof(PillBigAudioCheckpoint));
+		stream->finished = 0;
+	}
+
+	if (frame > stream->state.sample)
+	{
+		pillbig_audio_stream_decode(stream, NULL, frame - stream->state.sample);
+	}
+
+	return pillbig_error_get();
+}
+
+int
+pillbig_audio_stream_tell(PillBigAudioStream stream)
+{
+	pillbig_error_clear();
+	SET_ERROR_RETURN_VALUE_IF_FAIL(stream != NULL, PillBigError_InvalidStream, -1);
+
+	return stream->state.sample;
+}
+
+void
+pillbig_audio_stream_close(PillBigAudioStream stream)
+{
+	pillbig_error_clear();
+	SET_ERROR_RETURN_IF_FAIL(stream != NULL, PillBigError_InvalidStream);
+
+	free(stream);
+}
+
+PillBigError
+pillbig_audio_replace(
+	PillBig pillbig, int index, FILE *input,
+	PillBigAudioFormat input_format)
+{
+	pillbig_error_set(PillBigError_NotImplemented);
+	return pillbig_error_get();
+}
+
+PillBigError
+pillbig_audio_replace_from_filename(
+	PillBig pillbig, int index, const char *filename,
+	PillBigAudioFormat input_format)
+{
+	pillbig_error_set(PillBigError_NotImplemented);
+	return pillbig_error_get();
+}
+
+PillBigAudioFormat
+pillbig_audio_get_format(PillBig pillbig, int index)
+{
+	pillbig_error_clear();
+	SET_ERROR_RETURN_VALUE_IF_FAIL(pillbig != NULL,
+		PillBigError_InvalidPillBigObject, PillBigAudioFormat_Unknown);
+	SET_ERROR_RETURN_VALUE_IF_FAIL(0 <= index && index < pillbig->files_count,
+		PillBigError_FileIndexOutOfRange, PillBigAudioFormat_Unknown);
+
+	PillBigEntryInfo *info = &pillbig->infos[index];
+
+	if (!(info->known & PillBigEntryInfo_AudioFormat) &&
+	    !pillbig_audio_load_db_info(pillbig, index))
+	{
+		pillbig_filetype_probe(pillbig, index);
+	}
+
+	return info->audio_format;
+}
+
+double
+pillbig_audio_get_duration(PillBig pillbig, int index)
+{
+	pillbig_error_clear();
+	SET_ERROR_RETURN_VALUE_IF_FAIL(pillbig != NULL,
+		PillBigError_InvalidPillBigObject, -1);
+	SET_ERROR_RETURN_VALUE_IF_FAIL(0 <= index && index < pillbig->files_count,
+		PillBigError_FileIndexOutOfRange, -1);
+
+	int samples_count = pillbig_audio_get_samples_count(pillbig, index);
+	RETURN_VALUE_IF_FAIL(samples_count != -1, -1);
+
+	return (double)samples_count / AUDIO_SAMPLE_RATE;
+}
+
+PillBigAudioFormat
+pillbig_audio_guess_format(PillBigPlatform platform,
+	const unsigned char *header, int header_size)
+{
+	PillBigAudioFormat format = PillBigAudioFormat_Unknown;
+	int magic32, magic16;
+
+	if (header_size < 4)
+	{
+		return format;
+	}
+
+	memcpy(&magic32, header, 4);
+	magic16 = (magic32 & 0xffff);
+
+	switch (platform)
+	{
+		case PillBigPlatform_PC:
+			if (magic16 == 0x0000)
+			{
+				format = PillBigAudioFormat_ADPCM;
+			}
+			else if (magic16 == 0x0200 || magic32 == VAG_MAGIC_ID)
+			{
+				format = PillBigAudioFormat_VAG;
+			}
+			else if (magic32 == RIFF_MAGIC_ID)
+			{
+				format = PillBigAudioFormat_WAVE;
+			}
+			break;
+		case PillBigPlatform_PSX:
+			if (magic16 == 0x0200 || magic16 == 0x0000 || magic32 == VAG_MAGIC_ID)
+			{
+				format = PillBigAudioFormat_VAG;
+			}
+			break;
+		default:
+			/* TODO: add assert */
+			break;
+	}
+
+	return format;
+}
+
+int
+pillbig_audio_get_samples_count(PillBig pillbig, int index)
+{
+	PillBigEntryInfo *info = &pillbig->infos[index];
+	int samples_count = -1;
+
+	if ((info->known & PillBigEntryInfo_SamplesCount) ||
+	    pillbig_audio_load_db_info(pillbig, index))
+	{
+		return info->samples_count;
+	}
+
+	switch (pillbig_audio_get_format(pillbig, index))
+	{
+		case PillBigAudioFormat_ADPCM:
+			/* There are 2 IMA ADPCM samples for each byte. */
+			samples_count = pillbig->entries[index].size * 2;
+			break;
+		case PillBigAudioFormat_VAG:
+			samples_count = pillbig_audio_vag_get_samples_count(pillbig->source,
+				pillbig->entries[index].offset, pillbig->entries[index].size, -1);
+			break;
+		default:
+			break;
+	}
+
+	if (samples_count != -1)
+	{
+		info->samples_count = samples_count;
+		info->known |= PillBigEntryInfo_SamplesCount;
+	}
+
+	return samples_count;
+}
+
+unsigned int
+pillbig_audio_get_checksum(PillBigSource source, long offset, int size)
+{
+	unsigned char buffer[2 * AUDIO_CHECKSUM_SPAN];
+	unsigned int checksum = 2166136261U;
+	int count, tail, i;
+
+	count = MIN(size, AUDIO_CHECKSUM_SPAN);
+	tail = MIN(size - count, AUDIO_CHECKSUM_SPAN);
+	RETURN_VALUE_IF_FAIL(pillbig_source_read_at(source, buffer, count, offset) == count, 0);
+	RETURN_VALUE_IF_FAIL(pillbig_source_read_at(source, buffer + count, tail,
+		offset + size - tail) == tail, 0);
+
+	for (i = 0; i < count + tail; i++)
+	{
+		checksum = (checksum ^ buffer[i]) * 16777619U;
+	}
+
+	return checksum;
+}
+
+void
+pillbig_audio_free_seek_index(PillBigAudioSeekIndex *seek_index)
+{
+	if (seek_index != NULL)
+	{
+		free(seek_index->checkpoints);
+		free(seek_index);
+	}
+}
+
+
+static int
+pillbig_audio_load_db_info(PillBig pillbig, int index)
+{
+	PillBigEntryInfo *info = &pillbig->infos[index];
+	const PillBigFileEntry *file = &pillbig->entries[index];
+	const PillBigDBEntry *entry;
+	const PillBigDBAudioEntry *audio;
+	unsigned int checksum;
+
+	if (pillbig->db == NULL || (info->known & PillBigEntryInfo_Database))
+	{
+		return 0;
+	}
+	info->known |= PillBigEntryInfo_Database;
+
+	entry = pillbig_db_get_entry(pillbig->db, index);
+	audio = (entry != NULL && entry->filetype == PillBigFileType_Audio) ? entry->audio : NULL;
+	pillbig_error_clear();
+
+	if (audio == NULL || audio->samples_count <= 0 || audio->checksum == 0 ||
+	    (audio->format != PillBigAudioFormat_VAG && audio->format != PillBigAudioFormat_ADPCM) ||
+	    entry->size != file->size || audio->header_size < 0 || audio->header_size >= file->size)
+	{
+		return 0;
+	}
+
+	/*
+	 * The entry may come from another release or the file may have been
+	 * replaced, the checksum only reads both ends of the file.
+	 */
+	checksum = pillbig_audio_get_checksum(pillbig->source, file->offset, file->size);
+	pillbig_error_clear();
+	if (checksum != audio->checksum)
+	{
+		return 0;
+	}
+
+	info->filetype      = PillBigFileType_Audio;
+	info->audio_format  = audio->format;
+	info->header_size   = audio->header_size;
+	info->samples_count = audio->samples_count;
+	info->known |= PillBigEntryInfo_FileType | PillBigEntryInfo_AudioFormat |
+		PillBigEntryInfo_SamplesCount;
+
+	return 1;
+}
+
+static void
+pillbig_audio_make_wave_header(unsigned char *header, PillBigAudioParameters *parameters)
+{
+	#define WAVE 0x45564157
+	#define fmt  0x20746D66
+	#define data 0x61746164
+
+	#define WRITE_WAVE_FIELD_2(v) {value = v; memcpy(header, &value, 2); header += 2;}
+	#define WRITE_WAVE_FIELD_4(v) {value = v; memcpy(header, &value, 4); header += 4;}
+
+	int value;
+	int bytes_per_sample = parameters->bits_per_sample / 8;
+
+	/* RIFF chunk Id */
+	WRITE_WAVE_FIELD_4(RIFF_MAGIC_ID);
+	/* All chunks size starting next field */
+	WRITE_WAVE_FIELD_4(36 + parameters->samples_count * bytes_per_sample);
+	/* WAVE Id */
+	WRITE_WAVE_FIELD_4(WAVE);
+
+	/* Format chunk Id */
 	WRITE_WAVE_FIELD_4(fmt);
 	/* Chunk size */
 	WRITE_WAVE_FIELD_4(16);
@@ -270,5 +1423,486 @@ pillbig_audio_write_wave_header(FILE *output, PillBigAudioParameters *parameters
 	/* Chunk size */
 	WRITE_WAVE_FIELD_4(parameters->samples_count * bytes_per_sample);
 
+	#undef WAVE
+	#undef fmt
+	#undef data
+}
+
+static PillBigError
+pillbig_audio_write_wave_header(PillBigSink output, PillBigAudioParameters *parameters)
+{
+	unsigned char header[AUDIO_WAVE_HEADER_SIZE];
+
+	pillbig_audio_make_wave_header(header, parameters);
+
+	return pillbig_sink_write(output, header, AUDIO_WAVE_HEADER_SIZE);
+}
+
+static void
+pillbig_audio_set_batch_results(PillBigError *results, const int *positions, int count,
+	PillBigError result)
+{
+	int i;
+
+	for (i = 0; results != NULL && i < count; i++)
+	{
+		results[positions[i]] = result;
+	}
+}
+
+static PillBigError
+pillbig_audio_extract_lanes(PillBig pillbig, PillBigAudioFormat input_format,
+	const int *indices, PillBigSink *outputs, PillBigAudioAnalyzer **analyzers, int count,
+	PillBigAudioFormat output_format)
+{
+	unsigned char header[AUDIO_WAVE_HEADER_SIZE];
+	PillBigSinkVector vectors[2];
+	PillBigAudioLanes lanes;
+	PillBigAudioParameters parameters;
+	const PillBigAudioCodec *codec;
+	const PillBigFileEntry *entry;
+	PillBigEntryInfo *info;
+	unsigned char *inputs[AUDIO_LANES];
+	int lane, skip;
+
+	memset(&lanes, 0, sizeof(PillBigAudioLanes));
+	memset(inputs, 0, sizeof(inputs));
+
+	/*
+	 * Load every lane.
+	 */
+	for (lane = 0; lane < count && pillbig_no_error(); lane++)
+	{
+		entry = &pillbig->entries[indices[lane]];
+		info  = &pillbig->infos[indices[lane]];
+
+		inputs[lane] = pillbig_audio_read_entry(pillbig, indices[lane], &skip);
+		if (inputs[lane] == NULL)
+		{
+			break;
+		}
+
+		switch (input_format)
+		{
+			case PillBigAudioFormat_ADPCM:
+				/* There are 2 IMA ADPCM samples for each byte. */
+				lanes.samples_count[lane] = entry->size * 2;
+				break;
+			case PillBigAudioFormat_VAG:
+				lanes.samples_count[lane] = (info->known & PillBigEntryInfo_SamplesCount) ?
+					info->samples_count : VAG_MAX_SAMPLES_COUNT(entry->size - skip);
+				break;
+			default:
+				break;
+		}
+
+		lanes.input[lane]      = inputs[lane] + skip;
+		lanes.input_size[lane] = entry->size - skip;
+		lanes.output[lane]     = (short *)malloc(MAX(lanes.samples_count[lane], 1) * sizeof(short));
+		SET_ERROR_IF_FAIL(lanes.output[lane] != NULL, PillBigError_SystemError);
+	}
+
+	/*
+	 * Decode all lanes at once and write the results.
+	 */
+	if (pillbig_no_error())
+	{
+		codec = pillbig_audio_codec_find(input_format, PillBigAudioFormat_PCM);
+		if (codec != NULL && codec->decode_lanes != NULL)
+		{
+			codec->decode_lanes(&lanes);
+		}
+		else
+		{
+			pillbig_error_set(PillBigError_NotImplemented);
+		}
+	}
+
+	parameters.sample_rate     = AUDIO_SAMPLE_RATE;
+	parameters.channels_count  = 1;
+	parameters.bits_per_sample = 16;
+
+	for (lane = 0; lane < count && pillbig_no_error(); lane++)
+	{
+		parameters.samples_count = lanes.samples_count[lane];
+
+		info = &pillbig->infos[indices[lane]];
+		info->samples_count = parameters.samples_count;
+		info->known |= PillBigEntryInfo_SamplesCount;
+
+		/*
+		 * Header and samples go out together.
+		 */
+		if (outputs != NULL)
+		{
+			pillbig_audio_make_wave_header(header, &parameters);
+			vectors[0].data = header;
+			vectors[0].size = (output_format == PillBigAudioFormat_WAVE) ?
+				AUDIO_WAVE_HEADER_SIZE : 0;
+			vectors[1].data = lanes.output[lane];
+			vectors[1].size = parameters.samples_count * sizeof(short);
+			pillbig_sink_writev(outputs[lane], vectors, 2);
+		}
+
+		if (analyzers != NULL && pillbig_no_error())
+		{
+			pillbig_audio_analyzer_process(analyzers[lane],
+				lanes.output[lane], parameters.samples_count);
+		}
+	}
+
+	for (lane = 0; lane < count; lane++)
+	{
+		if (inputs[lane] != NULL)
+		{
+			free(inputs[lane]);
+		}
+		if (lanes.output[lane] != NULL)
+		{
+			free(lanes.output[lane]);
+		}
+	}
+
+	return pillbig_error_get();
+}
+
+static unsigned char *
+pillbig_audio_read_entry(PillBig pillbig, int index, int *header_size)
+{
+	const PillBigFileEntry *entry = &pillbig->entries[index];
+	const PillBigEntryInfo *info  = &pillbig->infos[index];
+	unsigned char *input;
+	int result;
+
+	input = (unsigned char *)malloc(MAX(entry->size, 1));
+	SET_ERROR_RETURN_VALUE_IF_FAIL(input != NULL, PillBigError_SystemError, NULL);
+
+	result = pillbig_source_read_at(pillbig->source, input, entry->size, entry->offset);
+	SET_ERROR_IF_FAIL(result == entry->size, PillBigError_SystemError);
+
+	if (pillbig_any_error())
+	{
+		free(input);
+		return NULL;
+	}
+
+	*header_size = (info->audio_format == PillBigAudioFormat_VAG) ?
+		MIN(info->header_size, entry->size) : 0;
+
+	return input;
+}
+
+static int
+pillbig_audio_decode_from(PillBigAudioFormat format,
+	const unsigned char *input, int input_size,
+	PillBigAudioCheckpoint *state, short *output, int samples_count)
+{
+	const PillBigAudioCodec *codec = pillbig_audio_codec_find(format, PillBigAudioFormat_PCM);
+
+	if (codec == NULL || codec->decode_from == NULL)
+	{
+		return 0;
+	}
+
+	return codec->decode_from(input, input_size, state, output, samples_count);
+}
+
+static int
+pillbig_audio_decode_checkpoints(PillBigAudioFormat format,
+	const unsigned char *input, int input_size,
+	PillBigAudioSeekIndex *seek_index, int first, int end_sample,
+	short *output)
+{
+	PillBigAudioLanes lanes;
+	PillBigAudioCheckpoint *checkpoints = &seek_index->checkpoints[first];
+	const PillBigAudioCodec *codec;
+	int base = checkpoints[0].sample;
+	int count, per_lane, lane, start, end;
+	int decoded = 0;
+
+	/*
+	 * Split the checkpoints between the lanes.
+	 */
+	count = 0;
+	while (first + count < seek_index->count && checkpoints[count].sample < end_sample)
+	{
+		count++;
+	}
+	per_lane = (count + AUDIO_LANES - 1) / AUDIO_LANES;
+
+	memset(&lanes, 0, sizeof(PillBigAudioLanes));
+	for (lane = 0; lane * per_lane < count; lane++)
+	{
+		start = checkpoints[lane * per_lane].sample;
+		end   = ((lane + 1) * per_lane < count) ?
+			checkpoints[(lane + 1) * per_lane].sample : end_sample;
+
+		lanes.input[lane]         = input;
+		lanes.input_size[lane]    = input_size;
+		lanes.start[lane]         = checkpoints[lane * per_lane];
+		lanes.output[lane]        = output + (start - base);
+		lanes.samples_count[lane] = end - start;
+	}
+
+	codec = pillbig_audio_codec_find(format, PillBigAudioFormat_PCM);
+	if (codec == NULL || codec->decode_lanes == NULL)
+	{
+		return 0;
+	}
+	codec->decode_lanes(&lanes);
+
+	/*
+	 * Decoded samples are contiguous up to the first lane falling short.
+	 */
+	for (lane = 0; lane * per_lane < count; lane++)
+	{
+		start = checkpoints[lane * per_lane].sample;
+		end   = ((lane + 1) * per_lane < count) ?
+			checkpoints[(lane + 1) * per_lane].sample : end_sample;
+
+		decoded += lanes.samples_count[lane];
+		if (lanes.samples_count[lane] < end - start)
+		{
+			break;
+		}
+	}
+
+	return decoded;
+}
+
+static PillBigError
+pillbig_audio_extract_streamed(PillBig pillbig, int index, PillBigSink output,
+	PillBigAudioParameters *parameters, int max_samples, int *decoded_count)
+{
+	PillBigAudioResampler *resampler = NULL;
+	PillBigAudioStream stream;
+	short  input_buffer[AUDIO_RESAMPLER_BLOCK];
+	short *output_buffer = input_buffer;
+	int read_count, count;
+	PillBigError error;
+
+	parameters->samples_count = 0;
+	*decoded_count = 0;
+
+	/*
+	 * Decoded blocks are pulled from a stream and resampled on the fly.
+	 */
+	stream = pillbig_audio_stream_open(pillbig, index, PillBigAudioFormat_PCM);
+	SET_RETURN_ERROR_IF_FAIL(stream != NULL, pillbig_error_get());
+
+	if (parameters->sample_rate != AUDIO_SAMPLE_RATE)
+	{
+		resampler = pillbig_audio_resampler_new(AUDIO_SAMPLE_RATE, parameters->sample_rate);
+		SET_ERROR_IF_FAIL(resampler != NULL, pillbig_error_get());
+		if (resampler != NULL)
+		{
+			output_buffer = (short *)malloc(pillbig_audio_resampler_get_max_output(
+				resampler, AUDIO_RESAMPLER_BLOCK) * sizeof(short));
+			SET_ERROR_IF_FAIL(output_buffer != NULL, PillBigError_SystemError);
+		}
+	}
+
+	while (pillbig_no_error() &&
+	       (max_samples < 0 || parameters->samples_count < max_samples))
+	{
+		/*
+		 * Without resampling don't decode past the limit.
+		 */
+		count = AUDIO_RESAMPLER_BLOCK;
+		if (resampler == NULL && max_samples >= 0)
+		{
+			count = MIN(count, max_samples - parameters->samples_count);
+		}
+
+		read_count = pillbig_audio_stream_read(stream, input_buffer, count);
+		if (read_count < 0)
+		{
+			break;
+		}
+		*decoded_count += read_count;
+
+		count = read_count;
+		if (resampler != NULL)
+		{
+			count = pillbig_audio_resampler_process(resampler,
+				(read_count > 0) ? input_buffer : NULL, read_count, output_buffer);
+		}
+		if (max_samples >= 0)
+		{
+			count = MIN(count, max_samples - parameters->samples_count);
+		}
+
+		pillbig_sink_write(output, output_buffer, count * sizeof(short));
+		parameters->samples_count += count;
+
+		if (read_count == 0)
+		{
+			break;
+		}
+	}
+
+	/*
+	 * Stopped before the end of the audio, the decoded count isn't
+	 * the length of the file.
+	 */
+	error = pillbig_error_get();
+	if (error != PillBigError_Success ||
+	    pillbig_audio_stream_read(stream, input_buffer, 1) != 0)
+	{
+		*decoded_count = -1;
+	}
+
+	if (output_buffer != input_buffer && output_buffer != NULL)
+	{
+		free(output_buffer);
+	}
+	pillbig_audio_resampler_free(resampler);
+
+	pillbig_audio_stream_close(stream);
+	pillbig_error_set(error);
+
+	return error;
+}
+
+static int
+pillbig_audio_stream_decode(PillBigAudioStream stream, short *output, int frames)
+{
+	PillBigAudioCheckpoint state;
+	int decoded = 0;
+	int needed, rebase, count, result;
+
+	while (decoded < frames && !stream->finished)
+	{
+		if (stream->state.sample >= stream->samples_limit)
+		{
+			stream->finished = 1;
+			break;
+		}
+
+		/*
+		 * Refill the window when the next ADPCM byte or VAG block
+		 * isn't there.
+		 */
+		needed = stream->state.offset +
+			((stream->input_format == PillBigAudioFormat_VAG) ? 16 : 1);
+		if (stream->state.offset < stream->window_offset ||
+		    needed > stream->window_offset + stream->window_size)
+		{
+			stream->window_offset = stream->state.offset;
+			stream->window_size = MAX(MIN(AUDIO_STREAM_BUFFER_SIZE,
+				stream->data_size - stream->window_offset), 0);
+			if (needed > stream->window_offset + stream->window_size)
+			{
+				stream->finished = 1;
+				break;
+			}
+
+			result = pillbig_source_read_at(stream->pillbig->source, stream->window,
+				stream->window_size, stream->data_offset + stream->window_offset);
+			SET_ERROR_RETURN_VALUE_IF_FAIL(result == stream->window_size,
+				PillBigError_SystemError, -1);
+		}
+
+		/*
+		 * Decoders address the data from the start of the stream,
+		 * rebase the state to the window.
+		 */
+		rebase = (stream->input_format == PillBigAudioFormat_VAG) ?
+			stream->window_offset / 16 * 28 : stream->window_offset * 2;
+		state = stream->state;
+		state.offset -= stream->window_offset;
+		state.sample -= rebase;
+
+		count = pillbig_audio_decode_from(stream->input_format,
+			stream->window, stream->window_size, &state,
+			(output != NULL) ? output + decoded : NULL,
+			MIN(frames - decoded, stream->samples_limit - stream->state.sample));
+
+		state.offset += stream->window_offset;
+		state.sample += rebase;
+		stream->state = state;
+		decoded += count;
+
+		/*
+		 * Nothing decoded with data in the window: end flag reached.
+		 */
+		needed = stream->state.offset +
+			((stream->input_format == PillBigAudioFormat_VAG) ? 16 : 1);
+		if (count == 0 && needed <= stream->window_offset + stream->window_size)
+		{
+			stream->finished = 1;
+		}
+	}
+
+	return decoded;
+}
+
+static PillBigError
+pillbig_audio_finish_wave(PillBigSink output, PillBigAudioFormat output_format,
+	long header_position, int announced_samples_count,
+	PillBigAudioParameters *parameters)
+{
+	if (output_format != PillBigAudioFormat_WAVE ||
+	    parameters->samples_count >= announced_samples_count)
+	{
+		return PillBigError_Success;
+	}
+
+	if (header_position != -1)
+	{
+		return pillbig_audio_patch_wave_header(output, header_position,
+			parameters);
+	}
+
+	/*
+	 * The header is already written, honor it.
+	 */
+	return pillbig_audio_write_silence(output,
+		announced_samples_count - parameters->samples_count, parameters);
+}
+
+static PillBigError
+pillbig_audio_patch_wave_header(PillBigSink output, long header_position,
+	PillBigAudioParameters *parameters)
+{
+	#define PATCH_WAVE_FIELD_4(offset, v) \
+		{value = v; \
+		SET_RETURN_ERROR_IF_FAIL(pillbig_sink_seek(output, header_position + offset) == \
+			PillBigError_Success, pillbig_error_get()); \
+		SET_RETURN_ERROR_IF_FAIL(pillbig_sink_write(output, &value, 4) == \
+			PillBigError_Success, pillbig_error_get());}
+
+	int value;
+	int bytes_per_sample = parameters->bits_per_sample / 8;
+	long end_position = pillbig_sink_tell(output);
+	SET_RETURN_ERROR_IF_FAIL(end_position != -1, PillBigError_SystemError);
+
+	/* All chunks size starting next field */
+	PATCH_WAVE_FIELD_4(4, 36 + parameters->samples_count * bytes_per_sample);
+
+	/* DATA chunk size */
+	PATCH_WAVE_FIELD_4(40, parameters->samples_count * bytes_per_sample);
+
+	return pillbig_sink_seek(output, end_position);
+}
+
+static PillBigError
+pillbig_audio_write_silence(PillBigSink output, int samples_count,
+	PillBigAudioParameters *parameters)
+{
+	unsigned char silence[1024];
+	int bytes_count = samples_count * parameters->channels_count *
+		parameters->bits_per_sample / 8;
+	int count;
+
+	memset(silence, 0, sizeof(silence));
+	while (bytes_count > 0)
+	{
+		count = MIN(bytes_count, (int)sizeof(silence));
+		SET_RETURN_ERROR_IF_FAIL(pillbig_sink_write(output, silence, count) ==
+			PillBigError_Success, pillbig_error_get());
+		bytes_count -= count;
+	}
+
 	return PillBigError_Success;
 }
@@ -15,9 +15,52 @@
 #ifndef __PILLBIG_AUDIO_INTERNAL_H__
 #define __PILLBIG_AUDIO_INTERNAL_H__
 
+#include <pillbig/file.h>
+
 #define VAG_MAGIC_ID 0x70474156
 #define RIFF_MAGIC_ID 0x46464952
 
+/**
+ *  Size of the RIFF WAVE header written before PCM data.
+ */
+#define AUDIO_WAVE_HEADER_SIZE 44
+
+/**
+ *  Sample rate of every pill.big audio file.
+ */
+#define AUDIO_SAMPLE_RATE 11025
+
+/**
+ *  Size of the header of the VAG files having one.
+ */
+#define AUDIO_VAG_HEADER_SIZE 64
+
+/**
+ *  Bytes of each end of an audio file covered by its checksum.
+ */
+#define AUDIO_CHECKSUM_SPAN 256
+
+/**
+ *  Count of audio streams decoded at once by the lane decoders.
+ */
+#define AUDIO_LANES 16
+
+/**
+ *  Count of samples per lane decoded between input and output transpositions.
+ */
+#define AUDIO_LANES_CHUNK 256
+
+/**
+ *  Default count of samples between seek index checkpoints.
+ */
+#define AUDIO_SEEK_INTERVAL 4096
+
+/**
+ *  Size of the encoded data window of audio streams. Multiple of the
+ *  VAG block size.
+ */
+#define AUDIO_STREAM_BUFFER_SIZE 2048
+
 
 
 typedef struct
@@ -29,4 +72,130 @@ typedef struct
 }
 PillBigAudioParameters;
 
+/**
+ *  Decoder state, enough to resume decoding from a given sample.
+ *
+ *  @remarks
+ *  	A zeroed checkpoint is the state at the start of the stream.
+ */
+typedef struct
+{
+	int       sample;     /**< Next sample to be decoded. */
+	int       offset;     /**< Offset of the encoded data holding the next sample. */
+	int       valprev;    /**< IMA ADPCM previous output value. */
+	int       index;      /**< IMA ADPCM index into the step size table. */
+	double    s_1;        /**< VAG last output value. */
+	double    s_2;        /**< VAG output value previous to the last one. */
+}
+PillBigAudioCheckpoint;
+
+/**
+ *  Decoder states taken every interval samples along an audio stream.
+ */
+typedef struct
+{
+	int                       interval;       /**< Samples between checkpoints. */
+	int                       count;          /**< Checkpoints count. */
+	PillBigAudioCheckpoint   *checkpoints;    /**< Checkpoints, the first one at sample 0. */
+}
+PillBigAudioSeekIndex;
+
+/**
+ *  Independent audio streams decoded in parallel, one stream per lane.
+ *
+ *  @remarks
+ *  	Unused lanes must have a NULL input. Inputs point to the start
+ *  	of the encoded data, the decoding starts at the checkpoint of
+ *  	each lane.
+ */
+typedef struct
+{
+	const unsigned char     *input[AUDIO_LANES];            /**< Encoded data of each lane. */
+	int                      input_size[AUDIO_LANES];       /**< Encoded data size of each lane. */
+	PillBigAudioCheckpoint   start[AUDIO_LANES];            /**< Decoder state each lane starts from. */
+	short                   *output[AUDIO_LANES];           /**< Decoded PCM samples of each lane. */
+	int                      samples_count[AUDIO_LANES];    /**< Maximum samples to decode. On return, decoded samples. */
+}
+PillBigAudioLanes;
+
+struct _PillBigAudioStream
+{
+	PillBig                   pillbig;                                  /**< PillBig object the audio belongs to. */
+	int                       index;                                    /**< pill.big file index. */
+	PillBigAudioFormat        input_format;                             /**< Audio format of the encoded data. */
+	PillBigAudioFormat        output_format;                            /**< Audio format of the decoded data. */
+	int                       data_offset;                              /**< pill.big offset of the encoded data, header excluded. */
+	int                       data_size;                                /**< Encoded data size. */
+	int                       samples_limit;                            /**< Samples count upper bound. */
+	int                       finished;                                 /**< 1 when the end of the audio was reached. */
+	PillBigAudioCheckpoint    state;                                    /**< Decoder state. */
+	int                       window_offset;                            /**< Encoded data offset of the window. */
+	int                       window_size;                              /**< Bytes in the window. */
+	unsigned char             window[AUDIO_STREAM_BUFFER_SIZE];         /**< Encoded data window. */
+};
+
+/**
+ *  Guesses the audio format from the first bytes of a file.
+ *
+ *  @param platform
+ *  	pill.big platform.
+ *  @param header
+ *  	First bytes of the file.
+ *  @param header_size
+ *  	Count of bytes in header.
+ *  @return
+ *  	Audio format if recognized. PillBigAudioFormat_Unknown otherwise.
+ */
+PillBigAudioFormat
+pillbig_audio_guess_format(PillBigPlatform platform,
+	const unsigned char *header, int header_size);
+
+/**
+ *  Gets the samples count of a pill.big audio file.
+ *
+ *  @remarks
+ *  	The samples count is cached by the PillBig object. It is taken
+ *  	from the attached database if its entry matches the file,
+ *  	otherwise VAG files are read completely the first time.
+ *
+ *  @param pillbig
+ *  	PillBig object.
+ *  @param index
+ *  	pill.big file index.
+ *  @return
+ *  	Samples count if successful. -1 otherwise.
+ */
+int
+pillbig_audio_get_samples_count(PillBig pillbig, int index);
+
+/**
+ *  Gets the checksum database entries guard their audio data with.
+ *
+ *  @remarks
+ *  	FNV-1a of the first and last AUDIO_CHECKSUM_SPAN bytes of the
+ *  	file, the whole file if shorter. They hold the VAG header and
+ *  	end flag, so it tells replaced files apart without reading them
+ *  	completely.
+ *
+ *  @param source
+ *  	pill.big source.
+ *  @param offset
+ *  	File offset.
+ *  @param size
+ *  	File size.
+ *  @return
+ *  	Checksum. 0 on error.
+ */
+unsigned int
+pillbig_audio_get_checksum(PillBigSource source, long offset, int size);
+
+/**
+ *  Frees an audio seek index.
+ *
+ *  @param seek_index
+ *  	Seek index to be freed. It can be NULL.
+ */
+void
+pillbig_audio_free_seek_index(PillBigAudioSeekIndex *seek_index);
+
 #endif
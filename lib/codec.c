@@ -0,0 +1,180 @@
+/*
+ *  libpillbig
+ *  A library to deal with Blood Omen: Legacy of Kain pill.big files.
+ */
+
+/**
+ *  @file
+ *  @brief
+ *  	Audio codecs registry. Implementation file.
+ *
+ *  @author  Alfonso Ruzafa <superruzafa@gmail.com>
+ *  @version SVN $Id$
+ */
+
+
+
+#include <stdio.h>
+#include <pthread.h>
+#include "error_internal.h"
+#include "common_internal.h"
+#include "codec.h"
+#include "adpcm.h"
+#include "vag.h"
+
+
+
+/**
+ *  Gets the fastest codec variant supported by the CPU.
+ */
+static PillBigAudioCodecVariant
+pillbig_audio_codec_detect_variant();
+
+/**
+ *  Detects the codec variant of the CPU. Run once.
+ */
+static void
+pillbig_audio_codec_init();
+
+
+
+/**
+ *  Codecs table. New codecs and variants only need to be added here.
+ */
+static const PillBigAudioCodec codecs[] =
+{
+	{
+		PillBigAudioFormat_ADPCM, PillBigAudioFormat_PCM, PillBigAudioCodecVariant_Scalar,
+		pillbig_audio_adpcm_prepare, pillbig_audio_adpcm_decode,
+		pillbig_audio_adpcm_decode_lanes, pillbig_audio_adpcm_decode_from
+	},
+	{
+		PillBigAudioFormat_VAG, PillBigAudioFormat_PCM, PillBigAudioCodecVariant_Scalar,
+		pillbig_audio_vag_prepare, pillbig_audio_vag_decode,
+		pillbig_audio_vag_decode_lanes, pillbig_audio_vag_decode_from
+	},
+#ifdef AUDIO_CODEC_X86_VARIANTS
+	{
+		PillBigAudioFormat_ADPCM, PillBigAudioFormat_PCM, PillBigAudioCodecVariant_SSE4,
+		pillbig_audio_adpcm_prepare, pillbig_audio_adpcm_decode_sse4,
+		pillbig_audio_adpcm_decode_lanes_sse4, pillbig_audio_adpcm_decode_from_sse4
+	},
+	{
+		PillBigAudioFormat_ADPCM, PillBigAudioFormat_PCM, PillBigAudioCodecVariant_AVX2,
+		pillbig_audio_adpcm_prepare, pillbig_audio_adpcm_decode_avx2,
+		pillbig_audio_adpcm_decode_lanes_avx2, pillbig_audio_adpcm_decode_from_avx2
+	},
+	{
+		PillBigAudioFormat_VAG, PillBigAudioFormat_PCM, PillBigAudioCodecVariant_SSE4,
+		pillbig_audio_vag_prepare, pillbig_audio_vag_decode_sse4,
+		pillbig_audio_vag_decode_lanes_sse4, pillbig_audio_vag_decode_from_sse4
+	},
+	{
+		PillBigAudioFormat_VAG, PillBigAudioFormat_PCM, PillBigAudioCodecVariant_AVX2,
+		pillbig_audio_vag_prepare, pillbig_audio_vag_decode_avx2,
+		pillbig_audio_vag_decode_lanes_avx2, pillbig_audio_vag_decode_from_avx2
+	},
+#endif
+	{
+		PillBigAudioFormat_Unknown, PillBigAudioFormat_Unknown, PillBigAudioCodecVariant_Auto,
+		NULL, NULL, NULL, NULL
+	},
+};
+
+/**
+ *  Fastest codec variant supported by the CPU.
+ */
+static PillBigAudioCodecVariant detected_variant = PillBigAudioCodecVariant_Scalar;
+
+/**
+ *  Codec variant in use.
+ */
+static PillBigAudioCodecVariant codec_variant = PillBigAudioCodecVariant_Scalar;
+
+/**
+ *  Guards the CPU detection, codecs may be looked up from several threads.
+ */
+static pthread_once_t codec_init_once = PTHREAD_ONCE_INIT;
+
+
+
+PillBigAudioCodecVariant
+pillbig_audio_get_codec_variant()
+{
+	pillbig_error_clear();
+	pthread_once(&codec_init_once, pillbig_audio_codec_init);
+
+	return codec_variant;
+}
+
+PillBigError
+pillbig_audio_set_codec_variant(PillBigAudioCodecVariant variant)
+{
+	pillbig_error_clear();
+	pthread_once(&codec_init_once, pillbig_audio_codec_init);
+	SET_RETURN_ERROR_IF_FAIL(PillBigAudioCodecVariant_Auto <= variant &&
+		variant <= detected_variant,
+		PillBigError_InvalidCodecVariant);
+
+	codec_variant = (variant == PillBigAudioCodecVariant_Auto) ?
+		detected_variant : variant;
+
+	return PillBigError_Success;
+}
+
+const PillBigAudioCodec *
+pillbig_audio_codec_find(PillBigAudioFormat input_format,
+	PillBigAudioFormat output_format)
+{
+	const PillBigAudioCodec *codec, *found = NULL;
+
+	pthread_once(&codec_init_once, pillbig_audio_codec_init);
+
+	if (output_format == PillBigAudioFormat_WAVE)
+	{
+		output_format = PillBigAudioFormat_PCM;
+	}
+
+	for (codec = codecs; codec->convert != NULL; codec++)
+	{
+		if (codec->input_format == input_format &&
+		    codec->output_format == output_format &&
+		    codec->variant <= codec_variant &&
+		    (found == NULL || codec->variant > found->variant))
+		{
+			found = codec;
+		}
+	}
+
+	return found;
+}
+
+
+
+static PillBigAudioCodecVariant
+pillbig_audio_codec_detect_variant()
+{
+#ifdef AUDIO_CODEC_X86_VARIANTS
+	/*
+	 * Queries CPUID.
+	 */
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+	{
+		return PillBigAudioCodecVariant_AVX2;
+	}
+	if (__builtin_cpu_supports("sse4.1"))
+	{
+		return PillBigAudioCodecVariant_SSE4;
+	}
+#endif
+
+	return PillBigAudioCodecVariant_Scalar;
+}
+
+static void
+pillbig_audio_codec_init()
+{
+	detected_variant = pillbig_audio_codec_detect_variant();
+	codec_variant = detected_variant;
+}
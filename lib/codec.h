@@ -0,0 +1,125 @@
+/*
+ *  libpillbig
+ *  A library to deal with Blood Omen: Legacy of Kain pill.big files.
+ */
+
+/**
+ *  @file
+ *  @brief
+ *  	Audio codecs registry.
+ *
+ *  @author  Alfonso Ruzafa <superruzafa@gmail.com>
+ *  @version SVN $Id$
+ */
+
+#ifndef __PILLBIG_AUDIO_CODEC_H__
+#define __PILLBIG_AUDIO_CODEC_H__
+
+#include <stdio.h>
+#include <pillbig/common.h>
+#include <pillbig/audio.h>
+#include "audio_internal.h"
+
+/*
+ * x86 variants are the same C code compiled for each instruction set,
+ * so GCC-compatible compilers are required to build them.
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#	define AUDIO_CODEC_X86_VARIANTS
+#	define AUDIO_CODEC_TARGET(isa) __attribute__((target(isa)))
+#	define AUDIO_CODEC_KERNEL static inline __attribute__((always_inline))
+#else
+#	define AUDIO_CODEC_KERNEL static inline
+#endif
+
+/**
+ *  Callback for codec setup before converting a pill.big file.
+ *
+ *  @param pillbig
+ *  	PillBig object.
+ *  @param index
+ *  	pill.big file index.
+ *  @param exact
+ *  	1 if the samples count must be exact, 0 if an upper bound is enough.
+ *  @param offset
+ *  	Position of the file in the source. On return, position of the
+ *  	audio data, past the header if any.
+ *  @param parameters
+ *  	Audio parameters of the file, filled on return.
+ *  @return
+ *  	Operation result.
+ */
+typedef
+PillBigError
+(*PillBigAudioPrepareCallback)(
+	PillBig pillbig, int index, int exact, long *offset,
+	PillBigAudioParameters *parameters);
+
+/**
+ *  Callback for stream converters.
+ */
+typedef
+PillBigError
+(*PillBigAudioConverterCallback)(
+	PillBigSource input, long offset, PillBigSink output,
+	PillBigAudioParameters *parameters);
+
+/**
+ *  Callback for lanes decoders.
+ */
+typedef
+void
+(*PillBigAudioLanesDecoderCallback)(PillBigAudioLanes *lanes);
+
+/**
+ *  Callback for memory decoders resuming from a decoder state.
+ */
+typedef
+int
+(*PillBigAudioResumingDecoderCallback)(
+	const unsigned char *input, int input_size,
+	PillBigAudioCheckpoint *state, short *output, int samples_count);
+
+/**
+ *  Codec implementation.
+ *
+ *  @remarks
+ *  	A codec converts straight from its input format to its output
+ *  	format. Resampling is applied by the callers on the decoded PCM.
+ */
+typedef struct
+{
+	PillBigAudioFormat                     input_format;     /**< Input audio format. */
+	PillBigAudioFormat                     output_format;    /**< Output audio format. */
+	PillBigAudioCodecVariant               variant;          /**< Instruction set required. */
+	PillBigAudioPrepareCallback            prepare;          /**< Parameters and header setup. */
+	PillBigAudioConverterCallback          convert;          /**< Stream converter. */
+	PillBigAudioLanesDecoderCallback       decode_lanes;     /**< Lanes decoder. NULL if none. */
+	PillBigAudioResumingDecoderCallback    decode_from;      /**< Resuming decoder. NULL if none. */
+}
+PillBigAudioCodec;
+
+BEGIN_C_DECLS
+
+/**
+ *  Finds the codec converting between two audio formats.
+ *
+ *  @remarks
+ *  	RIFF WAVE is PCM in a container, so decoders to PCM are used
+ *  	for WAVE output too. Among the codec variants, the fastest one
+ *  	allowed by the CPU or the forced variant is returned.
+ *
+ *  @param input_format
+ *  	Input audio format.
+ *  @param output_format
+ *  	Output audio format.
+ *  @return
+ *  	Codec if any. NULL otherwise.
+ */
+const PillBigAudioCodec *
+pillbig_audio_codec_find(PillBigAudioFormat input_format,
+	PillBigAudioFormat output_format);
+
+END_C_DECLS
+
+#endif
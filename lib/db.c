@@ -13,38 +13,225 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <malloc.h>
 #include <string.h>
-#include <libxml/tree.h>
-#include <libxml/xpath.h>
+#include <sys/stat.h>
+#include <libxml/xmlreader.h>
+#include <libxml/xmlwriter.h>
 #include <pillbig/pillbig.h>
 #include "pillbig_internal.h"
+#include "db_internal.h"
+#include "arena.h"
 
+/**
+ *  Speeches of the audio element being read.
+ */
+typedef struct
+{
+	PillBigDBAudioSpeech  *speeches;    /**< Speeches read. */
+	int                    count;       /**< Count of speeches read. */
+	int                    capacity;    /**< Count of speeches allocated. */
+}
+PillBigDBSpeechList;
 
+/**
+ *  Opens the compiled image of a database, if up to date.
+ *
+ *  @param filename
+ *  	Database filename, either an image or an XML document
+ *  	with an image next to it.
+ *  @return
+ *  	PillBigDB if successful. NULL otherwise.
+ */
+static PillBigDB
+pillbig_db_open_compiled(const char *filename);
 
-struct _PillBigDB
-{
-	xmlDocPtr           doc;
-	xmlXPathContextPtr  xpathContext;
-	int                 files_count;
-	PillBigDBEntry    **entries;
-	PillBigFileType     filetype;
-};
+/**
+ *  Gets the first bucket to probe for a hash.
+ *
+ *  @param hash
+ *  	File hash.
+ *  @param buckets_count
+ *  	Count of buckets, a power of two.
+ *  @return
+ *  	Bucket.
+ */
+static unsigned int
+pillbig_db_get_bucket(PillBigFileHash hash, unsigned int buckets_count);
+
+/**
+ *  Looks for a hash in the hash index.
+ *
+ *  @param db
+ *  	Database.
+ *  @param hash
+ *  	File hash.
+ *  @return
+ *  	File index if found. -1 otherwise.
+ */
+static int
+pillbig_db_find_hash(PillBigDB db, PillBigFileHash hash);
+
+/**
+ *  Reads the whole database document in a single pass.
+ *
+ *  @param db
+ *  	Database.
+ *  @param reader
+ *  	Reader at the start of the document.
+ *  @return
+ *  	Operation result.
+ */
+static PillBigError
+pillbig_db_load(PillBigDB db, xmlTextReaderPtr reader);
 
+/**
+ *  Makes room for a file element.
+ *
+ *  @param db
+ *  	Database.
+ *  @param index
+ *  	File index of the element.
+ *  @return
+ *  	Operation result.
+ */
+static PillBigError
+pillbig_db_grow(PillBigDB db, int index);
+
+/**
+ *  Adds a speech to the list of the audio element being read.
+ *
+ *  @param list
+ *  	Speech list.
+ *  @param language
+ *  	Speech language, stored in the database arena.
+ *  @param speech
+ *  	Speech text, stored in the database arena.
+ *  @return
+ *  	Operation result.
+ */
+static PillBigError
+pillbig_db_add_speech(PillBigDBSpeechList *list, char *language, char *speech);
+
+/**
+ *  Moves the speeches of a list into an audio entry, once its audio
+ *  element has been read.
+ *
+ *  @param db
+ *  	Database.
+ *  @param audio
+ *  	Audio entry.
+ *  @param list
+ *  	Speech list, emptied on return.
+ *  @return
+ *  	Operation result.
+ */
+static PillBigError
+pillbig_db_store_speeches(PillBigDB db, PillBigDBAudioEntry *audio,
+	PillBigDBSpeechList *list);
+
+/**
+ *  Stores a value read from the document in the database arena.
+ *
+ *  @param db
+ *  	Database.
+ *  @param value
+ *  	Value, freed by this function. May be NULL.
+ *  @param intern
+ *  	1 to share the copy with equal values, for often repeated ones.
+ *  @return
+ *  	Stored value. NULL if missing, empty or on error.
+ */
 static char *
-pillbig_db_get_xpath_query_as_string(PillBigDB db, const char *query);
+pillbig_db_store_string(PillBigDB db, xmlChar *value, int intern);
 
-static int
-pillbig_db_get_xpath_query_as_int(PillBigDB db, const char *query);
+/**
+ *  Converts a value read from the document to an integer.
+ *
+ *  @param value
+ *  	Value, freed by this function. May be NULL.
+ *  @param base
+ *  	Numeric base.
+ *  @param default_value
+ *  	Result if the value is missing.
+ *  @return
+ *  	Integer.
+ */
+static long
+pillbig_db_parse_number(xmlChar *value, int base, long default_value);
 
+/**
+ *  Converts a file type name.
+ *
+ *  @param value
+ *  	Type name, as in the DTD. May be NULL.
+ *  @return
+ *  	File type.
+ */
 static PillBigFileType
-pillbig_db_get_xpath_query_as_filetype(PillBigDB db, const char *query);
+pillbig_db_parse_filetype(const char *value);
+
+/**
+ *  Converts an audio format name.
+ *
+ *  @param value
+ *  	Format name, as in the DTD. May be NULL.
+ *  @return
+ *  	Audio format.
+ */
+static PillBigAudioFormat
+pillbig_db_parse_audio_format(const char *value);
+
+/**
+ *  Converts a platform name.
+ *
+ *  @param value
+ *  	Platform name, as in the platform attribute. May be NULL.
+ *  @return
+ *  	Platform.
+ */
+static PillBigPlatform
+pillbig_db_parse_platform(const char *value);
+
+/**
+ *  Writes a file element.
+ *
+ *  @param writer
+ *  	Document writer.
+ *  @param index
+ *  	File index.
+ *  @param entry
+ *  	Database entry.
+ *  @return
+ *  	A negative value on error.
+ */
+static int
+pillbig_db_write_entry(xmlTextWriterPtr writer, int index, const PillBigDBEntry *entry);
+
+/**
+ *  Gets the name of a file type.
+ *
+ *  @param filetype
+ *  	File type.
+ *  @return
+ *  	Type name, as in the DTD. NULL if it has none.
+ */
+static const char *
+pillbig_db_get_filetype_name(PillBigFileType filetype);
+
+/**
+ *  Gets the name of an audio format.
+ *
+ *  @param format
+ *  	Audio format.
+ *  @return
+ *  	Format name, as in the DTD. NULL if it has none.
+ */
+static const char *
+pillbig_db_get_audio_format_name(PillBigAudioFormat format);
 
-static PillBigDBAudioEntry *
-pillbig_db_get_audio_entry(PillBigDB db, int index);
 
-static PillBigDBAudioSpeech *
-pillbig_db_get_audio_speeches(PillBigDB db, int index, int *speeches_count);
 
 
 PillBigDB
@@ -53,39 +240,48 @@ pillbig_db_open(const char *filename)
 	pillbig_error_clear();
 	SET_ERROR_RETURN_VALUE_IF_FAIL(filename != "", PillBigError_InvalidFilename, NULL);
 
-	PillBigDB db = NULL;
-
-	xmlDocPtr doc = xmlParseFile(filename);
-	SET_ERROR_RETURN_VALUE_IF_FAIL(doc != NULL, PillBigError_UnknownError, NULL);
+	PillBigDB db = pillbig_db_open_compiled(filename);
+	if (db != NULL)
+	{
+		return db;
+	}
+	pillbig_error_clear();
 
-	xmlXPathContextPtr xpathContext = xmlXPathNewContext(doc);
-	SET_ERROR_RETURN_VALUE_IF_FAIL(xpathContext != NULL, PillBigError_UnknownError, NULL);
+	xmlTextReaderPtr reader = xmlReaderForFile(filename, NULL, XML_PARSE_NONET);
+	SET_ERROR_RETURN_VALUE_IF_FAIL(reader != NULL, PillBigError_UnknownError, NULL);
 
 	db = (PillBigDB)malloc(sizeof(struct _PillBigDB));
-	SET_ERROR_RETURN_VALUE_IF_FAIL(db != NULL, PillBigError_SystemError, NULL);
+	SET_ERROR_IF_FAIL(db != NULL, PillBigError_SystemError);
 
-	memset(db, 0, sizeof(struct _PillBigDB));
+	if (pillbig_no_error())
+	{
+		memset(db, 0, sizeof(struct _PillBigDB));
+		db->arena = pillbig_arena_new(0);
+	}
 
-	db->doc = doc;
-	db->xpathContext = xpathContext;
-	/*
-	 * Collateral effect: db->files_count gets updated
-	 * when calling pillbig_db_get_files_count().
-	 */
-	db->files_count = -1;
-	pillbig_db_get_files_count(db);
-	SET_ERROR_IF_FAIL(db->files_count >= 0, PillBigError_UnknownError);
+	if (pillbig_no_error())
+	{
+		pillbig_db_load(db, reader);
+	}
+	xmlFreeTextReader(reader);
 
-	db->entries = (PillBigDBEntry **)calloc(db->files_count, sizeof(PillBigDBEntry *));
-	SET_ERROR_IF_FAIL(db->entries != NULL, PillBigError_SystemError);
+	if (pillbig_no_error())
+	{
+		db->buckets_count = pillbig_db_get_buckets_count(db->files_count);
+		db->buckets = (PillBigDBBucket *)malloc(db->buckets_count * sizeof(PillBigDBBucket));
+		SET_ERROR_IF_FAIL(db->buckets != NULL, PillBigError_SystemError);
+	}
 
 	if (pillbig_no_error())
 	{
-		memset(db->entries, 0, sizeof(PillBigDBEntry *) * db->files_count);
+		pillbig_db_fill_buckets(db, db->buckets, db->buckets_count);
 	}
-	else
+
+	if (!pillbig_no_error() && db != NULL)
 	{
+		PillBigError error = pillbig_error_get();
 		pillbig_db_close(db);
+		pillbig_error_set(error);
 		db = NULL;
 	}
 
@@ -98,14 +294,6 @@ pillbig_db_get_files_count(PillBigDB db)
 	pillbig_error_clear();
 	SET_ERROR_RETURN_VALUE_IF_FAIL(db != NULL, PillBigError_UnknownError, -1);
 
-	if (db->files_count == -1)
-	{
-		xmlXPathObjectPtr xpathObject = xmlXPathEvalExpression("/pillbig/file", db->xpathContext);
-		SET_ERROR_RETURN_VALUE_IF_FAIL(xpathObject != NULL, PillBigError_SystemError, -1);
-		db->files_count = xpathObject->nodesetval->nodeNr;
-		free(xpathObject);
-	}
-
 	return db->files_count;
 }
 
@@ -114,46 +302,10 @@ pillbig_db_get_entry(PillBigDB db, int index)
 {
 	pillbig_error_clear();
 	SET_ERROR_RETURN_VALUE_IF_FAIL(db != NULL, PillBigError_UnknownError, NULL);
-	SET_ERROR_RETURN_VALUE_IF_FAIL(0 <= index && index < db->files_count,
+	SET_ERROR_RETURN_VALUE_IF_FAIL(0 <= index && index < db->entries_count,
 		PillBigError_UnknownError, NULL);
 
-	char query[64];
-	char *hash;
-
-	if (db->entries[index] == NULL)
-	{
-		db->entries[index] = (PillBigDBEntry *)malloc(sizeof(PillBigDBEntry));
-		SET_ERROR_RETURN_VALUE_IF_FAIL(db->entries[index] != NULL, PillBigError_SystemError, NULL);
-
-		sprintf(query, "/pillbig/file[@index='%d']/filename", index);
-		db->entries[index]->filename = pillbig_db_get_xpath_query_as_string(db, query);
-
-		sprintf(query, "/pillbig/file[@index='%d']/hash", index);
-		hash = pillbig_db_get_xpath_query_as_string(db, query);
-		if (hash != NULL)
-		{
-			sscanf(hash, "%X", &db->entries[index]->hash);
-			free(hash);
-		}
-
-		sprintf(query, "/pillbig/file[@index='%d']/offset", index);
-		db->entries[index]->offset = pillbig_db_get_xpath_query_as_int(db, query);
-
-		sprintf(query, "/pillbig/file[@index='%d']/size", index);
-		db->entries[index]->size = pillbig_db_get_xpath_query_as_int(db, query);
-
-		sprintf(query, "/pillbig/file[@index='%d']/@type", index);
-		db->entries[index]->filetype = pillbig_db_get_xpath_query_as_filetype(db, query);
-
-		switch (db->entries[index]->filetype)
-		{
-		case PillBigFileType_Audio:
-			db->entries[index]->audio = pillbig_db_get_audio_entry(db, index);
-			break;
-		}
-	}
-
-	return db->entries[index];
+	return db->defined[index] ? &db->entries[index] : NULL;
 }
 
 int
@@ -162,10 +314,26 @@ pillbig_db_get_entry_index_by_hash(PillBigDB db, PillBigFileHash hash)
 	pillbig_error_clear();
 	SET_ERROR_RETURN_VALUE_IF_FAIL(db != NULL, PillBigError_UnknownError, -1);
 
-	char query[64];
-	sprintf(query, "/pillbig/file[hash='%X']/@index", hash);
+	return pillbig_db_find_hash(db, hash);
+}
+
+PillBigError
+pillbig_db_get_entry_indices_by_hash(PillBigDB db, const PillBigFileHash *hashes,
+	int count, int *indices)
+{
+	pillbig_error_clear();
+	SET_RETURN_ERROR_IF_FAIL(db != NULL, PillBigError_UnknownError);
+	SET_RETURN_ERROR_IF_FAIL(count >= 0 && (count == 0 || (hashes != NULL && indices != NULL)),
+		PillBigError_UnknownError);
 
-	return pillbig_db_get_xpath_query_as_int(db, query);
+	int i;
+
+	for (i = 0; i < count; i++)
+	{
+		indices[i] = pillbig_db_find_hash(db, hashes[i]);
+	}
+
+	return PillBigError_Success;
 }
 
 int
@@ -182,10 +350,68 @@ pillbig_db_get_entry_index_by_position(PillBigDB db, int position)
 	SET_ERROR_RETURN_VALUE_IF_FAIL(db != NULL, PillBigError_UnknownError, -1);
 	SET_ERROR_RETURN_VALUE_IF_FAIL(position >= 0, PillBigError_UnknownError, -1);
 
-	char query[96];
-	sprintf(query, "/pillbig/file[count(preceding-sibling::file) = %d]/@index", position);
+	return (position < db->files_count) ? db->positions[position] : -1;
+}
 
-	return pillbig_db_get_xpath_query_as_int(db, query);
+PillBigError
+pillbig_db_get_entry_indices_by_position(PillBigDB db, const int *positions,
+	int count, int *indices)
+{
+	pillbig_error_clear();
+	SET_RETURN_ERROR_IF_FAIL(db != NULL, PillBigError_UnknownError);
+	SET_RETURN_ERROR_IF_FAIL(count >= 0 && (count == 0 || (positions != NULL && indices != NULL)),
+		PillBigError_UnknownError);
+
+	int i;
+
+	for (i = 0; i < count; i++)
+	{
+		indices[i] = (0 <= positions[i] && positions[i] < db->files_count)
+			? db->positions[positions[i]] : -1;
+	}
+
+	return PillBigError_Success;
+}
+
+PillBigError
+pillbig_db_save(PillBigDB db, const char *filename)
+{
+	pillbig_error_clear();
+	SET_RETURN_ERROR_IF_FAIL(db != NULL, PillBigError_UnknownError);
+	SET_RETURN_ERROR_IF_FAIL(filename != NULL, PillBigError_InvalidFilename);
+
+	xmlTextWriterPtr writer = xmlNewTextWriterFilename(filename, 0);
+	const char *platform;
+	int result, i;
+
+	SET_RETURN_ERROR_IF_FAIL(writer != NULL, PillBigError_SystemError);
+
+	switch (db->platform)
+	{
+		case PillBigPlatform_PC:  platform = "pc";      break;
+		case PillBigPlatform_PSX: platform = "psx";     break;
+		default:                  platform = "unknown"; break;
+	}
+
+	xmlTextWriterSetIndent(writer, 1);
+	xmlTextWriterSetIndentString(writer, BAD_CAST "\t");
+
+	result = xmlTextWriterStartDocument(writer, NULL, "UTF-8", NULL);
+	if (result >= 0) result = xmlTextWriterStartElement(writer, BAD_CAST "pillbig");
+	if (result >= 0) result = xmlTextWriterWriteAttribute(writer, BAD_CAST "platform", BAD_CAST platform);
+
+	/* File elements keep the document order of the database */
+	for (i = 0; i < db->files_count && result >= 0; i++)
+	{
+		result = pillbig_db_write_entry(writer, db->positions[i], &db->entries[db->positions[i]]);
+	}
+
+	if (result >= 0) result = xmlTextWriterEndDocument(writer);
+	xmlFreeTextWriter(writer);
+
+	SET_RETURN_ERROR_IF_FAIL(result >= 0, PillBigError_SystemError);
+
+	return PillBigError_Success;
 }
 
 void
@@ -194,87 +420,383 @@ pillbig_db_close(PillBigDB db)
 	pillbig_error_clear();
 	SET_ERROR_RETURN_IF_FAIL(db != NULL, PillBigError_UnknownError);
 
-	PillBigDBEntry *entry;
+	if (db->image != NULL)
+	{
+		pillbig_db_image_close(db);
+		return;
+	}
+
+	/* Strings and audio entries live in the arena */
+	pillbig_db_names_free(db->names);
+	pillbig_db_text_free(db->text);
+	pillbig_db_locale_free(db->locale);
+	pillbig_db_columns_free(db->columns);
+	pillbig_arena_free(db->arena);
+	if (db->entries   != NULL) free(db->entries);
+	if (db->defined   != NULL) free(db->defined);
+	if (db->positions != NULL) free(db->positions);
+	if (db->buckets   != NULL) free(db->buckets);
+	free(db);
+}
+
+unsigned int
+pillbig_db_get_buckets_count(int files_count)
+{
+	unsigned int buckets_count = 1;
+
+	while (buckets_count < 2 * (unsigned int)files_count)
+	{
+		buckets_count <<= 1;
+	}
+
+	return buckets_count;
+}
+
+void
+pillbig_db_fill_buckets(PillBigDB db, PillBigDBBucket *buckets,
+	unsigned int buckets_count)
+{
+	const PillBigDBEntry *entry;
+	unsigned int bucket;
+	int i;
 
-	int i = 0;
+	memset(buckets, 0xFF, buckets_count * sizeof(PillBigDBBucket));
 
-	if (db->entries != NULL)
+	for (i = 0; i < db->files_count; i++)
 	{
-		while (i < db->files_count)
+		entry = &db->entries[db->positions[i]];
+		bucket = pillbig_db_get_bucket(entry->hash, buckets_count);
+		while (buckets[bucket].index != -1 && buckets[bucket].hash != entry->hash)
 		{
-			entry = db->entries[i];
-			if (entry != NULL)
+			bucket = (bucket + 1) & (buckets_count - 1);
+		}
+		if (buckets[bucket].index == -1)
+		{
+			buckets[bucket].hash  = entry->hash;
+			buckets[bucket].index = db->positions[i];
+		}
+	}
+}
+
+
+
+static PillBigDB
+pillbig_db_open_compiled(const char *filename)
+{
+	PillBigDB db = pillbig_db_image_open(filename);
+	struct stat document_status, image_status;
+	const char *extension;
+	char *image_filename;
+
+	if (db != NULL)
+	{
+		return db;
+	}
+
+	extension = strrchr(filename, '.');
+	if (extension == NULL || strcmp(extension, ".xml") != 0)
+	{
+		return NULL;
+	}
+
+	image_filename = (char *)malloc(extension - filename + strlen(DB_IMAGE_EXTENSION) + 1);
+	SET_ERROR_RETURN_VALUE_IF_FAIL(image_filename != NULL, PillBigError_SystemError, NULL);
+	memcpy(image_filename, filename, extension - filename);
+	strcpy(image_filename + (extension - filename), DB_IMAGE_EXTENSION);
+
+	/* An image older than its document is stale */
+	if (stat(image_filename, &image_status) == 0 && (stat(filename, &document_status) != 0
+		|| image_status.st_mtime >= document_status.st_mtime))
+	{
+		db = pillbig_db_image_open(image_filename);
+	}
+	free(image_filename);
+
+	return db;
+}
+
+
+
+static unsigned int
+pillbig_db_get_bucket(PillBigFileHash hash, unsigned int buckets_count)
+{
+	hash ^= hash >> 16;
+	hash *= 0x45D9F3B;
+	hash ^= hash >> 16;
+
+	return hash & (buckets_count - 1);
+}
+
+static int
+pillbig_db_find_hash(PillBigDB db, PillBigFileHash hash)
+{
+	unsigned int bucket = pillbig_db_get_bucket(hash, db->buckets_count);
+
+	/* Buckets are half full at most, an empty one always ends the probe */
+	while (db->buckets[bucket].index != -1)
+	{
+		if (db->buckets[bucket].hash == hash)
+		{
+			return db->buckets[bucket].index;
+		}
+		bucket = (bucket + 1) & (db->buckets_count - 1);
+	}
+
+	return -1;
+}
+
+static PillBigError
+pillbig_db_load(PillBigDB db, xmlTextReaderPtr reader)
+{
+	PillBigDBSpeechList speeches = {NULL, 0, 0};
+	PillBigDBEntry *entry = NULL;
+	const char *name;
+	xmlChar *value;
+	int result, type, depth, index;
+
+	while ((result = xmlTextReaderRead(reader)) == 1 && pillbig_no_error())
+	{
+		type  = xmlTextReaderNodeType(reader);
+		name  = (const char *)xmlTextReaderConstName(reader);
+		depth = xmlTextReaderDepth(reader);
+
+		if (type == XML_READER_TYPE_END_ELEMENT && depth == 2 && strcmp(name, "audio") == 0
+			&& entry != NULL && entry->filetype == PillBigFileType_Audio)
+		{
+			pillbig_db_store_speeches(db, entry->audio, &speeches);
+			continue;
+		}
+		else if (type != XML_READER_TYPE_ELEMENT)
+		{
+			continue;
+		}
+
+		if (depth == 0 && strcmp(name, "pillbig") == 0)
+		{
+			value = xmlTextReaderGetAttribute(reader, BAD_CAST "platform");
+			db->platform = pillbig_db_parse_platform((const char *)value);
+			if (value != NULL) xmlFree(value);
+		}
+		else if (depth == 1 && strcmp(name, "file") == 0)
+		{
+			index = pillbig_db_parse_number(
+				xmlTextReaderGetAttribute(reader, BAD_CAST "index"), 10, -1);
+			SET_ERROR_IF_FAIL(index >= 0, PillBigError_UnknownError);
+			SET_ERROR_IF_FAIL(index < DB_MAX_FILES_COUNT, PillBigError_FileIndexOutOfRange);
+			if (pillbig_any_error() || pillbig_db_grow(db, index) != PillBigError_Success)
+			{
+				break;
+			}
+
+			/* A repeated index replaces the entry, its data stays in the arena */
+			entry = &db->entries[index];
+			memset(entry, 0, sizeof(PillBigDBEntry));
+			if (!db->defined[index])
+			{
+				db->defined[index] = 1;
+				db->positions[db->files_count++] = index;
+			}
+
+			value = xmlTextReaderGetAttribute(reader, BAD_CAST "type");
+			entry->filetype = pillbig_db_parse_filetype((const char *)value);
+			if (value != NULL) xmlFree(value);
+
+			value = xmlTextReaderGetAttribute(reader, BAD_CAST "used");
+			entry->used = (value == NULL || strcmp((const char *)value, "false") != 0);
+			if (value != NULL) xmlFree(value);
+
+			/* Audio entries have audio data even without an audio element */
+			if (entry->filetype == PillBigFileType_Audio)
 			{
-				if (entry->filename != NULL) free(entry->filename);
-
-				switch (entry->filetype)
-				{
-				case PillBigFileType_Audio:
-					if (entry->audio->character != NULL) free(entry->audio->character);
-					if (entry->audio->speeches != NULL)
-					{
-						int i;
-						for (i = 0; i < entry->audio->speeches_count; i++)
-						{
-							PillBigDBAudioSpeech *speech = &entry->audio->speeches[i];
-							if (speech->language != NULL) free(speech->language);
-							if (speech->speech   != NULL) free(speech->speech);
-						}
-						free(entry->audio->speeches);
-					}
-					break;
-				}
-
-				free(entry);
+				entry->audio = (PillBigDBAudioEntry *)pillbig_arena_alloc(db->arena,
+					sizeof(PillBigDBAudioEntry));
 			}
-			i++;
 		}
-		free(db->entries);
+		else if (entry == NULL || depth < 2)
+		{
+			continue;
+		}
+		else if (depth == 2 && strcmp(name, "filename") == 0)
+		{
+			entry->filename = pillbig_db_store_string(db, xmlTextReaderReadString(reader), 0);
+		}
+		else if (depth == 2 && strcmp(name, "hash") == 0)
+		{
+			entry->hash = pillbig_db_parse_number(xmlTextReaderReadString(reader), 16, 0);
+		}
+		else if (depth == 2 && strcmp(name, "offset") == 0)
+		{
+			entry->offset = pillbig_db_parse_number(xmlTextReaderReadString(reader), 10, 0);
+		}
+		else if (depth == 2 && strcmp(name, "size") == 0)
+		{
+			entry->size = pillbig_db_parse_number(xmlTextReaderReadString(reader), 10, 0);
+		}
+		else if (depth == 2 && strcmp(name, "audio") == 0
+			&& entry->filetype == PillBigFileType_Audio)
+		{
+			entry->audio->character = pillbig_db_store_string(db,
+				xmlTextReaderGetAttribute(reader, BAD_CAST "character"), 1);
+
+			value = xmlTextReaderGetAttribute(reader, BAD_CAST "format");
+			entry->audio->format = pillbig_db_parse_audio_format((const char *)value);
+			if (value != NULL) xmlFree(value);
+
+			entry->audio->rate = pillbig_db_parse_number(
+				xmlTextReaderGetAttribute(reader, BAD_CAST "rate"), 10, 0);
+			entry->audio->samples_count = pillbig_db_parse_number(
+				xmlTextReaderGetAttribute(reader, BAD_CAST "samples"), 10, 0);
+			entry->audio->header_size = pillbig_db_parse_number(
+				xmlTextReaderGetAttribute(reader, BAD_CAST "header"), 10, 0);
+			entry->audio->checksum = pillbig_db_parse_number(
+				xmlTextReaderGetAttribute(reader, BAD_CAST "checksum"), 16, 0);
+		}
+		else if (depth == 3 && strcmp(name, "speech") == 0
+			&& entry->filetype == PillBigFileType_Audio)
+		{
+			pillbig_db_add_speech(&speeches,
+				pillbig_db_store_string(db, xmlTextReaderXmlLang(reader), 1),
+				pillbig_db_store_string(db, xmlTextReaderReadString(reader), 0));
+		}
 	}
 
-	xmlFreeDoc(db->doc);
-	xmlXPathFreeContext(db->xpathContext);
-	free(db);
+	if (speeches.speeches != NULL) free(speeches.speeches);
+
+	/* Entries grow by doubling, but index sets span up to the highest index */
+	while (db->entries_count > 0 && !db->defined[db->entries_count - 1])
+	{
+		db->entries_count--;
+	}
+
+	SET_RETURN_ERROR_IF_FAIL(result == 0 || !pillbig_no_error(), PillBigError_UnknownError);
+
+	return pillbig_error_get();
 }
 
-static int
-pillbig_db_get_xpath_query_as_int(PillBigDB db, const char *query)
+static PillBigError
+pillbig_db_grow(PillBigDB db, int index)
+{
+	PillBigDBEntry *entries;
+	unsigned char *defined;
+	int *positions;
+	int count;
+
+	if (index >= db->entries_count)
+	{
+		count = MAX(index + 1, db->entries_count * 2);
+
+		entries = (PillBigDBEntry *)realloc(db->entries, count * sizeof(PillBigDBEntry));
+		SET_RETURN_ERROR_IF_FAIL(entries != NULL, PillBigError_SystemError);
+		db->entries = entries;
+
+		defined = (unsigned char *)realloc(db->defined, count);
+		SET_RETURN_ERROR_IF_FAIL(defined != NULL, PillBigError_SystemError);
+		db->defined = defined;
+
+		memset(&db->entries[db->entries_count], 0,
+			(count - db->entries_count) * sizeof(PillBigDBEntry));
+		memset(&db->defined[db->entries_count], 0, count - db->entries_count);
+		db->entries_count = count;
+	}
+
+	/* Positions double each time their count reaches a power of two */
+	if (db->files_count == 0 || (db->files_count & (db->files_count - 1)) == 0)
+	{
+		positions = (int *)realloc(db->positions,
+			MAX(db->files_count * 2, 1) * sizeof(int));
+		SET_RETURN_ERROR_IF_FAIL(positions != NULL, PillBigError_SystemError);
+		db->positions = positions;
+	}
+
+	return PillBigError_Success;
+}
+
+static PillBigError
+pillbig_db_add_speech(PillBigDBSpeechList *list, char *language, char *speech)
+{
+	PillBigDBAudioSpeech *speeches;
+
+	if (list->count == list->capacity)
+	{
+		speeches = (PillBigDBAudioSpeech *)realloc(list->speeches,
+			MAX(list->capacity * 2, 4) * sizeof(PillBigDBAudioSpeech));
+		SET_RETURN_ERROR_IF_FAIL(speeches != NULL, PillBigError_SystemError);
+		list->speeches = speeches;
+		list->capacity = MAX(list->capacity * 2, 4);
+	}
+
+	list->speeches[list->count].language = language;
+	list->speeches[list->count].speech   = speech;
+	list->count++;
+
+	return PillBigError_Success;
+}
+
+static PillBigError
+pillbig_db_store_speeches(PillBigDB db, PillBigDBAudioEntry *audio,
+	PillBigDBSpeechList *list)
 {
-	int value;
+	PillBigDBAudioSpeech *speeches;
+
+	RETURN_VALUE_IF_FAIL(list->count > 0, PillBigError_Success);
 
-	xmlXPathObjectPtr xpathObject = xmlXPathEvalExpression(query, db->xpathContext);
-	SET_ERROR_RETURN_VALUE_IF_FAIL(xpathObject != NULL, PillBigError_SystemError, -1);
-	value = xmlXPathCastNodeSetToNumber(xpathObject->nodesetval);
-	free(xpathObject);
+	/* Speeches of an earlier audio element of the same file are kept */
+	speeches = (PillBigDBAudioSpeech *)pillbig_arena_alloc(db->arena,
+		(audio->speeches_count + list->count) * sizeof(PillBigDBAudioSpeech));
+	RETURN_VALUE_IF_FAIL(speeches != NULL, pillbig_error_get());
 
-	return value;
+	if (audio->speeches_count > 0)
+	{
+		memcpy(speeches, audio->speeches, audio->speeches_count * sizeof(PillBigDBAudioSpeech));
+	}
+	memcpy(&speeches[audio->speeches_count], list->speeches,
+		list->count * sizeof(PillBigDBAudioSpeech));
+
+	audio->speeches = speeches;
+	audio->speeches_count += list->count;
+	list->count = 0;
+
+	return PillBigError_Success;
 }
 
 static char *
-pillbig_db_get_xpath_query_as_string(PillBigDB db, const char *query)
+pillbig_db_store_string(PillBigDB db, xmlChar *value, int intern)
 {
-	char *value = NULL;
+	char *string = NULL;
 
-	xmlXPathObjectPtr xpathObject = xmlXPathEvalExpression(query, db->xpathContext);
-	SET_ERROR_RETURN_VALUE_IF_FAIL(xpathObject != NULL, PillBigError_SystemError, NULL);
-	value = xmlXPathCastNodeSetToString(xpathObject->nodesetval);
-	value = (strlen(value) > 0) ? strdup(value) : NULL;
-	free(xpathObject);
+	if (value != NULL)
+	{
+		if (value[0] != '\0')
+		{
+			string = intern ? pillbig_arena_intern(db->arena, (const char *)value)
+			                : pillbig_arena_strdup(db->arena, (const char *)value);
+		}
+		xmlFree(value);
+	}
+
+	return string;
+}
+
+static long
+pillbig_db_parse_number(xmlChar *value, int base, long default_value)
+{
+	long number = default_value;
+
+	if (value != NULL)
+	{
+		number = strtoul((const char *)value, NULL, base);
+		xmlFree(value);
+	}
 
-	return value;
+	return number;
 }
 
 static PillBigFileType
-pillbig_db_get_xpath_query_as_filetype(PillBigDB db, const char *query)
+pillbig_db_parse_filetype(const char *value)
 {
 	PillBigFileType filetype = PillBigFileType_Unknown;
-	char *value;
 
-	xmlXPathObjectPtr xpathObject = xmlXPathEvalExpression(query, db->xpathContext);
-	SET_ERROR_RETURN_VALUE_IF_FAIL(xpathObject != NULL, PillBigError_SystemError, PillBigFileType_Unknown);
-	value = xmlXPathCastNodeSetToString(xpathObject->nodesetval);
-
-	if (strlen(value) > 0)
+	if (value != NULL)
 	{
 		     if (strcmp(value, "audio") == 0)   filetype = PillBigFileType_Audio;
 		else if (strcmp(value, "bitmap") == 0)  filetype = PillBigFileType_Bitmap;
@@ -282,52 +804,147 @@ pillbig_db_get_xpath_query_as_filetype(PillBigDB db, const char *query)
 		else if (strcmp(value, "sprite") == 0)  filetype = PillBigFileType_Sprite;
 		else if (strcmp(value, "tilemap") == 0) filetype = PillBigFileType_Tilemap;
 	}
-	free(xpathObject);
 
 	return filetype;
 }
 
-static PillBigDBAudioEntry *
-pillbig_db_get_audio_entry(PillBigDB db, int index)
+static PillBigAudioFormat
+pillbig_db_parse_audio_format(const char *value)
 {
-	PillBigDBAudioEntry *entry;
-	char query[128];
+	PillBigAudioFormat format = PillBigAudioFormat_Unknown;
 
-	entry = (PillBigDBAudioEntry *)malloc(sizeof(PillBigDBAudioEntry));
-	SET_ERROR_RETURN_VALUE_IF_FAIL(entry != NULL, PillBigError_SystemError, NULL);
-	memset(entry, 0, sizeof(PillBigDBAudioEntry));
+	if (value != NULL)
+	{
+		     if (strcmp(value, "vag") == 0)   format = PillBigAudioFormat_VAG;
+		else if (strcmp(value, "adpcm") == 0) format = PillBigAudioFormat_ADPCM;
+		else if (strcmp(value, "wave") == 0)  format = PillBigAudioFormat_WAVE;
+	}
+
+	return format;
+}
 
-	sprintf(query, "/pillbig/file[@index='%d']/audio/@character", index);
-	entry->character = pillbig_db_get_xpath_query_as_string(db, query);
-	entry->speeches = pillbig_db_get_audio_speeches(db, index, &entry->speeches_count);
+static PillBigPlatform
+pillbig_db_parse_platform(const char *value)
+{
+	PillBigPlatform platform = PillBigPlatform_Unknown;
+
+	if (value != NULL)
+	{
+		     if (strcmp(value, "pc") == 0)  platform = PillBigPlatform_PC;
+		else if (strcmp(value, "psx") == 0) platform = PillBigPlatform_PSX;
+	}
 
-	return entry;
+	return platform;
 }
 
-static PillBigDBAudioSpeech *
-pillbig_db_get_audio_speeches(PillBigDB db, int index, int *speeches_count)
+static int
+pillbig_db_write_entry(xmlTextWriterPtr writer, int index, const PillBigDBEntry *entry)
 {
-	PillBigDBAudioSpeech *speeches = NULL;
-	*speeches_count = 0;
-	char query[128];
+	const PillBigDBAudioEntry *audio = entry->audio;
+	const char *filetype = pillbig_db_get_filetype_name(entry->filetype);
+	const char *format;
+	int result, i;
+
+	result = xmlTextWriterStartElement(writer, BAD_CAST "file");
+	if (result >= 0) result = xmlTextWriterWriteFormatAttribute(writer, BAD_CAST "index", "%d", index);
+	if (result >= 0 && filetype != NULL)
+	{
+		result = xmlTextWriterWriteAttribute(writer, BAD_CAST "type", BAD_CAST filetype);
+	}
+	if (result >= 0 && !entry->used)
+	{
+		result = xmlTextWriterWriteAttribute(writer, BAD_CAST "used", BAD_CAST "false");
+	}
+
+	if (result >= 0 && entry->filename != NULL)
+	{
+		result = xmlTextWriterWriteElement(writer, BAD_CAST "filename", BAD_CAST entry->filename);
+	}
+	if (result >= 0) result = xmlTextWriterWriteFormatElement(writer, BAD_CAST "hash", "%X", entry->hash);
+	if (result >= 0) result = xmlTextWriterWriteFormatElement(writer, BAD_CAST "offset", "%d", entry->offset);
+	if (result >= 0) result = xmlTextWriterWriteFormatElement(writer, BAD_CAST "size", "%d", entry->size);
+
+	/* Audio elements only for audio entries with some data */
+	if (result >= 0 && entry->filetype == PillBigFileType_Audio && audio != NULL
+		&& (audio->character != NULL || audio->format != PillBigAudioFormat_Unknown
+			|| audio->rate > 0 || audio->samples_count > 0 || audio->speeches_count > 0))
+	{
+		format = pillbig_db_get_audio_format_name(audio->format);
+
+		result = xmlTextWriterStartElement(writer, BAD_CAST "audio");
+		if (result >= 0 && audio->character != NULL)
+		{
+			result = xmlTextWriterWriteAttribute(writer, BAD_CAST "character", BAD_CAST audio->character);
+		}
+		if (result >= 0 && format != NULL)
+		{
+			result = xmlTextWriterWriteAttribute(writer, BAD_CAST "format", BAD_CAST format);
+		}
+		if (result >= 0 && audio->rate > 0)
+		{
+			result = xmlTextWriterWriteFormatAttribute(writer, BAD_CAST "rate", "%d", audio->rate);
+		}
+		if (result >= 0 && audio->samples_count > 0)
+		{
+			result = xmlTextWriterWriteFormatAttribute(writer, BAD_CAST "samples", "%d",
+				audio->samples_count);
+		}
+		if (result >= 0 && audio->header_size > 0)
+		{
+			result = xmlTextWriterWriteFormatAttribute(writer, BAD_CAST "header", "%d",
+				audio->header_size);
+		}
+		if (result >= 0 && audio->checksum != 0)
+		{
+			result = xmlTextWriterWriteFormatAttribute(writer, BAD_CAST "checksum", "%X",
+				audio->checksum);
+		}
 
-	sprintf(query, "/pillbig/file[@index='%d']/audio/speech", index);
-	xmlXPathObjectPtr xpathObject = xmlXPathEvalExpression(query, db->xpathContext);
-	SET_ERROR_RETURN_VALUE_IF_FAIL(xpathObject != NULL, PillBigError_SystemError, NULL);
-	*speeches_count = xpathObject->nodesetval->nodeNr;
+		for (i = 0; i < audio->speeches_count && result >= 0; i++)
+		{
+			result = xmlTextWriterStartElement(writer, BAD_CAST "speech");
+			if (result >= 0 && audio->speeches[i].language != NULL)
+			{
+				result = xmlTextWriterWriteAttribute(writer, BAD_CAST "xml:lang",
+					BAD_CAST audio->speeches[i].language);
+			}
+			if (result >= 0 && audio->speeches[i].speech != NULL)
+			{
+				result = xmlTextWriterWriteString(writer, BAD_CAST audio->speeches[i].speech);
+			}
+			if (result >= 0) result = xmlTextWriterEndElement(writer);
+		}
 
-	speeches = (PillBigDBAudioSpeech *)calloc(*speeches_count, sizeof(PillBigDBAudioSpeech));
-	SET_ERROR_RETURN_VALUE_IF_FAIL(xpathObject != NULL, PillBigError_SystemError, NULL);
-	memset(speeches, 0, sizeof(*speeches_count * sizeof(PillBigDBAudioSpeech)));
+		if (result >= 0) result = xmlTextWriterEndElement(writer);
+	}
 
-	int i;
-	for (i = 0; i < *speeches_count; i++)
+	if (result >= 0) result = xmlTextWriterEndElement(writer);
+
+	return result;
+}
+
+static const char *
+pillbig_db_get_filetype_name(PillBigFileType filetype)
+{
+	switch (filetype)
 	{
-		db->xpathContext->node = xpathObject->nodesetval->nodeTab[i];
-		speeches[i].language = pillbig_db_get_xpath_query_as_string(db, "@xml:lang");
-		speeches[i].speech   = pillbig_db_get_xpath_query_as_string(db, ".");
+		case PillBigFileType_Audio:   return "audio";
+		case PillBigFileType_Bitmap:  return "bitmap";
+		case PillBigFileType_Map:     return "map";
+		case PillBigFileType_Sprite:  return "sprite";
+		case PillBigFileType_Tilemap: return "tilemap";
+		default:                      return NULL;
 	}
-	xmlFree(xpathObject);
+}
 
-	return speeches;
+static const char *
+pillbig_db_get_audio_format_name(PillBigAudioFormat format)
+{
+	switch (format)
+	{
+		case PillBigAudioFormat_VAG:   return "vag";
+		case PillBigAudioFormat_ADPCM: return "adpcm";
+		case PillBigAudioFormat_WAVE:  return "wave";
+		default:                       return NULL;
+	}
 }
@@ -0,0 +1,351 @@
+/*
+ *  libpillbig
+ *  A library to deal with Blood Omen: Legacy of Kain pill.big files.
+ */
+
+/**
+ *  @file
+ *  @brief
+ *  	Internal shared implementation of the PillBigDB object and
+ *  	layout of compiled database images.
+ *
+ *  @author  Alfonso Ruzafa <superruzafa@gmail.com>
+ *  @version SVN $Id$
+ */
+
+#ifndef __PILLBIG_DB_INTERNAL_H__
+#define __PILLBIG_DB_INTERNAL_H__
+
+#include <pillbig/pillbig.h>
+#include "pillbig_internal.h"
+#include "arena.h"
+
+/**
+ *  Compiled database image magic.
+ */
+#define DB_IMAGE_MAGIC "PBDB"
+
+/**
+ *  Compiled database image version.
+ */
+#define DB_IMAGE_VERSION 2
+
+/**
+ *  Written as is so images from hosts with another byte order are
+ *  told apart.
+ */
+#define DB_IMAGE_BYTE_ORDER 0x01020304
+
+/**
+ *  String offset of missing strings.
+ */
+#define DB_IMAGE_NO_STRING 0xFFFFFFFF
+
+/**
+ *  Filename extension of compiled images, replacing the XML one.
+ */
+#define DB_IMAGE_EXTENSION ".bin"
+
+/**
+ *  Highest count of files a database can describe, the PC archive is
+ *  the largest one.
+ */
+#define DB_MAX_FILES_COUNT FILES_COUNT_PC
+
+/**
+ *  Count of metadata columns, one per PillBigDBColumn.
+ */
+#define DB_COLUMNS_COUNT 8
+
+/**
+ *  @brief
+ *  	Compiled database image header.
+ *
+ *  The header is followed by the entries, audio entries, speeches,
+ *  positions, hash buckets and string pool sections, in that order
+ *  and with no padding between them.
+ */
+typedef struct
+{
+	char            magic[4];          /**< DB_IMAGE_MAGIC. */
+	unsigned int    version;           /**< DB_IMAGE_VERSION. */
+	unsigned int    byte_order;        /**< DB_IMAGE_BYTE_ORDER. */
+	unsigned int    entries_count;     /**< Count of entry records, highest file index plus one. */
+	unsigned int    files_count;       /**< Count of positions. */
+	unsigned int    audios_count;      /**< Count of audio entry records. */
+	unsigned int    speeches_count;    /**< Count of speech records. */
+	unsigned int    buckets_count;     /**< Count of hash buckets, a power of two. */
+	unsigned int    strings_size;      /**< Size of the string pool. */
+	int             platform;          /**< Platform of the document. */
+}
+PillBigDBImageHeader;
+
+/**
+ *  @brief
+ *  	Compiled database entry record.
+ */
+typedef struct
+{
+	PillBigFileHash  hash;        /**< File hash. */
+	int              offset;      /**< File offset. */
+	int              size;        /**< File size. */
+	unsigned int     filename;    /**< Filename string offset. */
+	int              audio;       /**< Audio entry record. -1 if none. */
+	unsigned char    defined;     /**< 1 if there is an entry for this index. */
+	unsigned char    used;        /**< Is file used? */
+	unsigned char    filetype;    /**< File type. */
+	unsigned char    reserved;
+}
+PillBigDBImageEntry;
+
+/**
+ *  @brief
+ *  	Compiled database audio entry record.
+ */
+typedef struct
+{
+	unsigned int    character;         /**< Character string offset. */
+	int             format;            /**< Audio format. */
+	int             rate;              /**< Sample rate. */
+	int             samples_count;     /**< Samples count. */
+	int             header_size;       /**< Bytes of header before the audio data. */
+	unsigned int    checksum;          /**< Checksum of the file ends. */
+	unsigned int    first_speech;      /**< First speech record. */
+	unsigned int    speeches_count;    /**< Count of speech records. */
+}
+PillBigDBImageAudio;
+
+/**
+ *  @brief
+ *  	Compiled database speech record.
+ */
+typedef struct
+{
+	unsigned int    language;    /**< Language string offset. */
+	unsigned int    speech;      /**< Speech string offset. */
+}
+PillBigDBImageSpeech;
+
+/**
+ *  @brief
+ *  	Hash index bucket, also stored as is in compiled images.
+ *  	Buckets are probed linearly.
+ */
+typedef struct
+{
+	PillBigFileHash  hash;     /**< File hash. */
+	int              index;    /**< File index. -1 if the bucket is empty. */
+}
+PillBigDBBucket;
+
+/**
+ *  @brief
+ *  	Named file, for sorted name arrays.
+ */
+typedef struct
+{
+	const char  *name;     /**< Filename. */
+	int          index;    /**< File index. */
+}
+PillBigDBName;
+
+/**
+ *  @brief
+ *  	Filename index, built on the first filename query.
+ *
+ *  Names are compared ignoring ASCII case. Sorted arrays stand for
+ *  a trie: the names sharing a prefix, or a suffix in the reversed
+ *  array, are a contiguous range found by binary search.
+ */
+typedef struct
+{
+	int             *buckets;          /**< File index of each name bucket. -1 if empty. */
+	unsigned int     buckets_count;    /**< Count of buckets, a power of two. */
+	PillBigDBName   *sorted;           /**< Named files, by name. */
+	PillBigDBName   *reversed;         /**< Named files, by name read backwards. */
+	int              count;            /**< Count of named files. */
+}
+PillBigDBNameIndex;
+
+/**
+ *  @brief
+ *  	Files whose speeches have a term.
+ */
+typedef struct
+{
+	int    index;    /**< File index. */
+	int    count;    /**< Occurrences of the term in the file speeches. */
+}
+PillBigDBPosting;
+
+/**
+ *  @brief
+ *  	Term of the speeches in a language.
+ */
+typedef struct
+{
+	const char  *term;        /**< Folded term. NULL if the bucket is empty. */
+	int          language;    /**< Language ID. */
+	int          first;       /**< First posting. */
+	int          count;       /**< Count of postings, by ascending file index. */
+}
+PillBigDBTerm;
+
+/**
+ *  @brief
+ *  	Inverted index of the speeches, built on the first search.
+ *
+ *  Terms are the runs of letters and digits of the speeches, in
+ *  lower case and with the Latin-1 diacritics removed.
+ */
+typedef struct
+{
+	PillBigArena         arena;              /**< Folded terms. */
+	int                 *files_counts;       /**< Count of files with speeches, by language ID. */
+	int                  languages_count;    /**< Count of languages. */
+	PillBigDBTerm       *terms;              /**< Terms hash table, probed linearly. */
+	unsigned int         terms_count;        /**< Count of term buckets, a power of two. */
+	PillBigDBPosting    *postings;           /**< Postings of every term, term after term. */
+}
+PillBigDBTextIndex;
+
+/**
+ *  @brief
+ *  	Speech languages and the locale preference among them, built on
+ *  	the first speech lookup.
+ */
+typedef struct
+{
+	const char                  **languages;          /**< Languages of the speeches, by ID. */
+	int                           languages_count;    /**< Count of languages. */
+	int                          *ranks;              /**< Locale preference of each language. -1 if none. */
+	const PillBigDBAudioSpeech  **speeches;           /**< Speech of each file in each language, file after file. */
+	const PillBigDBAudioSpeech  **preferred;          /**< Preferred speech of each file. */
+}
+PillBigDBLocale;
+
+/**
+ *  @brief
+ *  	Entry metadata by columns, built on the first filter.
+ *
+ *  Columns are padded to whole index set words, so filters compare
+ *  them a word of indices at a time.
+ */
+typedef struct
+{
+	int               rows;                        /**< Rows of each column, entries padded. */
+	int              *values;                      /**< Columns, one after another. */
+	unsigned long    *defined;                     /**< Bitmap of the indices with an entry. */
+	const char      **characters;                  /**< Characters, by ID. */
+	int               characters_count;            /**< Count of characters. */
+}
+PillBigDBColumns;
+
+struct _PillBigDB
+{
+	int                    files_count;      /**< Count of file elements. */
+	int                    entries_count;    /**< Size of the entries array, highest index plus one. */
+	PillBigDBEntry        *entries;          /**< Entries, by file index. */
+	unsigned char         *defined;          /**< Whether each index has an entry. */
+	int                   *positions;        /**< File index of each file element, in document order. */
+	PillBigFileType        filetype;
+	PillBigPlatform        platform;         /**< Platform of the document. */
+	PillBigArena           arena;            /**< Strings and audio entries loaded from XML. */
+	void                  *image;            /**< Mapped compiled image. NULL if loaded from XML. */
+	long                   image_size;       /**< Size of the mapped image. */
+	PillBigDBAudioEntry   *audios;           /**< Audio entries of a compiled image. */
+	PillBigDBAudioSpeech  *speeches;         /**< Speeches of a compiled image. */
+	PillBigDBBucket       *buckets;          /**< Hash index, owned unless in the image. */
+	unsigned int           buckets_count;    /**< Count of hash buckets, a power of two. */
+	PillBigDBNameIndex    *names;            /**< Filename index. NULL until needed. */
+	PillBigDBTextIndex    *text;             /**< Speeches index. NULL until needed. */
+	PillBigDBLocale       *locale;           /**< Speech languages. NULL until needed. */
+	PillBigDBColumns      *columns;          /**< Metadata columns. NULL until needed. */
+};
+
+/**
+ *  Opens a compiled database image.
+ *
+ *  @param filename
+ *  	Image filename.
+ *  @return
+ *  	PillBigDB if successful.
+ *  	NULL if the file is missing or isn't a valid image.
+ */
+PillBigDB
+pillbig_db_image_open(const char *filename);
+
+/**
+ *  Closes a database opened from a compiled image.
+ *
+ *  @param db
+ *  	Database opened from an image.
+ */
+void
+pillbig_db_image_close(PillBigDB db);
+
+/**
+ *  Gets the count of hash buckets for a count of files.
+ *
+ *  @param files_count
+ *  	Count of files.
+ *  @return
+ *  	Count of buckets, a power of two leaving them half full at most.
+ */
+unsigned int
+pillbig_db_get_buckets_count(int files_count);
+
+/**
+ *  Fills the hash index of a database.
+ *
+ *  @remarks
+ *  	Duplicated hashes resolve to the first file in document order.
+ *
+ *  @param db
+ *  	Database with its entries and positions loaded.
+ *  @param buckets
+ *  	Buckets to be filled.
+ *  @param buckets_count
+ *  	Count of buckets, as returned by pillbig_db_get_buckets_count().
+ */
+void
+pillbig_db_fill_buckets(PillBigDB db, PillBigDBBucket *buckets,
+	unsigned int buckets_count);
+
+/**
+ *  Frees a filename index.
+ *
+ *  @param names
+ *  	Filename index. May be NULL.
+ */
+void
+pillbig_db_names_free(PillBigDBNameIndex *names);
+
+/**
+ *  Frees a speeches index.
+ *
+ *  @param text
+ *  	Speeches index. May be NULL.
+ */
+void
+pillbig_db_text_free(PillBigDBTextIndex *text);
+
+/**
+ *  Frees a speech languages table.
+ *
+ *  @param locale
+ *  	Speech languages table. May be NULL.
+ */
+void
+pillbig_db_locale_free(PillBigDBLocale *locale);
+
+/**
+ *  Frees the metadata columns of a database.
+ *
+ *  @param columns
+ *  	Metadata columns. May be NULL.
+ */
+void
+pillbig_db_columns_free(PillBigDBColumns *columns);
+
+#endif
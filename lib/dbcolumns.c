@@ -0,0 +1,295 @@
+/*
+ *  libpillbig
+ *  A library to deal with Blood Omen: Legacy of Kain pill.big files.
+ */
+
+/**
+ *  @file
+ *  @brief
+ *  	Database metadata columns and filters. Implementation file.
+ *
+ *  @author  Alfonso Ruzafa <superruzafa@gmail.com>
+ *  @version SVN $Id$
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <pillbig/pillbig.h>
+#include "pillbig_internal.h"
+#include "db_internal.h"
+#include "indexset_internal.h"
+
+#if defined(__SSE2__)
+#	include <emmintrin.h>
+#endif
+
+/**
+ *  Gets the metadata columns of a database, building them if needed.
+ *
+ *  @param db
+ *  	Database.
+ *  @return
+ *  	Metadata columns if successful. NULL otherwise.
+ */
+static PillBigDBColumns *
+pillbig_db_columns_get(PillBigDB db);
+
+/**
+ *  Gets the ID of a character, adding it if needed.
+ *
+ *  @param columns
+ *  	Metadata columns.
+ *  @param character
+ *  	Character.
+ *  @return
+ *  	Character ID. -1 on error.
+ */
+static int
+pillbig_db_columns_add_character(PillBigDBColumns *columns, const char *character);
+
+/**
+ *  Compares a word of values with a filter value.
+ *
+ *  @param values
+ *  	INDEX_SET_WORD_BITS values.
+ *  @param compare
+ *  	PillBigDBCompare_Equal, PillBigDBCompare_Less or
+ *  	PillBigDBCompare_Greater.
+ *  @param value
+ *  	Filter value.
+ *  @param bias
+ *  	Flipped on values and filter value before comparing them. INT_MIN
+ *  	compares them as unsigned values.
+ *  @return
+ *  	Bitmap word with a bit set for each value satisfying the
+ *  	comparison.
+ */
+static unsigned long
+pillbig_db_columns_compare_word(const int *values, PillBigDBCompare compare, int value, int bias);
+
+
+
+int
+pillbig_db_get_character_id(PillBigDB db, const char *character)
+{
+	pillbig_error_clear();
+	SET_ERROR_RETURN_VALUE_IF_FAIL(db != NULL, PillBigError_UnknownError, -1);
+	SET_ERROR_RETURN_VALUE_IF_FAIL(character != NULL, PillBigError_UnknownError, -1);
+
+	PillBigDBColumns *columns = pillbig_db_columns_get(db);
+	int i;
+
+	RETURN_VALUE_IF_FAIL(columns != NULL, -1);
+
+	for (i = 0; i < columns->characters_count; i++)
+	{
+		if (strcmp(columns->characters[i], character) == 0)
+		{
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+const int *
+pillbig_db_get_column(PillBigDB db, PillBigDBColumn column)
+{
+	pillbig_error_clear();
+	SET_ERROR_RETURN_VALUE_IF_FAIL(db != NULL, PillBigError_UnknownError, NULL);
+	SET_ERROR_RETURN_VALUE_IF_FAIL(0 <= (int)column && column < DB_COLUMNS_COUNT,
+		PillBigError_UnknownError, NULL);
+
+	PillBigDBColumns *columns = pillbig_db_columns_get(db);
+	RETURN_VALUE_IF_FAIL(columns != NULL, NULL);
+
+	return &columns->values[column * columns->rows];
+}
+
+PillBigIndexSet
+pillbig_db_filter(PillBigDB db, PillBigDBColumn column, PillBigDBCompare compare, int value)
+{
+	pillbig_error_clear();
+	SET_ERROR_RETURN_VALUE_IF_FAIL(db != NULL, PillBigError_UnknownError, NULL);
+	SET_ERROR_RETURN_VALUE_IF_FAIL(0 <= (int)column && column < DB_COLUMNS_COUNT,
+		PillBigError_UnknownError, NULL);
+	SET_ERROR_RETURN_VALUE_IF_FAIL(PillBigDBCompare_Equal <= compare
+		&& compare <= PillBigDBCompare_GreaterEqual, PillBigError_UnknownError, NULL);
+
+	PillBigDBColumns *columns = pillbig_db_columns_get(db);
+	PillBigIndexSet set;
+	const int *values;
+	unsigned long invert = 0;
+	int bias, i;
+
+	RETURN_VALUE_IF_FAIL(columns != NULL, NULL);
+
+	set = pillbig_index_set_new(db->entries_count);
+	RETURN_VALUE_IF_FAIL(set != NULL, NULL);
+
+	/* The other comparisons are the complements of these three */
+	switch (compare)
+	{
+		case PillBigDBCompare_NotEqual:     compare = PillBigDBCompare_Equal;   invert = ~0UL; break;
+		case PillBigDBCompare_LessEqual:    compare = PillBigDBCompare_Greater; invert = ~0UL; break;
+		case PillBigDBCompare_GreaterEqual: compare = PillBigDBCompare_Less;    invert = ~0UL; break;
+		default: break;
+	}
+
+	values = &columns->values[column * columns->rows];
+	bias = (column == PillBigDBColumn_Hash) ? INT_MIN : 0;
+
+	for (i = 0; i < set->words_count; i++)
+	{
+		set->words[i] = columns->defined[i]
+			& (invert ^ pillbig_db_columns_compare_word(&values[i * INDEX_SET_WORD_BITS],
+				compare, value, bias));
+	}
+	pillbig_index_set_update_count(set);
+
+	return set;
+}
+
+void
+pillbig_db_columns_free(PillBigDBColumns *columns)
+{
+	RETURN_IF_FAIL(columns != NULL);
+
+	if (columns->values     != NULL) free(columns->values);
+	if (columns->defined    != NULL) free(columns->defined);
+	if (columns->characters != NULL) free(columns->characters);
+	free(columns);
+}
+
+
+
+static PillBigDBColumns *
+pillbig_db_columns_get(PillBigDB db)
+{
+	PillBigDBColumns *columns;
+	const PillBigDBEntry *entry;
+	int *values;
+	int words_count, character, i;
+
+	RETURN_VALUE_IF_FAIL(db->columns == NULL, db->columns);
+
+	columns = (PillBigDBColumns *)malloc(sizeof(PillBigDBColumns));
+	SET_ERROR_RETURN_VALUE_IF_FAIL(columns != NULL, PillBigError_SystemError, NULL);
+	memset(columns, 0, sizeof(PillBigDBColumns));
+
+	words_count = MAX((db->entries_count + INDEX_SET_WORD_BITS - 1) / INDEX_SET_WORD_BITS, 1);
+	columns->rows = words_count * INDEX_SET_WORD_BITS;
+	columns->values  = (int *)calloc(DB_COLUMNS_COUNT * columns->rows, sizeof(int));
+	columns->defined = (unsigned long *)calloc(words_count, sizeof(unsigned long));
+	if (columns->values == NULL || columns->defined == NULL)
+	{
+		pillbig_db_columns_free(columns);
+		columns = NULL;
+	}
+	SET_ERROR_RETURN_VALUE_IF_FAIL(columns != NULL, PillBigError_SystemError, NULL);
+
+	values = columns->values;
+	for (i = 0; i < db->entries_count; i++)
+	{
+		if (!db->defined[i])
+		{
+			continue;
+		}
+
+		entry = &db->entries[i];
+		columns->defined[i / INDEX_SET_WORD_BITS] |= 1UL << (i % INDEX_SET_WORD_BITS);
+
+		values[PillBigDBColumn_Hash      * columns->rows + i] = (int)entry->hash;
+		values[PillBigDBColumn_Offset    * columns->rows + i] = entry->offset;
+		values[PillBigDBColumn_Size      * columns->rows + i] = entry->size;
+		values[PillBigDBColumn_FileType  * columns->rows + i] = entry->filetype;
+		values[PillBigDBColumn_Used      * columns->rows + i] = (entry->used != 0);
+		values[PillBigDBColumn_Format    * columns->rows + i] = PillBigAudioFormat_Unknown;
+		values[PillBigDBColumn_Rate      * columns->rows + i] = 0;
+		values[PillBigDBColumn_Character * columns->rows + i] = -1;
+
+		if (entry->filetype != PillBigFileType_Audio || entry->audio == NULL)
+		{
+			continue;
+		}
+
+		values[PillBigDBColumn_Format * columns->rows + i] = entry->audio->format;
+		values[PillBigDBColumn_Rate   * columns->rows + i] = entry->audio->rate;
+
+		if (entry->audio->character != NULL)
+		{
+			character = pillbig_db_columns_add_character(columns, entry->audio->character);
+			if (character == -1)
+			{
+				pillbig_db_columns_free(columns);
+				return NULL;
+			}
+			values[PillBigDBColumn_Character * columns->rows + i] = character;
+		}
+	}
+
+	db->columns = columns;
+
+	return columns;
+}
+
+static int
+pillbig_db_columns_add_character(PillBigDBColumns *columns, const char *character)
+{
+	const char **characters;
+	int i;
+
+	for (i = 0; i < columns->characters_count; i++)
+	{
+		if (strcmp(columns->characters[i], character) == 0)
+		{
+			return i;
+		}
+	}
+
+	characters = (const char **)realloc(columns->characters,
+		(columns->characters_count + 1) * sizeof(const char *));
+	SET_ERROR_RETURN_VALUE_IF_FAIL(characters != NULL, PillBigError_SystemError, -1);
+
+	columns->characters = characters;
+	columns->characters[columns->characters_count] = character;
+
+	return columns->characters_count++;
+}
+
+static unsigned long
+pillbig_db_columns_compare_word(const int *values, PillBigDBCompare compare, int value, int bias)
+{
+	unsigned long word = 0;
+	int i;
+
+#if defined(__SSE2__)
+	__m128i flip = _mm_set1_epi32(bias);
+	__m128i target = _mm_set1_epi32(value ^ bias);
+	__m128i block, mask;
+
+	/* Four values per comparison, their sign bits gathered in a nibble */
+	for (i = 0; i < INDEX_SET_WORD_BITS; i += 4)
+	{
+		block = _mm_xor_si128(_mm_loadu_si128((const __m128i *)&values[i]), flip);
+		mask = (compare == PillBigDBCompare_Equal) ? _mm_cmpeq_epi32(block, target)
+			: (compare == PillBigDBCompare_Less) ? _mm_cmplt_epi32(block, target)
+			: _mm_cmpgt_epi32(block, target);
+		word |= (unsigned long)_mm_movemask_ps(_mm_castsi128_ps(mask)) << i;
+	}
+#else
+	int current;
+
+	value ^= bias;
+	for (i = 0; i < INDEX_SET_WORD_BITS; i++)
+	{
+		current = values[i] ^ bias;
+		word |= (unsigned long)((compare == PillBigDBCompare_Equal) ? current == value
+			: (compare == PillBigDBCompare_Less) ? current < value
+			: current > value) << i;
+	}
+#endif
+
+	return word;
+}
@@ -0,0 +1,330 @@
+/*
+ *  libpillbig
+ *  A library to deal with Blood Omen: Legacy of Kain pill.big files.
+ */
+
+/**
+ *  @file
+ *  @brief
+ *  	Database generation from pill.big contents. Implementation file.
+ *
+ *  @author  Alfonso Ruzafa <superruzafa@gmail.com>
+ *  @version SVN $Id$
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <pillbig/pillbig.h>
+#include "pillbig_internal.h"
+#include "db_internal.h"
+
+/**
+ *  Files a worker takes at a time, contiguous in offset order.
+ */
+#define GENERATE_CHUNK_SIZE 64
+
+/**
+ *  @brief
+ *  	Probing work shared by the generation workers.
+ */
+typedef struct
+{
+	const int        *indices;    /**< File indices, by offset. */
+	int               count;      /**< Count of file indices. */
+	int               next;       /**< First index not taken by any worker. */
+	unsigned int     *checksums;  /**< Checksum of each audio file, by file index. */
+	PillBigError      error;      /**< First error of any worker. */
+	pthread_mutex_t   lock;       /**< Guards next and error. */
+}
+PillBigDBGenerateJob;
+
+/**
+ *  @brief
+ *  	Generation worker.
+ */
+typedef struct
+{
+	PillBigDBGenerateJob  *job;        /**< Shared work. */
+	struct _PillBig        pillbig;    /**< PillBig object copy, reading its own source. */
+	pthread_t              thread;     /**< Worker thread. */
+	int                    started;    /**< 1 if the thread was started. */
+}
+PillBigDBGenerateWorker;
+
+/**
+ *  Probes files until there are none left.
+ *
+ *  @param data
+ *  	PillBigDBGenerateWorker.
+ *  @return
+ *  	NULL.
+ */
+static void *
+pillbig_db_generate_run(void *data);
+
+/**
+ *  Builds a database from the probed metadata of a PillBig object.
+ *
+ *  @param pillbig
+ *  	PillBig object, every file probed.
+ *  @param checksums
+ *  	Checksum of each audio file, by file index.
+ *  @param names
+ *  	Candidate filenames. May be NULL.
+ *  @param names_count
+ *  	Count of candidate filenames.
+ *  @return
+ *  	PillBigDB object if successful. NULL otherwise.
+ */
+static PillBigDB
+pillbig_db_generate_build(PillBig pillbig, const unsigned int *checksums,
+	const char **names, int names_count);
+
+
+
+PillBigDB
+pillbig_db_generate(PillBig pillbig, const char **names, int names_count,
+	int threads_count)
+{
+	pillbig_error_clear();
+	SET_ERROR_RETURN_VALUE_IF_FAIL(pillbig != NULL, PillBigError_InvalidPillBigObject, NULL);
+	SET_ERROR_RETURN_VALUE_IF_FAIL(names_count >= 0 && (names_count == 0 || names != NULL),
+		PillBigError_UnknownError, NULL);
+	SET_ERROR_RETURN_VALUE_IF_FAIL(threads_count >= 0, PillBigError_UnknownError, NULL);
+
+	PillBigDBGenerateJob job;
+	PillBigDBGenerateWorker *workers;
+	PillBigDB db;
+	int *indices;
+	int i;
+
+	if (threads_count == 0)
+	{
+		threads_count = MAX((int)sysconf(_SC_NPROCESSORS_ONLN), 1);
+	}
+	threads_count = MAX(MIN(threads_count,
+		((int)pillbig->files_count + GENERATE_CHUNK_SIZE - 1) / GENERATE_CHUNK_SIZE), 1);
+
+	indices = pillbig_get_indices_by_offset(pillbig);
+	RETURN_VALUE_IF_FAIL(indices != NULL, NULL);
+
+	workers = (PillBigDBGenerateWorker *)calloc(threads_count, sizeof(PillBigDBGenerateWorker));
+	job.checksums = (unsigned int *)calloc(MAX(pillbig->files_count, 1), sizeof(unsigned int));
+	if (workers == NULL || job.checksums == NULL)
+	{
+		free(workers);
+		free(job.checksums);
+		free(indices);
+		pillbig_error_set(PillBigError_SystemError);
+		return NULL;
+	}
+
+	job.indices = indices;
+	job.count   = pillbig->files_count;
+	job.next    = 0;
+	job.error   = PillBigError_Success;
+	pthread_mutex_init(&job.lock, NULL);
+
+	/* Workers share the metadata cache, each probes different files */
+	for (i = 0; i < threads_count; i++)
+	{
+		workers[i].job = &job;
+		workers[i].pillbig = *pillbig;
+		workers[i].pillbig.db = NULL;
+		workers[i].pillbig.free_source = 0;
+		if (i > 0)
+		{
+			workers[i].pillbig.source = pillbig_source_get_concurrent(pillbig->source);
+			if (workers[i].pillbig.source == NULL)
+			{
+				break;
+			}
+		}
+	}
+
+	/* Sources that can't be read concurrently are read from this thread alone */
+	threads_count = i;
+	for (i = 1; i < threads_count; i++)
+	{
+		workers[i].started = (pthread_create(&workers[i].thread, NULL,
+			pillbig_db_generate_run, &workers[i]) == 0);
+	}
+	pillbig_db_generate_run(&workers[0]);
+
+	for (i = 1; i < threads_count; i++)
+	{
+		if (workers[i].started)
+		{
+			pthread_join(workers[i].thread, NULL);
+		}
+		if (workers[i].pillbig.source != pillbig->source)
+		{
+			pillbig_source_free(workers[i].pillbig.source);
+		}
+	}
+
+	pthread_mutex_destroy(&job.lock);
+	free(workers);
+	free(indices);
+
+	db = NULL;
+	if (job.error == PillBigError_Success)
+	{
+		db = pillbig_db_generate_build(pillbig, job.checksums, names, names_count);
+	}
+	free(job.checksums);
+
+	SET_ERROR_RETURN_VALUE_IF_FAIL(job.error == PillBigError_Success, job.error, NULL);
+
+	return db;
+}
+
+
+
+static void *
+pillbig_db_generate_run(void *data)
+{
+	PillBigDBGenerateWorker *worker = (PillBigDBGenerateWorker *)data;
+	PillBigDBGenerateJob *job = worker->job;
+	PillBig pillbig = &worker->pillbig;
+	int first, last, i, index;
+
+	pillbig_error_clear();
+
+	for (;;)
+	{
+		pthread_mutex_lock(&job->lock);
+		first = job->next;
+		last = MIN(first + GENERATE_CHUNK_SIZE, job->count);
+		job->next = last;
+		if (job->error != PillBigError_Success)
+		{
+			last = first;
+		}
+		pthread_mutex_unlock(&job->lock);
+
+		if (first >= last)
+		{
+			break;
+		}
+
+		for (i = first; i < last && pillbig_no_error(); i++)
+		{
+			index = job->indices[i];
+			if (pillbig_file_get_type(pillbig, index) == PillBigFileType_Audio && pillbig_no_error())
+			{
+				pillbig_audio_get_samples_count(pillbig, index);
+				job->checksums[index] = pillbig_audio_get_checksum(pillbig->source,
+					pillbig->entries[index].offset, pillbig->entries[index].size);
+			}
+		}
+
+		if (pillbig_any_error())
+		{
+			pthread_mutex_lock(&job->lock);
+			if (job->error == PillBigError_Success)
+			{
+				job->error = pillbig_error_get();
+			}
+			pthread_mutex_unlock(&job->lock);
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+static PillBigDB
+pillbig_db_generate_build(PillBig pillbig, const unsigned int *checksums,
+	const char **names, int names_count)
+{
+	const PillBigEntryInfo *info;
+	PillBigDBEntry *entry;
+	PillBigFileHash hash;
+	PillBigDB db;
+	int count = pillbig->files_count;
+	int i, index;
+
+	db = (PillBigDB)malloc(sizeof(struct _PillBigDB));
+	SET_ERROR_RETURN_VALUE_IF_FAIL(db != NULL, PillBigError_SystemError, NULL);
+	memset(db, 0, sizeof(struct _PillBigDB));
+
+	db->platform      = pillbig->platform;
+	db->files_count   = count;
+	db->entries_count = count;
+	db->arena     = pillbig_arena_new(0);
+	db->entries   = (PillBigDBEntry *)calloc(MAX(count, 1), sizeof(PillBigDBEntry));
+	db->defined   = (unsigned char *)malloc(MAX(count, 1));
+	db->positions = (int *)malloc(MAX(count, 1) * sizeof(int));
+	db->buckets_count = pillbig_db_get_buckets_count(count);
+	db->buckets   = (PillBigDBBucket *)malloc(db->buckets_count * sizeof(PillBigDBBucket));
+	if (db->arena == NULL || db->entries == NULL || db->defined == NULL
+		|| db->positions == NULL || db->buckets == NULL)
+	{
+		pillbig_db_close(db);
+		db = NULL;
+	}
+	SET_ERROR_RETURN_VALUE_IF_FAIL(db != NULL, PillBigError_SystemError, NULL);
+
+	/* Every file is in the document, in index order */
+	memset(db->defined, 1, count);
+	for (i = 0; i < count; i++)
+	{
+		info  = &pillbig->infos[i];
+		entry = &db->entries[i];
+
+		db->positions[i] = i;
+		entry->hash     = pillbig->entries[i].hash;
+		entry->offset   = pillbig->entries[i].offset;
+		entry->size     = pillbig->entries[i].size;
+		entry->used     = 1;
+		entry->filetype = info->filetype;
+
+		if (entry->filetype == PillBigFileType_Audio)
+		{
+			entry->audio = (PillBigDBAudioEntry *)pillbig_arena_alloc(db->arena,
+				sizeof(PillBigDBAudioEntry));
+			if (entry->audio == NULL)
+			{
+				pillbig_db_close(db);
+				pillbig_error_set(PillBigError_SystemError);
+				return NULL;
+			}
+			entry->audio->format = info->audio_format;
+			entry->audio->rate = (info->audio_format == PillBigAudioFormat_VAG
+				|| info->audio_format == PillBigAudioFormat_ADPCM) ? AUDIO_SAMPLE_RATE : 0;
+			entry->audio->header_size = info->header_size;
+			entry->audio->checksum = checksums[i];
+			if (info->known & PillBigEntryInfo_SamplesCount)
+			{
+				entry->audio->samples_count = info->samples_count;
+			}
+		}
+	}
+	pillbig_db_fill_buckets(db, db->buckets, db->buckets_count);
+
+	/* The first candidate hashing like a file names it */
+	for (i = 0; i < names_count; i++)
+	{
+		hash = pillbig_get_hash_by_filename(names[i]);
+		index = pillbig_no_error() ? pillbig_db_get_entry_index_by_hash(db, hash) : -1;
+		if (index == -1 || db->entries[index].filename != NULL)
+		{
+			continue;
+		}
+
+		db->entries[index].filename = pillbig_arena_strdup(db->arena, names[i]);
+		if (db->entries[index].filename == NULL)
+		{
+			pillbig_db_close(db);
+			pillbig_error_set(PillBigError_SystemError);
+			return NULL;
+		}
+	}
+
+	pillbig_error_clear();
+
+	return db;
+}
@@ -0,0 +1,424 @@
+/*
+ *  libpillbig
+ *  A library to deal with Blood Omen: Legacy of Kain pill.big files.
+ */
+
+/**
+ *  @file
+ *  @brief
+ *  	Compiled database images. Implementation file.
+ *
+ *  @author  Alfonso Ruzafa <superruzafa@gmail.com>
+ *  @version SVN $Id$
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <pillbig/pillbig.h>
+#include "pillbig_internal.h"
+#include "db_internal.h"
+
+/**
+ *  String pool being built.
+ */
+typedef struct
+{
+	char            *data;        /**< Strings, NUL terminated. */
+	unsigned int     size;        /**< Bytes used. */
+	unsigned int     capacity;    /**< Bytes allocated. */
+}
+PillBigDBImagePool;
+
+/**
+ *  Gets a string of the pool of an image.
+ *
+ *  @param header
+ *  	Image header.
+ *  @param strings
+ *  	String pool.
+ *  @param offset
+ *  	String offset.
+ *  @param string
+ *  	On return, the string. NULL for DB_IMAGE_NO_STRING.
+ *  @return
+ *  	1 if the offset is valid. 0 otherwise.
+ */
+static int
+pillbig_db_image_get_string(const PillBigDBImageHeader *header, const char *strings,
+	unsigned int offset, char **string);
+
+/**
+ *  Fills the entries of a database from a mapped image.
+ *
+ *  @param db
+ *  	Database, with the image already mapped.
+ *  @return
+ *  	1 if the image is valid. 0 otherwise.
+ */
+static int
+pillbig_db_image_load(PillBigDB db);
+
+/**
+ *  Appends a string to a pool.
+ *
+ *  @param pool
+ *  	String pool.
+ *  @param string
+ *  	String. May be NULL.
+ *  @return
+ *  	String offset. DB_IMAGE_NO_STRING if string is NULL or on error.
+ */
+static unsigned int
+pillbig_db_image_add_string(PillBigDBImagePool *pool, const char *string);
+
+
+
+PillBigDB
+pillbig_db_image_open(const char *filename)
+{
+	PillBigDBImageHeader header;
+	struct stat status;
+	PillBigDB db;
+	void *image;
+	int fd;
+
+	fd = open(filename, O_RDONLY);
+	RETURN_VALUE_IF_FAIL(fd >= 0, NULL);
+
+	/* Most files aren't images, they're told apart before mapping them */
+	if (read(fd, &header, sizeof(header)) != sizeof(header)
+		|| memcmp(header.magic, DB_IMAGE_MAGIC, sizeof(header.magic)) != 0
+		|| header.version != DB_IMAGE_VERSION
+		|| header.byte_order != DB_IMAGE_BYTE_ORDER
+		|| fstat(fd, &status) != 0)
+	{
+		close(fd);
+		return NULL;
+	}
+
+	image = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	SET_ERROR_RETURN_VALUE_IF_FAIL(image != MAP_FAILED, PillBigError_SystemError, NULL);
+
+	db = (PillBigDB)malloc(sizeof(struct _PillBigDB));
+	if (db == NULL)
+	{
+		munmap(image, status.st_size);
+	}
+	SET_ERROR_RETURN_VALUE_IF_FAIL(db != NULL, PillBigError_SystemError, NULL);
+
+	memset(db, 0, sizeof(struct _PillBigDB));
+	db->image = image;
+	db->image_size = status.st_size;
+
+	if (!pillbig_db_image_load(db))
+	{
+		pillbig_db_image_close(db);
+		db = NULL;
+	}
+
+	return db;
+}
+
+void
+pillbig_db_image_close(PillBigDB db)
+{
+	/* Strings, positions and buckets live in the image */
+	pillbig_db_names_free(db->names);
+	pillbig_db_text_free(db->text);
+	pillbig_db_locale_free(db->locale);
+	pillbig_db_columns_free(db->columns);
+	if (db->entries  != NULL) free(db->entries);
+	if (db->defined  != NULL) free(db->defined);
+	if (db->audios   != NULL) free(db->audios);
+	if (db->speeches != NULL) free(db->speeches);
+	munmap(db->image, db->image_size);
+	free(db);
+}
+
+PillBigError
+pillbig_db_compile(PillBigDB db, const char *filename)
+{
+	pillbig_error_clear();
+	SET_RETURN_ERROR_IF_FAIL(db != NULL, PillBigError_UnknownError);
+	SET_RETURN_ERROR_IF_FAIL(filename != NULL, PillBigError_InvalidFilename);
+
+	PillBigDBImageHeader header;
+	PillBigDBImageEntry *entries = NULL;
+	PillBigDBImageAudio *audios = NULL;
+	PillBigDBImageSpeech *speeches = NULL;
+	PillBigDBBucket *buckets = NULL;
+	PillBigDBImagePool pool = {NULL, 0, 0};
+	const PillBigDBEntry *entry;
+	FILE *file = NULL;
+	int i, j;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, DB_IMAGE_MAGIC, sizeof(header.magic));
+	header.version = DB_IMAGE_VERSION;
+	header.byte_order = DB_IMAGE_BYTE_ORDER;
+	header.entries_count = db->entries_count;
+	header.files_count = db->files_count;
+	header.platform = db->platform;
+
+	for (i = 0; i < db->entries_count; i++)
+	{
+		entry = &db->entries[i];
+		if (db->defined[i] && entry->filetype == PillBigFileType_Audio && entry->audio != NULL)
+		{
+			header.audios_count++;
+			header.speeches_count += entry->audio->speeches_count;
+		}
+	}
+
+	header.buckets_count = pillbig_db_get_buckets_count(header.files_count);
+
+	entries  = (PillBigDBImageEntry *)calloc(MAX(header.entries_count, 1), sizeof(PillBigDBImageEntry));
+	audios   = (PillBigDBImageAudio *)calloc(MAX(header.audios_count, 1), sizeof(PillBigDBImageAudio));
+	speeches = (PillBigDBImageSpeech *)calloc(MAX(header.speeches_count, 1), sizeof(PillBigDBImageSpeech));
+	buckets  = (PillBigDBBucket *)malloc(header.buckets_count * sizeof(PillBigDBBucket));
+	SET_ERROR_IF_FAIL(entries != NULL && audios != NULL && speeches != NULL && buckets != NULL,
+		PillBigError_SystemError);
+
+	if (pillbig_no_error())
+	{
+		header.audios_count = header.speeches_count = 0;
+
+		for (i = 0; i < db->entries_count; i++)
+		{
+			entry = &db->entries[i];
+			entries[i].audio = -1;
+			if (!db->defined[i])
+			{
+				entries[i].filename = DB_IMAGE_NO_STRING;
+				continue;
+			}
+
+			entries[i].hash     = entry->hash;
+			entries[i].offset   = entry->offset;
+			entries[i].size     = entry->size;
+			entries[i].filename = pillbig_db_image_add_string(&pool, entry->filename);
+			entries[i].defined  = 1;
+			entries[i].used     = entry->used;
+			entries[i].filetype = entry->filetype;
+
+			if (entry->filetype == PillBigFileType_Audio && entry->audio != NULL)
+			{
+				PillBigDBImageAudio *audio = &audios[header.audios_count];
+
+				entries[i].audio = header.audios_count++;
+				audio->character = pillbig_db_image_add_string(&pool, entry->audio->character);
+				audio->format = entry->audio->format;
+				audio->rate = entry->audio->rate;
+				audio->samples_count = entry->audio->samples_count;
+				audio->header_size = entry->audio->header_size;
+				audio->checksum = entry->audio->checksum;
+				audio->first_speech = header.speeches_count;
+				audio->speeches_count = entry->audio->speeches_count;
+
+				for (j = 0; j < entry->audio->speeches_count; j++)
+				{
+					speeches[header.speeches_count].language =
+						pillbig_db_image_add_string(&pool, entry->audio->speeches[j].language);
+					speeches[header.speeches_count].speech =
+						pillbig_db_image_add_string(&pool, entry->audio->speeches[j].speech);
+					header.speeches_count++;
+				}
+			}
+		}
+
+		pillbig_db_fill_buckets(db, buckets, header.buckets_count);
+		header.strings_size = pool.size;
+	}
+
+	if (pillbig_no_error())
+	{
+		file = fopen(filename, "wb");
+		SET_ERROR_IF_FAIL(file != NULL, PillBigError_InvalidFilename);
+	}
+
+	if (pillbig_no_error())
+	{
+		if (fwrite(&header, sizeof(header), 1, file) != 1
+			|| fwrite(entries, sizeof(PillBigDBImageEntry), header.entries_count, file) != header.entries_count
+			|| fwrite(audios, sizeof(PillBigDBImageAudio), header.audios_count, file) != header.audios_count
+			|| fwrite(speeches, sizeof(PillBigDBImageSpeech), header.speeches_count, file) != header.speeches_count
+			|| fwrite(db->positions, sizeof(int), header.files_count, file) != header.files_count
+			|| fwrite(buckets, sizeof(PillBigDBBucket), header.buckets_count, file) != header.buckets_count
+			|| fwrite(pool.data, 1, pool.size, file) != pool.size)
+		{
+			pillbig_error_set(PillBigError_SystemError);
+		}
+		if (fclose(file) != 0)
+		{
+			pillbig_error_set(PillBigError_SystemError);
+		}
+		if (pillbig_any_error())
+		{
+			remove(filename);
+		}
+	}
+
+	if (entries  != NULL) free(entries);
+	if (audios   != NULL) free(audios);
+	if (speeches != NULL) free(speeches);
+	if (buckets  != NULL) free(buckets);
+	if (pool.data != NULL) free(pool.data);
+
+	return pillbig_error_get();
+}
+
+
+
+static int
+pillbig_db_image_get_string(const PillBigDBImageHeader *header, const char *strings,
+	unsigned int offset, char **string)
+{
+	*string = NULL;
+
+	if (offset == DB_IMAGE_NO_STRING)
+	{
+		return 1;
+	}
+	RETURN_VALUE_IF_FAIL(offset < header->strings_size, 0);
+
+	*string = (char *)&strings[offset];
+
+	return 1;
+}
+
+static int
+pillbig_db_image_load(PillBigDB db)
+{
+	const PillBigDBImageHeader *header = (const PillBigDBImageHeader *)db->image;
+	const PillBigDBImageEntry *entries;
+	const PillBigDBImageAudio *audios;
+	const PillBigDBImageSpeech *speeches;
+	const char *strings;
+	PillBigDBEntry *entry;
+	unsigned long size;
+	unsigned int i, empty_buckets;
+
+	size = sizeof(PillBigDBImageHeader)
+		+ (unsigned long)header->entries_count  * sizeof(PillBigDBImageEntry)
+		+ (unsigned long)header->audios_count   * sizeof(PillBigDBImageAudio)
+		+ (unsigned long)header->speeches_count * sizeof(PillBigDBImageSpeech)
+		+ (unsigned long)header->files_count    * sizeof(int)
+		+ (unsigned long)header->buckets_count  * sizeof(PillBigDBBucket)
+		+ header->strings_size;
+	RETURN_VALUE_IF_FAIL(size == db->image_size, 0);
+	RETURN_VALUE_IF_FAIL(header->files_count <= header->entries_count, 0);
+	RETURN_VALUE_IF_FAIL(header->buckets_count > 0
+		&& (header->buckets_count & (header->buckets_count - 1)) == 0, 0);
+
+	entries  = (const PillBigDBImageEntry *)(header + 1);
+	audios   = (const PillBigDBImageAudio *)(entries + header->entries_count);
+	speeches = (const PillBigDBImageSpeech *)(audios + header->audios_count);
+	db->positions = (int *)(speeches + header->speeches_count);
+	db->buckets = (PillBigDBBucket *)(db->positions + header->files_count);
+	strings = (const char *)(db->buckets + header->buckets_count);
+	RETURN_VALUE_IF_FAIL(header->strings_size == 0 || strings[header->strings_size - 1] == '\0', 0);
+
+	db->platform = header->platform;
+	db->files_count = header->files_count;
+	db->entries_count = header->entries_count;
+	db->buckets_count = header->buckets_count;
+
+	db->entries  = (PillBigDBEntry *)calloc(MAX(header->entries_count, 1), sizeof(PillBigDBEntry));
+	db->defined  = (unsigned char *)calloc(MAX(header->entries_count, 1), 1);
+	db->audios   = (PillBigDBAudioEntry *)calloc(MAX(header->audios_count, 1), sizeof(PillBigDBAudioEntry));
+	db->speeches = (PillBigDBAudioSpeech *)calloc(MAX(header->speeches_count, 1), sizeof(PillBigDBAudioSpeech));
+	SET_ERROR_RETURN_VALUE_IF_FAIL(db->entries != NULL && db->defined != NULL
+		&& db->audios != NULL && db->speeches != NULL, PillBigError_SystemError, 0);
+
+	/* Records only need their string offsets turned into pointers */
+	for (i = 0; i < header->speeches_count; i++)
+	{
+		RETURN_VALUE_IF_FAIL(pillbig_db_image_get_string(header, strings,
+			speeches[i].language, &db->speeches[i].language), 0);
+		RETURN_VALUE_IF_FAIL(pillbig_db_image_get_string(header, strings,
+			speeches[i].speech, &db->speeches[i].speech), 0);
+	}
+
+	for (i = 0; i < header->audios_count; i++)
+	{
+		RETURN_VALUE_IF_FAIL(audios[i].first_speech <= header->speeches_count
+			&& audios[i].speeches_count <= header->speeches_count - audios[i].first_speech, 0);
+		RETURN_VALUE_IF_FAIL(pillbig_db_image_get_string(header, strings,
+			audios[i].character, &db->audios[i].character), 0);
+		db->audios[i].format = audios[i].format;
+		db->audios[i].rate = audios[i].rate;
+		db->audios[i].samples_count = audios[i].samples_count;
+		db->audios[i].header_size = audios[i].header_size;
+		db->audios[i].checksum = audios[i].checksum;
+		db->audios[i].speeches_count = audios[i].speeches_count;
+		db->audios[i].speeches = &db->speeches[audios[i].first_speech];
+	}
+
+	for (i = 0; i < header->entries_count; i++)
+	{
+		entry = &db->entries[i];
+		db->defined[i] = entries[i].defined;
+		entry->hash = entries[i].hash;
+		entry->offset = entries[i].offset;
+		entry->size = entries[i].size;
+		entry->used = entries[i].used;
+		entry->filetype = entries[i].filetype;
+		RETURN_VALUE_IF_FAIL(pillbig_db_image_get_string(header, strings,
+			entries[i].filename, &entry->filename), 0);
+		if (entries[i].audio != -1)
+		{
+			RETURN_VALUE_IF_FAIL(0 <= entries[i].audio
+				&& entries[i].audio < (int)header->audios_count, 0);
+			entry->audio = &db->audios[entries[i].audio];
+		}
+	}
+
+	for (i = 0; i < header->files_count; i++)
+	{
+		RETURN_VALUE_IF_FAIL(0 <= db->positions[i]
+			&& db->positions[i] < (int)header->entries_count, 0);
+	}
+
+	/* Probes end at an empty bucket, there must be some */
+	empty_buckets = 0;
+	for (i = 0; i < header->buckets_count; i++)
+	{
+		RETURN_VALUE_IF_FAIL(-1 <= db->buckets[i].index
+			&& db->buckets[i].index < (int)header->entries_count, 0);
+		empty_buckets += (db->buckets[i].index == -1);
+	}
+	RETURN_VALUE_IF_FAIL(empty_buckets > 0, 0);
+
+	return 1;
+}
+
+static unsigned int
+pillbig_db_image_add_string(PillBigDBImagePool *pool, const char *string)
+{
+	unsigned int offset = pool->size;
+	unsigned int length;
+	char *data;
+
+	RETURN_VALUE_IF_FAIL(string != NULL, DB_IMAGE_NO_STRING);
+
+	length = strlen(string) + 1;
+	if (pool->size + length > pool->capacity)
+	{
+		pool->capacity = MAX(pool->capacity * 2, pool->size + length);
+		data = (char *)realloc(pool->data, pool->capacity);
+		SET_ERROR_RETURN_VALUE_IF_FAIL(data != NULL, PillBigError_SystemError,
+			DB_IMAGE_NO_STRING);
+		pool->data = data;
+	}
+
+	memcpy(&pool->data[offset], string, length);
+	pool->size += length;
+
+	return offset;
+}
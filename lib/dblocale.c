@@ -0,0 +1,389 @@
+/*
+ *  libpillbig
+ *  A library to deal with Blood Omen: Legacy of Kain pill.big files.
+ */
+
+/**
+ *  @file
+ *  @brief
+ *  	Database speech languages and locale resolution. Implementation
+ *  	file.
+ *
+ *  @author  Alfonso Ruzafa <superruzafa@gmail.com>
+ *  @version SVN $Id$
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pillbig/pillbig.h>
+#include "pillbig_internal.h"
+#include "db_internal.h"
+
+/**
+ *  Lower case of an ASCII character, languages are compared with it.
+ */
+#define LOCALE_LOWER(c) (('A' <= (c) && (c) <= 'Z') ? (c) - 'A' + 'a' : (unsigned char)(c))
+
+/**
+ *  Gets the speech languages table of a database, building it if
+ *  needed.
+ *
+ *  @param db
+ *  	Database.
+ *  @return
+ *  	Speech languages table if successful. NULL otherwise.
+ */
+static PillBigDBLocale *
+pillbig_db_locale_get(PillBigDB db);
+
+/**
+ *  Adds the languages of the database speeches to a table.
+ *
+ *  @param db
+ *  	Database.
+ *  @param locale
+ *  	Speech languages table.
+ *  @return
+ *  	Operation result.
+ */
+static PillBigError
+pillbig_db_locale_add_languages(PillBigDB db, PillBigDBLocale *locale);
+
+/**
+ *  Ranks the languages of a table and picks the preferred speech of
+ *  every file.
+ *
+ *  @param db
+ *  	Database.
+ *  @param locale
+ *  	Speech languages table, with its speeches filled.
+ *  @param locales
+ *  	Locales by preference, separated by colons. NULL for the ones
+ *  	of the environment.
+ *  @return
+ *  	Operation result.
+ */
+static PillBigError
+pillbig_db_locale_resolve(PillBigDB db, PillBigDBLocale *locale, const char *locales);
+
+/**
+ *  Gets the position of the first locale of a list a language
+ *  matches.
+ *
+ *  @param locales
+ *  	Locales by preference, separated by colons (e.g.
+ *  	es_ES.UTF-8:en).
+ *  @param language
+ *  	Language (e.g. es).
+ *  @return
+ *  	Locale position. -1 if the language matches none.
+ */
+static int
+pillbig_db_locale_get_rank(const char *locales, const char *language);
+
+
+
+int
+pillbig_db_get_languages_count(PillBigDB db)
+{
+	pillbig_error_clear();
+	SET_ERROR_RETURN_VALUE_IF_FAIL(db != NULL, PillBigError_UnknownError, -1);
+
+	PillBigDBLocale *locale = pillbig_db_locale_get(db);
+	RETURN_VALUE_IF_FAIL(locale != NULL, -1);
+
+	return locale->languages_count;
+}
+
+const char *
+pillbig_db_get_language(PillBigDB db, int language)
+{
+	pillbig_error_clear();
+	SET_ERROR_RETURN_VALUE_IF_FAIL(db != NULL, PillBigError_UnknownError, NULL);
+
+	PillBigDBLocale *locale = pillbig_db_locale_get(db);
+	RETURN_VALUE_IF_FAIL(locale != NULL, NULL);
+	SET_ERROR_RETURN_VALUE_IF_FAIL(0 <= language && language < locale->languages_count,
+		PillBigError_UnknownError, NULL);
+
+	return locale->languages[language];
+}
+
+int
+pillbig_db_get_language_id(PillBigDB db, const char *language)
+{
+	pillbig_error_clear();
+	SET_ERROR_RETURN_VALUE_IF_FAIL(db != NULL, PillBigError_UnknownError, -1);
+	SET_ERROR_RETURN_VALUE_IF_FAIL(language != NULL, PillBigError_UnknownError, -1);
+
+	PillBigDBLocale *locale = pillbig_db_locale_get(db);
+	int i;
+
+	RETURN_VALUE_IF_FAIL(locale != NULL, -1);
+
+	for (i = 0; i < locale->languages_count; i++)
+	{
+		if (strcmp(locale->languages[i], language) == 0)
+		{
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+PillBigError
+pillbig_db_set_locale(PillBigDB db, const char *locales)
+{
+	pillbig_error_clear();
+	SET_RETURN_ERROR_IF_FAIL(db != NULL, PillBigError_UnknownError);
+
+	PillBigDBLocale *locale = pillbig_db_locale_get(db);
+	RETURN_VALUE_IF_FAIL(locale != NULL, pillbig_error_get());
+
+	return pillbig_db_locale_resolve(db, locale, locales);
+}
+
+const PillBigDBAudioSpeech *
+pillbig_db_get_speech(PillBigDB db, int index, int language)
+{
+	pillbig_error_clear();
+	SET_ERROR_RETURN_VALUE_IF_FAIL(db != NULL, PillBigError_UnknownError, NULL);
+
+	PillBigDBLocale *locale = pillbig_db_locale_get(db);
+	RETURN_VALUE_IF_FAIL(locale != NULL, NULL);
+	SET_ERROR_RETURN_VALUE_IF_FAIL(0 <= index && index < db->entries_count,
+		PillBigError_UnknownError, NULL);
+	SET_ERROR_RETURN_VALUE_IF_FAIL(language == DB_LANGUAGE_PREFERRED
+		|| (0 <= language && language < locale->languages_count),
+		PillBigError_UnknownError, NULL);
+
+	if (language == DB_LANGUAGE_PREFERRED)
+	{
+		return locale->preferred[index];
+	}
+
+	return locale->speeches[index * locale->languages_count + language];
+}
+
+void
+pillbig_db_locale_free(PillBigDBLocale *locale)
+{
+	RETURN_IF_FAIL(locale != NULL);
+
+	if (locale->languages != NULL) free(locale->languages);
+	if (locale->ranks     != NULL) free(locale->ranks);
+	if (locale->speeches  != NULL) free(locale->speeches);
+	if (locale->preferred != NULL) free(locale->preferred);
+	free(locale);
+}
+
+
+
+static PillBigDBLocale *
+pillbig_db_locale_get(PillBigDB db)
+{
+	PillBigDBLocale *locale;
+	const PillBigDBAudioEntry *audio;
+	const PillBigDBAudioSpeech **speech;
+	int i, s, l;
+
+	RETURN_VALUE_IF_FAIL(db->locale == NULL, db->locale);
+
+	locale = (PillBigDBLocale *)malloc(sizeof(PillBigDBLocale));
+	SET_ERROR_RETURN_VALUE_IF_FAIL(locale != NULL, PillBigError_SystemError, NULL);
+	memset(locale, 0, sizeof(PillBigDBLocale));
+
+	if (pillbig_db_locale_add_languages(db, locale) == PillBigError_Success)
+	{
+		locale->ranks     = (int *)malloc(MAX(locale->languages_count, 1) * sizeof(int));
+		locale->speeches  = (const PillBigDBAudioSpeech **)calloc(
+			MAX(db->entries_count * locale->languages_count, 1), sizeof(PillBigDBAudioSpeech *));
+		locale->preferred = (const PillBigDBAudioSpeech **)calloc(
+			MAX(db->entries_count, 1), sizeof(PillBigDBAudioSpeech *));
+	}
+	if (locale->ranks == NULL || locale->speeches == NULL || locale->preferred == NULL)
+	{
+		pillbig_db_locale_free(locale);
+		locale = NULL;
+	}
+	SET_ERROR_RETURN_VALUE_IF_FAIL(locale != NULL, PillBigError_SystemError, NULL);
+
+	/* The first speech of a file in each language */
+	for (i = 0; i < db->entries_count; i++)
+	{
+		audio = db->entries[i].audio;
+		if (!db->defined[i] || db->entries[i].filetype != PillBigFileType_Audio || audio == NULL)
+		{
+			continue;
+		}
+
+		for (s = 0; s < audio->speeches_count; s++)
+		{
+			if (audio->speeches[s].language == NULL)
+			{
+				continue;
+			}
+			for (l = 0; strcmp(locale->languages[l], audio->speeches[s].language) != 0; l++);
+
+			speech = &locale->speeches[i * locale->languages_count + l];
+			if (*speech == NULL)
+			{
+				*speech = &audio->speeches[s];
+			}
+		}
+	}
+
+	if (pillbig_db_locale_resolve(db, locale, NULL) != PillBigError_Success)
+	{
+		pillbig_db_locale_free(locale);
+		return NULL;
+	}
+
+	db->locale = locale;
+
+	return locale;
+}
+
+static PillBigError
+pillbig_db_locale_add_languages(PillBigDB db, PillBigDBLocale *locale)
+{
+	const PillBigDBAudioEntry *audio;
+	const char **languages;
+	int i, s, l;
+
+	for (i = 0; i < db->entries_count; i++)
+	{
+		audio = db->entries[i].audio;
+		if (!db->defined[i] || db->entries[i].filetype != PillBigFileType_Audio || audio == NULL)
+		{
+			continue;
+		}
+
+		for (s = 0; s < audio->speeches_count; s++)
+		{
+			if (audio->speeches[s].language == NULL)
+			{
+				continue;
+			}
+
+			for (l = 0; l < locale->languages_count; l++)
+			{
+				if (strcmp(locale->languages[l], audio->speeches[s].language) == 0)
+				{
+					break;
+				}
+			}
+			if (l < locale->languages_count)
+			{
+				continue;
+			}
+
+			languages = (const char **)realloc(locale->languages,
+				(locale->languages_count + 1) * sizeof(const char *));
+			SET_RETURN_ERROR_IF_FAIL(languages != NULL, PillBigError_SystemError);
+
+			locale->languages = languages;
+			locale->languages[locale->languages_count++] = audio->speeches[s].language;
+		}
+	}
+
+	return PillBigError_Success;
+}
+
+static PillBigError
+pillbig_db_locale_resolve(PillBigDB db, PillBigDBLocale *locale, const char *locales)
+{
+	const PillBigDBAudioSpeech *speech, *best;
+	const char *language, *environment;
+	char *buffer = NULL;
+	int best_rank, i, l;
+
+	if (locales == NULL)
+	{
+		/* LANGUAGE lists locales by preference, then the messages locale */
+		language = getenv("LANGUAGE");
+		environment = getenv("LC_ALL");
+		if (environment == NULL || *environment == '\0') environment = getenv("LC_MESSAGES");
+		if (environment == NULL || *environment == '\0') environment = getenv("LANG");
+		if (environment == NULL) environment = "";
+
+		if (language != NULL && *language != '\0')
+		{
+			buffer = (char *)malloc(strlen(language) + strlen(environment) + 2);
+			SET_RETURN_ERROR_IF_FAIL(buffer != NULL, PillBigError_SystemError);
+			sprintf(buffer, "%s:%s", language, environment);
+		}
+		locales = (buffer != NULL) ? buffer : environment;
+	}
+
+	for (l = 0; l < locale->languages_count; l++)
+	{
+		locale->ranks[l] = pillbig_db_locale_get_rank(locales, locale->languages[l]);
+	}
+
+	if (buffer != NULL) free(buffer);
+
+	/* Speeches with text in the best ranked language, the first one if none matches */
+	for (i = 0; i < db->entries_count; i++)
+	{
+		best = NULL;
+		best_rank = -1;
+
+		for (l = 0; l < locale->languages_count; l++)
+		{
+			speech = locale->speeches[i * locale->languages_count + l];
+			if (speech == NULL || speech->speech == NULL || locale->ranks[l] == -1)
+			{
+				continue;
+			}
+			if (best == NULL || locale->ranks[l] < best_rank)
+			{
+				best = speech;
+				best_rank = locale->ranks[l];
+			}
+		}
+
+		if (best == NULL && db->defined[i] && db->entries[i].filetype == PillBigFileType_Audio
+			&& db->entries[i].audio != NULL)
+		{
+			for (l = 0; l < db->entries[i].audio->speeches_count && best == NULL; l++)
+			{
+				speech = &db->entries[i].audio->speeches[l];
+				best = (speech->speech != NULL) ? speech : NULL;
+			}
+		}
+
+		locale->preferred[i] = best;
+	}
+
+	return PillBigError_Success;
+}
+
+static int
+pillbig_db_locale_get_rank(const char *locales, const char *language)
+{
+	int rank = 0, i;
+
+	while (*locales != '\0')
+	{
+		/* The language is the locale part before the territory, codeset and modifier */
+		for (i = 0; language[i] != '\0' && LOCALE_LOWER(language[i]) == LOCALE_LOWER(locales[i]); i++);
+
+		if (i > 0 && language[i] == '\0'
+			&& (locales[i] == '\0' || strchr(":_.@-", locales[i]) != NULL))
+		{
+			return rank;
+		}
+
+		locales += strcspn(locales, ":");
+		if (*locales == ':')
+		{
+			locales++;
+		}
+		rank++;
+	}
+
+	return -1;
+}
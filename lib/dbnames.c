@@ -0,0 +1,466 @@
+/*
+ *  libpillbig
+ *  A library to deal with Blood Omen: Legacy of Kain pill.big files.
+ */
+
+/**
+ *  @file
+ *  @brief
+ *  	Database filename index. Implementation file.
+ *
+ *  @author  Alfonso Ruzafa <superruzafa@gmail.com>
+ *  @version SVN $Id$
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pillbig/pillbig.h>
+#include "pillbig_internal.h"
+#include "db_internal.h"
+
+/**
+ *  Upper case of an ASCII character, names are compared with it.
+ */
+#define NAME_UPPER(c) (('a' <= (c) && (c) <= 'z') ? (c) - 'a' + 'A' : (unsigned char)(c))
+
+/**
+ *  Gets the filename index of a database, building it if needed.
+ *
+ *  @param db
+ *  	Database.
+ *  @return
+ *  	Filename index if successful. NULL otherwise.
+ */
+static PillBigDBNameIndex *
+pillbig_db_names_get(PillBigDB db);
+
+/**
+ *  Gets the first bucket to probe for a name.
+ *
+ *  @param name
+ *  	Name.
+ *  @param buckets_count
+ *  	Count of buckets, a power of two.
+ *  @return
+ *  	Bucket.
+ */
+static unsigned int
+pillbig_db_names_get_bucket(const char *name, unsigned int buckets_count);
+
+/**
+ *  Compares two names, for sorting them.
+ */
+static int
+pillbig_db_names_compare(const void *a, const void *b);
+
+/**
+ *  Compares two names read backwards, for sorting them.
+ */
+static int
+pillbig_db_names_compare_reversed(const void *a, const void *b);
+
+/**
+ *  Compares the beginning of a name with a prefix.
+ *
+ *  @param name
+ *  	Name.
+ *  @param prefix
+ *  	Prefix.
+ *  @param length
+ *  	Prefix length.
+ *  @return
+ *  	Less than, equal to or greater than 0 if the beginning of the
+ *  	name sorts before, as or after the prefix.
+ */
+static int
+pillbig_db_names_compare_prefix(const char *name, const char *prefix, int length);
+
+/**
+ *  Compares the end of a name with a suffix, both read backwards.
+ *
+ *  @param name
+ *  	Name.
+ *  @param suffix
+ *  	Suffix.
+ *  @param length
+ *  	Suffix length.
+ *  @return
+ *  	Less than, equal to or greater than 0 if the end of the name
+ *  	sorts before, as or after the suffix.
+ */
+static int
+pillbig_db_names_compare_suffix(const char *name, const char *suffix, int length);
+
+/**
+ *  Gets the range of names sharing a prefix or a suffix.
+ *
+ *  @param names
+ *  	Sorted or reversed names.
+ *  @param count
+ *  	Count of names.
+ *  @param affix
+ *  	Prefix or suffix.
+ *  @param length
+ *  	Affix length.
+ *  @param compare
+ *  	pillbig_db_names_compare_prefix() or
+ *  	pillbig_db_names_compare_suffix().
+ *  @param last
+ *  	On return, position past the last name of the range.
+ *  @return
+ *  	Position of the first name of the range.
+ */
+static int
+pillbig_db_names_find_range(const PillBigDBName *names, int count,
+	const char *affix, int length,
+	int (*compare)(const char *, const char *, int), int *last);
+
+/**
+ *  Checks whether a name matches a pattern.
+ *
+ *  @param name
+ *  	Name.
+ *  @param pattern
+ *  	Pattern with * and ? wildcards.
+ *  @return
+ *  	1 if the name matches. 0 otherwise.
+ */
+static int
+pillbig_db_names_match(const char *name, const char *pattern);
+
+
+
+int
+pillbig_db_get_entry_index_by_filename(PillBigDB db, const char *filename)
+{
+	pillbig_error_clear();
+	SET_ERROR_RETURN_VALUE_IF_FAIL(db != NULL, PillBigError_UnknownError, -1);
+	SET_ERROR_RETURN_VALUE_IF_FAIL(filename != NULL, PillBigError_InvalidFilename, -1);
+
+	PillBigDBNameIndex *names = pillbig_db_names_get(db);
+	unsigned int bucket;
+	int index;
+
+	RETURN_VALUE_IF_FAIL(names != NULL, -1);
+
+	bucket = pillbig_db_names_get_bucket(filename, names->buckets_count);
+	while ((index = names->buckets[bucket]) != -1)
+	{
+		if (pillbig_db_names_compare_prefix(db->entries[index].filename, filename,
+			strlen(filename) + 1) == 0)
+		{
+			return index;
+		}
+		bucket = (bucket + 1) & (names->buckets_count - 1);
+	}
+
+	return -1;
+}
+
+PillBigIndexSet
+pillbig_db_find_by_prefix(PillBigDB db, const char *prefix)
+{
+	pillbig_error_clear();
+	SET_ERROR_RETURN_VALUE_IF_FAIL(db != NULL, PillBigError_UnknownError, NULL);
+	SET_ERROR_RETURN_VALUE_IF_FAIL(prefix != NULL, PillBigError_InvalidFilename, NULL);
+
+	PillBigDBNameIndex *names = pillbig_db_names_get(db);
+	PillBigIndexSet set;
+	int first, last;
+
+	RETURN_VALUE_IF_FAIL(names != NULL, NULL);
+
+	set = pillbig_index_set_new(db->entries_count);
+	RETURN_VALUE_IF_FAIL(set != NULL, NULL);
+
+	first = pillbig_db_names_find_range(names->sorted, names->count, prefix, strlen(prefix),
+		pillbig_db_names_compare_prefix, &last);
+	while (first < last)
+	{
+		pillbig_index_set_add(set, names->sorted[first++].index);
+	}
+
+	return set;
+}
+
+PillBigIndexSet
+pillbig_db_find_by_pattern(PillBigDB db, const char *pattern)
+{
+	pillbig_error_clear();
+	SET_ERROR_RETURN_VALUE_IF_FAIL(db != NULL, PillBigError_UnknownError, NULL);
+	SET_ERROR_RETURN_VALUE_IF_FAIL(pattern != NULL, PillBigError_InvalidFilename, NULL);
+
+	PillBigDBNameIndex *names = pillbig_db_names_get(db);
+	const PillBigDBName *candidates;
+	PillBigIndexSet set;
+	int prefix_length, suffix_length, length, first, last, index;
+
+	RETURN_VALUE_IF_FAIL(names != NULL, NULL);
+
+	set = pillbig_index_set_new(db->entries_count);
+	RETURN_VALUE_IF_FAIL(set != NULL, NULL);
+
+	length = strlen(pattern);
+	prefix_length = strcspn(pattern, "*?");
+
+	if (prefix_length == length)
+	{
+		/* No wildcards, an exact name */
+		index = pillbig_db_get_entry_index_by_filename(db, pattern);
+		if (index != -1)
+		{
+			pillbig_index_set_add(set, index);
+		}
+		return set;
+	}
+
+	for (suffix_length = 0; suffix_length < length; suffix_length++)
+	{
+		if (pattern[length - suffix_length - 1] == '*' || pattern[length - suffix_length - 1] == '?')
+		{
+			break;
+		}
+	}
+
+	/* Only the names sharing the longest literal affix are candidates */
+	if (prefix_length >= suffix_length)
+	{
+		candidates = names->sorted;
+		first = pillbig_db_names_find_range(candidates, names->count, pattern, prefix_length,
+			pillbig_db_names_compare_prefix, &last);
+	}
+	else
+	{
+		candidates = names->reversed;
+		first = pillbig_db_names_find_range(candidates, names->count,
+			&pattern[length - suffix_length], suffix_length,
+			pillbig_db_names_compare_suffix, &last);
+	}
+
+	for (; first < last; first++)
+	{
+		if (pillbig_db_names_match(candidates[first].name, pattern))
+		{
+			pillbig_index_set_add(set, candidates[first].index);
+		}
+	}
+
+	return set;
+}
+
+void
+pillbig_db_names_free(PillBigDBNameIndex *names)
+{
+	RETURN_IF_FAIL(names != NULL);
+
+	if (names->buckets  != NULL) free(names->buckets);
+	if (names->sorted   != NULL) free(names->sorted);
+	if (names->reversed != NULL) free(names->reversed);
+	free(names);
+}
+
+
+
+static PillBigDBNameIndex *
+pillbig_db_names_get(PillBigDB db)
+{
+	PillBigDBNameIndex *names;
+	unsigned int bucket;
+	int i;
+
+	RETURN_VALUE_IF_FAIL(db->names == NULL, db->names);
+
+	names = (PillBigDBNameIndex *)malloc(sizeof(PillBigDBNameIndex));
+	SET_ERROR_RETURN_VALUE_IF_FAIL(names != NULL, PillBigError_SystemError, NULL);
+	memset(names, 0, sizeof(PillBigDBNameIndex));
+
+	for (i = 0; i < db->entries_count; i++)
+	{
+		names->count += (db->defined[i] && db->entries[i].filename != NULL);
+	}
+
+	names->buckets_count = pillbig_db_get_buckets_count(names->count);
+	names->buckets  = (int *)malloc(names->buckets_count * sizeof(int));
+	names->sorted   = (PillBigDBName *)malloc(MAX(names->count, 1) * sizeof(PillBigDBName));
+	names->reversed = (PillBigDBName *)malloc(MAX(names->count, 1) * sizeof(PillBigDBName));
+	if (names->buckets == NULL || names->sorted == NULL || names->reversed == NULL)
+	{
+		pillbig_db_names_free(names);
+		names = NULL;
+	}
+	SET_ERROR_RETURN_VALUE_IF_FAIL(names != NULL, PillBigError_SystemError, NULL);
+
+	memset(names->buckets, 0xFF, names->buckets_count * sizeof(int));
+	names->count = 0;
+
+	for (i = 0; i < db->entries_count; i++)
+	{
+		if (!db->defined[i] || db->entries[i].filename == NULL)
+		{
+			continue;
+		}
+
+		names->sorted[names->count].name  = db->entries[i].filename;
+		names->sorted[names->count].index = i;
+		names->count++;
+
+		/* Repeated names resolve to the lowest index */
+		bucket = pillbig_db_names_get_bucket(db->entries[i].filename, names->buckets_count);
+		while (names->buckets[bucket] != -1)
+		{
+			if (pillbig_db_names_compare_prefix(db->entries[names->buckets[bucket]].filename,
+				db->entries[i].filename, strlen(db->entries[i].filename) + 1) == 0)
+			{
+				break;
+			}
+			bucket = (bucket + 1) & (names->buckets_count - 1);
+		}
+		if (names->buckets[bucket] == -1)
+		{
+			names->buckets[bucket] = i;
+		}
+	}
+
+	memcpy(names->reversed, names->sorted, names->count * sizeof(PillBigDBName));
+	qsort(names->sorted, names->count, sizeof(PillBigDBName), pillbig_db_names_compare);
+	qsort(names->reversed, names->count, sizeof(PillBigDBName), pillbig_db_names_compare_reversed);
+
+	db->names = names;
+
+	return names;
+}
+
+static unsigned int
+pillbig_db_names_get_bucket(const char *name, unsigned int buckets_count)
+{
+	unsigned int hash = 2166136261u;
+
+	while (*name != '\0')
+	{
+		hash = (hash ^ NAME_UPPER(*name)) * 16777619u;
+		name++;
+	}
+
+	return hash & (buckets_count - 1);
+}
+
+static int
+pillbig_db_names_compare(const void *a, const void *b)
+{
+	const char *name = ((const PillBigDBName *)a)->name;
+	const char *other = ((const PillBigDBName *)b)->name;
+
+	return pillbig_db_names_compare_prefix(name, other, strlen(other) + 1);
+}
+
+static int
+pillbig_db_names_compare_reversed(const void *a, const void *b)
+{
+	const char *name = ((const PillBigDBName *)a)->name;
+	const char *other = ((const PillBigDBName *)b)->name;
+	int result = pillbig_db_names_compare_suffix(name, other, strlen(other));
+
+	/* A name ending the other one sorts first */
+	return (result != 0) ? result : (int)strlen(name) - (int)strlen(other);
+}
+
+static int
+pillbig_db_names_compare_prefix(const char *name, const char *prefix, int length)
+{
+	int i;
+
+	for (i = 0; i < length; i++)
+	{
+		if (NAME_UPPER(name[i]) != NAME_UPPER(prefix[i]) || name[i] == '\0')
+		{
+			return NAME_UPPER(name[i]) - NAME_UPPER(prefix[i]);
+		}
+	}
+
+	return 0;
+}
+
+static int
+pillbig_db_names_compare_suffix(const char *name, const char *suffix, int length)
+{
+	int name_length = strlen(name);
+	int i;
+
+	for (i = 0; i < length; i++)
+	{
+		if (i == name_length)
+		{
+			return -1;
+		}
+		if (NAME_UPPER(name[name_length - i - 1]) != NAME_UPPER(suffix[length - i - 1]))
+		{
+			return NAME_UPPER(name[name_length - i - 1]) - NAME_UPPER(suffix[length - i - 1]);
+		}
+	}
+
+	return 0;
+}
+
+static int
+pillbig_db_names_find_range(const PillBigDBName *names, int count,
+	const char *affix, int length,
+	int (*compare)(const char *, const char *, int), int *last)
+{
+	int low = 0, high = count, middle, first;
+
+	while (low < high)
+	{
+		middle = (low + high) / 2;
+		if (compare(names[middle].name, affix, length) < 0) low = middle + 1;
+		else high = middle;
+	}
+	first = low;
+
+	high = count;
+	while (low < high)
+	{
+		middle = (low + high) / 2;
+		if (compare(names[middle].name, affix, length) <= 0) low = middle + 1;
+		else high = middle;
+	}
+	*last = low;
+
+	return first;
+}
+
+static int
+pillbig_db_names_match(const char *name, const char *pattern)
+{
+	const char *star = NULL, *resume = NULL;
+
+	while (*name != '\0')
+	{
+		if (*pattern == '*')
+		{
+			star = pattern++;
+			resume = name;
+		}
+		else if (*pattern != '\0' && (*pattern == '?' || NAME_UPPER(*pattern) == NAME_UPPER(*name)))
+		{
+			pattern++;
+			name++;
+		}
+		else if (star != NULL)
+		{
+			/* The last star takes one more character */
+			pattern = star + 1;
+			name = ++resume;
+		}
+		else
+		{
+			return 0;
+		}
+	}
+
+	while (*pattern == '*')
+	{
+		pattern++;
+	}
+
+	return *pattern == '\0';
+}
@@ -0,0 +1,613 @@
+/*
+ *  libpillbig
+ *  A library to deal with Blood Omen: Legacy of Kain pill.big files.
+ */
+
+/**
+ *  @file
+ *  @brief
+ *  	Database speeches index. Implementation file.
+ *
+ *  @author  Alfonso Ruzafa <superruzafa@gmail.com>
+ *  @version SVN $Id$
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pillbig/pillbig.h>
+#include "pillbig_internal.h"
+#include "db_internal.h"
+
+/**
+ *  Size of the term buffers. Longer terms are cut.
+ */
+#define TEXT_TERM_SIZE 64
+
+/**
+ *  Highest count of query terms. The following ones are ignored.
+ */
+#define TEXT_QUERY_TERMS 16
+
+/**
+ *  @brief
+ *  	Term of a speech, while the index is being built.
+ */
+typedef struct
+{
+	const char  *term;        /**< Folded term, interned. */
+	int          language;    /**< Language ID. */
+	int          index;       /**< File index. */
+}
+PillBigDBOccurrence;
+
+/**
+ *  @brief
+ *  	Search state of a file.
+ */
+typedef struct
+{
+	int       language;    /**< Language ID plus one being matched. 0 if none yet. */
+	int       terms;       /**< Count of query terms matched in that language. */
+	double    score;       /**< Score in that language. */
+	int       result;      /**< Result position. -1 if not found yet. */
+}
+PillBigDBTextHit;
+
+/**
+ *  @brief
+ *  	File found by a search.
+ */
+typedef struct
+{
+	int       index;    /**< File index. */
+	double    score;    /**< Best score among the languages. */
+}
+PillBigDBTextResult;
+
+/**
+ *  Folded forms of the U+00C0 to U+00FF characters, encoded as 0xC3
+ *  0x80 to 0xC3 0xBF. NULL for the ones which aren't letters.
+ */
+static const char *text_latin1_folds[64] =
+{
+	"a", "a", "a", "a", "a", "a", "ae", "c", "e", "e", "e", "e", "i", "i", "i", "i",
+	"d", "n", "o", "o", "o", "o", "o", NULL, "o", "u", "u", "u", "u", "y", "th", "ss",
+	"a", "a", "a", "a", "a", "a", "ae", "c", "e", "e", "e", "e", "i", "i", "i", "i",
+	"d", "n", "o", "o", "o", "o", "o", NULL, "o", "u", "u", "u", "u", "y", "th", "y"
+};
+
+/**
+ *  Gets the speeches index of a database, building it if needed.
+ *
+ *  @param db
+ *  	Database.
+ *  @return
+ *  	Speeches index if successful. NULL otherwise.
+ */
+static PillBigDBTextIndex *
+pillbig_db_text_get(PillBigDB db);
+
+/**
+ *  Adds the terms of a database to a speeches index.
+ *
+ *  @param db
+ *  	Database.
+ *  @param text
+ *  	Speeches index, with its arena created.
+ *  @param occurrences
+ *  	On return, the terms of every speech. To be freed.
+ *  @return
+ *  	Count of occurrences. -1 on error.
+ */
+static int
+pillbig_db_text_get_occurrences(PillBigDB db, PillBigDBTextIndex *text,
+	PillBigDBOccurrence **occurrences);
+
+/**
+ *  Gets the next term of a text.
+ *
+ *  @param text
+ *  	Text, in UTF-8.
+ *  @param term
+ *  	On return, the folded term. TEXT_TERM_SIZE bytes long.
+ *  @return
+ *  	Position of the text after the term. NULL if there are no more
+ *  	terms.
+ */
+static const char *
+pillbig_db_text_next_term(const char *text, char *term);
+
+/**
+ *  Folds a character of a text.
+ *
+ *  @param text
+ *  	Text, in UTF-8.
+ *  @param folded
+ *  	On return, the folded character. Empty if it separates terms.
+ *  	5 bytes long.
+ *  @return
+ *  	Count of bytes of the character.
+ */
+static int
+pillbig_db_text_fold(const char *text, char *folded);
+
+/**
+ *  Gets a term of a speeches index.
+ *
+ *  @param text
+ *  	Speeches index.
+ *  @param term
+ *  	Folded term.
+ *  @param language
+ *  	Language ID.
+ *  @return
+ *  	Term bucket. Its term is NULL if the term isn't in the index.
+ */
+static PillBigDBTerm *
+pillbig_db_text_get_term(PillBigDBTextIndex *text, const char *term, int language);
+
+/**
+ *  Compares two occurrences by language, term and file index, for
+ *  sorting them.
+ */
+static int
+pillbig_db_text_compare_occurrences(const void *a, const void *b);
+
+/**
+ *  Compares two results by score and file index, for sorting them.
+ */
+static int
+pillbig_db_text_compare_results(const void *a, const void *b);
+
+
+
+int
+pillbig_db_search_speeches(PillBigDB db, const char *query, const char *language,
+	const char *character, int *indices, int max_count)
+{
+	pillbig_error_clear();
+	SET_ERROR_RETURN_VALUE_IF_FAIL(db != NULL, PillBigError_UnknownError, -1);
+	SET_ERROR_RETURN_VALUE_IF_FAIL(query != NULL, PillBigError_UnknownError, -1);
+	SET_ERROR_RETURN_VALUE_IF_FAIL(indices != NULL || max_count <= 0, PillBigError_UnknownError, -1);
+
+	PillBigDBTextIndex *text = pillbig_db_text_get(db);
+	char terms[TEXT_QUERY_TERMS][TEXT_TERM_SIZE];
+	PillBigDBTextHit *hits;
+	PillBigDBTextResult *results;
+	const PillBigDBTerm *term;
+	const PillBigDBPosting *posting;
+	const char *character_found;
+	PillBigDBTextHit *hit;
+	int terms_count = 0, results_count = 0;
+	int first_language, last_language, l, t, p, i;
+	double weight;
+
+	RETURN_VALUE_IF_FAIL(text != NULL, -1);
+
+	/* Query terms, each one once */
+	while (terms_count < TEXT_QUERY_TERMS && (query = pillbig_db_text_next_term(query, terms[terms_count])) != NULL)
+	{
+		for (i = 0; i < terms_count && strcmp(terms[i], terms[terms_count]) != 0; i++);
+		terms_count += (i == terms_count);
+	}
+	RETURN_VALUE_IF_FAIL(terms_count > 0, 0);
+
+	if (language != NULL)
+	{
+		first_language = pillbig_db_get_language_id(db, language);
+		RETURN_VALUE_IF_FAIL(first_language != -1, 0);
+		last_language = first_language + 1;
+	}
+	else
+	{
+		first_language = 0;
+		last_language = text->languages_count;
+	}
+
+	hits = (PillBigDBTextHit *)calloc(MAX(db->entries_count, 1), sizeof(PillBigDBTextHit));
+	results = (PillBigDBTextResult *)malloc(MAX(db->entries_count, 1) * sizeof(PillBigDBTextResult));
+	if (hits == NULL || results == NULL)
+	{
+		if (hits    != NULL) free(hits);
+		if (results != NULL) free(results);
+		hits = NULL;
+	}
+	SET_ERROR_RETURN_VALUE_IF_FAIL(hits != NULL, PillBigError_SystemError, -1);
+
+	for (i = 0; i < db->entries_count; i++)
+	{
+		hits[i].result = -1;
+	}
+
+	for (l = first_language; l < last_language; l++)
+	{
+		/* A file stays a candidate while it has every term so far */
+		for (t = 0; t < terms_count; t++)
+		{
+			term = pillbig_db_text_get_term(text, terms[t], l);
+			if (term->term == NULL)
+			{
+				break;
+			}
+
+			weight = log(1.0 + (double)text->files_counts[l] / term->count);
+			for (p = 0; p < term->count; p++)
+			{
+				posting = &text->postings[term->first + p];
+				hit = &hits[posting->index];
+
+				if (hit->language != l + 1)
+				{
+					hit->language = l + 1;
+					hit->terms = 0;
+					hit->score = 0.0;
+				}
+				if (hit->terms != t)
+				{
+					continue;
+				}
+
+				hit->terms++;
+				hit->score += (1.0 + log((double)posting->count)) * weight;
+
+				if (hit->terms < terms_count)
+				{
+					continue;
+				}
+
+				character_found = db->entries[posting->index].audio->character;
+				if (character != NULL && (character_found == NULL || strcmp(character_found, character) != 0))
+				{
+					continue;
+				}
+
+				if (hit->result == -1)
+				{
+					hit->result = results_count++;
+					results[hit->result].index = posting->index;
+					results[hit->result].score = hit->score;
+				}
+				else
+				{
+					results[hit->result].score = MAX(results[hit->result].score, hit->score);
+				}
+			}
+		}
+	}
+
+	qsort(results, results_count, sizeof(PillBigDBTextResult), pillbig_db_text_compare_results);
+	for (i = 0; i < results_count && i < max_count; i++)
+	{
+		indices[i] = results[i].index;
+	}
+
+	free(hits);
+	free(results);
+
+	return results_count;
+}
+
+void
+pillbig_db_text_free(PillBigDBTextIndex *text)
+{
+	RETURN_IF_FAIL(text != NULL);
+
+	pillbig_arena_free(text->arena);
+	if (text->files_counts != NULL) free(text->files_counts);
+	if (text->terms        != NULL) free(text->terms);
+	if (text->postings     != NULL) free(text->postings);
+	free(text);
+}
+
+
+
+static PillBigDBTextIndex *
+pillbig_db_text_get(PillBigDB db)
+{
+	PillBigDBTextIndex *text;
+	PillBigDBOccurrence *occurrences = NULL;
+	PillBigDBTerm *term = NULL;
+	int occurrences_count, terms_count, postings_count, i;
+
+	RETURN_VALUE_IF_FAIL(db->text == NULL, db->text);
+
+	text = (PillBigDBTextIndex *)malloc(sizeof(PillBigDBTextIndex));
+	SET_ERROR_RETURN_VALUE_IF_FAIL(text != NULL, PillBigError_SystemError, NULL);
+	memset(text, 0, sizeof(PillBigDBTextIndex));
+
+	text->arena = pillbig_arena_new(0);
+	occurrences_count = (text->arena != NULL)
+		? pillbig_db_text_get_occurrences(db, text, &occurrences)
+		: -1;
+	if (occurrences_count == -1)
+	{
+		pillbig_db_text_free(text);
+		return NULL;
+	}
+
+	/* Equal terms of a file and language come together */
+	qsort(occurrences, occurrences_count, sizeof(PillBigDBOccurrence),
+		pillbig_db_text_compare_occurrences);
+
+	terms_count = postings_count = 0;
+	for (i = 0; i < occurrences_count; i++)
+	{
+		if (i == 0
+			|| occurrences[i].term != occurrences[i - 1].term
+			|| occurrences[i].language != occurrences[i - 1].language)
+		{
+			terms_count++;
+			postings_count++;
+		}
+		else if (occurrences[i].index != occurrences[i - 1].index)
+		{
+			postings_count++;
+		}
+	}
+
+	text->terms_count = pillbig_db_get_buckets_count(terms_count);
+	text->terms = (PillBigDBTerm *)calloc(text->terms_count, sizeof(PillBigDBTerm));
+	text->postings = (PillBigDBPosting *)malloc(MAX(postings_count, 1) * sizeof(PillBigDBPosting));
+	if (text->terms == NULL || text->postings == NULL)
+	{
+		free(occurrences);
+		pillbig_db_text_free(text);
+		text = NULL;
+	}
+	SET_ERROR_RETURN_VALUE_IF_FAIL(text != NULL, PillBigError_SystemError, NULL);
+
+	postings_count = 0;
+	for (i = 0; i < occurrences_count; i++)
+	{
+		if (i == 0
+			|| occurrences[i].term != occurrences[i - 1].term
+			|| occurrences[i].language != occurrences[i - 1].language)
+		{
+			term = pillbig_db_text_get_term(text, occurrences[i].term, occurrences[i].language);
+			term->term     = occurrences[i].term;
+			term->language = occurrences[i].language;
+			term->first    = postings_count;
+		}
+		else if (occurrences[i].index == occurrences[i - 1].index)
+		{
+			text->postings[postings_count - 1].count++;
+			continue;
+		}
+
+		text->postings[postings_count].index = occurrences[i].index;
+		text->postings[postings_count].count = 1;
+		postings_count++;
+		term->count++;
+	}
+
+	if (occurrences != NULL) free(occurrences);
+	db->text = text;
+
+	return text;
+}
+
+static int
+pillbig_db_text_get_occurrences(PillBigDB db, PillBigDBTextIndex *text,
+	PillBigDBOccurrence **occurrences)
+{
+	PillBigDBOccurrence *list = NULL, *grown;
+	const PillBigDBAudioEntry *audio;
+	const char *speech;
+	char term[TEXT_TERM_SIZE];
+	int count = 0, capacity = 0;
+	int language, i, s, previous;
+
+	text->languages_count = pillbig_db_get_languages_count(db);
+	RETURN_VALUE_IF_FAIL(text->languages_count != -1, -1);
+
+	text->files_counts = (int *)calloc(MAX(text->languages_count, 1), sizeof(int));
+	SET_ERROR_RETURN_VALUE_IF_FAIL(text->files_counts != NULL, PillBigError_SystemError, -1);
+
+	for (i = 0; i < db->entries_count; i++)
+	{
+		if (!db->defined[i] || db->entries[i].filetype != PillBigFileType_Audio
+			|| db->entries[i].audio == NULL)
+		{
+			continue;
+		}
+
+		audio = db->entries[i].audio;
+		for (s = 0; s < audio->speeches_count; s++)
+		{
+			if (audio->speeches[s].language == NULL || audio->speeches[s].speech == NULL)
+			{
+				continue;
+			}
+
+			language = pillbig_db_get_language_id(db, audio->speeches[s].language);
+
+			/* Files are counted once per language */
+			for (previous = 0; previous < s; previous++)
+			{
+				if (audio->speeches[previous].language != NULL
+					&& audio->speeches[previous].speech != NULL
+					&& strcmp(audio->speeches[previous].language, audio->speeches[s].language) == 0)
+				{
+					break;
+				}
+			}
+			text->files_counts[language] += (previous == s);
+
+			speech = audio->speeches[s].speech;
+			while ((speech = pillbig_db_text_next_term(speech, term)) != NULL)
+			{
+				if (count == capacity)
+				{
+					capacity = MAX(2 * capacity, 1024);
+					grown = (PillBigDBOccurrence *)realloc(list, capacity * sizeof(PillBigDBOccurrence));
+					if (grown == NULL)
+					{
+						if (list != NULL) free(list);
+					}
+					SET_ERROR_RETURN_VALUE_IF_FAIL(grown != NULL, PillBigError_SystemError, -1);
+					list = grown;
+				}
+
+				/* Interned, so equal terms are told by their address */
+				list[count].term = pillbig_arena_intern(text->arena, term);
+				if (list[count].term == NULL)
+				{
+					free(list);
+					return -1;
+				}
+				list[count].language = language;
+				list[count].index = i;
+				count++;
+			}
+		}
+	}
+
+	*occurrences = list;
+
+	return count;
+}
+
+static const char *
+pillbig_db_text_next_term(const char *text, char *term)
+{
+	char folded[5];
+	int length = 0, size, folded_length;
+
+	/* Separators before the term */
+	while (*text != '\0')
+	{
+		size = pillbig_db_text_fold(text, folded);
+		if (folded[0] != '\0')
+		{
+			break;
+		}
+		text += size;
+	}
+	RETURN_VALUE_IF_FAIL(*text != '\0', NULL);
+
+	while (*text != '\0')
+	{
+		size = pillbig_db_text_fold(text, folded);
+		if (folded[0] == '\0')
+		{
+			break;
+		}
+
+		folded_length = strlen(folded);
+		if (length + folded_length < TEXT_TERM_SIZE)
+		{
+			memcpy(&term[length], folded, folded_length);
+			length += folded_length;
+		}
+		text += size;
+	}
+	term[length] = '\0';
+
+	return text;
+}
+
+static int
+pillbig_db_text_fold(const char *text, char *folded)
+{
+	const unsigned char *c = (const unsigned char *)text;
+	int size, i;
+
+	folded[0] = '\0';
+
+	if (c[0] < 0x80)
+	{
+		if (('a' <= c[0] && c[0] <= 'z') || ('0' <= c[0] && c[0] <= '9'))
+		{
+			folded[0] = c[0];
+			folded[1] = '\0';
+		}
+		else if ('A' <= c[0] && c[0] <= 'Z')
+		{
+			folded[0] = c[0] - 'A' + 'a';
+			folded[1] = '\0';
+		}
+		return 1;
+	}
+
+	size = (c[0] >= 0xF0) ? 4 : (c[0] >= 0xE0) ? 3 : (c[0] >= 0xC0) ? 2 : 1;
+	for (i = 1; i < size; i++)
+	{
+		/* Truncated sequences are taken byte by byte */
+		RETURN_VALUE_IF_FAIL((c[i] & 0xC0) == 0x80, 1);
+	}
+
+	if (c[0] == 0xC3)
+	{
+		if (text_latin1_folds[c[1] - 0x80] != NULL)
+		{
+			strcpy(folded, text_latin1_folds[c[1] - 0x80]);
+		}
+	}
+	else if (c[0] == 0xC2 || (c[0] == 0xE2 && c[1] == 0x80))
+	{
+		/* Latin-1 symbols and general punctuation separate terms */
+	}
+	else
+	{
+		memcpy(folded, text, size);
+		folded[size] = '\0';
+	}
+
+	return size;
+}
+
+static PillBigDBTerm *
+pillbig_db_text_get_term(PillBigDBTextIndex *text, const char *term, int language)
+{
+	unsigned int hash = 2166136261u;
+	const char *c;
+
+	for (c = term; *c != '\0'; c++)
+	{
+		hash = (hash ^ (unsigned char)*c) * 16777619u;
+	}
+	hash = (hash ^ (unsigned int)language) * 16777619u;
+	hash &= text->terms_count - 1;
+
+	while (text->terms[hash].term != NULL)
+	{
+		if (text->terms[hash].language == language && strcmp(text->terms[hash].term, term) == 0)
+		{
+			break;
+		}
+		hash = (hash + 1) & (text->terms_count - 1);
+	}
+
+	return &text->terms[hash];
+}
+
+static int
+pillbig_db_text_compare_occurrences(const void *a, const void *b)
+{
+	const PillBigDBOccurrence *occurrence = (const PillBigDBOccurrence *)a;
+	const PillBigDBOccurrence *other = (const PillBigDBOccurrence *)b;
+	int result;
+
+	RETURN_VALUE_IF_FAIL(occurrence->language == other->language,
+		occurrence->language - other->language);
+
+	result = strcmp(occurrence->term, other->term);
+	RETURN_VALUE_IF_FAIL(result == 0, result);
+
+	return occurrence->index - other->index;
+}
+
+static int
+pillbig_db_text_compare_results(const void *a, const void *b)
+{
+	const PillBigDBTextResult *result = (const PillBigDBTextResult *)a;
+	const PillBigDBTextResult *other = (const PillBigDBTextResult *)b;
+
+	if (result->score != other->score)
+	{
+		return (result->score > other->score) ? -1 : 1;
+	}
+
+	return result->index - other->index;
+}
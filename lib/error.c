@@ -15,7 +15,14 @@
 #include <pillbig/error.h>
 #include "error_internal.h"
 
+/*
+ * Each thread has its own error, so probing workers don't clobber it.
+ */
+#if defined(__GNUC__)
+static __thread PillBigError last_error = PillBigError_Success;
+#else
 static PillBigError last_error = PillBigError_Success;
+#endif
 
 PillBigError
 pillbig_error_get()
@@ -14,11 +14,13 @@
 
 
 
+#include <stdlib.h>
 #include <malloc.h>
 #include <string.h>
 #include <ctype.h>
 #include <pillbig/pillbig.h>
 #include "pillbig_internal.h"
+#include "filetype_internal.h"
 
 
 
@@ -44,9 +46,25 @@ pillbig_read_file_entries(PillBig pillbig);
 static PillBigPlatform
 pillbig_guess_platform(PillBig pillbig);
 
+/**
+ *  Guesses the type of a pill.big file from its contents.
+ *
+ *  @param pillbig
+ *  	PillBig object.
+ *  @param index
+ *  	pill.big file index.
+ *  @return
+ *  	PillBigFileType.
+ */
 static PillBigFileType
 pillbig_guess_filetype(PillBig pillbig, int index);
 
+/**
+ *  Compares two file entries offsets. Callback for qsort().
+ */
+static int
+pillbig_compare_offsets(const void *a, const void *b);
+
 PillBig
 pillbig_open(FILE *input)
 {
@@ -54,6 +72,29 @@ pillbig_open(FILE *input)
 	SET_ERROR_RETURN_VALUE_IF_FAIL(input != NULL,
 		PillBigError_InvalidStream, NULL);
 
+	PillBigSource source = pillbig_source_new_from_file(input);
+	RETURN_VALUE_IF_FAIL(source != NULL, NULL);
+
+	PillBig pillbig = pillbig_open_from_source(source);
+	if (pillbig == NULL)
+	{
+		pillbig_source_free(source);
+		return NULL;
+	}
+
+	pillbig->pillbig     = input;
+	pillbig->free_source = 1;
+
+	return pillbig;
+}
+
+PillBig
+pillbig_open_from_source(PillBigSource source)
+{
+	pillbig_error_clear();
+	SET_ERROR_RETURN_VALUE_IF_FAIL(source != NULL,
+		PillBigError_InvalidStream, NULL);
+
 	PillBig pillbig = (PillBig)malloc(sizeof(struct _PillBig));
 	SET_ERROR_RETURN_VALUE_IF_FAIL(pillbig != NULL,
 		PillBigError_SystemError, NULL);
@@ -62,9 +103,16 @@ pillbig_open(FILE *input)
 	 * Initialize the object.
 	 */
 	memset(pillbig, 0, sizeof(struct _PillBig));
-	pillbig->pillbig      = input;
+	pillbig->source       = source;
 	pillbig->platform     = PillBigPlatform_Unknown;
 	pillbig->replace_mode = PillBigReplaceMode_Strict;
+	pillbig->sample_rate  = AUDIO_SAMPLE_RATE;
+
+	/*
+	 * The files count and the entries table are read next. Remote
+	 * sources get the largest table of any platform in one request.
+	 */
+	pillbig_source_prefetch(source, 0, 4 + MAX(FILES_COUNT_PC, FILES_COUNT_PSX) * 12);
 
 	/*
 	 * Try to guess the pill.big platform.
@@ -106,6 +154,10 @@ pillbig_open(FILE *input)
 		{
 			free(pillbig->entries);
 		}
+		if (pillbig->infos != NULL)
+		{
+			free(pillbig->infos);
+		}
 		free(pillbig);
 		pillbig = NULL;
 	}
@@ -290,6 +342,14 @@ pillbig_set_db(PillBig pillbig, PillBigDB db)
 	SET_ERROR_RETURN_IF_FAIL(db != NULL,
 		PillBigError_UnknownError);
 
+	unsigned int i;
+
+	/* Entries of the new database are checked again before trusting them */
+	for (i = 0; i < pillbig->files_count; i++)
+	{
+		pillbig->infos[i].known &= ~PillBigEntryInfo_Database;
+	}
+
 	pillbig->db = db;
 }
 
@@ -313,13 +373,15 @@ pillbig_file_get_type(PillBig pillbig, int index)
 
 	PillBigFileType filetype = PillBigFileType_Unknown;
 
-	if (pillbig->db != NULL)
+	/*
+	 * The database is trusted, even when it doesn't know the file type.
+	 * Only files missing from it are classified.
+	 */
+	const PillBigDBEntry *dbentry = (pillbig->db != NULL) ?
+		pillbig_db_get_entry(pillbig->db, index) : NULL;
+	if (dbentry != NULL)
 	{
-		const PillBigDBEntry *dbentry = pillbig_db_get_entry(pillbig->db, index);
-		if (dbentry != NULL)
-		{
-			filetype = dbentry->filetype;
-		}
+		filetype = dbentry->filetype;
 	}
 	else
 	{
@@ -329,10 +391,80 @@ pillbig_file_get_type(PillBig pillbig, int index)
 	return filetype;
 }
 
+PillBigError
+pillbig_file_get_types(PillBig pillbig, PillBigFileType *filetypes)
+{
+	pillbig_error_clear();
+	SET_RETURN_ERROR_IF_FAIL(pillbig != NULL,
+		PillBigError_InvalidPillBigObject);
+	SET_RETURN_ERROR_IF_FAIL(filetypes != NULL, PillBigError_UnknownError);
+
+	int i;
+
+	pillbig_probe_entries(pillbig, 0);
+	for (i = 0; i < pillbig->files_count && pillbig_no_error(); i++)
+	{
+		filetypes[i] = pillbig_file_get_type(pillbig, i);
+	}
+
+	return pillbig_error_get();
+}
+
+PillBigError
+pillbig_probe_entries(PillBig pillbig, int count_samples)
+{
+	pillbig_error_clear();
+	SET_RETURN_ERROR_IF_FAIL(pillbig != NULL,
+		PillBigError_InvalidPillBigObject);
+
+	PillBigEntryInfo *info;
+	int *indices;
+	int i, index;
+
+	/*
+	 * Probing in offset order keeps pill.big reads sequential.
+	 */
+	indices = pillbig_get_indices_by_offset(pillbig);
+	SET_RETURN_ERROR_IF_FAIL(indices != NULL, PillBigError_SystemError);
+
+	for (i = 0; i < pillbig->files_count && pillbig_no_error(); i++)
+	{
+		index = indices[i];
+		info = &pillbig->infos[index];
+
+		pillbig_guess_filetype(pillbig, index);
+
+		if (count_samples && pillbig_no_error() &&
+		    info->filetype == PillBigFileType_Audio)
+		{
+			pillbig_audio_get_samples_count(pillbig, index);
+		}
+	}
+
+	free(indices);
+
+	return pillbig_error_get();
+}
+
 PillBigError
 pillbig_file_extract(PillBig pillbig, int index, FILE *output)
 {
-	#define EXTRACT_BUFFER_SIZE 1024
+	pillbig_error_clear();
+
+	PillBigSink sink = (output != NULL) ? pillbig_sink_new_from_file(output) : NULL;
+	if (pillbig_file_extract_to_sink(pillbig, index, sink) == PillBigError_Success)
+	{
+		pillbig_sink_flush(sink);
+	}
+	pillbig_sink_free(sink);
+
+	return pillbig_error_get();
+}
+
+PillBigError
+pillbig_file_extract_to_sink(PillBig pillbig, int index, PillBigSink output)
+{
+	#define EXTRACT_BUFFER_SIZE 8192
 
 	pillbig_error_clear();
 	SET_RETURN_ERROR_IF_FAIL(pillbig != NULL,
@@ -344,26 +476,22 @@ pillbig_file_extract(PillBig pillbig, int index, FILE *output)
 	PillBigFileEntry *entry = &pillbig->entries[index];
 	SET_RETURN_ERROR_IF_FAIL(entry != NULL, PillBigError_UnknownError);
 
-	char buffer[EXTRACT_BUFFER_SIZE], *ptr;
-	int remaining_bytes = entry->size, result;
-	int bytes_read, bytes_written;
+	char buffer[EXTRACT_BUFFER_SIZE];
+	int remaining_bytes = entry->size;
+	long offset = entry->offset;
+	int bytes_read;
 
-	result = fseek(pillbig->pillbig, entry->offset, SEEK_SET);
-	SET_RETURN_ERROR_IF_FAIL(result == 0, PillBigError_SystemError);
+	pillbig_source_prefetch(pillbig->source, entry->offset, entry->size);
 
 	while (remaining_bytes > 0)
 	{
-		bytes_read = fread(buffer, sizeof(char), MIN(EXTRACT_BUFFER_SIZE, remaining_bytes), pillbig->pillbig);
-		remaining_bytes -= bytes_read;
+		bytes_read = pillbig_source_read_at(pillbig->source, buffer,
+			MIN(EXTRACT_BUFFER_SIZE, remaining_bytes), offset);
 		SET_RETURN_ERROR_IF_FAIL(bytes_read > 0, PillBigError_SystemError);
-		ptr = buffer;
-		while (bytes_read > 0)
-		{
-			bytes_written = fwrite(ptr, sizeof(char), bytes_read, output);
-			bytes_read -= bytes_written;
-			SET_RETURN_ERROR_IF_FAIL(bytes_written > 0, PillBigError_SystemError);
-			ptr += bytes_written;
-		}
+		remaining_bytes -= bytes_read;
+		offset += bytes_read;
+		SET_RETURN_ERROR_IF_FAIL(pillbig_sink_write(output, buffer, bytes_read) ==
+			PillBigError_Success, pillbig_error_get());
 	}
 
 	return pillbig_error_get();
@@ -382,7 +510,10 @@ pillbig_file_extract_to_filename(PillBig pillbig, int index, const char *filenam
 	FILE *file = fopen(filename, "wb");
 	SET_RETURN_ERROR_IF_FAIL(file != NULL, PillBigError_SystemError);
 	pillbig_file_extract(pillbig, index, file);
-	fclose(file);
+	if (fclose(file) != 0 && pillbig_no_error())
+	{
+		pillbig_error_set(PillBigError_SystemError);
+	}
 
 	return pillbig_error_get();
 }
@@ -400,6 +531,13 @@ pillbig_close(PillBig pillbig)
 	pillbig_error_clear();
 	SET_ERROR_RETURN_IF_FAIL(pillbig != NULL, PillBigError_InvalidPillBigObject);
 
+	int i;
+
+	if (pillbig->free_source)
+	{
+		pillbig_source_free(pillbig->source);
+	}
+
 	if (pillbig->close_on_free)
 	{
 		fclose(pillbig->pillbig);
@@ -410,6 +548,20 @@ pillbig_close(PillBig pillbig)
 		free(pillbig->entries);
 	}
 
+	if (pillbig->infos != NULL)
+	{
+		for (i = 0; i < pillbig->files_count; i++)
+		{
+			pillbig_audio_free_seek_index(pillbig->infos[i].seek_index);
+		}
+		free(pillbig->infos);
+	}
+
+	if (pillbig->waveform_cache != NULL)
+	{
+		free(pillbig->waveform_cache);
+	}
+
 	free(pillbig);
 }
 
@@ -421,33 +573,39 @@ pillbig_read_file_entries(PillBig pillbig)
 	pillbig_error_clear();
 	SET_RETURN_ERROR_IF_FAIL(pillbig != NULL, PillBigError_InvalidPillBigObject);
 
+	unsigned int *table;
 	int result;
 	int i;
 
-	result = fseek(pillbig->pillbig, 0, SEEK_SET);
-	SET_RETURN_ERROR_IF_FAIL(result == 0, PillBigError_SystemError);
-
-	result = fread(&pillbig->files_count, 4, 1, pillbig->pillbig);
-	SET_RETURN_ERROR_IF_FAIL(result == 1, PillBigError_SystemError);
+	result = pillbig_source_read_at(pillbig->source, &pillbig->files_count, 4, 0);
+	SET_RETURN_ERROR_IF_FAIL(result == 4, PillBigError_SystemError);
 
 	pillbig->entries = (PillBigFileEntry *)calloc(sizeof(PillBigFileEntry), pillbig->files_count);
 	SET_RETURN_ERROR_IF_FAIL(pillbig->entries != NULL, PillBigError_SystemError);
 
-	i = 0;
-	while (i < pillbig->files_count)
-	{
-		result = fread(&pillbig->entries[i].hash, 4, 1, pillbig->pillbig);
-		SET_RETURN_ERROR_IF_FAIL(result == 1, PillBigError_SystemError);
+	pillbig->infos = (PillBigEntryInfo *)calloc(sizeof(PillBigEntryInfo), pillbig->files_count);
+	SET_RETURN_ERROR_IF_FAIL(pillbig->infos != NULL, PillBigError_SystemError);
 
-		result = fread(&pillbig->entries[i].size, 4, 1, pillbig->pillbig);
-		SET_RETURN_ERROR_IF_FAIL(result == 1, PillBigError_SystemError);
+	/*
+	 * The whole table is read at once. Each entry holds its hash,
+	 * size and offset.
+	 */
+	table = (unsigned int *)malloc(pillbig->files_count * 12);
+	SET_RETURN_ERROR_IF_FAIL(table != NULL, PillBigError_SystemError);
 
-		result = fread(&pillbig->entries[i].offset, 4, 1, pillbig->pillbig);
-		SET_RETURN_ERROR_IF_FAIL(result == 1, PillBigError_SystemError);
-		i++;
+	result = pillbig_source_read_at(pillbig->source, table, pillbig->files_count * 12, 4);
+	SET_ERROR_IF_FAIL(result == pillbig->files_count * 12, PillBigError_SystemError);
+
+	for (i = 0; i < pillbig->files_count && pillbig_no_error(); i++)
+	{
+		pillbig->entries[i].hash   = table[i * 3];
+		pillbig->entries[i].size   = table[i * 3 + 1];
+		pillbig->entries[i].offset = table[i * 3 + 2];
 	}
 
-	return PillBigError_Success;
+	free(table);
+
+	return pillbig_error_get();
 }
 
 static PillBigPlatform
@@ -461,12 +619,8 @@ pillbig_guess_platform(PillBig pillbig)
 	int result;
 	int magic;
 
-	result = fseek(pillbig->pillbig, 0, SEEK_SET);
-	SET_ERROR_RETURN_VALUE_IF_FAIL(result == 0,
-		PillBigError_SystemError, PillBigPlatform_Unknown);
-
-	result = fread(&magic, 4, 1, pillbig->pillbig);
-	SET_ERROR_RETURN_VALUE_IF_FAIL(result == 1,
+	result = pillbig_source_read_at(pillbig->source, &magic, 4, 0);
+	SET_ERROR_RETURN_VALUE_IF_FAIL(result == 4,
 		PillBigError_SystemError, PillBigPlatform_Unknown);
 
 	switch (magic)
@@ -485,21 +639,58 @@ pillbig_guess_platform(PillBig pillbig)
 	return platform;
 }
 
+int *
+pillbig_get_indices_by_offset(PillBig pillbig)
+{
+	PillBigFileEntry **sorted;
+	int *indices;
+	int i;
+
+	sorted = (PillBigFileEntry **)calloc(pillbig->files_count, sizeof(PillBigFileEntry *));
+	SET_ERROR_RETURN_VALUE_IF_FAIL(sorted != NULL, PillBigError_SystemError, NULL);
+
+	indices = (int *)calloc(pillbig->files_count, sizeof(int));
+	if (indices == NULL)
+	{
+		free(sorted);
+		pillbig_error_set(PillBigError_SystemError);
+		return NULL;
+	}
+
+	for (i = 0; i < pillbig->files_count; i++)
+	{
+		sorted[i] = &pillbig->entries[i];
+	}
+	qsort(sorted, pillbig->files_count, sizeof(PillBigFileEntry *),
+		pillbig_compare_offsets);
+
+	for (i = 0; i < pillbig->files_count; i++)
+	{
+		indices[i] = sorted[i] - pillbig->entries;
+	}
+	free(sorted);
+
+	return indices;
+}
+
 static PillBigFileType
 pillbig_guess_filetype(PillBig pillbig, int index)
 {
-	PillBigFileType filetype = PillBigFileType_Unknown;
+	PillBigEntryInfo *info = &pillbig->infos[index];
 
-	/*
-	 * Guess an audio filetype.
-	 */
-	PillBigAudioFormat audio_format = pillbig_audio_get_format(pillbig, index);
-	if (audio_format != PillBigAudioFormat_Unknown)
+	if (!(info->known & PillBigEntryInfo_FileType))
 	{
-		filetype = PillBigFileType_Audio;
+		pillbig_filetype_probe(pillbig, index);
 	}
 
-	// TODO Detect other types here.
+	return info->filetype;
+}
 
-	return filetype;
+static int
+pillbig_compare_offsets(const void *a, const void *b)
+{
+	const PillBigFileEntry *entry_a = *(const PillBigFileEntry **)a;
+	const PillBigFileEntry *entry_b = *(const PillBigFileEntry **)b;
+
+	return (entry_a->offset > entry_b->offset) - (entry_a->offset < entry_b->offset);
 }
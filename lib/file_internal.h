@@ -18,16 +18,61 @@
 #include <stdio.h>
 #include <pillbig/pillbig.h>
 #include "pillbig_internal.h"
+#include "audio_internal.h"
+#include "source_internal.h"
+
+/**
+ *  Entry metadata already probed.
+ */
+typedef enum
+{
+	PillBigEntryInfo_FileType     = 1 << 0,    /**< filetype is known. */
+	PillBigEntryInfo_AudioFormat  = 1 << 1,    /**< audio_format and header_size are known. */
+	PillBigEntryInfo_SamplesCount = 1 << 2,    /**< samples_count is known. */
+	PillBigEntryInfo_Database     = 1 << 3,    /**< The attached database entry was checked. */
+}
+PillBigEntryInfoFlags;
+
+/**
+ *  Cached metadata of a pill.big file entry.
+ */
+typedef struct
+{
+	int                   known;            /**< PillBigEntryInfoFlags of the fields already probed. */
+	PillBigFileType       filetype;         /**< File type. */
+	PillBigAudioFormat    audio_format;     /**< Audio format. */
+	int                   header_size;      /**< Bytes of header before the audio data. */
+	int                   samples_count;    /**< Audio samples count. */
+	PillBigAudioSeekIndex *seek_index;      /**< Audio seek index. NULL if not built. */
+}
+PillBigEntryInfo;
 
 struct _PillBig
 {
-	FILE                *pillbig;          /**< pill.big file descriptor .*/
+	FILE                *pillbig;          /**< pill.big file descriptor. NULL unless opened from a stream. */
+	PillBigSource        source;           /**< pill.big data, every read goes through it. */
+	int                  free_source;      /**< 1 if source must be freed when freeing the object. */
 	PillBigPlatform      platform;         /**< Blood Omen's pill.big platform. */
 	PillBigDB            db;               /**< Files database. */
 	unsigned int         files_count;      /**< pill.big files count. */
 	PillBigFileEntry    *entries;          /**< File entries table. */
+	PillBigEntryInfo    *infos;            /**< Lazily probed metadata of every entry. */
 	PillBigReplaceMode   replace_mode;     /**< Replacement mode. */
+	int                  sample_rate;      /**< Sample rate of extracted and replacement audio. */
+	char                *waveform_cache;   /**< Waveform cache directory. NULL if disabled. */
 	int                  close_on_free;    /**< 1 if pill.big FILE must be closed when freeing the object. */
 };
 
+/**
+ *  Gets the file indices sorted by their offset in pill.big.
+ *
+ *  @param pillbig
+ *  	PillBig object.
+ *  @return
+ *  	Array of pillbig->files_count indices if successful, it must be
+ *  	freed by the caller. NULL otherwise.
+ */
+int *
+pillbig_get_indices_by_offset(PillBig pillbig);
+
 #endif
@@ -0,0 +1,290 @@
+/*
+ *  libpillbig
+ *  A library to deal with Blood Omen: Legacy of Kain pill.big files.
+ */
+
+/**
+ *  @file
+ *  @brief
+ *  	Internal file type classifier. Implementation file.
+ *
+ *  @author  Alfonso Ruzafa <superruzafa@gmail.com>
+ *  @version SVN $Id$
+ */
+
+
+
+#include <stdio.h>
+#include <pillbig/pillbig.h>
+#include "pillbig_internal.h"
+#include "filetype_internal.h"
+
+#define TIM_MAGIC_ID 0x00000010
+#define TIM_FLAG_CLUT 0x08
+
+#define VAG_BLOCK_SIZE 16
+#define VAG_MAX_PREDICTOR 4
+#define VAG_MAX_SHIFT 12
+#define VAG_MAX_FLAGS 0x07
+#define VAG_FLAG_END 0x01
+
+/*
+ * Shortest IMA ADPCM file taken as audio, 0.19 seconds long.
+ * The shortest PC voice is 4098 bytes long.
+ */
+#define ADPCM_MIN_SIZE 1024
+
+#define READ_LE32(p) \
+	((p)[0] | ((p)[1] << 8) | ((p)[2] << 16) | ((unsigned int)(p)[3] << 24))
+
+
+
+/**
+ *  Callback for file type signatures.
+ *
+ *  @param info
+ *  	Metadata probed so far. Audio format is already known.
+ *  @param entry
+ *  	pill.big file entry.
+ *  @param header
+ *  	First bytes of the file.
+ *  @param header_size
+ *  	Count of bytes in header.
+ *  @return
+ *  	1 if the file matches the signature. 0 otherwise.
+ */
+typedef
+int
+(*PillBigFileTypeMatcher)(
+	const PillBigEntryInfo *info, const PillBigFileEntry *entry,
+	const unsigned char *header, int header_size);
+
+/**
+ *  File type signature.
+ */
+typedef struct
+{
+	PillBigFileType           filetype;    /**< File type detected by the signature. */
+	PillBigFileTypeMatcher    matches;     /**< Signature matcher. */
+}
+PillBigFileTypeSignature;
+
+
+
+/**
+ *  Matches PlayStation TIM bitmaps.
+ */
+static int
+pillbig_filetype_matches_tim(
+	const PillBigEntryInfo *info, const PillBigFileEntry *entry,
+	const unsigned char *header, int header_size);
+
+/**
+ *  Matches any supported audio format.
+ */
+static int
+pillbig_filetype_matches_audio(
+	const PillBigEntryInfo *info, const PillBigFileEntry *entry,
+	const unsigned char *header, int header_size);
+
+/**
+ *  Checks the VAG ADPCM blocks within the header window.
+ *
+ *  @remarks
+ *  	Every block starts with a predictor from 0 to 4, a shift from 0
+ *  	to 12 and the flags byte. Blocks after an end flag aren't checked,
+ *  	they may be padding.
+ *
+ *  @param info
+ *  	Metadata probed so far. VAG header size is already known.
+ *  @param entry
+ *  	pill.big file entry.
+ *  @param header
+ *  	First bytes of the file.
+ *  @param header_size
+ *  	Count of bytes in header.
+ *  @return
+ *  	1 if there is at least one block and every checked block is valid.
+ *  	0 otherwise.
+ */
+static int
+pillbig_filetype_matches_vag_blocks(
+	const PillBigEntryInfo *info, const PillBigFileEntry *entry,
+	const unsigned char *header, int header_size);
+
+
+
+/**
+ *  Signatures table. Ordered from the strongest to the weakest signature,
+ *  the first one matching wins.
+ *
+ *  @remarks
+ *  	Only bitmaps and audio files are classified. Tilemaps, maps and
+ *  	sprites are out of the classifier scope.
+ */
+static const PillBigFileTypeSignature signatures[] =
+{
+	{ PillBigFileType_Bitmap,   pillbig_filetype_matches_tim   },
+	{ PillBigFileType_Audio,    pillbig_filetype_matches_audio },
+	{ PillBigFileType_Unknown,  NULL                           },
+};
+
+
+
+PillBigError
+pillbig_filetype_probe(PillBig pillbig, int index)
+{
+	pillbig_error_clear();
+	SET_RETURN_ERROR_IF_FAIL(pillbig != NULL,
+		PillBigError_InvalidPillBigObject);
+	SET_RETURN_ERROR_IF_FAIL(0 <= index && index < pillbig->files_count,
+		PillBigError_FileIndexOutOfRange);
+
+	const PillBigFileEntry *entry = &pillbig->entries[index];
+	const PillBigFileTypeSignature *signature;
+	PillBigEntryInfo *info = &pillbig->infos[index];
+	unsigned char header[FILETYPE_HEADER_SIZE];
+	int header_size = MIN(entry->size, FILETYPE_HEADER_SIZE);
+	int result;
+
+	/*
+	 * Consecutive files are contiguous in pill.big, stream sources
+	 * keep their buffering when probing in offset order.
+	 */
+	result = pillbig_source_read_at(pillbig->source, header, header_size, entry->offset);
+	SET_RETURN_ERROR_IF_FAIL(result == header_size, PillBigError_SystemError);
+
+	info->audio_format = pillbig_audio_guess_format(pillbig->platform,
+		header, header_size);
+	info->header_size = (info->audio_format == PillBigAudioFormat_VAG &&
+		header_size >= 4 && READ_LE32(header) == VAG_MAGIC_ID) ? AUDIO_VAG_HEADER_SIZE : 0;
+	info->known |= PillBigEntryInfo_AudioFormat;
+
+	info->filetype = PillBigFileType_Unknown;
+	for (signature = signatures; signature->matches != NULL; signature++)
+	{
+		if (signature->matches(info, entry, header, header_size))
+		{
+			info->filetype = signature->filetype;
+			break;
+		}
+	}
+	info->known |= PillBigEntryInfo_FileType;
+
+	/* Leading bytes alike audio ones aren't enough to decode a file */
+	if (info->filetype != PillBigFileType_Audio)
+	{
+		info->audio_format = PillBigAudioFormat_Unknown;
+		info->header_size = 0;
+	}
+
+	return PillBigError_Success;
+}
+
+
+
+static int
+pillbig_filetype_matches_tim(
+	const PillBigEntryInfo *info, const PillBigFileEntry *entry,
+	const unsigned char *header, int header_size)
+{
+	unsigned int flags, block_size;
+	int offset;
+
+	if (header_size < 20 || READ_LE32(header) != TIM_MAGIC_ID)
+	{
+		return 0;
+	}
+
+	/*
+	 * Only the pixel mode (4, 8, 16, 24 bits or mixed)
+	 * and the CLUT flag can be set.
+	 */
+	flags = READ_LE32(header + 4);
+	if ((flags & ~0x0f) != 0 || (flags & 0x07) > 4)
+	{
+		return 0;
+	}
+
+	/*
+	 * Every block starts with its own size, header included.
+	 * Blocks must fit in the file.
+	 */
+	offset = 8;
+	if (flags & TIM_FLAG_CLUT)
+	{
+		block_size = READ_LE32(header + offset);
+		if (block_size < 12 || block_size > entry->size - offset)
+		{
+			return 0;
+		}
+		offset += block_size;
+	}
+
+	if (offset + 4 <= header_size)
+	{
+		block_size = READ_LE32(header + offset);
+		if (block_size < 12 || block_size > entry->size - offset)
+		{
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static int
+pillbig_filetype_matches_audio(
+	const PillBigEntryInfo *info, const PillBigFileEntry *entry,
+	const unsigned char *header, int header_size)
+{
+	switch (info->audio_format)
+	{
+		case PillBigAudioFormat_ADPCM:
+			/* Headerless, only the first bytes are known to be zero */
+			return entry->size >= ADPCM_MIN_SIZE;
+		case PillBigAudioFormat_VAG:
+			return pillbig_filetype_matches_vag_blocks(info, entry, header, header_size);
+		case PillBigAudioFormat_WAVE:
+			return 1;
+		default:
+			return 0;
+	}
+}
+
+static int
+pillbig_filetype_matches_vag_blocks(
+	const PillBigEntryInfo *info, const PillBigFileEntry *entry,
+	const unsigned char *header, int header_size)
+{
+	const unsigned char *block;
+	int offset;
+
+	/* VAG headers fill the whole window, the magic is enough */
+	if (info->header_size >= header_size)
+	{
+		return entry->size >= info->header_size + VAG_BLOCK_SIZE;
+	}
+
+	if (info->header_size + VAG_BLOCK_SIZE > header_size)
+	{
+		return 0;
+	}
+
+	for (offset = info->header_size; offset + VAG_BLOCK_SIZE <= header_size;
+		offset += VAG_BLOCK_SIZE)
+	{
+		block = header + offset;
+		if ((block[0] >> 4) > VAG_MAX_PREDICTOR || (block[0] & 0x0f) > VAG_MAX_SHIFT
+			|| block[1] > VAG_MAX_FLAGS)
+		{
+			return 0;
+		}
+		if (block[1] & VAG_FLAG_END)
+		{
+			break;
+		}
+	}
+
+	return 1;
+}
@@ -0,0 +1,42 @@
+/*
+ *  libpillbig
+ *  A library to deal with Blood Omen: Legacy of Kain pill.big files.
+ */
+
+/**
+ *  @file
+ *  @brief
+ *  	Internal file type classifier.
+ *
+ *  @author  Alfonso Ruzafa <superruzafa@gmail.com>
+ *  @version SVN $Id$
+ */
+
+#ifndef __PILLBIG_FILETYPE_INTERNAL_H__
+#define __PILLBIG_FILETYPE_INTERNAL_H__
+
+#include <pillbig/file.h>
+
+/**
+ *  Size of the file header window read by the classifier.
+ */
+#define FILETYPE_HEADER_SIZE 64
+
+/**
+ *  Probes the type and audio format of a pill.big file.
+ *
+ *  @remarks
+ *  	Only the first FILETYPE_HEADER_SIZE bytes of the file are read.
+ *  	The results are stored in the PillBig metadata cache.
+ *
+ *  @param pillbig
+ *  	PillBig object.
+ *  @param index
+ *  	pill.big file index.
+ *  @return
+ *  	Operation result.
+ */
+PillBigError
+pillbig_filetype_probe(PillBig pillbig, int index);
+
+#endif
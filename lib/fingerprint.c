@@ -0,0 +1,559 @@
+/*
+ *  libpillbig
+ *  A library to deal with Blood Omen: Legacy of Kain pill.big files.
+ */
+
+/**
+ *  @file
+ *  @brief
+ *  	Audio fingerprints and fingerprint index. Implementation file.
+ *
+ *  @author  Alfonso Ruzafa <superruzafa@gmail.com>
+ *  @version SVN $Id$
+ *  @remarks
+ *  	The strongest spectral peak of each frequency band is picked on
+ *  	every frame. Each peak is paired with the next few peaks and every
+ *  	pair is hashed from both frequencies and their distance in frames.
+ *  	Two audios match when many of their hashes agree with the same
+ *  	time offset.
+ */
+
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pillbig/pillbig.h>
+#include "pillbig_internal.h"
+
+#define FINGERPRINT_FFT_SIZE 512
+#define FINGERPRINT_HOP_SIZE 256
+#define FINGERPRINT_BANDS_COUNT 6
+#define FINGERPRINT_TARGET_FRAMES 32
+#define FINGERPRINT_FAN_OUT 4
+#define FINGERPRINT_PEAK_THRESHOLD 1e-4
+
+/**
+ *  Builds a fingerprint hash from a pair of peaks. Bins are below 256
+ *  and the distance below 64 frames.
+ */
+#define FINGERPRINT_HASH(bin1, bin2, distance) \
+	(((unsigned int)(bin1) << 14) | ((unsigned int)(bin2) << 6) | (unsigned int)(distance))
+
+/**
+ *  Spectral peak.
+ */
+typedef struct
+{
+	int    frame;    /**< Frame. */
+	int    bin;      /**< Frequency bin. */
+}
+PillBigAudioFingerprintPeak;
+
+/**
+ *  Fingerprint index posting.
+ */
+typedef struct
+{
+	unsigned int    hash;    /**< Hash. */
+	int             id;      /**< Identifier of the indexed fingerprint. */
+	int             time;    /**< Time of the hash in the indexed fingerprint. */
+}
+PillBigAudioFingerprintPosting;
+
+/**
+ *  Fingerprint index.
+ */
+struct _PillBigAudioFingerprintIndex
+{
+	PillBigAudioFingerprintPosting    *postings;          /**< Postings of every indexed hash. */
+	int                                postings_count;    /**< Count of postings. */
+	int                                postings_size;     /**< Allocated postings. */
+	int                                sorted;            /**< Postings are sorted by hash. */
+};
+
+/**
+ *  Lower bin of each frequency band, and the upper bin of the last one.
+ */
+static const int bands[FINGERPRINT_BANDS_COUNT + 1] = { 2, 8, 16, 32, 64, 128, 256 };
+
+
+
+/**
+ *  Computes the power spectrum of a frame, in place.
+ *
+ *  @param real
+ *  	Frame samples. On return, power of each bin.
+ *  @param imaginary
+ *  	Work buffer.
+ *  @param window
+ *  	Analysis window.
+ */
+static void
+pillbig_audio_fingerprint_spectrum(float *real, float *imaginary, const float *window);
+
+/**
+ *  Picks the spectral peaks of a frame.
+ *
+ *  @param power
+ *  	Power spectrum of the frame.
+ *  @param frame
+ *  	Frame number.
+ *  @param peaks
+ *  	Peaks array, grown as needed.
+ *  @param peaks_count
+ *  	Count of peaks in the array.
+ *  @param peaks_size
+ *  	Allocated peaks.
+ *  @return
+ *  	Operation result.
+ */
+static PillBigError
+pillbig_audio_fingerprint_pick_peaks(const float *power, int frame,
+	PillBigAudioFingerprintPeak **peaks, int *peaks_count, int *peaks_size);
+
+/**
+ *  Pairs the peaks into the hashes of a fingerprint.
+ *
+ *  @param fingerprint
+ *  	Fingerprint without hashes.
+ *  @param peaks
+ *  	Peaks sorted by frame.
+ *  @param peaks_count
+ *  	Count of peaks.
+ *  @return
+ *  	Operation result.
+ */
+static PillBigError
+pillbig_audio_fingerprint_pair_peaks(PillBigAudioFingerprint *fingerprint,
+	const PillBigAudioFingerprintPeak *peaks, int peaks_count);
+
+/**
+ *  Compares postings by hash, for qsort() and bsearch().
+ */
+static int
+pillbig_audio_fingerprint_compare_postings(const void *a, const void *b);
+
+/**
+ *  Compares match candidates by identifier and time offset, for qsort().
+ */
+static int
+pillbig_audio_fingerprint_compare_candidates(const void *a, const void *b);
+
+
+
+PillBigAudioFingerprint *
+pillbig_audio_get_fingerprint(PillBig pillbig, int index)
+{
+	pillbig_error_clear();
+	SET_ERROR_RETURN_VALUE_IF_FAIL(pillbig != NULL,
+		PillBigError_InvalidPillBigObject, NULL);
+	SET_ERROR_RETURN_VALUE_IF_FAIL(0 <= index && index < pillbig->files_count,
+		PillBigError_FileIndexOutOfRange, NULL);
+
+	PillBigAudioFingerprint *fingerprint;
+	PillBigAudioFingerprintPeak *peaks = NULL;
+	PillBigAudioStream stream;
+	PillBigError error;
+	short samples[FINGERPRINT_FFT_SIZE];
+	float window[FINGERPRINT_FFT_SIZE];
+	float real[FINGERPRINT_FFT_SIZE], imaginary[FINGERPRINT_FFT_SIZE];
+	int peaks_count = 0, peaks_size = 0;
+	int frame, filled, read_count, i;
+
+	stream = pillbig_audio_stream_open(pillbig, index, PillBigAudioFormat_PCM);
+	SET_ERROR_RETURN_VALUE_IF_FAIL(stream != NULL, pillbig_error_get(), NULL);
+
+	fingerprint = (PillBigAudioFingerprint *)calloc(1, sizeof(PillBigAudioFingerprint));
+	SET_ERROR_IF_FAIL(fingerprint != NULL, PillBigError_SystemError);
+
+	for (i = 0; i < FINGERPRINT_FFT_SIZE; i++)
+	{
+		window[i] = 0.5 - 0.5 * cos(2.0 * M_PI * i / FINGERPRINT_FFT_SIZE);
+	}
+
+	/*
+	 * Frames overlap by half, only a hop of samples is read each time.
+	 */
+	filled = 0;
+	for (frame = 0; pillbig_no_error(); frame++)
+	{
+		read_count = pillbig_audio_stream_read(stream, samples + filled,
+			FINGERPRINT_FFT_SIZE - filled);
+		if (read_count < 0)
+		{
+			break;
+		}
+		fingerprint->samples_count += read_count;
+		filled += read_count;
+
+		if (filled < FINGERPRINT_FFT_SIZE && (read_count == 0 || frame > 0))
+		{
+			break;
+		}
+
+		memset(real + filled, 0, (FINGERPRINT_FFT_SIZE - filled) * sizeof(float));
+		for (i = 0; i < filled; i++)
+		{
+			real[i] = samples[i] / 32768.0f;
+		}
+
+		pillbig_audio_fingerprint_spectrum(real, imaginary, window);
+		pillbig_audio_fingerprint_pick_peaks(real, frame, &peaks, &peaks_count, &peaks_size);
+
+		memmove(samples, samples + FINGERPRINT_HOP_SIZE,
+			(FINGERPRINT_FFT_SIZE - FINGERPRINT_HOP_SIZE) * sizeof(short));
+		filled = MAX(filled - FINGERPRINT_HOP_SIZE, 0);
+	}
+
+	if (pillbig_no_error())
+	{
+		pillbig_audio_fingerprint_pair_peaks(fingerprint, peaks, peaks_count);
+	}
+
+	free(peaks);
+
+	error = pillbig_error_get();
+	pillbig_audio_stream_close(stream);
+	pillbig_error_set(error);
+
+	if (pillbig_any_error())
+	{
+		pillbig_audio_fingerprint_free(fingerprint);
+		return NULL;
+	}
+
+	return fingerprint;
+}
+
+void
+pillbig_audio_fingerprint_free(PillBigAudioFingerprint *fingerprint)
+{
+	if (fingerprint != NULL)
+	{
+		free(fingerprint->hashes);
+		free(fingerprint);
+	}
+}
+
+PillBigAudioFingerprintIndex
+pillbig_audio_fingerprint_index_new()
+{
+	pillbig_error_clear();
+
+	PillBigAudioFingerprintIndex index;
+
+	index = (PillBigAudioFingerprintIndex)calloc(1, sizeof(struct _PillBigAudioFingerprintIndex));
+	SET_ERROR_RETURN_VALUE_IF_FAIL(index != NULL, PillBigError_SystemError, NULL);
+	index->sorted = 1;
+
+	return index;
+}
+
+void
+pillbig_audio_fingerprint_index_free(PillBigAudioFingerprintIndex index)
+{
+	if (index != NULL)
+	{
+		free(index->postings);
+		free(index);
+	}
+}
+
+PillBigError
+pillbig_audio_fingerprint_index_add(PillBigAudioFingerprintIndex index, int id,
+	const PillBigAudioFingerprint *fingerprint)
+{
+	pillbig_error_clear();
+	SET_RETURN_ERROR_IF_FAIL(index != NULL, PillBigError_UnknownError);
+	SET_RETURN_ERROR_IF_FAIL(fingerprint != NULL && id >= 0, PillBigError_UnknownError);
+
+	PillBigAudioFingerprintPosting *postings, *posting;
+	int size, i;
+
+	if (index->postings_count + fingerprint->hashes_count > index->postings_size)
+	{
+		size = MAX(index->postings_size * 2, index->postings_count + fingerprint->hashes_count);
+		postings = (PillBigAudioFingerprintPosting *)realloc(index->postings,
+			size * sizeof(PillBigAudioFingerprintPosting));
+		SET_RETURN_ERROR_IF_FAIL(postings != NULL, PillBigError_SystemError);
+		index->postings = postings;
+		index->postings_size = size;
+	}
+
+	for (i = 0; i < fingerprint->hashes_count; i++)
+	{
+		posting = &index->postings[index->postings_count++];
+		posting->hash = fingerprint->hashes[i].hash;
+		posting->id   = id;
+		posting->time = fingerprint->hashes[i].time;
+	}
+
+	/*
+	 * Sorting is deferred until the next match.
+	 */
+	index->sorted = (fingerprint->hashes_count == 0) && index->sorted;
+
+	return PillBigError_Success;
+}
+
+int
+pillbig_audio_fingerprint_index_match(PillBigAudioFingerprintIndex index,
+	const PillBigAudioFingerprint *fingerprint, double *score)
+{
+	pillbig_error_clear();
+	SET_ERROR_RETURN_VALUE_IF_FAIL(index != NULL, PillBigError_UnknownError, -1);
+	SET_ERROR_RETURN_VALUE_IF_FAIL(fingerprint != NULL, PillBigError_UnknownError, -1);
+
+	PillBigAudioFingerprintPosting key, *found, *candidates = NULL, *candidate;
+	int candidates_count = 0, candidates_size = 0;
+	int best_id = -1, best_count = 0, count, i;
+
+	if (score != NULL)
+	{
+		*score = 0.0;
+	}
+
+	if (!index->sorted)
+	{
+		qsort(index->postings, index->postings_count,
+			sizeof(PillBigAudioFingerprintPosting),
+			pillbig_audio_fingerprint_compare_postings);
+		index->sorted = 1;
+	}
+
+	/*
+	 * Every posting sharing a hash votes for its identifier
+	 * and time offset.
+	 */
+	for (i = 0; i < fingerprint->hashes_count && pillbig_no_error(); i++)
+	{
+		key.hash = fingerprint->hashes[i].hash;
+		found = (PillBigAudioFingerprintPosting *)bsearch(&key, index->postings,
+			index->postings_count, sizeof(PillBigAudioFingerprintPosting),
+			pillbig_audio_fingerprint_compare_postings);
+		if (found == NULL)
+		{
+			continue;
+		}
+
+		while (found > index->postings && (found - 1)->hash == key.hash)
+		{
+			found--;
+		}
+
+		for (; found < index->postings + index->postings_count && found->hash == key.hash; found++)
+		{
+			if (candidates_count == candidates_size)
+			{
+				candidates_size = candidates_size * 2 + 256;
+				candidate = (PillBigAudioFingerprintPosting *)realloc(candidates,
+					candidates_size * sizeof(PillBigAudioFingerprintPosting));
+				SET_ERROR_IF_FAIL(candidate != NULL, PillBigError_SystemError);
+				if (candidate == NULL)
+				{
+					break;
+				}
+				candidates = candidate;
+			}
+
+			candidate = &candidates[candidates_count++];
+			candidate->id   = found->id;
+			candidate->time = found->time - fingerprint->hashes[i].time;
+		}
+	}
+
+	/*
+	 * The longest run of equal identifier and offset wins.
+	 */
+	if (pillbig_no_error() && candidates_count > 0)
+	{
+		qsort(candidates, candidates_count, sizeof(PillBigAudioFingerprintPosting),
+			pillbig_audio_fingerprint_compare_candidates);
+
+		for (i = 0; i < candidates_count; i += count)
+		{
+			for (count = 1; i + count < candidates_count &&
+			     candidates[i + count].id == candidates[i].id &&
+			     candidates[i + count].time == candidates[i].time; count++);
+
+			if (count > best_count)
+			{
+				best_count = count;
+				best_id = candidates[i].id;
+			}
+		}
+
+		if (score != NULL)
+		{
+			*score = MIN((double)best_count / fingerprint->hashes_count, 1.0);
+		}
+	}
+
+	free(candidates);
+
+	return pillbig_no_error() ? best_id : -1;
+}
+
+
+
+static void
+pillbig_audio_fingerprint_spectrum(float *real, float *imaginary, const float *window)
+{
+	float wr, wi, tr, ti, angle;
+	int size, half, i, j, k, bit;
+
+	for (i = 0; i < FINGERPRINT_FFT_SIZE; i++)
+	{
+		real[i] *= window[i];
+		imaginary[i] = 0.0f;
+	}
+
+	/*
+	 * Iterative radix-2 FFT.
+	 */
+	for (i = 0, j = 0; i < FINGERPRINT_FFT_SIZE; i++)
+	{
+		if (i < j)
+		{
+			tr = real[i]; real[i] = real[j]; real[j] = tr;
+		}
+		for (bit = FINGERPRINT_FFT_SIZE >> 1; j & bit; bit >>= 1)
+		{
+			j ^= bit;
+		}
+		j |= bit;
+	}
+
+	for (size = 2; size <= FINGERPRINT_FFT_SIZE; size <<= 1)
+	{
+		half = size >> 1;
+		for (k = 0; k < half; k++)
+		{
+			angle = -2.0f * (float)M_PI * k / size;
+			wr = cosf(angle);
+			wi = sinf(angle);
+			for (i = k; i < FINGERPRINT_FFT_SIZE; i += size)
+			{
+				j = i + half;
+				tr = wr * real[j] - wi * imaginary[j];
+				ti = wr * imaginary[j] + wi * real[j];
+				real[j]      = real[i] - tr;
+				imaginary[j] = imaginary[i] - ti;
+				real[i]      += tr;
+				imaginary[i] += ti;
+			}
+		}
+	}
+
+	for (i = 0; i <= FINGERPRINT_FFT_SIZE / 2; i++)
+	{
+		real[i] = real[i] * real[i] + imaginary[i] * imaginary[i];
+	}
+}
+
+static PillBigError
+pillbig_audio_fingerprint_pick_peaks(const float *power, int frame,
+	PillBigAudioFingerprintPeak **peaks, int *peaks_count, int *peaks_size)
+{
+	PillBigAudioFingerprintPeak *grown;
+	int band, bin, best;
+
+	for (band = 0; band < FINGERPRINT_BANDS_COUNT; band++)
+	{
+		/*
+		 * Only local maxima are peaks, so the spectrum slope
+		 * doesn't pin every band to one of its edges.
+		 */
+		best = -1;
+		for (bin = bands[band]; bin < bands[band + 1]; bin++)
+		{
+			if (power[bin] > power[bin - 1] && power[bin] >= power[bin + 1] &&
+			    (best == -1 || power[bin] > power[best]))
+			{
+				best = bin;
+			}
+		}
+
+		/*
+		 * Silence has no peaks.
+		 */
+		if (best == -1 || power[best] < FINGERPRINT_PEAK_THRESHOLD)
+		{
+			continue;
+		}
+
+		if (*peaks_count == *peaks_size)
+		{
+			grown = (PillBigAudioFingerprintPeak *)realloc(*peaks,
+				(*peaks_size * 2 + 256) * sizeof(PillBigAudioFingerprintPeak));
+			SET_RETURN_ERROR_IF_FAIL(grown != NULL, PillBigError_SystemError);
+			*peaks = grown;
+			*peaks_size = *peaks_size * 2 + 256;
+		}
+
+		(*peaks)[*peaks_count].frame = frame;
+		(*peaks)[*peaks_count].bin   = best;
+		(*peaks_count)++;
+	}
+
+	return PillBigError_Success;
+}
+
+static PillBigError
+pillbig_audio_fingerprint_pair_peaks(PillBigAudioFingerprint *fingerprint,
+	const PillBigAudioFingerprintPeak *peaks, int peaks_count)
+{
+	PillBigAudioFingerprintHash *hash;
+	int anchor, target, paired, distance;
+
+	fingerprint->hashes = (PillBigAudioFingerprintHash *)malloc(
+		MAX(peaks_count * FINGERPRINT_FAN_OUT, 1) * sizeof(PillBigAudioFingerprintHash));
+	SET_RETURN_ERROR_IF_FAIL(fingerprint->hashes != NULL, PillBigError_SystemError);
+
+	for (anchor = 0; anchor < peaks_count; anchor++)
+	{
+		paired = 0;
+		for (target = anchor + 1; target < peaks_count && paired < FINGERPRINT_FAN_OUT; target++)
+		{
+			distance = peaks[target].frame - peaks[anchor].frame;
+			if (distance == 0)
+			{
+				continue;
+			}
+			if (distance >= FINGERPRINT_TARGET_FRAMES)
+			{
+				break;
+			}
+
+			hash = &fingerprint->hashes[fingerprint->hashes_count++];
+			hash->hash = FINGERPRINT_HASH(peaks[anchor].bin, peaks[target].bin, distance);
+			hash->time = peaks[anchor].frame;
+			paired++;
+		}
+	}
+
+	return PillBigError_Success;
+}
+
+static int
+pillbig_audio_fingerprint_compare_postings(const void *a, const void *b)
+{
+	unsigned int hash_a = ((const PillBigAudioFingerprintPosting *)a)->hash;
+	unsigned int hash_b = ((const PillBigAudioFingerprintPosting *)b)->hash;
+
+	return (hash_a > hash_b) - (hash_a < hash_b);
+}
+
+static int
+pillbig_audio_fingerprint_compare_candidates(const void *a, const void *b)
+{
+	const PillBigAudioFingerprintPosting *candidate_a = a, *candidate_b = b;
+
+	if (candidate_a->id != candidate_b->id)
+	{
+		return (candidate_a->id > candidate_b->id) - (candidate_a->id < candidate_b->id);
+	}
+
+	return (candidate_a->time > candidate_b->time) - (candidate_a->time < candidate_b->time);
+}
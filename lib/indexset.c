@@ -0,0 +1,272 @@
+/*
+ *  libpillbig
+ *  A library to deal with Blood Omen: Legacy of Kain pill.big files.
+ */
+
+/**
+ *  @file
+ *  @brief
+ *  	Sets of file indices. Implementation file.
+ *
+ *  @author  Alfonso Ruzafa <superruzafa@gmail.com>
+ *  @version SVN $Id$
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "pillbig_internal.h"
+#include "indexset_internal.h"
+
+/**
+ *  Gets the position of the lowest bit set of a word.
+ *
+ *  @param word
+ *  	Non zero word.
+ *  @return
+ *  	Bit position.
+ */
+static int
+pillbig_index_set_get_lowest_bit(unsigned long word);
+
+/**
+ *  Counts the bits set of a word.
+ *
+ *  @param word
+ *  	Word.
+ *  @return
+ *  	Count of bits set.
+ */
+static int
+pillbig_index_set_count_bits(unsigned long word);
+
+
+
+PillBigIndexSet
+pillbig_index_set_new(int capacity)
+{
+	pillbig_error_clear();
+	SET_ERROR_RETURN_VALUE_IF_FAIL(capacity >= 0, PillBigError_UnknownError, NULL);
+
+	PillBigIndexSet set = (PillBigIndexSet)malloc(sizeof(struct _PillBigIndexSet));
+	SET_ERROR_RETURN_VALUE_IF_FAIL(set != NULL, PillBigError_SystemError, NULL);
+
+	set->capacity = capacity;
+	set->count = 0;
+	set->words_count = (capacity + INDEX_SET_WORD_BITS - 1) / INDEX_SET_WORD_BITS;
+	set->words = (unsigned long *)calloc(MAX(set->words_count, 1), sizeof(unsigned long));
+	if (set->words == NULL)
+	{
+		free(set);
+		set = NULL;
+	}
+	SET_ERROR_IF_FAIL(set != NULL, PillBigError_SystemError);
+
+	return set;
+}
+
+void
+pillbig_index_set_free(PillBigIndexSet set)
+{
+	pillbig_error_clear();
+	SET_ERROR_RETURN_IF_FAIL(set != NULL, PillBigError_UnknownError);
+
+	free(set->words);
+	free(set);
+}
+
+PillBigError
+pillbig_index_set_add(PillBigIndexSet set, int index)
+{
+	pillbig_error_clear();
+	SET_RETURN_ERROR_IF_FAIL(set != NULL, PillBigError_UnknownError);
+	SET_RETURN_ERROR_IF_FAIL(0 <= index && index < set->capacity, PillBigError_UnknownError);
+
+	unsigned long bit = 1UL << (index % INDEX_SET_WORD_BITS);
+	unsigned long *word = &set->words[index / INDEX_SET_WORD_BITS];
+
+	if ((*word & bit) == 0)
+	{
+		*word |= bit;
+		set->count++;
+	}
+
+	return PillBigError_Success;
+}
+
+int
+pillbig_index_set_contains(PillBigIndexSet set, int index)
+{
+	pillbig_error_clear();
+	SET_ERROR_RETURN_VALUE_IF_FAIL(set != NULL, PillBigError_UnknownError, 0);
+	RETURN_VALUE_IF_FAIL(0 <= index && index < set->capacity, 0);
+
+	return (set->words[index / INDEX_SET_WORD_BITS] >> (index % INDEX_SET_WORD_BITS)) & 1;
+}
+
+int
+pillbig_index_set_get_count(PillBigIndexSet set)
+{
+	pillbig_error_clear();
+	SET_ERROR_RETURN_VALUE_IF_FAIL(set != NULL, PillBigError_UnknownError, -1);
+
+	return set->count;
+}
+
+int
+pillbig_index_set_get_capacity(PillBigIndexSet set)
+{
+	pillbig_error_clear();
+	SET_ERROR_RETURN_VALUE_IF_FAIL(set != NULL, PillBigError_UnknownError, -1);
+
+	return set->capacity;
+}
+
+int
+pillbig_index_set_next(PillBigIndexSet set, int index)
+{
+	pillbig_error_clear();
+	SET_ERROR_RETURN_VALUE_IF_FAIL(set != NULL, PillBigError_UnknownError, -1);
+
+	int position = MAX(index, 0) / INDEX_SET_WORD_BITS;
+	unsigned long word;
+
+	RETURN_VALUE_IF_FAIL(MAX(index, 0) < set->capacity, -1);
+
+	/* Bits below index are masked out of its word */
+	word = set->words[position] & (~0UL << (MAX(index, 0) % INDEX_SET_WORD_BITS));
+	while (word == 0)
+	{
+		RETURN_VALUE_IF_FAIL(++position < set->words_count, -1);
+		word = set->words[position];
+	}
+
+	return position * INDEX_SET_WORD_BITS + pillbig_index_set_get_lowest_bit(word);
+}
+
+int
+pillbig_index_set_get_indices(PillBigIndexSet set, int *indices, int max_count)
+{
+	pillbig_error_clear();
+	SET_ERROR_RETURN_VALUE_IF_FAIL(set != NULL, PillBigError_UnknownError, -1);
+	SET_ERROR_RETURN_VALUE_IF_FAIL(indices != NULL || max_count <= 0, PillBigError_UnknownError, -1);
+
+	unsigned long word;
+	int count = 0, position;
+
+	for (position = 0; position < set->words_count && count < max_count; position++)
+	{
+		/* The lowest bit is cleared after each index */
+		for (word = set->words[position]; word != 0 && count < max_count; word &= word - 1)
+		{
+			indices[count++] = position * INDEX_SET_WORD_BITS + pillbig_index_set_get_lowest_bit(word);
+		}
+	}
+
+	return count;
+}
+
+PillBigError
+pillbig_index_set_and(PillBigIndexSet set, PillBigIndexSet other)
+{
+	pillbig_error_clear();
+	SET_RETURN_ERROR_IF_FAIL(set != NULL && other != NULL, PillBigError_UnknownError);
+	SET_RETURN_ERROR_IF_FAIL(set->capacity == other->capacity, PillBigError_UnknownError);
+
+	int i;
+
+	for (i = 0; i < set->words_count; i++)
+	{
+		set->words[i] &= other->words[i];
+	}
+	pillbig_index_set_update_count(set);
+
+	return PillBigError_Success;
+}
+
+PillBigError
+pillbig_index_set_or(PillBigIndexSet set, PillBigIndexSet other)
+{
+	pillbig_error_clear();
+	SET_RETURN_ERROR_IF_FAIL(set != NULL && other != NULL, PillBigError_UnknownError);
+	SET_RETURN_ERROR_IF_FAIL(set->capacity == other->capacity, PillBigError_UnknownError);
+
+	int i;
+
+	for (i = 0; i < set->words_count; i++)
+	{
+		set->words[i] |= other->words[i];
+	}
+	pillbig_index_set_update_count(set);
+
+	return PillBigError_Success;
+}
+
+PillBigError
+pillbig_index_set_not(PillBigIndexSet set)
+{
+	pillbig_error_clear();
+	SET_RETURN_ERROR_IF_FAIL(set != NULL, PillBigError_UnknownError);
+
+	int i;
+
+	for (i = 0; i < set->words_count; i++)
+	{
+		set->words[i] = ~set->words[i];
+	}
+	if (set->capacity % INDEX_SET_WORD_BITS != 0)
+	{
+		set->words[set->words_count - 1] &= (1UL << (set->capacity % INDEX_SET_WORD_BITS)) - 1;
+	}
+	set->count = set->capacity - set->count;
+
+	return PillBigError_Success;
+}
+
+void
+pillbig_index_set_update_count(PillBigIndexSet set)
+{
+	int i;
+
+	set->count = 0;
+	for (i = 0; i < set->words_count; i++)
+	{
+		set->count += pillbig_index_set_count_bits(set->words[i]);
+	}
+}
+
+
+
+static int
+pillbig_index_set_get_lowest_bit(unsigned long word)
+{
+#if defined(__GNUC__)
+	return __builtin_ctzl(word);
+#else
+	int bit = 0;
+
+	while ((word & 1) == 0)
+	{
+		word >>= 1;
+		bit++;
+	}
+
+	return bit;
+#endif
+}
+
+static int
+pillbig_index_set_count_bits(unsigned long word)
+{
+#if defined(__GNUC__)
+	return __builtin_popcountl(word);
+#else
+	int count = 0;
+
+	for (; word != 0; word &= word - 1)
+	{
+		count++;
+	}
+
+	return count;
+#endif
+}
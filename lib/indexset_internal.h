@@ -0,0 +1,42 @@
+/*
+ *  libpillbig
+ *  A library to deal with Blood Omen: Legacy of Kain pill.big files.
+ */
+
+/**
+ *  @file
+ *  @brief
+ *  	Internal shared implementation of the PillBigIndexSet object.
+ *
+ *  @author  Alfonso Ruzafa <superruzafa@gmail.com>
+ *  @version SVN $Id$
+ */
+
+#ifndef __PILLBIG_INDEXSET_INTERNAL_H__
+#define __PILLBIG_INDEXSET_INTERNAL_H__
+
+#include <pillbig/indexset.h>
+
+/**
+ *  Bits per bitmap word.
+ */
+#define INDEX_SET_WORD_BITS (8 * (int)sizeof(unsigned long))
+
+struct _PillBigIndexSet
+{
+	int              capacity;       /**< Indices are lower than this. */
+	int              count;          /**< Count of indices. */
+	int              words_count;    /**< Count of bitmap words. */
+	unsigned long   *words;          /**< Bitmap, a bit per index. Bits past capacity are clear. */
+};
+
+/**
+ *  Counts again the indices of a set, once its words are written.
+ *
+ *  @param set
+ *  	Index set.
+ */
+void
+pillbig_index_set_update_count(PillBigIndexSet set);
+
+#endif
@@ -18,5 +18,6 @@
 #include "common_internal.h"
 #include "error_internal.h"
 #include "file_internal.h"
+#include "audio_internal.h"
 
 #endif
@@ -0,0 +1,266 @@
+/*
+ *  libpillbig
+ *  A library to deal with Blood Omen: Legacy of Kain pill.big files.
+ */
+
+/**
+ *  @file
+ *  @brief
+ *  	Polyphase windowed-sinc PCM resampler. Implementation file.
+ *
+ *  @author  Alfonso Ruzafa <superruzafa@gmail.com>
+ *  @version SVN $Id$
+ *  @remarks
+ *  	The rates ratio is reduced to up/down. Each output sample is
+ *  	computed with the filter phase matching its position between two
+ *  	input samples, so only the taps actually used are evaluated.
+ */
+
+
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "error_internal.h"
+#include "common_internal.h"
+#include "resample.h"
+
+
+
+/**
+ *  Greatest common divisor.
+ */
+static int
+pillbig_audio_resampler_gcd(int a, int b);
+
+/**
+ *  Computes the filter phases of a resampler.
+ *
+ *  @param resampler
+ *  	Resampler with up, down, taps and filters already set.
+ */
+static void
+pillbig_audio_resampler_build_filters(PillBigAudioResampler *resampler);
+
+
+
+PillBigAudioResampler *
+pillbig_audio_resampler_new(int input_rate, int output_rate)
+{
+	SET_ERROR_RETURN_VALUE_IF_FAIL(input_rate > 0 && output_rate > 0,
+		PillBigError_InvalidSampleRate, NULL);
+
+	PillBigAudioResampler *resampler;
+	int gcd = pillbig_audio_resampler_gcd(input_rate, output_rate);
+	int zero_crossings;
+
+	resampler = (PillBigAudioResampler *)malloc(sizeof(PillBigAudioResampler));
+	SET_ERROR_RETURN_VALUE_IF_FAIL(resampler != NULL, PillBigError_SystemError, NULL);
+	memset(resampler, 0, sizeof(PillBigAudioResampler));
+
+	resampler->up   = output_rate / gcd;
+	resampler->down = input_rate / gcd;
+
+	/*
+	 * When downsampling the filter gets wider as its cutoff lowers.
+	 * Taps are a multiple of 8 so the dot product can be unrolled.
+	 */
+	zero_crossings = AUDIO_RESAMPLER_ZERO_CROSSINGS *
+		MAX((resampler->down + resampler->up - 1) / resampler->up, 1);
+	resampler->taps = (2 * zero_crossings + 7) / 8 * 8;
+
+	resampler->filters = (float *)malloc(
+		resampler->up * resampler->taps * sizeof(float));
+	resampler->history = (float *)malloc(
+		(resampler->taps + MAX(AUDIO_RESAMPLER_BLOCK, resampler->taps)) * sizeof(float));
+
+	if (resampler->filters == NULL || resampler->history == NULL)
+	{
+		pillbig_audio_resampler_free(resampler);
+		pillbig_error_set(PillBigError_SystemError);
+		return NULL;
+	}
+
+	pillbig_audio_resampler_build_filters(resampler);
+
+	/*
+	 * Leading silence centers the filter on the first input sample.
+	 */
+	resampler->history_count = resampler->taps / 2 - 1;
+	memset(resampler->history, 0, resampler->history_count * sizeof(float));
+
+	return resampler;
+}
+
+void
+pillbig_audio_resampler_free(PillBigAudioResampler *resampler)
+{
+	if (resampler != NULL)
+	{
+		free(resampler->filters);
+		free(resampler->history);
+		free(resampler);
+	}
+}
+
+int
+pillbig_audio_resampler_get_max_output(PillBigAudioResampler *resampler,
+	int input_count)
+{
+	return (int)(((long long)(input_count + resampler->taps) * resampler->up)
+		/ resampler->down) + 1;
+}
+
+int
+pillbig_audio_resampler_get_output_count(int input_rate, int output_rate,
+	int input_count)
+{
+	return (int)(((long long)input_count * output_rate + input_rate - 1) / input_rate);
+}
+
+int
+pillbig_audio_resampler_get_input_count(int input_rate, int output_rate,
+	int output_count)
+{
+	return (int)MIN(((long long)output_count * input_rate + output_rate - 1) / output_rate,
+		INT_MAX);
+}
+
+int
+pillbig_audio_resampler_process(PillBigAudioResampler *resampler,
+	const short *input, int input_count, short *output)
+{
+	const int taps = resampler->taps;
+	long long output_limit = -1;
+	float sums[8], value;
+	const float *filter, *samples;
+	int produced = 0;
+	int i, j, k, start;
+
+	if (input != NULL)
+	{
+		for (i = 0; i < input_count; i++)
+		{
+			resampler->history[resampler->history_count++] = input[i];
+		}
+		resampler->input_count += input_count;
+	}
+	else
+	{
+		/*
+		 * Trailing silence lets the filter reach the last input sample.
+		 */
+		for (i = 0; i < taps / 2; i++)
+		{
+			resampler->history[resampler->history_count++] = 0.0f;
+		}
+		output_limit = (resampler->input_count * resampler->up +
+			resampler->down - 1) / resampler->down;
+	}
+
+	while (resampler->position / resampler->up + taps <= resampler->history_count &&
+	       resampler->output_count != output_limit)
+	{
+		filter  = resampler->filters + (resampler->position % resampler->up) * taps;
+		samples = resampler->history + resampler->position / resampler->up;
+
+		/*
+		 * Independent partial sums so the loop can be vectorized.
+		 */
+		for (k = 0; k < 8; k++)
+		{
+			sums[k] = 0.0f;
+		}
+		for (j = 0; j < taps; j += 8)
+		{
+			for (k = 0; k < 8; k++)
+			{
+				sums[k] += filter[j + k] * samples[j + k];
+			}
+		}
+		value = ((sums[0] + sums[4]) + (sums[1] + sums[5])) +
+		        ((sums[2] + sums[6]) + (sums[3] + sums[7]));
+
+		output[produced++] = (short)MIN(MAX(floorf(value + 0.5f), -32768.0f), 32767.0f);
+		resampler->output_count++;
+		resampler->position += resampler->down;
+	}
+
+	/*
+	 * Drop the input samples no longer needed.
+	 */
+	start = MIN(resampler->position / resampler->up, resampler->history_count);
+	memmove(resampler->history, resampler->history + start,
+		(resampler->history_count - start) * sizeof(float));
+	resampler->history_count -= start;
+	resampler->position -= start * resampler->up;
+
+	return produced;
+}
+
+
+
+static int
+pillbig_audio_resampler_gcd(int a, int b)
+{
+	int t;
+
+	while (b != 0)
+	{
+		t = a % b;
+		a = b;
+		b = t;
+	}
+
+	return a;
+}
+
+static void
+pillbig_audio_resampler_build_filters(PillBigAudioResampler *resampler)
+{
+	const int taps = resampler->taps;
+	const double half = taps / 2.0;
+	double cutoff, t, x, value, sum;
+	float *filter;
+	int phase, j;
+
+	cutoff = AUDIO_RESAMPLER_ROLLOFF *
+		MIN(1.0, (double)resampler->up / resampler->down);
+
+	for (phase = 0; phase < resampler->up; phase++)
+	{
+		filter = resampler->filters + phase * taps;
+		sum = 0.0;
+
+		for (j = 0; j < taps; j++)
+		{
+			/*
+			 * Distance in input samples between tap j and the output
+			 * sample, Blackman windowed.
+			 */
+			t = j - (taps / 2 - 1) - (double)phase / resampler->up;
+			x = M_PI * cutoff * t;
+			value = (x == 0.0) ? cutoff : cutoff * sin(x) / x;
+			if (fabs(t) < half)
+			{
+				value *= 0.42 + 0.5 * cos(M_PI * t / half) + 0.08 * cos(2.0 * M_PI * t / half);
+			}
+			else
+			{
+				value = 0.0;
+			}
+
+			filter[j] = value;
+			sum += value;
+		}
+
+		/*
+		 * Unity gain for every phase.
+		 */
+		for (j = 0; j < taps; j++)
+		{
+			filter[j] /= sum;
+		}
+	}
+}
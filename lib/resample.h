@@ -0,0 +1,148 @@
+/*
+ *  libpillbig
+ *  A library to deal with Blood Omen: Legacy of Kain pill.big files.
+ */
+
+/**
+ *  @file
+ *  @brief
+ *  	Polyphase windowed-sinc PCM resampler.
+ *
+ *  @author  Alfonso Ruzafa <superruzafa@gmail.com>
+ *  @version SVN $Id$
+ */
+
+#ifndef __PILLBIG_AUDIO_RESAMPLE_H__
+#define __PILLBIG_AUDIO_RESAMPLE_H__
+
+#include <stdio.h>
+#include <pillbig/common.h>
+#include "audio_internal.h"
+
+/**
+ *  Maximum count of input samples per resampler call.
+ */
+#define AUDIO_RESAMPLER_BLOCK 1024
+
+/**
+ *  Filter zero crossings at each side of the center, when upsampling.
+ */
+#define AUDIO_RESAMPLER_ZERO_CROSSINGS 8
+
+/**
+ *  Filter cutoff relative to the lowest Nyquist frequency.
+ */
+#define AUDIO_RESAMPLER_ROLLOFF 0.95
+
+/**
+ *  Resampler state.
+ */
+typedef struct
+{
+	int         up;                 /**< Interpolation factor. */
+	int         down;               /**< Decimation factor. */
+	int         taps;               /**< Coefficients per filter phase. Multiple of 8. */
+	float      *filters;            /**< up filter phases of taps coefficients each. */
+	float      *history;            /**< Pending input samples. */
+	int         history_count;      /**< Count of pending input samples. */
+	int         position;           /**< Next output position, in 1/up input samples from the history start. */
+	long long   input_count;        /**< Input samples consumed. */
+	long long   output_count;       /**< Output samples produced. */
+}
+PillBigAudioResampler;
+
+BEGIN_C_DECLS
+
+/**
+ *  Creates a resampler.
+ *
+ *  @param input_rate
+ *  	Input sample rate.
+ *  @param output_rate
+ *  	Output sample rate.
+ *  @return
+ *  	Resampler if successful. NULL otherwise.
+ */
+PillBigAudioResampler *
+pillbig_audio_resampler_new(int input_rate, int output_rate);
+
+/**
+ *  Frees a resampler.
+ *
+ *  @param resampler
+ *  	Resampler to be freed.
+ */
+void
+pillbig_audio_resampler_free(PillBigAudioResampler *resampler);
+
+/**
+ *  Gets the maximum count of samples a resampler call can produce.
+ *
+ *  @param resampler
+ *  	Resampler.
+ *  @param input_count
+ *  	Count of input samples.
+ *  @return
+ *  	Maximum count of output samples.
+ */
+int
+pillbig_audio_resampler_get_max_output(PillBigAudioResampler *resampler,
+	int input_count);
+
+/**
+ *  Gets the count of samples produced when resampling a given count
+ *  of samples.
+ *
+ *  @param input_rate
+ *  	Input sample rate.
+ *  @param output_rate
+ *  	Output sample rate.
+ *  @param input_count
+ *  	Count of input samples.
+ *  @return
+ *  	Count of output samples.
+ */
+int
+pillbig_audio_resampler_get_output_count(int input_rate, int output_rate,
+	int input_count);
+
+/**
+ *  Gets the least count of samples to resample to produce a given count
+ *  of samples.
+ *
+ *  @param input_rate
+ *  	Input sample rate.
+ *  @param output_rate
+ *  	Output sample rate.
+ *  @param output_count
+ *  	Count of output samples.
+ *  @return
+ *  	Count of input samples.
+ */
+int
+pillbig_audio_resampler_get_input_count(int input_rate, int output_rate,
+	int output_count);
+
+/**
+ *  Resamples a block of PCM samples.
+ *
+ *  @param resampler
+ *  	Resampler.
+ *  @param input
+ *  	Input samples. NULL to flush the samples still pending at the
+ *  	end of the audio.
+ *  @param input_count
+ *  	Count of input samples. At most AUDIO_RESAMPLER_BLOCK.
+ *  @param output
+ *  	Output samples. It must hold the count given by
+ *  	pillbig_audio_resampler_get_max_output().
+ *  @return
+ *  	Count of output samples.
+ */
+int
+pillbig_audio_resampler_process(PillBigAudioResampler *resampler,
+	const short *input, int input_count, short *output);
+
+END_C_DECLS
+
+#endif
@@ -0,0 +1,546 @@
+/*
+ *  libpillbig
+ *  A library to deal with Blood Omen: Legacy of Kain pill.big files.
+ */
+
+/**
+ *  @file
+ *  @brief
+ *  	Output sinks. Implementation file.
+ *
+ *  @author  Alfonso Ruzafa <superruzafa@gmail.com>
+ *  @version SVN $Id$
+ *  @remarks
+ *  	Streams already have their own buffer and memory outputs need
+ *  	none, so only file descriptors and callbacks are written through
+ *  	the sink buffer.
+ */
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <pillbig/sink.h>
+#include "error_internal.h"
+#include "common_internal.h"
+
+/**
+ *  Size of the buffer gathering small writes.
+ */
+#define SINK_BUFFER_SIZE 8192
+
+/**
+ *  Maximum blocks written by a single system call.
+ */
+#define SINK_MAX_VECTORS 16
+
+/**
+ *  Initial size of growable memory sinks.
+ */
+#define SINK_MEMORY_SIZE 8192
+
+/**
+ *  Sink outputs.
+ */
+typedef enum
+{
+	PillBigSinkType_File,        /**< Stream. */
+	PillBigSinkType_Fd,          /**< File descriptor. */
+	PillBigSinkType_Memory,      /**< Growable memory buffer. */
+	PillBigSinkType_Buffer,      /**< Caller buffer. */
+	PillBigSinkType_Callback,    /**< User callbacks. */
+}
+PillBigSinkType;
+
+/**
+ *  Sink object.
+ */
+struct _PillBigSink
+{
+	PillBigSinkType             type;                        /**< Output type. */
+	FILE                       *file;                        /**< Output stream. */
+	int                         fd;                          /**< Output file descriptor. */
+	PillBigSinkWriteCallback    write;                       /**< User write callback. */
+	PillBigSinkSeekCallback     seek;                        /**< User seek callback. */
+	void                       *user_data;                   /**< User callbacks data. */
+	unsigned char              *data;                        /**< Memory output. */
+	int                         data_size;                   /**< Bytes written into the memory output. */
+	int                         data_capacity;               /**< Memory output size. */
+	long                        position;                    /**< Output position, buffered data excluded. */
+	int                         seekable;                    /**< Whether the output allows seeking. */
+	unsigned char               buffer[SINK_BUFFER_SIZE];    /**< Data not written yet. */
+	int                         buffered;                    /**< Bytes in the buffer. */
+};
+
+
+
+/**
+ *  Allocates a sink.
+ *
+ *  @param type
+ *  	Output type.
+ *  @return
+ *  	Sink if successful. NULL otherwise.
+ */
+static PillBigSink
+pillbig_sink_new(PillBigSinkType type);
+
+/**
+ *  Writes blocks of data straight into the sink output.
+ *
+ *  @param sink
+ *  	Sink.
+ *  @param vectors
+ *  	Blocks to be written. They are modified on partial writes.
+ *  @param count
+ *  	Count of blocks.
+ *  @return
+ *  	Operation result.
+ */
+static PillBigError
+pillbig_sink_output(PillBigSink sink, PillBigSinkVector *vectors, int count);
+
+/**
+ *  Writes blocks of data into a memory output.
+ *
+ *  @param sink
+ *  	Memory or caller buffer sink.
+ *  @param vectors
+ *  	Blocks to be written.
+ *  @param count
+ *  	Count of blocks.
+ *  @return
+ *  	Operation result.
+ */
+static PillBigError
+pillbig_sink_output_memory(PillBigSink sink, const PillBigSinkVector *vectors,
+	int count);
+
+/**
+ *  Writes the buffered data into the sink output.
+ *
+ *  @param sink
+ *  	Sink.
+ *  @return
+ *  	Operation result.
+ */
+static PillBigError
+pillbig_sink_flush_buffer(PillBigSink sink);
+
+
+
+PillBigSink
+pillbig_sink_new_from_file(FILE *file)
+{
+	pillbig_error_clear();
+	SET_ERROR_RETURN_VALUE_IF_FAIL(file != NULL, PillBigError_InvalidStream, NULL);
+
+	PillBigSink sink = pillbig_sink_new(PillBigSinkType_File);
+	RETURN_VALUE_IF_FAIL(sink != NULL, NULL);
+
+	sink->file = file;
+	sink->seekable = ftell(file) != -1 && fseek(file, 0, SEEK_CUR) == 0;
+
+	return sink;
+}
+
+PillBigSink
+pillbig_sink_new_from_fd(int fd)
+{
+	pillbig_error_clear();
+	SET_ERROR_RETURN_VALUE_IF_FAIL(fd >= 0, PillBigError_InvalidStream, NULL);
+
+	PillBigSink sink = pillbig_sink_new(PillBigSinkType_Fd);
+	RETURN_VALUE_IF_FAIL(sink != NULL, NULL);
+
+	sink->fd = fd;
+	sink->position = lseek(fd, 0, SEEK_CUR);
+	sink->seekable = sink->position != -1;
+	if (!sink->seekable)
+	{
+		sink->position = 0;
+	}
+
+	return sink;
+}
+
+PillBigSink
+pillbig_sink_new_memory()
+{
+	pillbig_error_clear();
+
+	PillBigSink sink = pillbig_sink_new(PillBigSinkType_Memory);
+	RETURN_VALUE_IF_FAIL(sink != NULL, NULL);
+
+	sink->data = (unsigned char *)malloc(SINK_MEMORY_SIZE);
+	if (sink->data == NULL)
+	{
+		free(sink);
+		pillbig_error_set(PillBigError_SystemError);
+		return NULL;
+	}
+	sink->data_capacity = SINK_MEMORY_SIZE;
+	sink->seekable = 1;
+
+	return sink;
+}
+
+PillBigSink
+pillbig_sink_new_from_buffer(void *buffer, int size)
+{
+	pillbig_error_clear();
+	SET_ERROR_RETURN_VALUE_IF_FAIL(buffer != NULL && size >= 0,
+		PillBigError_InvalidStream, NULL);
+
+	PillBigSink sink = pillbig_sink_new(PillBigSinkType_Buffer);
+	RETURN_VALUE_IF_FAIL(sink != NULL, NULL);
+
+	sink->data = (unsigned char *)buffer;
+	sink->data_capacity = size;
+	sink->seekable = 1;
+
+	return sink;
+}
+
+PillBigSink
+pillbig_sink_new_from_callback(PillBigSinkWriteCallback write,
+	PillBigSinkSeekCallback seek, void *user_data)
+{
+	pillbig_error_clear();
+	SET_ERROR_RETURN_VALUE_IF_FAIL(write != NULL, PillBigError_InvalidStream, NULL);
+
+	PillBigSink sink = pillbig_sink_new(PillBigSinkType_Callback);
+	RETURN_VALUE_IF_FAIL(sink != NULL, NULL);
+
+	sink->write = write;
+	sink->seek = seek;
+	sink->user_data = user_data;
+	sink->seekable = seek != NULL;
+
+	return sink;
+}
+
+void
+pillbig_sink_free(PillBigSink sink)
+{
+	PillBigError error = pillbig_error_get();
+
+	if (sink != NULL)
+	{
+		pillbig_sink_flush_buffer(sink);
+		if (sink->type == PillBigSinkType_Memory)
+		{
+			free(sink->data);
+		}
+		free(sink);
+	}
+
+	pillbig_error_set(error);
+}
+
+PillBigError
+pillbig_sink_write(PillBigSink sink, const void *data, int size)
+{
+	PillBigSinkVector vector;
+
+	vector.data = data;
+	vector.size = size;
+
+	return pillbig_sink_writev(sink, &vector, 1);
+}
+
+PillBigError
+pillbig_sink_writev(PillBigSink sink, const PillBigSinkVector *vectors, int count)
+{
+	pillbig_error_clear();
+	SET_RETURN_ERROR_IF_FAIL(sink != NULL, PillBigError_InvalidStream);
+	SET_RETURN_ERROR_IF_FAIL(vectors != NULL || count == 0, PillBigError_UnknownError);
+
+	PillBigSinkVector blocks[SINK_MAX_VECTORS];
+	int i, size = 0;
+
+	for (i = 0; i < count; i++)
+	{
+		SET_RETURN_ERROR_IF_FAIL(vectors[i].size >= 0, PillBigError_UnknownError);
+		size += vectors[i].size;
+	}
+
+	switch (sink->type)
+	{
+		case PillBigSinkType_File:
+			for (i = 0; i < count && pillbig_no_error(); i += SINK_MAX_VECTORS)
+			{
+				memcpy(blocks, vectors + i,
+					MIN(count - i, SINK_MAX_VECTORS) * sizeof(PillBigSinkVector));
+				pillbig_sink_output(sink, blocks, MIN(count - i, SINK_MAX_VECTORS));
+			}
+			break;
+
+		case PillBigSinkType_Memory:
+		case PillBigSinkType_Buffer:
+			pillbig_sink_output_memory(sink, vectors, count);
+			break;
+
+		default:
+			/*
+			 * Small writes are gathered. Otherwise the buffered data and
+			 * the new blocks are written together, in a single system
+			 * call when possible.
+			 */
+			if (sink->buffered + size <= SINK_BUFFER_SIZE)
+			{
+				for (i = 0; i < count; i++)
+				{
+					memcpy(sink->buffer + sink->buffered, vectors[i].data, vectors[i].size);
+					sink->buffered += vectors[i].size;
+				}
+			}
+			else if (count < SINK_MAX_VECTORS)
+			{
+				blocks[0].data = sink->buffer;
+				blocks[0].size = sink->buffered;
+				memcpy(blocks + 1, vectors, count * sizeof(PillBigSinkVector));
+				sink->buffered = 0;
+				pillbig_sink_output(sink, blocks, count + 1);
+			}
+			else
+			{
+				pillbig_sink_flush_buffer(sink);
+				for (i = 0; i < count && pillbig_no_error(); i += SINK_MAX_VECTORS)
+				{
+					memcpy(blocks, vectors + i,
+						MIN(count - i, SINK_MAX_VECTORS) * sizeof(PillBigSinkVector));
+					pillbig_sink_output(sink, blocks, MIN(count - i, SINK_MAX_VECTORS));
+				}
+			}
+			break;
+	}
+
+	return pillbig_error_get();
+}
+
+PillBigError
+pillbig_sink_flush(PillBigSink sink)
+{
+	pillbig_error_clear();
+	SET_RETURN_ERROR_IF_FAIL(sink != NULL, PillBigError_InvalidStream);
+
+	return pillbig_sink_flush_buffer(sink);
+}
+
+int
+pillbig_sink_is_seekable(PillBigSink sink)
+{
+	pillbig_error_clear();
+	SET_ERROR_RETURN_VALUE_IF_FAIL(sink != NULL, PillBigError_InvalidStream, 0);
+
+	return sink->seekable;
+}
+
+long
+pillbig_sink_tell(PillBigSink sink)
+{
+	pillbig_error_clear();
+	SET_ERROR_RETURN_VALUE_IF_FAIL(sink != NULL, PillBigError_InvalidStream, -1);
+
+	long position = sink->position + sink->buffered;
+
+	if (sink->type == PillBigSinkType_File)
+	{
+		position = ftell(sink->file);
+		SET_ERROR_IF_FAIL(position != -1, PillBigError_SystemError);
+	}
+
+	return position;
+}
+
+PillBigError
+pillbig_sink_seek(PillBigSink sink, long position)
+{
+	pillbig_error_clear();
+	SET_RETURN_ERROR_IF_FAIL(sink != NULL, PillBigError_InvalidStream);
+	SET_RETURN_ERROR_IF_FAIL(sink->seekable, PillBigError_InvalidStream);
+	SET_RETURN_ERROR_IF_FAIL(position >= 0, PillBigError_UnknownError);
+
+	int result = 0;
+
+	SET_RETURN_ERROR_IF_FAIL(pillbig_sink_flush_buffer(sink) == PillBigError_Success,
+		pillbig_error_get());
+
+	switch (sink->type)
+	{
+		case PillBigSinkType_File:
+			result = fseek(sink->file, position, SEEK_SET);
+			break;
+		case PillBigSinkType_Fd:
+			result = (lseek(sink->fd, position, SEEK_SET) == -1) ? -1 : 0;
+			break;
+		case PillBigSinkType_Memory:
+		case PillBigSinkType_Buffer:
+			result = (position <= sink->data_size) ? 0 : -1;
+			break;
+		case PillBigSinkType_Callback:
+			result = sink->seek(position, sink->user_data);
+			break;
+	}
+	SET_RETURN_ERROR_IF_FAIL(result == 0, PillBigError_SystemError);
+
+	sink->position = position;
+
+	return PillBigError_Success;
+}
+
+const void *
+pillbig_sink_get_data(PillBigSink sink, int *size)
+{
+	pillbig_error_clear();
+	SET_ERROR_RETURN_VALUE_IF_FAIL(sink != NULL, PillBigError_InvalidStream, NULL);
+
+	if (sink->type != PillBigSinkType_Memory && sink->type != PillBigSinkType_Buffer)
+	{
+		return NULL;
+	}
+
+	if (size != NULL)
+	{
+		*size = sink->data_size;
+	}
+
+	return sink->data;
+}
+
+
+
+static PillBigSink
+pillbig_sink_new(PillBigSinkType type)
+{
+	PillBigSink sink = (PillBigSink)malloc(sizeof(struct _PillBigSink));
+	SET_ERROR_RETURN_VALUE_IF_FAIL(sink != NULL, PillBigError_SystemError, NULL);
+	memset(sink, 0, sizeof(struct _PillBigSink));
+
+	sink->type = type;
+	sink->fd = -1;
+
+	return sink;
+}
+
+static PillBigError
+pillbig_sink_output(PillBigSink sink, PillBigSinkVector *vectors, int count)
+{
+	struct iovec iov[SINK_MAX_VECTORS];
+	int i, result;
+
+	/*
+	 * Blocks fully written are skipped, a partial write resumes
+	 * in the middle of its block.
+	 */
+	while (count > 0 && vectors->size == 0)
+	{
+		vectors++;
+		count--;
+	}
+
+	while (count > 0)
+	{
+		switch (sink->type)
+		{
+			case PillBigSinkType_File:
+				result = fwrite(vectors->data, sizeof(char), vectors->size, sink->file);
+				SET_RETURN_ERROR_IF_FAIL(result > 0, PillBigError_SystemError);
+				break;
+
+			case PillBigSinkType_Fd:
+				for (i = 0; i < count && i < SINK_MAX_VECTORS; i++)
+				{
+					iov[i].iov_base = (void *)vectors[i].data;
+					iov[i].iov_len  = vectors[i].size;
+				}
+				result = writev(sink->fd, iov, i);
+				if (result == -1 && errno == EINTR)
+				{
+					continue;
+				}
+				SET_RETURN_ERROR_IF_FAIL(result > 0, PillBigError_SystemError);
+				break;
+
+			case PillBigSinkType_Callback:
+				result = sink->write(vectors->data, vectors->size, sink->user_data);
+				SET_RETURN_ERROR_IF_FAIL(result > 0, PillBigError_SystemError);
+				break;
+
+			default:
+				return pillbig_sink_output_memory(sink, vectors, count);
+		}
+
+		sink->position += result;
+		while (count > 0 && result >= vectors->size)
+		{
+			result -= vectors->size;
+			vectors++;
+			count--;
+		}
+		if (count > 0)
+		{
+			vectors->data = (const char *)vectors->data + result;
+			vectors->size -= result;
+		}
+	}
+
+	return PillBigError_Success;
+}
+
+static PillBigError
+pillbig_sink_output_memory(PillBigSink sink, const PillBigSinkVector *vectors,
+	int count)
+{
+	unsigned char *data;
+	long end = sink->position;
+	int i, capacity;
+
+	for (i = 0; i < count; i++)
+	{
+		end += vectors[i].size;
+	}
+
+	if (end > sink->data_capacity)
+	{
+		SET_RETURN_ERROR_IF_FAIL(sink->type == PillBigSinkType_Memory,
+			PillBigError_BufferTooSmall);
+
+		capacity = MAX(sink->data_capacity * 2, end);
+		data = (unsigned char *)realloc(sink->data, capacity);
+		SET_RETURN_ERROR_IF_FAIL(data != NULL, PillBigError_SystemError);
+		sink->data = data;
+		sink->data_capacity = capacity;
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		memcpy(sink->data + sink->position, vectors[i].data, vectors[i].size);
+		sink->position += vectors[i].size;
+	}
+	sink->data_size = MAX(sink->data_size, sink->position);
+
+	return PillBigError_Success;
+}
+
+static PillBigError
+pillbig_sink_flush_buffer(PillBigSink sink)
+{
+	PillBigSinkVector block;
+
+	if (sink->buffered > 0)
+	{
+		block.data = sink->buffer;
+		block.size = sink->buffered;
+		sink->buffered = 0;
+		SET_RETURN_ERROR_IF_FAIL(pillbig_sink_output(sink, &block, 1) ==
+			PillBigError_Success, pillbig_error_get());
+	}
+
+	return PillBigError_Success;
+}
@@ -0,0 +1,686 @@
+/*
+ *  libpillbig
+ *  A library to deal with Blood Omen: Legacy of Kain pill.big files.
+ */
+
+/**
+ *  @file
+ *  @brief
+ *  	Input sources. Implementation file.
+ *
+ *  @author  Alfonso Ruzafa <superruzafa@gmail.com>
+ *  @version SVN $Id$
+ */
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <pillbig/source.h>
+#include "error_internal.h"
+#include "common_internal.h"
+#include "source_internal.h"
+
+/**
+ *  Default size of the blocks of ranged sources.
+ */
+#define SOURCE_RANGED_BLOCK_SIZE 65536
+
+/**
+ *  Default count of cached blocks of ranged sources.
+ */
+#define SOURCE_RANGED_BLOCKS_COUNT 64
+
+/**
+ *  Source inputs.
+ */
+typedef enum
+{
+	PillBigSourceType_File,        /**< Stream. */
+	PillBigSourceType_Fd,          /**< File descriptor. */
+	PillBigSourceType_Mapped,      /**< File descriptor mapped in memory. */
+	PillBigSourceType_Memory,      /**< Caller memory. */
+	PillBigSourceType_Callback,    /**< User callback. */
+	PillBigSourceType_Ranged,      /**< User callback behind a block cache. */
+}
+PillBigSourceType;
+
+/**
+ *  Block cache of ranged sources.
+ */
+typedef struct
+{
+	int                  block_size;      /**< Size of each block. */
+	int                  blocks_count;    /**< Count of cached blocks. */
+	long                *tags;            /**< Block held by each slot. -1 if none. */
+	int                 *sizes;           /**< Valid bytes of each slot, short at the end of the input. */
+	unsigned int        *ages;            /**< Last use of each slot. */
+	unsigned int         age;             /**< Use counter. */
+	unsigned char       *data;            /**< Data of every slot. */
+	long                 hint_first;      /**< First block of the last prefetched range. */
+	long                 hint_last;       /**< Last block of the last prefetched range. */
+}
+PillBigSourceCache;
+
+/**
+ *  Source object.
+ */
+struct _PillBigSource
+{
+	PillBigSourceType            type;         /**< Input type. */
+	FILE                        *file;         /**< Input stream. */
+	int                          fd;           /**< Input file descriptor. */
+	const unsigned char         *data;         /**< Memory or mapped input. */
+	long                         size;         /**< Input size. -1 if unknown. */
+	PillBigSourceReadCallback    read;         /**< User read callback. */
+	void                        *user_data;    /**< User callback data. */
+	PillBigSourceCache           cache;        /**< Block cache of ranged sources. */
+};
+
+
+
+/**
+ *  Allocates a source.
+ *
+ *  @param type
+ *  	Input type.
+ *  @return
+ *  	Source if successful. NULL otherwise.
+ */
+static PillBigSource
+pillbig_source_new(PillBigSourceType type);
+
+/**
+ *  Gets the size of a file descriptor.
+ *
+ *  @param fd
+ *  	File descriptor.
+ *  @return
+ *  	Size of regular files. -1 otherwise.
+ */
+static long
+pillbig_source_get_fd_size(int fd);
+
+/**
+ *  Reads through the user callback until the data is complete or
+ *  the end of the input is reached.
+ *
+ *  @param source
+ *  	Callback or ranged source.
+ *  @param buffer
+ *  	Buffer where data will be read.
+ *  @param size
+ *  	Count of bytes to read.
+ *  @param offset
+ *  	Absolute position of the data.
+ *  @return
+ *  	Count of bytes read. -1 on error.
+ */
+static int
+pillbig_source_read_callback(PillBigSource source, void *buffer, int size, long offset);
+
+/**
+ *  Reads data from the block cache of a ranged source, fetching the
+ *  missing blocks.
+ *
+ *  @param source
+ *  	Ranged source.
+ *  @param buffer
+ *  	Buffer where data will be read.
+ *  @param size
+ *  	Count of bytes to read.
+ *  @param offset
+ *  	Absolute position of the data.
+ *  @return
+ *  	Count of bytes read. -1 on error.
+ */
+static int
+pillbig_source_ranged_read(PillBigSource source, unsigned char *buffer, int size,
+	long offset);
+
+/**
+ *  Fetches the missing blocks of a range, consecutive ones in a single
+ *  request.
+ *
+ *  @param source
+ *  	Ranged source.
+ *  @param first
+ *  	First block of the range.
+ *  @param last
+ *  	Last block of the range.
+ *  @return
+ *  	Operation result.
+ */
+static PillBigError
+pillbig_source_ranged_fetch(PillBigSource source, long first, long last);
+
+/**
+ *  Finds the cache slot holding a block.
+ *
+ *  @param source
+ *  	Ranged source.
+ *  @param block
+ *  	Block.
+ *  @return
+ *  	Slot if the block is cached. -1 otherwise.
+ */
+static int
+pillbig_source_ranged_find(PillBigSource source, long block);
+
+
+
+PillBigSource
+pillbig_source_new_from_file(FILE *file)
+{
+	pillbig_error_clear();
+	SET_ERROR_RETURN_VALUE_IF_FAIL(file != NULL, PillBigError_InvalidStream, NULL);
+
+	PillBigSource source = pillbig_source_new(PillBigSourceType_File);
+	RETURN_VALUE_IF_FAIL(source != NULL, NULL);
+
+	source->file = file;
+	source->size = pillbig_source_get_fd_size(fileno(file));
+
+	return source;
+}
+
+PillBigSource
+pillbig_source_new_from_fd(int fd)
+{
+	pillbig_error_clear();
+	SET_ERROR_RETURN_VALUE_IF_FAIL(fd >= 0, PillBigError_InvalidStream, NULL);
+
+	PillBigSource source = pillbig_source_new(PillBigSourceType_Fd);
+	RETURN_VALUE_IF_FAIL(source != NULL, NULL);
+
+	source->fd = fd;
+	source->size = pillbig_source_get_fd_size(fd);
+
+	return source;
+}
+
+PillBigSource
+pillbig_source_new_mapped(int fd)
+{
+	pillbig_error_clear();
+	SET_ERROR_RETURN_VALUE_IF_FAIL(fd >= 0, PillBigError_InvalidStream, NULL);
+
+	long size = pillbig_source_get_fd_size(fd);
+	SET_ERROR_RETURN_VALUE_IF_FAIL(size > 0, PillBigError_InvalidStream, NULL);
+
+	void *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	SET_ERROR_RETURN_VALUE_IF_FAIL(data != MAP_FAILED, PillBigError_SystemError, NULL);
+
+	PillBigSource source = pillbig_source_new(PillBigSourceType_Mapped);
+	if (source == NULL)
+	{
+		munmap(data, size);
+		return NULL;
+	}
+
+	source->data = (const unsigned char *)data;
+	source->size = size;
+
+	return source;
+}
+
+PillBigSource
+pillbig_source_new_from_memory(const void *data, long size)
+{
+	pillbig_error_clear();
+	SET_ERROR_RETURN_VALUE_IF_FAIL(data != NULL && size >= 0,
+		PillBigError_InvalidStream, NULL);
+
+	PillBigSource source = pillbig_source_new(PillBigSourceType_Memory);
+	RETURN_VALUE_IF_FAIL(source != NULL, NULL);
+
+	source->data = (const unsigned char *)data;
+	source->size = size;
+
+	return source;
+}
+
+PillBigSource
+pillbig_source_new_from_callback(PillBigSourceReadCallback read, long size,
+	void *user_data)
+{
+	pillbig_error_clear();
+	SET_ERROR_RETURN_VALUE_IF_FAIL(read != NULL, PillBigError_InvalidStream, NULL);
+
+	PillBigSource source = pillbig_source_new(PillBigSourceType_Callback);
+	RETURN_VALUE_IF_FAIL(source != NULL, NULL);
+
+	source->read = read;
+	source->size = (size >= 0) ? size : -1;
+	source->user_data = user_data;
+
+	return source;
+}
+
+PillBigSource
+pillbig_source_new_ranged(PillBigSourceReadCallback read, long size,
+	int block_size, int blocks_count, void *user_data)
+{
+	pillbig_error_clear();
+	SET_ERROR_RETURN_VALUE_IF_FAIL(read != NULL, PillBigError_InvalidStream, NULL);
+
+	PillBigSource source = pillbig_source_new(PillBigSourceType_Ranged);
+	RETURN_VALUE_IF_FAIL(source != NULL, NULL);
+
+	PillBigSourceCache *cache = &source->cache;
+	int slot;
+
+	source->read = read;
+	source->size = (size >= 0) ? size : -1;
+	source->user_data = user_data;
+
+	cache->block_size   = (block_size > 0) ? block_size : SOURCE_RANGED_BLOCK_SIZE;
+	cache->blocks_count = (blocks_count > 0) ? blocks_count : SOURCE_RANGED_BLOCKS_COUNT;
+	cache->tags  = (long *)malloc(cache->blocks_count * sizeof(long));
+	cache->sizes = (int *)calloc(cache->blocks_count, sizeof(int));
+	cache->ages  = (unsigned int *)calloc(cache->blocks_count, sizeof(unsigned int));
+	cache->data  = (unsigned char *)malloc((size_t)cache->blocks_count * cache->block_size);
+	if (cache->tags == NULL || cache->sizes == NULL || cache->ages == NULL ||
+	    cache->data == NULL)
+	{
+		pillbig_source_free(source);
+		pillbig_error_set(PillBigError_SystemError);
+		return NULL;
+	}
+
+	for (slot = 0; slot < cache->blocks_count; slot++)
+	{
+		cache->tags[slot] = -1;
+	}
+	cache->hint_first = cache->hint_last = -1;
+
+	return source;
+}
+
+void
+pillbig_source_free(PillBigSource source)
+{
+	if (source != NULL)
+	{
+		if (source->type == PillBigSourceType_Mapped)
+		{
+			munmap((void *)source->data, source->size);
+		}
+		free(source->cache.tags);
+		free(source->cache.sizes);
+		free(source->cache.ages);
+		free(source->cache.data);
+		free(source);
+	}
+}
+
+int
+pillbig_source_read_at(PillBigSource source, void *buffer, int size, long offset)
+{
+	pillbig_error_clear();
+	SET_ERROR_RETURN_VALUE_IF_FAIL(source != NULL, PillBigError_InvalidStream, -1);
+	SET_ERROR_RETURN_VALUE_IF_FAIL(buffer != NULL && size >= 0 && offset >= 0,
+		PillBigError_UnknownError, -1);
+
+	int count = 0, result;
+
+	switch (source->type)
+	{
+		case PillBigSourceType_Memory:
+		case PillBigSourceType_Mapped:
+			if (offset < source->size)
+			{
+				count = MIN(size, source->size - offset);
+				memcpy(buffer, source->data + offset, count);
+			}
+			break;
+
+		case PillBigSourceType_File:
+			/*
+			 * Avoid seeking when the stream is already there so stdio
+			 * buffering is kept on sequential reads.
+			 */
+			if (ftell(source->file) != offset || feof(source->file))
+			{
+				result = fseek(source->file, offset, SEEK_SET);
+				SET_ERROR_RETURN_VALUE_IF_FAIL(result == 0, PillBigError_SystemError, -1);
+			}
+			count = fread(buffer, 1, size, source->file);
+			SET_ERROR_RETURN_VALUE_IF_FAIL(count == size || !ferror(source->file),
+				PillBigError_SystemError, -1);
+			break;
+
+		case PillBigSourceType_Fd:
+			while (count < size)
+			{
+				result = pread(source->fd, (char *)buffer + count,
+					size - count, offset + count);
+				if (result == -1 && errno == EINTR)
+				{
+					continue;
+				}
+				SET_ERROR_RETURN_VALUE_IF_FAIL(result >= 0, PillBigError_SystemError, -1);
+
+				if (result == 0)
+				{
+					break;
+				}
+				count += result;
+			}
+			break;
+
+		case PillBigSourceType_Callback:
+			count = pillbig_source_read_callback(source, buffer, size, offset);
+			break;
+
+		case PillBigSourceType_Ranged:
+			count = pillbig_source_ranged_read(source, (unsigned char *)buffer,
+				size, offset);
+			break;
+	}
+
+	return count;
+}
+
+PillBigError
+pillbig_source_prefetch(PillBigSource source, long offset, int size)
+{
+	pillbig_error_clear();
+	SET_RETURN_ERROR_IF_FAIL(source != NULL, PillBigError_InvalidStream);
+	SET_RETURN_ERROR_IF_FAIL(size >= 0 && offset >= 0, PillBigError_UnknownError);
+
+	int block_size = source->cache.block_size;
+
+	if (source->size >= 0)
+	{
+		size = MAX(MIN(size, source->size - offset), 0);
+	}
+
+	if (size > 0)
+	{
+		switch (source->type)
+		{
+			case PillBigSourceType_Fd:
+				posix_fadvise(source->fd, offset, size, POSIX_FADV_WILLNEED);
+				break;
+			case PillBigSourceType_Ranged:
+				/*
+				 * The range may not fit in the cache, the rest is
+				 * fetched as it's read.
+				 */
+				source->cache.hint_first = offset / block_size;
+				source->cache.hint_last  = (offset + size - 1) / block_size;
+				pillbig_source_ranged_fetch(source, source->cache.hint_first,
+					MIN(source->cache.hint_last, source->cache.hint_first +
+					MAX(source->cache.blocks_count / 2, 1) - 1));
+				break;
+			default:
+				break;
+		}
+	}
+
+	return pillbig_error_get();
+}
+
+long
+pillbig_source_get_size(PillBigSource source)
+{
+	pillbig_error_clear();
+	SET_ERROR_RETURN_VALUE_IF_FAIL(source != NULL, PillBigError_InvalidStream, -1);
+
+	return source->size;
+}
+
+void
+pillbig_source_reader_init(PillBigSourceReader *reader, PillBigSource source,
+	long offset)
+{
+	reader->source   = source;
+	reader->offset   = offset;
+	reader->data     = NULL;
+	reader->position = 0;
+	reader->count    = 0;
+	reader->eof      = 0;
+}
+
+int
+pillbig_source_reader_fill(PillBigSourceReader *reader)
+{
+	PillBigSource source = reader->source;
+
+	reader->offset  += reader->position;
+	reader->position = 0;
+	reader->count    = 0;
+
+	/*
+	 * Memory is read in place.
+	 */
+	if (source->type == PillBigSourceType_Memory ||
+	    source->type == PillBigSourceType_Mapped)
+	{
+		if (reader->offset < source->size)
+		{
+			reader->data  = source->data + reader->offset;
+			reader->count = MIN(source->size - reader->offset, INT_MAX);
+		}
+	}
+	else
+	{
+		reader->data  = reader->buffer;
+		reader->count = MAX(pillbig_source_read_at(source, reader->buffer,
+			SOURCE_READER_BUFFER_SIZE, reader->offset), 0);
+	}
+
+	reader->eof = (reader->count == 0);
+
+	return reader->count;
+}
+
+PillBigSource
+pillbig_source_get_concurrent(PillBigSource source)
+{
+	switch (source->type)
+	{
+		case PillBigSourceType_Fd:
+		case PillBigSourceType_Mapped:
+		case PillBigSourceType_Memory:
+			return source;
+		case PillBigSourceType_File:
+			/* Positional reads of the stream descriptor leave its offset alone */
+			fflush(source->file);
+			return pillbig_source_new_from_fd(fileno(source->file));
+		default:
+			return NULL;
+	}
+}
+
+
+
+static PillBigSource
+pillbig_source_new(PillBigSourceType type)
+{
+	PillBigSource source = (PillBigSource)malloc(sizeof(struct _PillBigSource));
+	SET_ERROR_RETURN_VALUE_IF_FAIL(source != NULL, PillBigError_SystemError, NULL);
+	memset(source, 0, sizeof(struct _PillBigSource));
+
+	source->type = type;
+	source->fd = -1;
+	source->size = -1;
+
+	return source;
+}
+
+static long
+pillbig_source_get_fd_size(int fd)
+{
+	struct stat status;
+
+	if (fstat(fd, &status) != 0 || !S_ISREG(status.st_mode))
+	{
+		return -1;
+	}
+
+	return status.st_size;
+}
+
+static int
+pillbig_source_read_callback(PillBigSource source, void *buffer, int size, long offset)
+{
+	int count = 0, result;
+
+	while (count < size)
+	{
+		result = source->read((char *)buffer + count, size - count,
+			offset + count, source->user_data);
+		SET_ERROR_RETURN_VALUE_IF_FAIL(result >= 0, PillBigError_SystemError, -1);
+
+		if (result == 0)
+		{
+			break;
+		}
+		count += result;
+	}
+
+	return count;
+}
+
+static int
+pillbig_source_ranged_read(PillBigSource source, unsigned char *buffer, int size,
+	long offset)
+{
+	PillBigSourceCache *cache = &source->cache;
+	int count = 0, slot, skip, chunk;
+	long block, last;
+
+	if (source->size >= 0)
+	{
+		size = MAX(MIN(size, source->size - offset), 0);
+	}
+
+	while (count < size)
+	{
+		block = (offset + count) / cache->block_size;
+		slot = pillbig_source_ranged_find(source, block);
+		if (slot == -1)
+		{
+			/*
+			 * Blocks up to the end of the read, or of the prefetched
+			 * range when reading it, are fetched together. As many
+			 * as half the cache so none is evicted before being copied.
+			 */
+			last = (offset + size - 1) / cache->block_size;
+			if (cache->hint_first <= block && block <= cache->hint_last)
+			{
+				last = MAX(last, cache->hint_last);
+			}
+			pillbig_source_ranged_fetch(source, block, MIN(last,
+				block + MAX(cache->blocks_count / 2, 1) - 1));
+			RETURN_VALUE_IF_FAIL(pillbig_no_error(), -1);
+
+			slot = pillbig_source_ranged_find(source, block);
+			SET_ERROR_RETURN_VALUE_IF_FAIL(slot != -1, PillBigError_UnknownError, -1);
+		}
+
+		skip  = offset + count - block * cache->block_size;
+		chunk = MIN(cache->sizes[slot] - skip, size - count);
+		if (chunk <= 0)
+		{
+			break;
+		}
+
+		memcpy(buffer + count, cache->data + (size_t)slot * cache->block_size + skip, chunk);
+		count += chunk;
+	}
+
+	return count;
+}
+
+static PillBigError
+pillbig_source_ranged_fetch(PillBigSource source, long first, long last)
+{
+	PillBigSourceCache *cache = &source->cache;
+	unsigned char *data;
+	long block, end;
+	int slot, oldest, i, result;
+
+	for (block = first; block <= last; block = end + 1)
+	{
+		if (pillbig_source_ranged_find(source, block) != -1)
+		{
+			end = block;
+			continue;
+		}
+
+		/*
+		 * Adjacent missing blocks make a single request.
+		 */
+		end = block;
+		while (end < last && end - block + 1 < cache->blocks_count &&
+		       pillbig_source_ranged_find(source, end + 1) == -1)
+		{
+			end++;
+		}
+
+		data = (unsigned char *)malloc((end - block + 1) * cache->block_size);
+		SET_RETURN_ERROR_IF_FAIL(data != NULL, PillBigError_SystemError);
+
+		result = pillbig_source_read_callback(source, data,
+			(end - block + 1) * cache->block_size, block * cache->block_size);
+		if (result < 0)
+		{
+			free(data);
+			return pillbig_error_get();
+		}
+
+		for (i = 0; i <= end - block; i++)
+		{
+			/*
+			 * Least recently used slot.
+			 */
+			oldest = 0;
+			for (slot = 1; slot < cache->blocks_count; slot++)
+			{
+				if (cache->ages[slot] < cache->ages[oldest])
+				{
+					oldest = slot;
+				}
+			}
+
+			cache->tags[oldest]  = block + i;
+			cache->sizes[oldest] = MAX(MIN(result - i * cache->block_size,
+				cache->block_size), 0);
+			cache->ages[oldest]  = ++cache->age;
+			memcpy(cache->data + (size_t)oldest * cache->block_size,
+				data + (size_t)i * cache->block_size, cache->sizes[oldest]);
+		}
+
+		free(data);
+	}
+
+	return PillBigError_Success;
+}
+
+static int
+pillbig_source_ranged_find(PillBigSource source, long block)
+{
+	PillBigSourceCache *cache = &source->cache;
+	int slot;
+
+	for (slot = 0; slot < cache->blocks_count; slot++)
+	{
+		if (cache->tags[slot] == block)
+		{
+			cache->ages[slot] = ++cache->age;
+			return slot;
+		}
+	}
+
+	return -1;
+}
@@ -0,0 +1,108 @@
+/*
+ *  libpillbig
+ *  A library to deal with Blood Omen: Legacy of Kain pill.big files.
+ */
+
+/**
+ *  @file
+ *  @brief
+ *  	Sequential reading of input sources.
+ *
+ *  @author  Alfonso Ruzafa <superruzafa@gmail.com>
+ *  @version SVN $Id$
+ */
+
+#ifndef __PILLBIG_SOURCE_INTERNAL_H__
+#define __PILLBIG_SOURCE_INTERNAL_H__
+
+#include <pillbig/source.h>
+
+/**
+ *  Size of the buffer of source readers.
+ */
+#define SOURCE_READER_BUFFER_SIZE 4096
+
+/**
+ *  Sequential reader of a source, for byte by byte decoders.
+ */
+typedef struct
+{
+	PillBigSource           source;                                /**< Source. */
+	long                    offset;                                /**< Source offset of the data. */
+	const unsigned char    *data;                                  /**< Data read, the buffer or source memory. */
+	int                     position;                              /**< Next byte in the data. */
+	int                     count;                                 /**< Bytes of data. */
+	int                     eof;                                   /**< 1 once a read hit the end of the source. */
+	unsigned char           buffer[SOURCE_READER_BUFFER_SIZE];     /**< Buffer for sources not in memory. */
+}
+PillBigSourceReader;
+
+BEGIN_C_DECLS
+
+/**
+ *  Starts reading a source.
+ *
+ *  @param reader
+ *  	Reader.
+ *  @param source
+ *  	Source.
+ *  @param offset
+ *  	Position of the first byte to read.
+ */
+void
+pillbig_source_reader_init(PillBigSourceReader *reader, PillBigSource source,
+	long offset);
+
+/**
+ *  Reads the next data of a reader. Use the macros below instead.
+ *
+ *  @param reader
+ *  	Reader.
+ *  @return
+ *  	Bytes available. 0 at the end of the source or on error.
+ */
+int
+pillbig_source_reader_fill(PillBigSourceReader *reader);
+
+/**
+ *  Gets a source of the same input that can be read from another
+ *  thread while the source is being read.
+ *
+ *  @param source
+ *  	Source.
+ *  @return
+ *  	The source itself if its reads don't share any state, a new
+ *  	source to be freed by the caller for streams, NULL if the
+ *  	input can't be read concurrently.
+ */
+PillBigSource
+pillbig_source_get_concurrent(PillBigSource source);
+
+END_C_DECLS
+
+/**
+ *  Reads a byte, -1 at the end of the source. Like fgetc().
+ */
+#define pillbig_source_reader_getc(reader) \
+	(((reader)->position < (reader)->count || pillbig_source_reader_fill(reader) > 0) ? \
+	 (reader)->data[(reader)->position++] : -1)
+
+/**
+ *  Skips bytes. Like fseek(..., SEEK_CUR).
+ */
+#define pillbig_source_reader_skip(reader, bytes) \
+	((reader)->position += (bytes))
+
+/**
+ *  Whether a read hit the end of the source. Like feof().
+ */
+#define pillbig_source_reader_eof(reader) \
+	((reader)->eof)
+
+/**
+ *  Current position of a reader.
+ */
+#define pillbig_source_reader_tell(reader) \
+	((reader)->offset + (reader)->position)
+
+#endif
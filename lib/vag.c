@@ -22,6 +22,8 @@
 #include <pillbig/pillbig.h>
 #include "error_internal.h"
 #include "common_internal.h"
+#include "source_internal.h"
+#include "pillbig_internal.h"
 #include "vag.h"
 
 
@@ -38,7 +40,48 @@ double f[5][2] =
 
 
 PillBigError
-pillbig_audio_vag_decode(FILE *input, FILE *output,
+pillbig_audio_vag_prepare(PillBig pillbig, int index, int exact, long *offset,
+	PillBigAudioParameters *parameters)
+{
+	PillBigEntryInfo *info = &pillbig->infos[index];
+
+	/*
+	 * VAG audio files from the PSX version of Blood Omen has a
+	 * non-standard headerless format. The length of the audio is only
+	 * known after finding the end flag.
+	 *
+	 * Decode in a single pass up to the maximum length the file could
+	 * hold, the header is patched later. Only when the header cannot be
+	 * patched the stream is scanned first.
+	 */
+	if ((info->known & PillBigEntryInfo_SamplesCount) || exact)
+	{
+		parameters->samples_count = pillbig_audio_get_samples_count(pillbig, index);
+		SET_RETURN_ERROR_IF_FAIL(parameters->samples_count != -1,
+			PillBigError_SystemError);
+	}
+	else
+	{
+		parameters->samples_count = pillbig_audio_vag_get_max_samples_count(
+			pillbig->source, *offset, pillbig->entries[index].size);
+	}
+	parameters->sample_rate     = AUDIO_SAMPLE_RATE;
+	parameters->channels_count  = 1;
+	parameters->bits_per_sample = 16;
+
+	/*
+	 * If this file has a header then skip it.
+	 */
+	*offset += info->header_size;
+
+	return PillBigError_Success;
+}
+
+/*
+ * Stream decoder body, inlined in every instruction set variant.
+ */
+AUDIO_CODEC_KERNEL PillBigError
+pillbig_audio_vag_decode_kernel(PillBigSource input, long offset, PillBigSink output,
 	PillBigAudioParameters *parameters)
 {
 	SET_RETURN_ERROR_IF_FAIL(input != NULL, PillBigError_InvalidStream);
@@ -48,27 +91,37 @@ pillbig_audio_vag_decode(FILE *input, FILE *output,
 	int remaining_samples = parameters->samples_count;
 	int predict_nr, shift_factor, flags;
 	int i, d, s;
-	int result;
+	unsigned char pcm[28 * 2];
 	double samples[28];
 	double s_1 = 0.0, s_2 = 0.0;
+	PillBigSourceReader reader;
 
 	parameters->samples_count = 0;
+	pillbig_source_reader_init(&reader, input, offset);
 
-	predict_nr = fgetc(input);
-	if (predict_nr != EOF)
+	predict_nr = pillbig_source_reader_getc(&reader);
+	if (predict_nr != -1)
 	{
-		flags = fgetc(input);
+		flags = pillbig_source_reader_getc(&reader);
 	}
-	while (!feof(input) && remaining_samples > 0
+	while (!pillbig_source_reader_eof(&reader) && remaining_samples > 0
 	       && flags != 0x07 && flags != 0x05)
 	{
 		shift_factor = predict_nr & 0x0f;
 		predict_nr >>= 4;
 
+		/*
+		 * Filters out of the table are not valid, don't predict.
+		 */
+		if (predict_nr > 4)
+		{
+			predict_nr = 0;
+		}
+
 		i = 0;
-		while (!feof(input) && i < 28)
+		while (!pillbig_source_reader_eof(&reader) && i < 28)
 		{
-			d = fgetc(input);
+			d = pillbig_source_reader_getc(&reader);
 			s = (d & 0x0f) << 12;
 			if (s & 0x8000)
 			{
@@ -92,76 +145,347 @@ pillbig_audio_vag_decode(FILE *input, FILE *output,
 			s_2 = s_1;
 			s_1 = samples[i];
 			d = (int)(samples[i] + 0.5);
-			result = fputc(d & 0xff, output);
-			SET_ERROR_RETURN_IF_FAIL(result != EOF, PillBigError_SystemError);
-			result = fputc(d >> 8, output);
-			SET_ERROR_RETURN_IF_FAIL(result != EOF, PillBigError_SystemError);
+			pcm[i * 2]     = d & 0xff;
+			pcm[i * 2 + 1] = d >> 8;
 
+			parameters->samples_count++;
+			remaining_samples--;
 			i++;
 		}
 
-		predict_nr = fgetc(input);
-		if (predict_nr != EOF)
+		/*
+		 * Written block by block, little endian whatever the host is.
+		 */
+		SET_RETURN_ERROR_IF_FAIL(pillbig_sink_write(output, pcm, i * 2) ==
+			PillBigError_Success, pillbig_error_get());
+
+		predict_nr = pillbig_source_reader_getc(&reader);
+		if (predict_nr != -1)
+		{
+			flags = pillbig_source_reader_getc(&reader);
+		}
+	}
+
+	return PillBigError_Success;
+}
+
+PillBigError
+pillbig_audio_vag_decode(PillBigSource input, long offset, PillBigSink output,
+	PillBigAudioParameters *parameters)
+{
+	return pillbig_audio_vag_decode_kernel(input, offset, output, parameters);
+}
+
+#ifdef AUDIO_CODEC_X86_VARIANTS
+
+AUDIO_CODEC_TARGET("sse4.1") PillBigError
+pillbig_audio_vag_decode_sse4(PillBigSource input, long offset, PillBigSink output,
+	PillBigAudioParameters *parameters)
+{
+	return pillbig_audio_vag_decode_kernel(input, offset, output, parameters);
+}
+
+AUDIO_CODEC_TARGET("avx2") PillBigError
+pillbig_audio_vag_decode_avx2(PillBigSource input, long offset, PillBigSink output,
+	PillBigAudioParameters *parameters)
+{
+	return pillbig_audio_vag_decode_kernel(input, offset, output, parameters);
+}
+
+#endif
+
+/*
+ * Lanes decoder body, inlined in every instruction set variant.
+ */
+AUDIO_CODEC_KERNEL void
+pillbig_audio_vag_decode_lanes_kernel(PillBigAudioLanes *lanes)
+{
+	double  samples[28][AUDIO_LANES];
+	double  s_1[AUDIO_LANES], s_2[AUDIO_LANES];
+	double  f_0[AUDIO_LANES], f_1[AUDIO_LANES];
+	short   pcm[28][AUDIO_LANES];
+	int     active[AUDIO_LANES];
+	int     position[AUDIO_LANES];
+	int     decoded[AUDIO_LANES];
+	int     active_count;
+	int     lane, i, d, s, count;
+	int     predict_nr, shift_factor, flags;
+	const unsigned char *block;
+
+	for (lane = 0; lane < AUDIO_LANES; lane++)
+	{
+		s_1[lane]      = lanes->start[lane].s_1;
+		s_2[lane]      = lanes->start[lane].s_2;
+		position[lane] = lanes->start[lane].offset;
+		decoded[lane]  = 0;
+		active[lane]   = (lanes->input[lane] != NULL);
+	}
+
+	do
+	{
+		/*
+		 * Unpack the current block of every lane. Finished lanes
+		 * decode silence that is discarded.
+		 */
+		active_count = 0;
+		for (lane = 0; lane < AUDIO_LANES; lane++)
+		{
+			if (active[lane])
+			{
+				block = lanes->input[lane] + position[lane];
+				flags = (position[lane] + 16 <= lanes->input_size[lane]) ? block[1] : 0x07;
+				active[lane] = (decoded[lane] < lanes->samples_count[lane] &&
+				                flags != 0x07 && flags != 0x05);
+			}
+
+			if (!active[lane])
+			{
+				f_0[lane] = f_1[lane] = 0.0;
+				for (i = 0; i < 28; i++)
+				{
+					samples[i][lane] = 0.0;
+				}
+				continue;
+			}
+
+			active_count++;
+			shift_factor = block[0] & 0x0f;
+			predict_nr   = block[0] >> 4;
+			if (predict_nr > 4)
+			{
+				predict_nr = 0;
+			}
+			f_0[lane] = f[predict_nr][0];
+			f_1[lane] = f[predict_nr][1];
+
+			for (i = 0; i < 28; i += 2)
+			{
+				d = block[2 + i / 2];
+				s = (d & 0x0f) << 12;
+				if (s & 0x8000)
+				{
+					s |= 0xffff0000;
+				}
+				samples[i][lane] = (double)(s >> shift_factor);
+
+				s = (d & 0xf0) << 8;
+				if (s & 0x8000)
+				{
+					s |= 0xffff0000;
+				}
+				samples[i + 1][lane] = (double)(s >> shift_factor);
+			}
+		}
+
+		/*
+		 * Same filter than pillbig_audio_vag_decode(), lane-wise.
+		 * Operations order is kept so results are bit-exact.
+		 */
+		for (i = 0; i < 28; i++)
 		{
-			flags = fgetc(input);
+			for (lane = 0; lane < AUDIO_LANES; lane++)
+			{
+				samples[i][lane] += s_1[lane] * f_0[lane] + s_2[lane] * f_1[lane];
+				s_2[lane] = s_1[lane];
+				s_1[lane] = samples[i][lane];
+				pcm[i][lane] = (int)(samples[i][lane] + 0.5);
+			}
 		}
 
-		remaining_samples -= 28;
+		for (lane = 0; lane < AUDIO_LANES; lane++)
+		{
+			if (active[lane])
+			{
+				count = MIN(28, lanes->samples_count[lane] - decoded[lane]);
+				for (i = 0; i < count; i++)
+				{
+					lanes->output[lane][decoded[lane] + i] = pcm[i][lane];
+				}
+				decoded[lane]  += count;
+				position[lane] += 16;
+			}
+		}
 	}
+	while (active_count > 0);
 
-	while (remaining_samples-- > 0)
+	for (lane = 0; lane < AUDIO_LANES; lane++)
 	{
-		fputc(0, output);
+		lanes->samples_count[lane] = decoded[lane];
 	}
+}
 
-	return PillBigError_Success;
+void
+pillbig_audio_vag_decode_lanes(PillBigAudioLanes *lanes)
+{
+	pillbig_audio_vag_decode_lanes_kernel(lanes);
+}
+
+#ifdef AUDIO_CODEC_X86_VARIANTS
+
+AUDIO_CODEC_TARGET("sse4.1") void
+pillbig_audio_vag_decode_lanes_sse4(PillBigAudioLanes *lanes)
+{
+	pillbig_audio_vag_decode_lanes_kernel(lanes);
+}
+
+AUDIO_CODEC_TARGET("avx2") void
+pillbig_audio_vag_decode_lanes_avx2(PillBigAudioLanes *lanes)
+{
+	pillbig_audio_vag_decode_lanes_kernel(lanes);
+}
+
+#endif
+
+/*
+ * Resuming decoder body, inlined in every instruction set variant.
+ */
+AUDIO_CODEC_KERNEL int
+pillbig_audio_vag_decode_from_kernel(const unsigned char *input, int input_size,
+	PillBigAudioCheckpoint *state, short *output, int samples_count)
+{
+	double samples[28];
+	int decoded = 0;
+	int predict_nr, shift_factor, flags;
+	int i, d, s;
+	const unsigned char *block;
+
+	while (decoded < samples_count && state->offset + 16 <= input_size)
+	{
+		block = input + state->offset;
+		flags = block[1];
+		if (flags == 0x07 || flags == 0x05)
+		{
+			break;
+		}
+
+		shift_factor = block[0] & 0x0f;
+		predict_nr   = block[0] >> 4;
+		if (predict_nr > 4)
+		{
+			predict_nr = 0;
+		}
+
+		for (i = 0; i < 28; i += 2)
+		{
+			d = block[2 + i / 2];
+			s = (d & 0x0f) << 12;
+			if (s & 0x8000)
+			{
+				s |= 0xffff0000;
+			}
+			samples[i] = (double)(s >> shift_factor);
+
+			s = (d & 0xf0) << 8;
+			if (s & 0x8000)
+			{
+				s |= 0xffff0000;
+			}
+			samples[i + 1] = (double)(s >> shift_factor);
+		}
+
+		/*
+		 * The state may stop in the middle of a block,
+		 * skip the samples already decoded.
+		 */
+		for (i = state->sample - state->offset / 16 * 28;
+		     i < 28 && decoded < samples_count; i++)
+		{
+			samples[i] += state->s_1 * f[predict_nr][0] + state->s_2 * f[predict_nr][1];
+			state->s_2 = state->s_1;
+			state->s_1 = samples[i];
+			if (output != NULL)
+			{
+				output[decoded] = (int)(samples[i] + 0.5);
+			}
+			decoded++;
+			state->sample++;
+		}
+
+		if (i == 28)
+		{
+			state->offset += 16;
+		}
+	}
+
+	return decoded;
 }
 
 int
-pillbig_audio_vag_get_samples_count(FILE *input, int filesize)
+pillbig_audio_vag_decode_from(const unsigned char *input, int input_size,
+	PillBigAudioCheckpoint *state, short *output, int samples_count)
 {
-	int file_position;
+	return pillbig_audio_vag_decode_from_kernel(input, input_size, state, output, samples_count);
+}
+
+#ifdef AUDIO_CODEC_X86_VARIANTS
+
+AUDIO_CODEC_TARGET("sse4.1") int
+pillbig_audio_vag_decode_from_sse4(const unsigned char *input, int input_size,
+	PillBigAudioCheckpoint *state, short *output, int samples_count)
+{
+	return pillbig_audio_vag_decode_from_kernel(input, input_size, state, output, samples_count);
+}
+
+AUDIO_CODEC_TARGET("avx2") int
+pillbig_audio_vag_decode_from_avx2(const unsigned char *input, int input_size,
+	PillBigAudioCheckpoint *state, short *output, int samples_count)
+{
+	return pillbig_audio_vag_decode_from_kernel(input, input_size, state, output, samples_count);
+}
+
+#endif
+
+int
+pillbig_audio_vag_get_samples_count(PillBigSource input, long offset, int filesize,
+	int max_samples_count)
+{
+	PillBigSourceReader reader;
 	int samples_count = 0;
 	int flags;
-	int result;
 
-	file_position = ftell(input);
-
-	if (pillbig_audio_vag_has_header(input))
+	if (pillbig_audio_vag_has_header(input, offset))
 	{
-		result = fseek(input, 64, SEEK_CUR);
-		SET_ERROR_RETURN_VALUE_IF_FAIL(result == 0, PillBigError_SystemError, -1);
+		offset += 64;
 		filesize -= 64;
 	}
 
-	result = fseek(input, 1, SEEK_CUR);
-	SET_ERROR_RETURN_VALUE_IF_FAIL(result == 0, PillBigError_SystemError, -1);
-	flags = fgetc(input);
-	SET_ERROR_RETURN_VALUE_IF_FAIL(flags != EOF, PillBigError_SystemError, -1);
+	/*
+	 * Only the flags byte of each block is read.
+	 */
+	pillbig_source_reader_init(&reader, input, offset);
+	pillbig_source_reader_skip(&reader, 1);
+	flags = pillbig_source_reader_getc(&reader);
+	SET_ERROR_RETURN_VALUE_IF_FAIL(flags != -1, PillBigError_SystemError, -1);
 
-	while (!feof(input) &&
-	       flags != 0x05 && flags != 0x07)
+	while (flags != 0x05 && flags != 0x07
+		&& (max_samples_count == -1 || samples_count < max_samples_count))
 	{
 		samples_count += 28;
-		result = fseek(input, 15, SEEK_CUR);
-		SET_ERROR_RETURN_VALUE_IF_FAIL(result == 0, PillBigError_SystemError, -1);
-		flags = fgetc(input);
-		SET_ERROR_RETURN_VALUE_IF_FAIL(flags != EOF, PillBigError_SystemError, -1);
+		pillbig_source_reader_skip(&reader, 15);
+		flags = pillbig_source_reader_getc(&reader);
+		SET_ERROR_RETURN_VALUE_IF_FAIL(flags != -1, PillBigError_SystemError, -1);
 	}
 
-	fseek(input, file_position, SEEK_SET);
-
 	return MAX(MIN((filesize - 16) / 16 * 28, samples_count), 0);
 }
 
 int
-pillbig_audio_vag_has_header(FILE *input)
+pillbig_audio_vag_get_max_samples_count(PillBigSource input, long offset, int filesize)
+{
+	if (pillbig_audio_vag_has_header(input, offset))
+	{
+		filesize -= 64;
+	}
+
+	return VAG_MAX_SAMPLES_COUNT(filesize);
+}
+
+int
+pillbig_audio_vag_has_header(PillBigSource input, long offset)
 {
-	int magic32;
-	int result;
+	int magic32 = 0;
 
-	result = fread(&magic32, 4, 1, input);
-	fseek(input, -4, SEEK_CUR);
+	pillbig_source_read_at(input, &magic32, 4, offset);
 
 	return magic32 == VAG_MAGIC_ID;
 }
@@ -21,6 +21,15 @@
 #include <stdio.h>
 #include <pillbig/common.h>
 #include "audio_internal.h"
+#include "codec.h"
+
+/**
+ *  Maximum samples count of VAG data of a given size, header excluded.
+ *  Every 16 bytes block holds 28 samples. The last block is the end
+ *  marker and holds none.
+ */
+#define VAG_MAX_SAMPLES_COUNT(data_size) \
+	(((data_size) - 16) / 16 * 28 > 0 ? ((data_size) - 16) / 16 * 28 : 0)
 
 BEGIN_C_DECLS
 
@@ -40,40 +49,192 @@ PillBigError
 pillbig_audio_vag_encode(FILE *input, FILE *output,
 	PillBigAudioParameters *parameters);
 
+/**
+ *  Sets the parameters of a VAG pill.big file up for decoding.
+ *
+ *  @remarks
+ *  	VAG files from the PSX version of Blood Omen have a non-standard
+ *  	headerless format, their length is only known after finding the
+ *  	end flag. Unless already known or an exact count is required,
+ *  	the maximum length the file could hold is given instead and the
+ *  	stream isn't scanned.
+ *
+ *  @param pillbig
+ *  	PillBig object.
+ *  @param index
+ *  	pill.big file index.
+ *  @param exact
+ *  	1 if the samples count must be exact, 0 if an upper bound is enough.
+ *  @param offset
+ *  	Position of the file in the source. On return, position of the
+ *  	VAG data, past the header if any.
+ *  @param parameters
+ *  	Audio parameters of the file, filled on return.
+ *  @return
+ *  	Operation result.
+ */
+PillBigError
+pillbig_audio_vag_prepare(PillBig pillbig, int index, int exact, long *offset,
+	PillBigAudioParameters *parameters);
+
 /**
  *  Decodes a PlayStation VAG ADPCM audio into PCM.
  *
+ *  @remarks
+ *  	Decoding stops at the end flag or when parameters->samples_count
+ *  	samples have been decoded, whatever happens first. On return
+ *  	parameters->samples_count holds the count of decoded samples.
+ *
  *  @param input
- *  	Input VAG ADPCM stream.
+ *  	Input VAG ADPCM source.
+ *  @param offset
+ *  	Position of the VAG data in the source, past the header if any.
  *  @param output
- *  	Output PCM stream.
+ *  	Output PCM sink.
  *  @param parameters
  *  	Audio parameters.
  *  @return
  *  	Operation result.
  */
 PillBigError
-pillbig_audio_vag_decode(FILE *input, FILE *output,
+pillbig_audio_vag_decode(PillBigSource input, long offset, PillBigSink output,
+	PillBigAudioParameters *parameters);
+
+#ifdef AUDIO_CODEC_X86_VARIANTS
+
+/**
+ *  pillbig_audio_vag_decode() built for SSE4.1.
+ */
+PillBigError
+pillbig_audio_vag_decode_sse4(PillBigSource input, long offset, PillBigSink output,
+	PillBigAudioParameters *parameters);
+
+/**
+ *  pillbig_audio_vag_decode() built for AVX2.
+ */
+PillBigError
+pillbig_audio_vag_decode_avx2(PillBigSource input, long offset, PillBigSink output,
 	PillBigAudioParameters *parameters);
 
+#endif
+
+/**
+ *  Decodes several PlayStation VAG ADPCM audios at once, one per lane.
+ *
+ *  @remarks
+ *  	Input data must not include the VAG header. Output is bit-exact
+ *  	with pillbig_audio_vag_decode(). Lanes must start at a block
+ *  	boundary.
+ *
+ *  @param lanes
+ *  	Lanes to be decoded.
+ */
+void
+pillbig_audio_vag_decode_lanes(PillBigAudioLanes *lanes);
+
+#ifdef AUDIO_CODEC_X86_VARIANTS
+
+/**
+ *  pillbig_audio_vag_decode_lanes() built for SSE4.1.
+ */
+void
+pillbig_audio_vag_decode_lanes_sse4(PillBigAudioLanes *lanes);
+
+/**
+ *  pillbig_audio_vag_decode_lanes() built for AVX2.
+ */
+void
+pillbig_audio_vag_decode_lanes_avx2(PillBigAudioLanes *lanes);
+
+#endif
+
+/**
+ *  Decodes PlayStation VAG ADPCM data from memory resuming from a
+ *  decoder state.
+ *
+ *  @param input
+ *  	Encoded data without the VAG header, from the start of the stream.
+ *  @param input_size
+ *  	Encoded data size.
+ *  @param state
+ *  	Decoder state to start from. On return, the state after the last
+ *  	decoded sample.
+ *  @param output
+ *  	Decoded PCM samples. NULL to only advance the state.
+ *  @param samples_count
+ *  	Maximum samples to decode.
+ *  @return
+ *  	Decoded samples count.
+ */
+int
+pillbig_audio_vag_decode_from(const unsigned char *input, int input_size,
+	PillBigAudioCheckpoint *state, short *output, int samples_count);
+
+#ifdef AUDIO_CODEC_X86_VARIANTS
+
+/**
+ *  pillbig_audio_vag_decode_from() built for SSE4.1.
+ */
+int
+pillbig_audio_vag_decode_from_sse4(const unsigned char *input, int input_size,
+	PillBigAudioCheckpoint *state, short *output, int samples_count);
+
+/**
+ *  pillbig_audio_vag_decode_from() built for AVX2.
+ */
+int
+pillbig_audio_vag_decode_from_avx2(const unsigned char *input, int input_size,
+	PillBigAudioCheckpoint *state, short *output, int samples_count);
+
+#endif
+
 /**
  *  Counts the samples of the non-standard headerless VAG files.
  *
+ *  @remarks
+ *  	This walks the stream looking for the end flag, stopping early
+ *  	once max_samples_count samples are counted.
+ *
+ *  @param input
+ *  	VAG ADPCM source.
+ *  @param offset
+ *  	Position of the VAG file in the source.
+ *  @param filesize
+ *  	Input file size.
+ *  @param max_samples_count
+ *  	Samples to count at most. -1 to walk the whole stream.
+ *  @return
+ *  	Samples count, up to max_samples_count or a block beyond it,
+ *  	if successful. -1 otherwise.
+ */
+int
+pillbig_audio_vag_get_samples_count(PillBigSource input, long offset, int filesize,
+	int max_samples_count);
+
+/**
+ *  Gets the maximum samples count a VAG file could hold given its size.
+ *
+ *  @remarks
+ *  	Unlike pillbig_audio_vag_get_samples_count() the stream isn't
+ *  	scanned, only the header presence is checked.
+ *
  *  @param input
- *  	VAG ADPCM stream positionated at the start of the data.
+ *  	VAG ADPCM source.
+ *  @param offset
+ *  	Position of the VAG file in the source.
  *  @param filesize
  *  	Input file size.
  *  @return
- *  	Samples count if successful. -1 otherwise.
+ *  	Maximum samples count.
  */
 int
-pillbig_audio_vag_count_samples(FILE *input, int filesize);
+pillbig_audio_vag_get_max_samples_count(PillBigSource input, long offset, int filesize);
 
 /**
  *  Guess either a VAG audio has a header or not.
  */
 int
-pillbig_audio_vag_has_header(FILE *input);
+pillbig_audio_vag_has_header(PillBigSource input, long offset);
 
 END_C_DECLS
 
@@ -0,0 +1,458 @@
+/*
+ *  libpillbig
+ *  A library to deal with Blood Omen: Legacy of Kain pill.big files.
+ */
+
+/**
+ *  @file
+ *  @brief
+ *  	Audio waveform overviews. Implementation file.
+ *
+ *  @author  Alfonso Ruzafa <superruzafa@gmail.com>
+ *  @version SVN $Id$
+ */
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pillbig/pillbig.h>
+#include "pillbig_internal.h"
+
+#define WAVEFORM_SAMPLES_PER_POINT 64
+#define WAVEFORM_LEVEL_FACTOR 4
+#define WAVEFORM_BLOCK_SIZE (WAVEFORM_SAMPLES_PER_POINT * 64)
+
+#define WAVEFORM_CACHE_MAGIC_ID 0x46574250
+#define WAVEFORM_CACHE_VERSION 1
+
+/**
+ *  Cached waveform file header. Only the finest level is stored.
+ */
+typedef struct
+{
+	unsigned int    magic;                /**< WAVEFORM_CACHE_MAGIC_ID. */
+	unsigned int    version;              /**< WAVEFORM_CACHE_VERSION. */
+	unsigned int    hash;                 /**< pill.big file hashname. */
+	unsigned int    size;                 /**< pill.big file size. */
+	unsigned int    samples_count;        /**< Audio samples count. */
+	unsigned int    samples_per_point;    /**< Samples per point of the stored level. */
+	unsigned int    points_count;         /**< Points of the stored level. */
+}
+PillBigAudioWaveformCacheHeader;
+
+
+
+/**
+ *  Decodes a pill.big audio file computing the finest waveform level.
+ *
+ *  @param pillbig
+ *  	PillBig object.
+ *  @param index
+ *  	pill.big audio file index.
+ *  @return
+ *  	Waveform with only the finest level if successful. NULL otherwise.
+ */
+static PillBigAudioWaveform *
+pillbig_audio_waveform_compute(PillBig pillbig, int index);
+
+/**
+ *  Builds the coarser levels of a waveform from its finest one.
+ *
+ *  @param waveform
+ *  	Waveform with only the finest level.
+ *  @return
+ *  	Operation result.
+ */
+static PillBigError
+pillbig_audio_waveform_build_levels(PillBigAudioWaveform *waveform);
+
+/**
+ *  Gets the cache filename of a pill.big file waveform.
+ *
+ *  @param pillbig
+ *  	PillBig object with a waveform cache.
+ *  @param index
+ *  	pill.big file index.
+ *  @param buffer
+ *  	Buffer for the filename.
+ *  @param buffer_length
+ *  	Buffer length.
+ */
+static void
+pillbig_audio_waveform_get_cache_filename(PillBig pillbig, int index,
+	char *buffer, int buffer_length);
+
+/**
+ *  Reads a waveform from the cache.
+ *
+ *  @param pillbig
+ *  	PillBig object with a waveform cache.
+ *  @param index
+ *  	pill.big file index.
+ *  @return
+ *  	Waveform with only the finest level if cached. NULL otherwise.
+ */
+static PillBigAudioWaveform *
+pillbig_audio_waveform_load(PillBig pillbig, int index);
+
+/**
+ *  Writes a waveform in the cache.
+ *
+ *  @param pillbig
+ *  	PillBig object with a waveform cache.
+ *  @param index
+ *  	pill.big file index.
+ *  @param waveform
+ *  	Waveform to be cached.
+ */
+static void
+pillbig_audio_waveform_save(PillBig pillbig, int index,
+	const PillBigAudioWaveform *waveform);
+
+/**
+ *  Allocates a waveform with a single level.
+ *
+ *  @param points_count
+ *  	Points of the finest level.
+ *  @return
+ *  	Waveform if successful. NULL otherwise.
+ */
+static PillBigAudioWaveform *
+pillbig_audio_waveform_new(int points_count);
+
+
+
+PillBigAudioWaveform *
+pillbig_audio_get_waveform(PillBig pillbig, int index)
+{
+	pillbig_error_clear();
+	SET_ERROR_RETURN_VALUE_IF_FAIL(pillbig != NULL,
+		PillBigError_InvalidPillBigObject, NULL);
+	SET_ERROR_RETURN_VALUE_IF_FAIL(0 <= index && index < pillbig->files_count,
+		PillBigError_FileIndexOutOfRange, NULL);
+
+	PillBigAudioWaveform *waveform = NULL;
+
+	if (pillbig->waveform_cache != NULL)
+	{
+		waveform = pillbig_audio_waveform_load(pillbig, index);
+	}
+
+	if (waveform == NULL)
+	{
+		waveform = pillbig_audio_waveform_compute(pillbig, index);
+		if (waveform != NULL && pillbig->waveform_cache != NULL)
+		{
+			pillbig_audio_waveform_save(pillbig, index, waveform);
+		}
+	}
+
+	if (waveform != NULL && pillbig_audio_waveform_build_levels(waveform) != PillBigError_Success)
+	{
+		pillbig_audio_waveform_free(waveform);
+		waveform = NULL;
+	}
+
+	return waveform;
+}
+
+void
+pillbig_audio_waveform_free(PillBigAudioWaveform *waveform)
+{
+	int i;
+
+	if (waveform != NULL)
+	{
+		for (i = 0; i < waveform->levels_count; i++)
+		{
+			free(waveform->levels[i].points);
+		}
+		free(waveform->levels);
+		free(waveform);
+	}
+}
+
+void
+pillbig_audio_set_waveform_cache(PillBig pillbig, const char *directory)
+{
+	pillbig_error_clear();
+	SET_ERROR_RETURN_IF_FAIL(pillbig != NULL, PillBigError_InvalidPillBigObject);
+
+	if (pillbig->waveform_cache != NULL)
+	{
+		free(pillbig->waveform_cache);
+		pillbig->waveform_cache = NULL;
+	}
+
+	if (directory != NULL)
+	{
+		pillbig->waveform_cache = strdup(directory);
+		SET_ERROR_IF_FAIL(pillbig->waveform_cache != NULL, PillBigError_SystemError);
+	}
+}
+
+
+
+static PillBigAudioWaveform *
+pillbig_audio_waveform_compute(PillBig pillbig, int index)
+{
+	PillBigAudioWaveform *waveform;
+	PillBigAudioWaveformPoint *point;
+	PillBigAudioStream stream;
+	PillBigError error;
+	short samples[WAVEFORM_BLOCK_SIZE];
+	long long squares;
+	int minimum, maximum;
+	int read_count, first, count, i;
+
+	stream = pillbig_audio_stream_open(pillbig, index, PillBigAudioFormat_PCM);
+	if (stream == NULL)
+	{
+		return NULL;
+	}
+
+	waveform = pillbig_audio_waveform_new(
+		(stream->samples_limit + WAVEFORM_SAMPLES_PER_POINT - 1) / WAVEFORM_SAMPLES_PER_POINT);
+	SET_ERROR_IF_FAIL(waveform != NULL, PillBigError_SystemError);
+
+	while (pillbig_no_error())
+	{
+		read_count = pillbig_audio_stream_read(stream, samples, WAVEFORM_BLOCK_SIZE);
+		if (read_count <= 0)
+		{
+			break;
+		}
+
+		for (first = 0; first < read_count; first += WAVEFORM_SAMPLES_PER_POINT)
+		{
+			count = MIN(WAVEFORM_SAMPLES_PER_POINT, read_count - first);
+
+			/*
+			 * Branchless reductions, vectorized by the compiler.
+			 */
+			minimum = 32767;
+			maximum = -32768;
+			squares = 0;
+			for (i = first; i < first + count; i++)
+			{
+				minimum = MIN(minimum, samples[i]);
+				maximum = MAX(maximum, samples[i]);
+				squares += samples[i] * samples[i];
+			}
+
+			point = &waveform->levels[0].points[waveform->levels[0].points_count++];
+			point->min = minimum;
+			point->max = maximum;
+			point->rms = (unsigned short)(sqrt((double)squares / count) + 0.5);
+		}
+
+		waveform->samples_count += read_count;
+	}
+
+	error = pillbig_error_get();
+	pillbig_audio_stream_close(stream);
+	pillbig_error_set(error);
+
+	if (pillbig_any_error())
+	{
+		pillbig_audio_waveform_free(waveform);
+		return NULL;
+	}
+
+	/*
+	 * The whole file was decoded, cache its length.
+	 */
+	pillbig->infos[index].samples_count = waveform->samples_count;
+	pillbig->infos[index].known |= PillBigEntryInfo_SamplesCount;
+
+	return waveform;
+}
+
+static PillBigError
+pillbig_audio_waveform_build_levels(PillBigAudioWaveform *waveform)
+{
+	PillBigAudioWaveformLevel *levels, *level, *finer;
+	PillBigAudioWaveformPoint *point, *child;
+	double squares;
+	int samples, child_samples, total_samples;
+	int l, i, j;
+
+	while (waveform->levels[waveform->levels_count - 1].points_count > 1)
+	{
+		levels = (PillBigAudioWaveformLevel *)realloc(waveform->levels,
+			(waveform->levels_count + 1) * sizeof(PillBigAudioWaveformLevel));
+		SET_RETURN_ERROR_IF_FAIL(levels != NULL, PillBigError_SystemError);
+		waveform->levels = levels;
+
+		l = waveform->levels_count;
+		finer = &waveform->levels[l - 1];
+		level = &waveform->levels[l];
+		level->samples_per_point = finer->samples_per_point * WAVEFORM_LEVEL_FACTOR;
+		level->points_count = (finer->points_count + WAVEFORM_LEVEL_FACTOR - 1) / WAVEFORM_LEVEL_FACTOR;
+		level->points = (PillBigAudioWaveformPoint *)malloc(
+			level->points_count * sizeof(PillBigAudioWaveformPoint));
+		SET_RETURN_ERROR_IF_FAIL(level->points != NULL, PillBigError_SystemError);
+		waveform->levels_count++;
+
+		for (i = 0; i < level->points_count; i++)
+		{
+			point = &level->points[i];
+			point->min = 32767;
+			point->max = -32768;
+			squares = 0.0;
+			total_samples = 0;
+
+			for (j = i * WAVEFORM_LEVEL_FACTOR;
+			     j < MIN((i + 1) * WAVEFORM_LEVEL_FACTOR, finer->points_count); j++)
+			{
+				/*
+				 * The last point may summarize fewer samples.
+				 */
+				child = &finer->points[j];
+				samples = j * finer->samples_per_point;
+				child_samples = MIN(finer->samples_per_point, waveform->samples_count - samples);
+
+				point->min = MIN(point->min, child->min);
+				point->max = MAX(point->max, child->max);
+				squares += (double)child->rms * child->rms * child_samples;
+				total_samples += child_samples;
+			}
+
+			point->rms = (total_samples > 0) ?
+				(unsigned short)(sqrt(squares / total_samples) + 0.5) : 0;
+		}
+	}
+
+	return PillBigError_Success;
+}
+
+static void
+pillbig_audio_waveform_get_cache_filename(PillBig pillbig, int index,
+	char *buffer, int buffer_length)
+{
+	snprintf(buffer, buffer_length, "%s/%08X-%d.wfm", pillbig->waveform_cache,
+		pillbig->entries[index].hash, pillbig->entries[index].size);
+}
+
+static PillBigAudioWaveform *
+pillbig_audio_waveform_load(PillBig pillbig, int index)
+{
+	PillBigAudioWaveformCacheHeader header;
+	PillBigAudioWaveform *waveform = NULL;
+	char filename[1024];
+	FILE *file;
+	int result;
+
+	pillbig_audio_waveform_get_cache_filename(pillbig, index, filename, 1024);
+	file = fopen(filename, "rb");
+	if (file == NULL)
+	{
+		return NULL;
+	}
+
+	/*
+	 * Stale or damaged cache files are just ignored.
+	 */
+	result = fread(&header, sizeof(PillBigAudioWaveformCacheHeader), 1, file);
+	if (result == 1 &&
+	    header.magic == WAVEFORM_CACHE_MAGIC_ID &&
+	    header.version == WAVEFORM_CACHE_VERSION &&
+	    header.hash == pillbig->entries[index].hash &&
+	    header.size == pillbig->entries[index].size &&
+	    header.samples_per_point == WAVEFORM_SAMPLES_PER_POINT &&
+	    header.points_count == (header.samples_count + WAVEFORM_SAMPLES_PER_POINT - 1) / WAVEFORM_SAMPLES_PER_POINT)
+	{
+		waveform = pillbig_audio_waveform_new(header.points_count);
+	}
+
+	if (waveform != NULL)
+	{
+		waveform->samples_count = header.samples_count;
+		waveform->levels[0].points_count = header.points_count;
+		result = fread(waveform->levels[0].points, sizeof(PillBigAudioWaveformPoint),
+			header.points_count, file);
+		if (result != header.points_count)
+		{
+			pillbig_audio_waveform_free(waveform);
+			waveform = NULL;
+		}
+	}
+
+	fclose(file);
+
+	return waveform;
+}
+
+static void
+pillbig_audio_waveform_save(PillBig pillbig, int index,
+	const PillBigAudioWaveform *waveform)
+{
+	PillBigAudioWaveformCacheHeader header;
+	char filename[1024];
+	FILE *file;
+	int result;
+
+	pillbig_audio_waveform_get_cache_filename(pillbig, index, filename, 1024);
+	file = fopen(filename, "wb");
+	if (file == NULL)
+	{
+		return;
+	}
+
+	header.magic             = WAVEFORM_CACHE_MAGIC_ID;
+	header.version           = WAVEFORM_CACHE_VERSION;
+	header.hash              = pillbig->entries[index].hash;
+	header.size              = pillbig->entries[index].size;
+	header.samples_count     = waveform->samples_count;
+	header.samples_per_point = waveform->levels[0].samples_per_point;
+	header.points_count      = waveform->levels[0].points_count;
+
+	result = fwrite(&header, sizeof(PillBigAudioWaveformCacheHeader), 1, file);
+	if (result == 1)
+	{
+		result = fwrite(waveform->levels[0].points, sizeof(PillBigAudioWaveformPoint),
+			header.points_count, file);
+	}
+	fclose(file);
+
+	/*
+	 * A partially written cache file would be ignored anyway,
+	 * but don't leave it behind.
+	 */
+	if (result != header.points_count)
+	{
+		remove(filename);
+	}
+}
+
+static PillBigAudioWaveform *
+pillbig_audio_waveform_new(int points_count)
+{
+	PillBigAudioWaveform *waveform;
+
+	waveform = (PillBigAudioWaveform *)calloc(1, sizeof(PillBigAudioWaveform));
+	if (waveform == NULL)
+	{
+		return NULL;
+	}
+
+	waveform->levels = (PillBigAudioWaveformLevel *)calloc(1, sizeof(PillBigAudioWaveformLevel));
+	if (waveform->levels != NULL)
+	{
+		waveform->levels_count = 1;
+		waveform->levels[0].samples_per_point = WAVEFORM_SAMPLES_PER_POINT;
+		waveform->levels[0].points = (PillBigAudioWaveformPoint *)malloc(
+			MAX(points_count, 1) * sizeof(PillBigAudioWaveformPoint));
+	}
+
+	if (waveform->levels == NULL || waveform->levels[0].points == NULL)
+	{
+		pillbig_audio_waveform_free(waveform);
+		return NULL;
+	}
+
+	return waveform;
+}
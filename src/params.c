@@ -33,6 +33,9 @@ parse_bitmap_format(char *arg, int *error);
 static PillBigReplaceMode
 parse_replace_mode(char *arg, int *error);
 
+static void
+parse_filter(char *arg, PillBigCMDParams *params);
+
 
 
 PillBigCMDParams *
@@ -47,11 +50,16 @@ pillbig_cmd_params_decode(int argc, char **argv)
 		{"extract",  no_argument,       0, 'x'},
 		{"replace",  optional_argument, 0, 'r'},
 		{"hash",     no_argument,       0, 's'},
+		{"analyze",  no_argument,       0, 'n'},
+		{"match",    required_argument, 0, 'm'},
 
 		{"pillbig",  required_argument, 0, 'p'},
 		{"database", optional_argument, 0, 'd'},
 		{"convert",  required_argument, 0, 'c'},
 		{"pattern",  required_argument, 0, 't'},
+		{"rate",     required_argument, 0, 'a'},
+		{"preview",  required_argument, 0, 'w'},
+		{"filter",   required_argument, 0, 'f'},
 
 		{0,          0,                 0, 0}
 	};
@@ -67,7 +75,7 @@ pillbig_cmd_params_decode(int argc, char **argv)
 	int index = 0;
 	while (1)
 	{
-		c = getopt_long(argc, argv, "hvi::xr::sp:d::c:t:", options, &index);
+		c = getopt_long(argc, argv, "hvi::xr::snm:p:d::c:t:a:w:f:", options, &index);
 		if (c == -1) break;
 
 		switch (c)
@@ -98,6 +106,15 @@ pillbig_cmd_params_decode(int argc, char **argv)
 				if (params->mode != -1) params->error = 1;
 				params->mode = PillBigCMDMode_Hash;
 				break;
+			case 'n': // --analyze
+				if (params->mode != -1) params->error = 1;
+				params->mode = PillBigCMDMode_Analyze;
+				break;
+			case 'm': // --match
+				if (params->mode != -1) params->error = 1;
+				params->mode = PillBigCMDMode_Match;
+				params->match_pillbig = optarg;
+				break;
 
 			case 'p': // --pillbig
 				params->pillbig = optarg;
@@ -116,6 +133,18 @@ pillbig_cmd_params_decode(int argc, char **argv)
 					params->filename_pattern = optarg;
 				}
 				break;
+			case 'a': // --rate
+				params->sample_rate = str_to_number(optarg);
+				if (params->sample_rate <= 0) params->error = 1;
+				break;
+			case 'w': // --preview
+				params->preview = str_to_number(optarg);
+				if (params->preview <= 0) params->error = 1;
+				break;
+			case 'f': // --filter
+				params->use_database = 1;
+				parse_filter(optarg, params);
+				break;
 		}
 
 	}
@@ -128,6 +157,8 @@ pillbig_cmd_params_decode(int argc, char **argv)
 		case PillBigCMDMode_Info:
 		case PillBigCMDMode_Extract:
 		case PillBigCMDMode_Replace:
+		case PillBigCMDMode_Analyze:
+		case PillBigCMDMode_Match:
 			params->indices = (int *)calloc(argc_count, sizeof(int));
 			// TODO: Check memory allocation
 
@@ -173,6 +204,10 @@ pillbig_cmd_params_free(PillBigCMDParams *params)
 		{
 			free(params->filenames);
 		}
+		if (params->filters != NULL)
+		{
+			free(params->filters);
+		}
 		free(params);
 	}
 }
@@ -273,3 +308,74 @@ parse_replace_mode(char *arg, int *error)
 
 	return mode;
 }
+
+static void
+parse_filter(char *arg, PillBigCMDParams *params)
+{
+	assert(arg != NULL);
+	assert(params != NULL);
+	PillBigCMDFilter filter = {0, 0, 0, NULL};
+	PillBigCMDFilter *filters;
+	size_t length = strspn(arg, "abcdefghijklmnopqrstuvwxyz");
+	char *value;
+
+	     if (length == 4 && strncmp(arg, "hash", 4) == 0)      filter.column = PillBigDBColumn_Hash;
+	else if (length == 6 && strncmp(arg, "offset", 6) == 0)    filter.column = PillBigDBColumn_Offset;
+	else if (length == 4 && strncmp(arg, "size", 4) == 0)      filter.column = PillBigDBColumn_Size;
+	else if (length == 4 && strncmp(arg, "type", 4) == 0)      filter.column = PillBigDBColumn_FileType;
+	else if (length == 4 && strncmp(arg, "used", 4) == 0)      filter.column = PillBigDBColumn_Used;
+	else if (length == 6 && strncmp(arg, "format", 6) == 0)    filter.column = PillBigDBColumn_Format;
+	else if (length == 4 && strncmp(arg, "rate", 4) == 0)      filter.column = PillBigDBColumn_Rate;
+	else if (length == 9 && strncmp(arg, "character", 9) == 0) filter.column = PillBigDBColumn_Character;
+	else params->error = 1;
+
+	value = &arg[length];
+	     if (strncmp(value, "!=", 2) == 0) { filter.compare = PillBigDBCompare_NotEqual;     value += 2; }
+	else if (strncmp(value, "<=", 2) == 0) { filter.compare = PillBigDBCompare_LessEqual;    value += 2; }
+	else if (strncmp(value, ">=", 2) == 0) { filter.compare = PillBigDBCompare_GreaterEqual; value += 2; }
+	else if (strncmp(value, "=", 1) == 0)  { filter.compare = PillBigDBCompare_Equal;        value += 1; }
+	else if (strncmp(value, "<", 1) == 0)  { filter.compare = PillBigDBCompare_Less;         value += 1; }
+	else if (strncmp(value, ">", 1) == 0)  { filter.compare = PillBigDBCompare_Greater;      value += 1; }
+	else params->error = 1;
+
+	switch (filter.column)
+	{
+		case PillBigDBColumn_Hash:
+			filter.value = (int)strtoul(value, &value, 16);
+			if (*value != '\0') params->error = 1;
+			break;
+		case PillBigDBColumn_FileType:
+			     if (strcmp(value, "unknown") == 0) filter.value = PillBigFileType_Unknown;
+			else if (strcmp(value, "audio") == 0)   filter.value = PillBigFileType_Audio;
+			else if (strcmp(value, "bitmap") == 0)  filter.value = PillBigFileType_Bitmap;
+			else if (strcmp(value, "tilemap") == 0) filter.value = PillBigFileType_Tilemap;
+			else if (strcmp(value, "sprite") == 0)  filter.value = PillBigFileType_Sprite;
+			else if (strcmp(value, "map") == 0)     filter.value = PillBigFileType_Map;
+			else params->error = 1;
+			break;
+		case PillBigDBColumn_Format:
+			     if (strcmp(value, "pcm") == 0)   filter.value = PillBigAudioFormat_PCM;
+			else if (strcmp(value, "vag") == 0)   filter.value = PillBigAudioFormat_VAG;
+			else if (strcmp(value, "adpcm") == 0) filter.value = PillBigAudioFormat_ADPCM;
+			else params->error = 1;
+			break;
+		case PillBigDBColumn_Character:
+			filter.character = value;
+			break;
+		default:
+			filter.value = str_to_number(value);
+			if (filter.value == -1 || *value == '\0') params->error = 1;
+			break;
+	}
+
+	filters = (PillBigCMDFilter *)realloc(params->filters,
+		(params->filters_count + 1) * sizeof(PillBigCMDFilter));
+	if (filters == NULL)
+	{
+		params->error = 1;
+		return;
+	}
+
+	params->filters = filters;
+	params->filters[params->filters_count++] = filter;
+}
@@ -25,6 +25,8 @@ typedef enum
 	PillBigCMDMode_Extract,    /**< Extracts (and optionally converts) pill.big files. */
 	PillBigCMDMode_Replace,    /**< Replace (and optionally converts) pill.big files */
 	PillBigCMDMode_Hash,       /**< Calculate the Blood Omen hashes of filenames. */
+	PillBigCMDMode_Analyze,    /**< Shows audio statistics of pill.big files. */
+	PillBigCMDMode_Match,      /**< Finds the same audio files in another pill.big. */
 }
 PillBigCMDMode;
 
@@ -52,23 +54,37 @@ typedef enum
 }
 PillBigCMDInfo;
 
+typedef struct
+{
+	PillBigDBColumn     column;       /**< Compared metadata. */
+	PillBigDBCompare    compare;      /**< Comparison. */
+	int                 value;        /**< Value compared with. */
+	char               *character;    /**< Character compared with, to be looked up in the database. */
+}
+PillBigCMDFilter;
+
 typedef struct
 {
 	char                 *command;             /**< Command line tool name. */
 	PillBigCMDMode        mode;                /**< Operation mode. */
 	int                   error;               /**< Error flag. */
 	char                 *pillbig;             /**< pill.big filename to use. */
+	char                 *match_pillbig;       /**< pill.big filename to match audio files against. */
 	int                   use_database;        /**< Use database flag. */
 	char                 *database;            /**< Database filename, if specified. */
 	PillBigReplaceMode    replace_mode;        /**< Replacement mode, when operation mode is replace */
 	PillBigCMDFormat      audio_format;        /**< Audio format. */
 	PillBigCMDFormat      bitmap_format;       /**< Bitmap format. */
+	int                   sample_rate;         /**< Audio sample rate. 0 to keep the original one. */
+	int                   preview;             /**< Audio preview length in milliseconds. 0 to extract whole files. */
 	PillBigCMDInfo        show_info;           /**< Info flags. */
 	char                 *filename_pattern;    /**< Filename pattern. */
 	int                   files_count;         /**< Count of file indices. */
 	int                  *indices;             /**< File indices. */
 	int                   filenames_count;     /**< Count of filenames. */
 	char                **filenames;           /**< Filenames */
+	int                   filters_count;       /**< Count of filters. */
+	PillBigCMDFilter     *filters;             /**< Filters files must satisfy. */
 }
 PillBigCMDParams;
 
@@ -0,0 +1,268 @@
+/*
+ *  libpillbig
+ *  A library to deal with Blood Omen: Legacy of Kain pill.big files.
+ */
+
+/**
+ *  @file
+ *  @brief
+ *  	Database maintenance tool.
+ *
+ *  @author  Alfonso Ruzafa <superruzafa@gmail.com>
+ *  @version SVN $Id$
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libintl.h>
+#include <pillbig/pillbig.h>
+
+#ifdef HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#define _(String) gettext(String)
+
+void
+pillbig_db_cmd_help(const char *command);
+
+int
+pillbig_db_cmd_compile(const char *input, const char *output);
+
+int
+pillbig_db_cmd_generate(const char *input, const char *output, const char *dictionary);
+
+char **
+pillbig_db_cmd_read_names(const char *filename, int *count);
+
+char *
+pillbig_db_cmd_get_image_filename(const char *filename);
+
+
+
+int
+main (int argc, char **argv)
+{
+	if (argc >= 3 && argc <= 4 && strcmp(argv[1], "compile") == 0)
+	{
+		return pillbig_db_cmd_compile(argv[2], (argc == 4) ? argv[3] : NULL);
+	}
+	if (argc >= 4 && argc <= 5 && strcmp(argv[1], "generate") == 0)
+	{
+		return pillbig_db_cmd_generate(argv[2], argv[3], (argc == 5) ? argv[4] : NULL);
+	}
+
+	pillbig_db_cmd_help(argv[0]);
+
+	return (argc == 2 && (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0))
+		? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+void
+pillbig_db_cmd_help(const char *command)
+{
+	puts(_("Maintain pill.big databases."));
+	printf(_("Usage: %s MODE [ARGUMENTS]\n"), command);
+	puts(_("Modes:"));
+	puts(_("    compile DATABASE [IMAGE]     Compile a database into a binary image"));
+	puts(_("                                 (default: DATABASE with a .bin extension)"));
+	puts(_("    generate PILLBIG DATABASE [DICTIONARY]"));
+	puts(_("                                 Generate a database by scanning a pill.big file,"));
+	puts(_("                                 naming files from a list of candidate filenames"));
+	puts(_("                                 (one per line). DATABASE is written as a binary"));
+	puts(_("                                 image if its extension is .bin, as XML otherwise"));
+}
+
+int
+pillbig_db_cmd_compile(const char *input, const char *output)
+{
+	PillBigDB db;
+	char *image_filename = NULL;
+	int result = EXIT_SUCCESS;
+
+	if (output == NULL)
+	{
+		output = image_filename = pillbig_db_cmd_get_image_filename(input);
+	}
+
+	db = pillbig_db_open(input);
+	if (db == NULL)
+	{
+		fprintf(stderr, _("%s: Cannot open the database\n"), input);
+		result = EXIT_FAILURE;
+	}
+	else
+	{
+		if (pillbig_db_compile(db, output) != PillBigError_Success)
+		{
+			fprintf(stderr, _("%s: Cannot write the image\n"), output);
+			result = EXIT_FAILURE;
+		}
+		pillbig_db_close(db);
+	}
+
+	free(image_filename);
+
+	return result;
+}
+
+int
+pillbig_db_cmd_generate(const char *input, const char *output, const char *dictionary)
+{
+	const char *extension = strrchr(output, '.');
+	const PillBigDBEntry *entry;
+	PillBig pillbig;
+	PillBigDB db = NULL;
+	PillBigError error;
+	char **names = NULL;
+	int names_count = 0, audios_count = 0, named_count = 0, i;
+	int result = EXIT_FAILURE;
+	double duration = 0, seconds;
+
+	if (dictionary != NULL)
+	{
+		names = pillbig_db_cmd_read_names(dictionary, &names_count);
+		if (names == NULL)
+		{
+			fprintf(stderr, _("%s: Cannot read the dictionary\n"), dictionary);
+			return EXIT_FAILURE;
+		}
+	}
+
+	pillbig = pillbig_open_from_filename(input);
+	if (pillbig == NULL)
+	{
+		fprintf(stderr, _("%s: Cannot open the pill.big file\n"), input);
+	}
+	else
+	{
+		db = pillbig_db_generate(pillbig, (const char **)names, names_count, 0);
+		if (db == NULL)
+		{
+			fprintf(stderr, _("%s: Cannot scan the pill.big file\n"), input);
+		}
+	}
+
+	if (db != NULL)
+	{
+		error = (extension != NULL && strcmp(extension, ".bin") == 0)
+			? pillbig_db_compile(db, output) : pillbig_db_save(db, output);
+		if (error != PillBigError_Success)
+		{
+			fprintf(stderr, _("%s: Cannot write the database\n"), output);
+		}
+		else
+		{
+			result = EXIT_SUCCESS;
+
+			/* Samples counts were probed by the generation, durations are cached */
+			for (i = 0; i < pillbig_db_get_files_count(db); i++)
+			{
+				entry = pillbig_db_get_entry(db, i);
+				named_count += (entry->filename != NULL);
+				if (entry->filetype == PillBigFileType_Audio)
+				{
+					audios_count++;
+					seconds = pillbig_audio_get_duration(pillbig, i);
+					duration += (seconds > 0) ? seconds : 0;
+				}
+			}
+			printf(_("%d files, %d named, %d audio files lasting %d:%02d:%02d\n"),
+				pillbig_db_get_files_count(db), named_count, audios_count,
+				(int)duration / 3600, (int)duration / 60 % 60, (int)duration % 60);
+		}
+		pillbig_db_close(db);
+	}
+
+	if (pillbig != NULL)
+	{
+		pillbig_close(pillbig);
+	}
+	for (i = 0; i < names_count; i++)
+	{
+		free(names[i]);
+	}
+	free(names);
+
+	return result;
+}
+
+char **
+pillbig_db_cmd_read_names(const char *filename, int *count)
+{
+	FILE *file = fopen(filename, "r");
+	char line[1024], **names = NULL, **grown;
+	size_t length;
+	int capacity = 0, failed = 0;
+
+	*count = 0;
+	if (file == NULL)
+	{
+		return NULL;
+	}
+
+	while (fgets(line, sizeof(line), file) != NULL)
+	{
+		length = strcspn(line, "\r\n");
+		line[length] = '\0';
+		if (length == 0)
+		{
+			continue;
+		}
+
+		if (*count == capacity)
+		{
+			capacity = (capacity > 0) ? capacity * 2 : 256;
+			grown = (char **)realloc(names, capacity * sizeof(char *));
+			failed = (grown == NULL);
+			if (failed)
+			{
+				break;
+			}
+			names = grown;
+		}
+		names[*count] = strdup(line);
+		failed = (names[*count] == NULL);
+		if (failed)
+		{
+			break;
+		}
+		(*count)++;
+	}
+	fclose(file);
+
+	/* An empty dictionary is valid, but needs an array */
+	if (!failed && names == NULL)
+	{
+		names = (char **)malloc(sizeof(char *));
+	}
+	else if (failed)
+	{
+		while (*count > 0)
+		{
+			free(names[--(*count)]);
+		}
+		free(names);
+		names = NULL;
+	}
+
+	return names;
+}
+
+char *
+pillbig_db_cmd_get_image_filename(const char *filename)
+{
+	const char *extension = strrchr(filename, '.');
+	size_t length = (extension != NULL && strchr(extension, '/') == NULL)
+		? (size_t)(extension - filename) : strlen(filename);
+	char *image_filename = (char *)malloc(length + sizeof(".bin"));
+
+	if (image_filename != NULL)
+	{
+		memcpy(image_filename, filename, length);
+		strcpy(image_filename + length, ".bin");
+	}
+
+	return image_filename;
+}
@@ -16,13 +16,15 @@
 #include <libintl.h>
 #include <assert.h>
 #include <string.h>
-#include <regex.h>
 #include <pillbig/pillbig.h>
 #include "params.h"
 #include "datadir.h"
 
 #define DEFAULT_FILENAME_PATTERN "file*"
 #define PATTERN_WILDCARD_CHAR '*'
+#define EXTRACT_BATCH_SIZE 64
+#define ANALYZE_BATCH_SIZE 64
+#define MATCH_MIN_SCORE 0.1
 
 #ifdef HAVE_CONFIG_H
 #	include <config.h>
@@ -34,7 +36,10 @@ PillBig
 pillbig_cmd_open(PillBigCMDParams *params);
 
 PillBigDB
-pillbig_cmd_db_open(PillBigPlatform platform, PillBigCMDParams *params);
+pillbig_cmd_db_open(PillBigPlatform platform, const char *database);
+
+PillBigIndexSet
+pillbig_cmd_filter_open(PillBigDB db, PillBigCMDParams *params);
 
 void
 pillbig_cmd_help(PillBigCMDParams *params);
@@ -49,7 +54,7 @@ void
 pillbig_cmd_info(PillBig pillbig, int index, PillBigCMDParams *params);
 
 void
-pillbig_cmd_info_audio(PillBigDBAudioEntry *audio_entry);
+pillbig_cmd_info_audio(PillBigDB db, int index, PillBigDBAudioEntry *audio_entry);
 
 void
 pillbig_cmd_hash(PillBigCMDParams *params);
@@ -57,6 +62,21 @@ pillbig_cmd_hash(PillBigCMDParams *params);
 void
 pillbig_cmd_extract(PillBig pillbig, int index, PillBigCMDParams *params);
 
+void
+pillbig_cmd_extract_flush(PillBig pillbig, PillBigCMDParams *params);
+
+void
+pillbig_cmd_analyze(PillBig pillbig, int index, PillBigCMDParams *params);
+
+void
+pillbig_cmd_analyze_flush(PillBig pillbig, PillBigCMDParams *params);
+
+PillBigAudioFingerprintIndex
+pillbig_cmd_match_open(PillBigCMDParams *params);
+
+void
+pillbig_cmd_match(PillBig pillbig, int index, PillBigCMDParams *params);
+
 void
 pillbig_cmd_unimplemented();
 
@@ -69,15 +89,43 @@ pillbig_fill_filename(const char *pattern, int index, char *buffer, int buffer_l
 PillBigFileType
 pillbig_get_filetype(PillBig pillbig, int index, PillBigCMDParams *params);
 
-PillBigDBAudioSpeech *
-pillbig_get_best_l10n_speech(PillBigDBAudioEntry *entry);
-
-int
-pillbig_language_matches(const char *language);
-
 typedef
 void (* PillBigCMDActionCallback)(PillBig pillbig, int index, PillBigCMDParams *params);
 
+/*
+ * Audio conversions pending to be extracted at once.
+ */
+static struct
+{
+	int    indices[EXTRACT_BATCH_SIZE];
+	FILE  *outputs[EXTRACT_BATCH_SIZE];
+	char  *filenames[EXTRACT_BATCH_SIZE];
+	int    count;
+	PillBigAudioFormat format;
+}
+extract_batch;
+
+/*
+ * Audio files pending to be analyzed at once.
+ */
+static struct
+{
+	int                     indices[ANALYZE_BATCH_SIZE];
+	PillBigAudioAnalysis    analyses[ANALYZE_BATCH_SIZE];
+	int                     count;
+}
+analyze_batch;
+
+/*
+ * Fingerprints of the audio files of the pill.big to match against.
+ */
+static PillBigAudioFingerprintIndex match_index;
+
+/*
+ * Database of the pill.big to match against, if found.
+ */
+static PillBigDB match_db;
+
 
 
 int
@@ -85,6 +133,7 @@ main (int argc, char **argv)
 {
 	PillBig pillbig = NULL;
 	PillBigDB db = NULL;
+	PillBigIndexSet filter = NULL;
 	PillBigCMDParams *params = pillbig_cmd_params_decode(argc, argv);
 	PillBigCMDActionCallback callback = NULL;
 	assert(params != NULL);
@@ -104,6 +153,8 @@ main (int argc, char **argv)
 		case PillBigCMDMode_Info:
 		case PillBigCMDMode_Extract:
 		case PillBigCMDMode_Replace:
+		case PillBigCMDMode_Analyze:
+		case PillBigCMDMode_Match:
 			pillbig = pillbig_cmd_open(params);
 			if (pillbig == NULL)
 			{
@@ -112,6 +163,15 @@ main (int argc, char **argv)
 					_("Cannot open the specified pill.big file.\n"));
 				exit(EXIT_FAILURE);
 			}
+			if (params->sample_rate != 0)
+			{
+				pillbig_audio_set_sample_rate(pillbig, params->sample_rate);
+				if (pillbig_error_get() != PillBigError_Success)
+				{
+					fprintf(stderr, _("Invalid audio sample rate.\n"));
+					exit(EXIT_FAILURE);
+				}
+			}
 			break;
 	}
 
@@ -125,8 +185,10 @@ main (int argc, char **argv)
 			case PillBigCMDMode_Info:
 			case PillBigCMDMode_Extract:
 			case PillBigCMDMode_Replace:
+			case PillBigCMDMode_Analyze:
+			case PillBigCMDMode_Match:
 				assert(pillbig != NULL);
-				db = pillbig_cmd_db_open(pillbig_get_platform(pillbig), params);
+				db = pillbig_cmd_db_open(pillbig_get_platform(pillbig), params->database);
 				if (db == NULL)
 				{
 					fprintf(stderr, (params->database == NULL) ?
@@ -139,6 +201,19 @@ main (int argc, char **argv)
 		}
 	}
 
+	/*
+	 * Select the database files satisfying every filter.
+	 */
+	if (params->filters_count > 0)
+	{
+		filter = (db != NULL) ? pillbig_cmd_filter_open(db, params) : NULL;
+		if (filter == NULL)
+		{
+			fprintf(stderr, _("Cannot filter files with the database.\n"));
+			exit(EXIT_FAILURE);
+		}
+	}
+
 	/*
 	 * Perform the command mode.
 	 */
@@ -163,6 +238,19 @@ main (int argc, char **argv)
 		case PillBigCMDMode_Replace:
 			pillbig_cmd_unimplemented();
 			break;
+		case PillBigCMDMode_Analyze:
+			puts(_("Index  Samples  Peak dBFS  RMS dBFS  Loudness LUFS  DC offset  Clipped"));
+			callback = pillbig_cmd_analyze;
+			break;
+		case PillBigCMDMode_Match:
+			match_index = pillbig_cmd_match_open(params);
+			if (match_index == NULL)
+			{
+				fprintf(stderr, _("Cannot open the pill.big file to match against.\n"));
+				exit(EXIT_FAILURE);
+			}
+			callback = pillbig_cmd_match;
+			break;
 		case PillBigCMDMode_Help:
 		default:
 			pillbig_cmd_help(params);
@@ -176,8 +264,35 @@ main (int argc, char **argv)
 	{
 		assert(pillbig != NULL);
 		int i = 0;
-		if (params->files_count == 0)
+		if (filter != NULL)
 		{
+			/*
+			 * Given indices are kept only if they satisfy the filters.
+			 */
+			if (params->files_count == 0)
+			{
+				for (i = pillbig_index_set_next(filter, 0);
+					i != -1 && i < pillbig_get_files_count(pillbig);
+					i = pillbig_index_set_next(filter, i + 1))
+				{
+					callback(pillbig, i, params);
+				}
+			}
+			for (i = 0; i < params->files_count; i++)
+			{
+				if (pillbig_index_set_contains(filter, params->indices[i]))
+				{
+					callback(pillbig, params->indices[i], params);
+				}
+			}
+		}
+		else if (params->files_count == 0)
+		{
+			/*
+			 * Classify every file at once reading pill.big sequentially.
+			 */
+			pillbig_probe_entries(pillbig, 0);
+
 			for (i = 0; i < pillbig_get_files_count(pillbig); i++)
 			{
 				callback(pillbig, i, params);
@@ -190,11 +305,35 @@ main (int argc, char **argv)
 				callback(pillbig, params->indices[i], params);
 			}
 		}
+
+		if (params->mode == PillBigCMDMode_Extract)
+		{
+			pillbig_cmd_extract_flush(pillbig, params);
+		}
+		else if (params->mode == PillBigCMDMode_Analyze)
+		{
+			pillbig_cmd_analyze_flush(pillbig, params);
+		}
 	}
 
 	/*
 	 * Free resources
 	 */
+	if (match_index != NULL)
+	{
+		pillbig_audio_fingerprint_index_free(match_index);
+	}
+
+	if (match_db != NULL)
+	{
+		pillbig_db_close(match_db);
+	}
+
+	if (filter != NULL)
+	{
+		pillbig_index_set_free(filter);
+	}
+
 	if (db != NULL)
 	{
 		pillbig_set_db(pillbig, NULL);
@@ -246,10 +385,8 @@ pillbig_cmd_open(PillBigCMDParams *params)
 }
 
 PillBigDB
-pillbig_cmd_db_open(PillBigPlatform platform, PillBigCMDParams *params)
+pillbig_cmd_db_open(PillBigPlatform platform, const char *database)
 {
-	assert(params != NULL);
-
 	PillBigDB db = NULL;
 	char *filenames_pc[] =
 	{
@@ -275,9 +412,9 @@ pillbig_cmd_db_open(PillBigPlatform platform, PillBigCMDParams *params)
 			break;
 	}
 
-	if (params->database != NULL)
+	if (database != NULL)
 	{
-		db = pillbig_db_open(params->database);
+		db = pillbig_db_open(database);
 	}
 	else
 	{
@@ -291,6 +428,48 @@ pillbig_cmd_db_open(PillBigPlatform platform, PillBigCMDParams *params)
 	return db;
 }
 
+PillBigIndexSet
+pillbig_cmd_filter_open(PillBigDB db, PillBigCMDParams *params)
+{
+	assert(db != NULL);
+	assert(params != NULL);
+	PillBigIndexSet set = NULL, other;
+	PillBigCMDFilter *filter;
+	int i;
+
+	for (i = 0; i < params->filters_count; i++)
+	{
+		filter = &params->filters[i];
+		if (filter->character != NULL)
+		{
+			/*
+			 * Unknown characters have no files, as no ID matches -1.
+			 */
+			filter->value = pillbig_db_get_character_id(db, filter->character);
+			if (filter->value == -1) filter->value = -2;
+		}
+
+		other = pillbig_db_filter(db, filter->column, filter->compare, filter->value);
+		if (other == NULL)
+		{
+			if (set != NULL) pillbig_index_set_free(set);
+			return NULL;
+		}
+
+		if (set == NULL)
+		{
+			set = other;
+		}
+		else
+		{
+			pillbig_index_set_and(set, other);
+			pillbig_index_set_free(other);
+		}
+	}
+
+	return set;
+}
+
 void
 pillbig_cmd_help(PillBigCMDParams *params)
 {
@@ -305,7 +484,9 @@ pillbig_cmd_help(PillBigCMDParams *params)
     -i, --info=INFO              Show information about pill.big files\n\
     -x, --extract                Extract files from pill.big\n\
     -r, --replace=REPLACEMODE    Replace pill.big files with external ones\n\
-    -s, --hash                   Calculate Blood Omen hashnames from filenames"));
+    -s, --hash                   Calculate Blood Omen hashnames from filenames\n\
+    -n, --analyze                Show peak, RMS, loudness and clipping of audio files\n\
+    -m, --match=PILLBIG          Find the same audio files in another pill.big"));
 
     puts("");
 
@@ -313,7 +494,10 @@ pillbig_cmd_help(PillBigCMDParams *params)
     -p, --pillbig=PILLBIG        Specify the pill.big file to use\n\
     -d, --database=DATABASE      Specify the database file to use\n\
     -c, --convert=FORMAT         Set a conversion format\n\
-    -t,	--pattern=PATTERN        External filenames pattern"));
+    -t,	--pattern=PATTERN        External filenames pattern\n\
+    -a, --rate=RATE              Set the audio sample rate in Hz\n\
+    -w, --preview=MILLISECONDS   Extract only the beginning of audio files\n\
+    -f, --filter=FILTER          Select only the database files satisfying FILTER"));
 
 	puts("");
 
@@ -341,6 +525,14 @@ pillbig_cmd_help(PillBigCMDParams *params)
 
 	puts("");
 
+	puts(_("Filters:\n\
+    FIELD=VALUE, FIELD!=VALUE    FIELD is one of hash, offset, size, type, used,\n\
+    FIELD<VALUE, FIELD<=VALUE    format, rate or character (e.g. size>102400,\n\
+    FIELD>VALUE, FIELD>=VALUE    type=audio, character=Kain). Repeated filters\n\
+                                 must all be satisfied"));
+
+	puts("");
+
 	puts(_("Patterns:\n\
     Any string where all ocurrences of * will be replaced by the file index"));
 }
@@ -412,7 +604,7 @@ pillbig_cmd_info(PillBig pillbig, int index, PillBigCMDParams *params)
 		switch (dbentry->filetype)
 		{
 		case PillBigFileType_Audio:
-			pillbig_cmd_info_audio(dbentry->audio);
+			pillbig_cmd_info_audio(db, index, dbentry->audio);
 			break;
 		}
 	}
@@ -420,7 +612,7 @@ pillbig_cmd_info(PillBig pillbig, int index, PillBigCMDParams *params)
 }
 
 void
-pillbig_cmd_info_audio(PillBigDBAudioEntry *audio_entry)
+pillbig_cmd_info_audio(PillBigDB db, int index, PillBigDBAudioEntry *audio_entry)
 {
 
 	if (audio_entry->character != NULL)
@@ -428,7 +620,10 @@ pillbig_cmd_info_audio(PillBigDBAudioEntry *audio_entry)
 		printf(_("Character: %s\n"), audio_entry->character);
 	}
 
-	PillBigDBAudioSpeech *speech = pillbig_get_best_l10n_speech(audio_entry);
+	/*
+	 * The library picks the speech of the locale language.
+	 */
+	const PillBigDBAudioSpeech *speech = pillbig_db_get_speech(db, index, DB_LANGUAGE_PREFERRED);
 	if (speech != NULL)
 	{
 		printf(_("Speech: %s\n"), speech->speech);
@@ -483,8 +678,42 @@ pillbig_cmd_extract(PillBig pillbig, int index, PillBigCMDParams *params)
 	}
 
 	if (filetype == PillBigFileType_Audio &&
-	    audio_output_format != PillBigAudioFormat_Unknown)
+	    audio_output_format != PillBigAudioFormat_Unknown &&
+	    params->preview > 0)
+	{
+		FILE *output = fopen(filename, "wb");
+		if (output == NULL)
+		{
+			fprintf(stderr, _("%s(%04d) -> %s: Error!\n"), params->pillbig, index, filename);
+			return;
+		}
+		pillbig_audio_extract_preview(pillbig, index, output, audio_output_format,
+			(int)((long long)params->preview * pillbig_audio_get_sample_rate(pillbig) / 1000));
+		if (fclose(output) != 0)
+		{
+			fprintf(stderr, _("%s(%04d) -> %s: Error!\n"), params->pillbig, index, filename);
+			return;
+		}
+	}
+	else if (filetype == PillBigFileType_Audio &&
+	         audio_output_format != PillBigAudioFormat_Unknown)
 	{
+		/*
+		 * Audio conversions are queued and decoded in batches.
+		 */
+		FILE *output = fopen(filename, "wb");
+		if (output != NULL)
+		{
+			extract_batch.indices[extract_batch.count]   = index;
+			extract_batch.outputs[extract_batch.count]   = output;
+			extract_batch.filenames[extract_batch.count] = strdup(filename);
+			extract_batch.format = audio_output_format;
+			if (++extract_batch.count == EXTRACT_BATCH_SIZE)
+			{
+				pillbig_cmd_extract_flush(pillbig, params);
+			}
+			return;
+		}
 		pillbig_audio_extract_to_filename(pillbig, index, filename, audio_output_format);
 	}
 	else
@@ -502,6 +731,234 @@ pillbig_cmd_extract(PillBig pillbig, int index, PillBigCMDParams *params)
 	}
 }
 
+void
+pillbig_cmd_extract_flush(PillBig pillbig, PillBigCMDParams *params)
+{
+	assert(pillbig != NULL);
+	assert(params != NULL);
+
+	PillBigError results[EXTRACT_BATCH_SIZE];
+	PillBigError error;
+	int i;
+
+	if (extract_batch.count == 0)
+	{
+		return;
+	}
+
+	pillbig_audio_extract_batch(pillbig, extract_batch.indices,
+		extract_batch.outputs, extract_batch.count, extract_batch.format, results);
+
+	for (i = 0; i < extract_batch.count; i++)
+	{
+		/*
+		 * The batch stops at the first failure.
+		 * Retry one by one the files not extracted to report each one.
+		 */
+		error = results[i];
+		if (fclose(extract_batch.outputs[i]) != 0)
+		{
+			error = PillBigError_SystemError;
+		}
+		if (error != PillBigError_Success)
+		{
+			error = pillbig_audio_extract_to_filename(pillbig, extract_batch.indices[i],
+				extract_batch.filenames[i], extract_batch.format);
+		}
+
+		if (error == PillBigError_Success)
+		{
+			printf(_("%s(%04d) -> %s: OK\n"), params->pillbig,
+				extract_batch.indices[i], extract_batch.filenames[i]);
+		}
+		else
+		{
+			fprintf(stderr, _("%s(%04d) -> %s: Error!\n"), params->pillbig,
+				extract_batch.indices[i], extract_batch.filenames[i]);
+		}
+
+		free(extract_batch.filenames[i]);
+	}
+
+	extract_batch.count = 0;
+}
+
+void
+pillbig_cmd_analyze(PillBig pillbig, int index, PillBigCMDParams *params)
+{
+	assert(pillbig != NULL);
+	assert(0 <= index && index < pillbig_get_files_count(pillbig));
+	assert(params != NULL);
+
+	if (pillbig_get_filetype(pillbig, index, params) != PillBigFileType_Audio)
+	{
+		return;
+	}
+
+	/*
+	 * Audio files are queued and analyzed in batches.
+	 */
+	analyze_batch.indices[analyze_batch.count] = index;
+	if (++analyze_batch.count == ANALYZE_BATCH_SIZE)
+	{
+		pillbig_cmd_analyze_flush(pillbig, params);
+	}
+}
+
+void
+pillbig_cmd_analyze_flush(PillBig pillbig, PillBigCMDParams *params)
+{
+	assert(pillbig != NULL);
+	assert(params != NULL);
+
+	PillBigAudioAnalysis *analysis;
+	PillBigError error;
+	int i;
+
+	if (analyze_batch.count == 0)
+	{
+		return;
+	}
+
+	error = pillbig_audio_analyze_batch(pillbig, analyze_batch.indices,
+		analyze_batch.analyses, analyze_batch.count);
+
+	for (i = 0; i < analyze_batch.count; i++)
+	{
+		analysis = &analyze_batch.analyses[i];
+
+		/*
+		 * The batch stops at the first failure.
+		 * Retry one by one to report each file.
+		 */
+		if (error != PillBigError_Success)
+		{
+			pillbig_audio_analyze(pillbig, analyze_batch.indices[i], analysis);
+		}
+
+		if (pillbig_error_get() == PillBigError_Success)
+		{
+			printf("%5d  %7d  %9.2f  %8.2f  %13.2f  %+9.5f  %7d\n",
+				analyze_batch.indices[i], analysis->samples_count, analysis->peak,
+				analysis->rms, analysis->loudness, analysis->dc_offset,
+				analysis->clipped_count);
+		}
+		else
+		{
+			fprintf(stderr, _("%s(%04d): Error!\n"), params->pillbig,
+				analyze_batch.indices[i]);
+		}
+	}
+
+	analyze_batch.count = 0;
+}
+
+PillBigAudioFingerprintIndex
+pillbig_cmd_match_open(PillBigCMDParams *params)
+{
+	assert(params != NULL);
+
+	PillBigAudioFingerprintIndex index;
+	PillBigAudioFingerprint *fingerprint;
+	PillBig other;
+	int i;
+
+	other = pillbig_open_from_filename(params->match_pillbig);
+	if (other == NULL)
+	{
+		return NULL;
+	}
+
+	/*
+	 * Both pill.big files are fingerprinted at the same sample rate.
+	 */
+	if (params->sample_rate != 0)
+	{
+		pillbig_audio_set_sample_rate(other, params->sample_rate);
+	}
+
+	index = pillbig_audio_fingerprint_index_new();
+	if (index != NULL)
+	{
+		pillbig_probe_entries(other, 0);
+		for (i = 0; i < pillbig_get_files_count(other); i++)
+		{
+			if (pillbig_file_get_type(other, i) != PillBigFileType_Audio)
+			{
+				continue;
+			}
+
+			fingerprint = pillbig_audio_get_fingerprint(other, i);
+			if (fingerprint != NULL)
+			{
+				pillbig_audio_fingerprint_index_add(index, i, fingerprint);
+				pillbig_audio_fingerprint_free(fingerprint);
+			}
+		}
+	}
+
+	/*
+	 * Matches show the filename and speeches of the other pill.big files.
+	 */
+	match_db = pillbig_cmd_db_open(pillbig_get_platform(other), NULL);
+
+	pillbig_close(other);
+
+	return index;
+}
+
+void
+pillbig_cmd_match(PillBig pillbig, int index, PillBigCMDParams *params)
+{
+	assert(pillbig != NULL);
+	assert(0 <= index && index < pillbig_get_files_count(pillbig));
+	assert(params != NULL);
+
+	PillBigAudioFingerprint *fingerprint;
+	const PillBigDBEntry *entry;
+	double score;
+	int match, i;
+
+	if (pillbig_get_filetype(pillbig, index, params) != PillBigFileType_Audio)
+	{
+		return;
+	}
+
+	fingerprint = pillbig_audio_get_fingerprint(pillbig, index);
+	if (fingerprint == NULL)
+	{
+		fprintf(stderr, _("%s(%04d): Error!\n"), params->pillbig, index);
+		return;
+	}
+
+	match = pillbig_audio_fingerprint_index_match(match_index, fingerprint, &score);
+	if (match != -1 && score >= MATCH_MIN_SCORE)
+	{
+		printf(_("%s(%04d) -> %s(%04d): %.2f\n"), params->pillbig, index,
+			params->match_pillbig, match, score);
+
+		entry = (match_db != NULL) ? pillbig_db_get_entry(match_db, match) : NULL;
+		if (entry != NULL && entry->filename != NULL)
+		{
+			printf(_("Filename: %s\n"), entry->filename);
+		}
+		if (entry != NULL && entry->audio != NULL)
+		{
+			for (i = 0; i < entry->audio->speeches_count; i++)
+			{
+				printf(_("Speech (%s): %s\n"), entry->audio->speeches[i].language,
+					entry->audio->speeches[i].speech);
+			}
+		}
+	}
+	else
+	{
+		printf(_("%s(%04d) -> no match\n"), params->pillbig, index);
+	}
+
+	pillbig_audio_fingerprint_free(fingerprint);
+}
+
 void
 pillbig_cmd_unimplemented()
 {
@@ -579,68 +1036,8 @@ pillbig_get_filetype(PillBig pillbig, int index, PillBigCMDParams *params)
 	assert(0 <= index & index < pillbig_get_files_count(pillbig));
 	assert(params != NULL);
 
-	PillBigFileType filetype = PillBigFileType_Unknown;
-	PillBigDB db = pillbig_get_db(pillbig);
-
-	if (db != NULL)
-	{
-		const PillBigDBEntry *dbentry = NULL;
-		dbentry = pillbig_db_get_entry(db, index);
-		if (dbentry != NULL)
-		{
-			filetype = dbentry->filetype;
-		}
-	}
-	else
-	{
-		filetype = pillbig_file_get_type(pillbig, index);
-	}
-	return filetype;
-}
-
-PillBigDBAudioSpeech *
-pillbig_get_best_l10n_speech(PillBigDBAudioEntry *entry)
-{
-	assert(entry != NULL);
-	PillBigDBAudioSpeech *speech = NULL;
-	int i = 0;
-
-	while (i < entry->speeches_count)
-	{
-		if (speech == NULL)
-		{
-			speech = &entry->speeches[i];
-		}
-		else if (pillbig_language_matches(entry->speeches[i].language))
-		{
-			speech = &entry->speeches[i];
-			break;
-		}
-		i++;
-	}
-
-	return speech;
-}
-
-int
-pillbig_language_matches(const char *language)
-{
-	static char *envlang = NULL;
-	int result;
-	char buffer[16];
-
-	if (strlen(language) > 14) return 0;
-
-	sprintf(buffer, "^%s", language);
-	if (envlang == NULL) envlang = getenv("LANG");
-
-	regex_t regex;
-	result = regcomp(&regex, buffer, REG_NOSUB);
-	assert(result == 0);
-
-	result = regexec(&regex, envlang, 0, NULL, 0);
-	result = result == 0 ? 1 : 0;
-	regfree(&regex);
-
-	return result;
+	/*
+	 * Files unknown to the database are classified by the library.
+	 */
+	return pillbig_file_get_type(pillbig, index);
 }
@@ -16,6 +16,9 @@
 #include <pillbig/pillbig.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
 
 #ifdef HAVE_CONFIG_H
 #	include <config.h>
@@ -64,6 +67,725 @@ START_TEST(get_format)
 }
 END_TEST
 
+START_TEST(extract_vag_wave_sizes)
+{
+	int riff_size, data_size;
+	long file_size;
+	FILE *file = tmpfile();
+	fail_unless(file != NULL);
+
+	pillbig_audio_extract(pillbig, 315, file, PillBigAudioFormat_WAVE);
+	fail_unless(pillbig_error_get() == PillBigError_Success);
+
+	/* The header must match the single-pass decoded length. */
+	file_size = ftell(file);
+	fail_unless(fseek(file, 4, SEEK_SET) == 0);
+	fail_unless(fread(&riff_size, 4, 1, file) == 1);
+	fail_unless(fseek(file, 40, SEEK_SET) == 0);
+	fail_unless(fread(&data_size, 4, 1, file) == 1);
+	fclose(file);
+
+	fail_unless(riff_size == file_size - 8);
+	fail_unless(data_size == file_size - 44);
+}
+END_TEST
+
+START_TEST(trust_database)
+{
+	const PillBigDBEntry *entry;
+	PillBigDBAudioEntry *audio;
+	PillBig attached;
+	PillBigDB db;
+	int vags[2], count = 0, i;
+
+	db = pillbig_db_generate(pillbig, NULL, 0, 0);
+	fail_unless(db != NULL);
+	for (i = 0; i < pillbig_db_get_files_count(db) && count < 2; i++)
+	{
+		entry = pillbig_db_get_entry(db, i);
+		if (entry->filetype == PillBigFileType_Audio && entry->audio->format == PillBigAudioFormat_VAG)
+		{
+			fail_unless(entry->audio->samples_count > 0);
+			vags[count++] = i;
+		}
+	}
+	fail_unless(count == 2);
+
+	attached = pillbig_open_from_filename(TEST_PILLBIG_FILENAME);
+	fail_unless(attached != NULL);
+	pillbig_set_db(attached, db);
+
+	/* Entries matching the file are trusted instead of scanning it */
+	audio = pillbig_db_get_entry(db, vags[0])->audio;
+	audio->samples_count += 28;
+	fail_unless(pillbig_audio_get_duration(attached, vags[0]) ==
+		(double)audio->samples_count / 11025);
+	fail_unless(pillbig_audio_get_duration(attached, vags[0]) >
+		pillbig_audio_get_duration(pillbig, vags[0]));
+
+	/* Entries of another file are not */
+	audio = pillbig_db_get_entry(db, vags[1])->audio;
+	audio->samples_count += 28;
+	audio->checksum ^= 1;
+	fail_unless(pillbig_audio_get_duration(attached, vags[1]) ==
+		pillbig_audio_get_duration(pillbig, vags[1]));
+	fail_unless(pillbig_error_get() == PillBigError_Success);
+
+	pillbig_close(attached);
+	pillbig_db_close(db);
+}
+END_TEST
+
+START_TEST(extract_batch)
+{
+	int indices[44];
+	FILE *outputs[44];
+	PillBigError results[44];
+	FILE *file;
+	long size;
+	int i, a, b;
+
+	/* ADPCM files and VAG files, with and without header */
+	for (i = 0; i < 44; i++)
+	{
+		indices[i] = i < 24 ? 16 + i : 300 + i - 24;
+		outputs[i] = tmpfile();
+		fail_unless(outputs[i] != NULL);
+	}
+
+	pillbig_audio_extract_batch(pillbig, indices, outputs, 44, PillBigAudioFormat_WAVE, results);
+	fail_unless(pillbig_error_get() == PillBigError_Success);
+
+	/* Batch and single decoding must be bit-exact. */
+	for (i = 0; i < 44; i++)
+	{
+		file = tmpfile();
+		fail_unless(file != NULL);
+		pillbig_audio_extract(pillbig, indices[i], file, PillBigAudioFormat_WAVE);
+		fail_unless(pillbig_error_get() == PillBigError_Success);
+		fail_unless(results[i] == PillBigError_Success);
+
+		size = ftell(file);
+		fail_unless(size == ftell(outputs[i]));
+		rewind(file);
+		rewind(outputs[i]);
+		while ((a = fgetc(file)) != EOF)
+		{
+			b = fgetc(outputs[i]);
+			fail_unless(a == b);
+		}
+
+		fclose(file);
+		fclose(outputs[i]);
+	}
+}
+END_TEST
+
+START_TEST(extract_batch_results)
+{
+	int indices[] = { 16, -1, 17 };
+	FILE *outputs[3];
+	PillBigError results[3];
+	int i;
+
+	for (i = 0; i < 3; i++)
+	{
+		outputs[i] = tmpfile();
+		fail_unless(outputs[i] != NULL);
+	}
+
+	/* Resampled files are extracted one by one, in order */
+	pillbig_audio_set_sample_rate(pillbig, 22050);
+	fail_unless(pillbig_error_get() == PillBigError_Success);
+	pillbig_audio_extract_batch(pillbig, indices, outputs, 3, PillBigAudioFormat_WAVE, results);
+	fail_unless(pillbig_error_get() == PillBigError_FileIndexOutOfRange);
+	fail_unless(results[0] == PillBigError_Success);
+	fail_unless(results[1] == PillBigError_FileIndexOutOfRange);
+	fail_unless(results[2] == PillBigError_UnknownError);
+
+	/* The file extracted before the failure is complete */
+	fail_unless(ftell(outputs[0]) > 44);
+	fail_unless(ftell(outputs[2]) == 0);
+
+	for (i = 0; i < 3; i++)
+	{
+		fclose(outputs[i]);
+	}
+}
+END_TEST
+
+static char callback_data[65536];
+static int  callback_size;
+
+static int
+write_callback(const void *data, int size, void *user_data)
+{
+	size = (size < 1000) ? size : 1000;
+	memcpy(callback_data + callback_size, data, size);
+	callback_size += size;
+
+	return size;
+}
+
+START_TEST(extract_to_sinks)
+{
+	int indices[] = { 16, 300, 303 };
+	char expected[65536], buffer[65536];
+	const char *data;
+	int i, size, expected_size;
+	PillBigSink sink;
+	FILE *file;
+
+	for (i = 0; i < 3; i++)
+	{
+		file = tmpfile();
+		fail_unless(file != NULL);
+		pillbig_audio_extract(pillbig, indices[i], file, PillBigAudioFormat_WAVE);
+		fail_unless(pillbig_error_get() == PillBigError_Success);
+		expected_size = ftell(file);
+		rewind(file);
+		fail_unless(fread(expected, 1, expected_size, file) == expected_size);
+
+		/* Growable memory */
+		sink = pillbig_sink_new_memory();
+		fail_unless(sink != NULL);
+		pillbig_audio_extract_to_sink(pillbig, indices[i], sink, PillBigAudioFormat_WAVE);
+		fail_unless(pillbig_error_get() == PillBigError_Success);
+		data = pillbig_sink_get_data(sink, &size);
+		fail_unless(size == expected_size);
+		fail_unless(memcmp(data, expected, size) == 0);
+		pillbig_sink_free(sink);
+
+		/* Caller buffer, exact and too small */
+		sink = pillbig_sink_new_from_buffer(buffer, expected_size);
+		fail_unless(sink != NULL);
+		pillbig_audio_extract_to_sink(pillbig, indices[i], sink, PillBigAudioFormat_WAVE);
+		fail_unless(pillbig_error_get() == PillBigError_Success);
+		fail_unless(memcmp(buffer, expected, expected_size) == 0);
+		pillbig_sink_free(sink);
+
+		sink = pillbig_sink_new_from_buffer(buffer, expected_size - 1);
+		fail_unless(sink != NULL);
+		pillbig_audio_extract_to_sink(pillbig, indices[i], sink, PillBigAudioFormat_WAVE);
+		fail_unless(pillbig_error_get() == PillBigError_BufferTooSmall);
+		pillbig_sink_free(sink);
+
+		/* File descriptor, buffered and patched in place */
+		rewind(file);
+		fail_unless(ftruncate(fileno(file), 0) == 0);
+		sink = pillbig_sink_new_from_fd(fileno(file));
+		fail_unless(sink != NULL);
+		fail_unless(pillbig_sink_is_seekable(sink));
+		pillbig_audio_extract_to_sink(pillbig, indices[i], sink, PillBigAudioFormat_WAVE);
+		fail_unless(pillbig_error_get() == PillBigError_Success);
+		fail_unless(pillbig_sink_flush(sink) == PillBigError_Success);
+		fail_unless(pillbig_sink_tell(sink) == expected_size);
+		pillbig_sink_free(sink);
+		fail_unless(pread(fileno(file), buffer, sizeof(buffer), 0) == expected_size);
+		fail_unless(memcmp(buffer, expected, expected_size) == 0);
+		fclose(file);
+
+		/* Not seekable callback with partial writes */
+		callback_size = 0;
+		sink = pillbig_sink_new_from_callback(write_callback, NULL, NULL);
+		fail_unless(sink != NULL);
+		fail_unless(!pillbig_sink_is_seekable(sink));
+		pillbig_audio_extract_to_sink(pillbig, indices[i], sink, PillBigAudioFormat_WAVE);
+		fail_unless(pillbig_error_get() == PillBigError_Success);
+		pillbig_sink_free(sink);
+		fail_unless(callback_size == expected_size);
+		fail_unless(memcmp(callback_data, expected, expected_size) == 0);
+	}
+}
+END_TEST
+
+START_TEST(codec_variants)
+{
+	int indices[44];
+	FILE *outputs[44], *scalar[44];
+	PillBigAudioCodecVariant variant, fastest;
+	int i, a, b;
+
+	fastest = pillbig_audio_get_codec_variant();
+	fail_unless(fastest != PillBigAudioCodecVariant_Auto);
+	if (fastest < PillBigAudioCodecVariant_AVX2)
+	{
+		fail_unless(pillbig_audio_set_codec_variant(fastest + 1) ==
+			PillBigError_InvalidCodecVariant);
+	}
+
+	/* Every variant the CPU supports is bit-exact with the scalar one */
+	for (variant = PillBigAudioCodecVariant_Scalar; variant <= fastest; variant++)
+	{
+		fail_unless(pillbig_audio_set_codec_variant(variant) == PillBigError_Success);
+		fail_unless(pillbig_audio_get_codec_variant() == variant);
+
+		for (i = 0; i < 44; i++)
+		{
+			indices[i] = i < 24 ? 16 + i : 300 + i - 24;
+			outputs[i] = tmpfile();
+			fail_unless(outputs[i] != NULL);
+		}
+
+		pillbig_audio_extract_batch(pillbig, indices, outputs, 44, PillBigAudioFormat_PCM, NULL);
+		fail_unless(pillbig_error_get() == PillBigError_Success);
+
+		for (i = 0; i < 44; i++)
+		{
+			if (variant == PillBigAudioCodecVariant_Scalar)
+			{
+				scalar[i] = outputs[i];
+				continue;
+			}
+
+			fail_unless(ftell(scalar[i]) == ftell(outputs[i]));
+			rewind(scalar[i]);
+			rewind(outputs[i]);
+			while ((a = fgetc(scalar[i])) != EOF)
+			{
+				b = fgetc(outputs[i]);
+				fail_unless(a == b);
+			}
+			fclose(outputs[i]);
+		}
+	}
+
+	for (i = 0; i < 44; i++)
+	{
+		fclose(scalar[i]);
+	}
+
+	fail_unless(pillbig_audio_set_codec_variant(PillBigAudioCodecVariant_Auto) ==
+		PillBigError_Success);
+	fail_unless(pillbig_audio_get_codec_variant() == fastest);
+}
+END_TEST
+
+START_TEST(decode_range)
+{
+	int indices[] = { 16, 39, 300, 303 };
+	short *full, *range;
+	long size;
+	int i, j, count, first, expected;
+	FILE *file;
+
+	for (i = 0; i < 4; i++)
+	{
+		file = tmpfile();
+		fail_unless(file != NULL);
+		pillbig_audio_extract(pillbig, indices[i], file, PillBigAudioFormat_PCM);
+		fail_unless(pillbig_error_get() == PillBigError_Success);
+
+		size = ftell(file);
+		count = size / sizeof(short);
+		full  = (short *)malloc(size);
+		range = (short *)malloc(size);
+		rewind(file);
+		fail_unless(fread(full, sizeof(short), count, file) == count);
+		fclose(file);
+
+		/* Without seek index */
+		fail_unless(pillbig_audio_decode_range(pillbig, indices[i], 0, count + 100, range) == count);
+		fail_unless(memcmp(full, range, size) == 0);
+
+		/* With seek index, decoding in lanes */
+		pillbig_audio_build_seek_index(pillbig, indices[i], 50);
+		fail_unless(pillbig_error_get() == PillBigError_Success);
+		fail_unless(pillbig_audio_decode_range(pillbig, indices[i], 0, count, range) == count);
+		fail_unless(memcmp(full, range, size) == 0);
+
+		for (j = 0; j < 8; j++)
+		{
+			first = count * j / 9 + j;
+			expected = (count - first < count / 5) ? count - first : count / 5;
+			fail_unless(pillbig_audio_decode_range(pillbig, indices[i], first, count / 5, range) == expected);
+			fail_unless(memcmp(full + first, range, expected * sizeof(short)) == 0);
+		}
+
+		free(full);
+		free(range);
+	}
+}
+END_TEST
+
+START_TEST(resample_sine)
+{
+	int rates[][2] = { { 11025, 44100 }, { 11025, 48000 }, { 44100, 11025 } };
+	short sample;
+	double t, error, max_error;
+	int i, n, count;
+	FILE *input, *output;
+
+	for (i = 0; i < 3; i++)
+	{
+		/* One second of a 1 kHz sine */
+		input = tmpfile();
+		output = tmpfile();
+		fail_unless(input != NULL && output != NULL);
+		for (n = 0; n < rates[i][0]; n++)
+		{
+			sample = (short)(10000.0 * sin(2.0 * M_PI * 1000.0 * n / rates[i][0]));
+			fwrite(&sample, sizeof(short), 1, input);
+		}
+		rewind(input);
+
+		pillbig_audio_resample(input, output, rates[i][0], rates[i][1]);
+		fail_unless(pillbig_error_get() == PillBigError_Success);
+
+		count = ftell(output) / sizeof(short);
+		fail_unless(count == rates[i][1]);
+
+		/* Away from the edges the sine must be preserved */
+		rewind(output);
+		max_error = 0.0;
+		for (n = 0; n < count; n++)
+		{
+			fail_unless(fread(&sample, sizeof(short), 1, output) == 1);
+			if (n < count / 10 || n > count * 9 / 10)
+			{
+				continue;
+			}
+			t = (double)n / rates[i][1];
+			error = fabs(sample - 10000.0 * sin(2.0 * M_PI * 1000.0 * t));
+			max_error = (error > max_error) ? error : max_error;
+		}
+		fail_unless(max_error < 150.0);
+
+		fclose(input);
+		fclose(output);
+	}
+}
+END_TEST
+
+START_TEST(extract_resampled_wave)
+{
+	int sample_rate, data_size, native_size;
+	long file_size;
+	FILE *file = tmpfile();
+	fail_unless(file != NULL);
+
+	pillbig_audio_extract(pillbig, 16, file, PillBigAudioFormat_WAVE);
+	native_size = ftell(file) - 44;
+	rewind(file);
+
+	pillbig_audio_set_sample_rate(pillbig, 22050);
+	fail_unless(pillbig_audio_get_sample_rate(pillbig) == 22050);
+	pillbig_audio_extract(pillbig, 16, file, PillBigAudioFormat_WAVE);
+	fail_unless(pillbig_error_get() == PillBigError_Success);
+
+	file_size = ftell(file);
+	fail_unless(fseek(file, 24, SEEK_SET) == 0);
+	fail_unless(fread(&sample_rate, 4, 1, file) == 1);
+	fail_unless(fseek(file, 40, SEEK_SET) == 0);
+	fail_unless(fread(&data_size, 4, 1, file) == 1);
+	fclose(file);
+
+	fail_unless(sample_rate == 22050);
+	fail_unless(data_size == native_size * 2);
+	fail_unless(data_size == file_size - 44);
+
+	pillbig_audio_set_sample_rate(pillbig, 100);
+	fail_unless(pillbig_error_get() == PillBigError_InvalidSampleRate);
+	fail_unless(pillbig_audio_get_sample_rate(pillbig) == 22050);
+}
+END_TEST
+
+START_TEST(extract_preview)
+{
+	int indices[] = { 16, 300, 303 };
+	char full[65536], preview[65536];
+	int i, data_size, full_size, preview_size;
+	PillBigSink sink;
+	FILE *file;
+
+	for (i = 0; i < 3; i++)
+	{
+		/* Previews decode before the full file, VAG length still unknown */
+		file = tmpfile();
+		fail_unless(file != NULL);
+		pillbig_audio_extract_preview(pillbig, indices[i], file, PillBigAudioFormat_WAVE, 1000);
+		fail_unless(pillbig_error_get() == PillBigError_Success);
+		preview_size = ftell(file);
+		rewind(file);
+		fail_unless(fread(preview, 1, preview_size, file) == preview_size);
+		fclose(file);
+
+		/* Not seekable, the header is sized scanning only the preview */
+		callback_size = 0;
+		sink = pillbig_sink_new_from_callback(write_callback, NULL, NULL);
+		fail_unless(sink != NULL);
+		pillbig_audio_extract_preview_to_sink(pillbig, indices[i], sink,
+			PillBigAudioFormat_WAVE, 1000);
+		fail_unless(pillbig_error_get() == PillBigError_Success);
+		fail_unless(pillbig_sink_flush(sink) == PillBigError_Success);
+		pillbig_sink_free(sink);
+		fail_unless(callback_size == preview_size);
+		fail_unless(memcmp(callback_data, preview, preview_size) == 0);
+
+		file = tmpfile();
+		fail_unless(file != NULL);
+		pillbig_audio_extract(pillbig, indices[i], file, PillBigAudioFormat_WAVE);
+		full_size = ftell(file);
+		rewind(file);
+		fail_unless(fread(full, 1, full_size, file) == full_size);
+		fclose(file);
+
+		memcpy(&data_size, preview + 40, 4);
+		fail_unless(preview_size == 44 + 2000);
+		fail_unless(data_size == 2000);
+		fail_unless(memcmp(full + 44, preview + 44, 2000) == 0);
+
+		/* Longer than the file, the whole file is extracted */
+		file = tmpfile();
+		fail_unless(file != NULL);
+		pillbig_audio_extract_preview(pillbig, indices[i], file, PillBigAudioFormat_WAVE, 100000);
+		fail_unless(pillbig_error_get() == PillBigError_Success);
+		preview_size = ftell(file);
+		rewind(file);
+		fail_unless(fread(preview, 1, preview_size, file) == preview_size);
+		fclose(file);
+
+		fail_unless(preview_size == full_size);
+		fail_unless(memcmp(full, preview, full_size) == 0);
+	}
+}
+END_TEST
+
+START_TEST(stream_read)
+{
+	int indices[] = { 16, 39, 300, 303 };
+	short *full, *streamed;
+	PillBigAudioStream stream;
+	long size;
+	int i, count, read, total;
+	FILE *file;
+
+	for (i = 0; i < 4; i++)
+	{
+		file = tmpfile();
+		fail_unless(file != NULL);
+		pillbig_audio_extract(pillbig, indices[i], file, PillBigAudioFormat_PCM);
+		fail_unless(pillbig_error_get() == PillBigError_Success);
+
+		size = ftell(file);
+		count = size / sizeof(short);
+		full     = (short *)malloc(size);
+		streamed = (short *)malloc(size + 100 * sizeof(short));
+		rewind(file);
+		fail_unless(fread(full, sizeof(short), count, file) == count);
+		fclose(file);
+
+		stream = pillbig_audio_stream_open(pillbig, indices[i], PillBigAudioFormat_PCM);
+		fail_unless(stream != NULL);
+
+		/* Odd sized reads cross the blocks and the data window */
+		total = 0;
+		while ((read = pillbig_audio_stream_read(stream, streamed + total, 37)) > 0)
+		{
+			total += read;
+			fail_unless(total <= count);
+		}
+		fail_unless(read == 0);
+		fail_unless(total == count);
+		fail_unless(memcmp(full, streamed, size) == 0);
+
+		/* Seeking backwards and forwards */
+		fail_unless(pillbig_audio_stream_seek(stream, count / 3) == PillBigError_Success);
+		fail_unless(pillbig_audio_stream_tell(stream) == count / 3);
+		fail_unless(pillbig_audio_stream_read(stream, streamed, 100) == 100);
+		fail_unless(memcmp(full + count / 3, streamed, 100 * sizeof(short)) == 0);
+
+		pillbig_audio_build_seek_index(pillbig, indices[i], 0);
+		fail_unless(pillbig_audio_stream_seek(stream, count / 2 + 1) == PillBigError_Success);
+		fail_unless(pillbig_audio_stream_read(stream, streamed, 100) == 100);
+		fail_unless(memcmp(full + count / 2 + 1, streamed, 100 * sizeof(short)) == 0);
+
+		pillbig_audio_stream_close(stream);
+		free(full);
+		free(streamed);
+	}
+}
+END_TEST
+
+START_TEST(analyze)
+{
+	int indices[] = { 16, 300, 17, 303, 39, 20 };
+	PillBigAudioAnalysis analyses[6], analysis;
+	short *full;
+	long size;
+	long long sum, squares;
+	int i, j, count, peak, clipped;
+	FILE *file;
+
+	fail_unless(pillbig_audio_analyze_batch(pillbig, indices, analyses, 6) == PillBigError_Success);
+
+	for (i = 0; i < 6; i++)
+	{
+		file = tmpfile();
+		fail_unless(file != NULL);
+		pillbig_audio_extract(pillbig, indices[i], file, PillBigAudioFormat_PCM);
+		size = ftell(file);
+		count = size / sizeof(short);
+		full = (short *)malloc(size);
+		rewind(file);
+		fail_unless(fread(full, sizeof(short), count, file) == count);
+		fclose(file);
+
+		sum = squares = 0;
+		peak = clipped = 0;
+		for (j = 0; j < count; j++)
+		{
+			sum += full[j];
+			squares += full[j] * full[j];
+			peak = (abs(full[j]) > peak) ? abs(full[j]) : peak;
+			clipped += (full[j] == 32767 || full[j] == -32768);
+		}
+
+		fail_unless(analyses[i].samples_count == count);
+		fail_unless(analyses[i].clipped_count == clipped);
+		fail_unless(fabs(analyses[i].peak - 20.0 * log10(peak / 32768.0)) < 1e-9);
+		fail_unless(fabs(analyses[i].rms - 10.0 * log10(squares / (double)count / 32768.0 / 32768.0)) < 1e-9);
+		fail_unless(fabs(analyses[i].dc_offset - sum / (double)count / 32768.0) < 1e-9);
+		fail_unless(analyses[i].loudness > -70.0 && analyses[i].loudness < 0.0);
+
+		/* Lanes and streamed analysis are the same */
+		fail_unless(pillbig_audio_analyze(pillbig, indices[i], &analysis) == PillBigError_Success);
+		fail_unless(memcmp(&analysis, &analyses[i], sizeof(PillBigAudioAnalysis)) == 0);
+
+		free(full);
+	}
+
+	/* Non audio files can't be analyzed */
+	fail_unless(pillbig_audio_analyze(pillbig, 327, &analysis) != PillBigError_Success);
+}
+END_TEST
+
+START_TEST(fingerprint_match)
+{
+	PillBigAudioFingerprintIndex index;
+	PillBigAudioFingerprint *fingerprints[48];
+	double score;
+	int i, file;
+
+	index = pillbig_audio_fingerprint_index_new();
+	fail_unless(index != NULL);
+
+	/* Even ADPCM and VAG files are indexed, odd ones are not */
+	for (i = 0; i < 48; i++)
+	{
+		file = (i < 24) ? 16 + i : 300 + i - 24;
+		fingerprints[i] = pillbig_audio_get_fingerprint(pillbig, file);
+		fail_unless(fingerprints[i] != NULL);
+		fail_unless(fingerprints[i]->hashes_count > 0);
+		if (i % 2 == 0)
+		{
+			fail_unless(pillbig_audio_fingerprint_index_add(index, file, fingerprints[i]) ==
+				PillBigError_Success);
+		}
+	}
+
+	for (i = 0; i < 48; i++)
+	{
+		file = (i < 24) ? 16 + i : 300 + i - 24;
+		if (i % 2 == 0)
+		{
+			fail_unless(pillbig_audio_fingerprint_index_match(index, fingerprints[i], &score) == file);
+			fail_unless(score == 1.0);
+		}
+		else if (file >= 300)
+		{
+			/* Test ADPCM files share chunks of audio, VAG ones don't */
+			pillbig_audio_fingerprint_index_match(index, fingerprints[i], &score);
+			fail_unless(score < 0.5);
+		}
+	}
+
+	for (i = 0; i < 48; i++)
+	{
+		pillbig_audio_fingerprint_free(fingerprints[i]);
+	}
+	pillbig_audio_fingerprint_index_free(index);
+}
+END_TEST
+
+START_TEST(get_waveform)
+{
+	PillBigAudioWaveform *waveform, *cached;
+	PillBigAudioWaveformLevel *level;
+	char directory[] = "/tmp/pillbig-waveform-XXXXXX";
+	char filename[256];
+	short *full;
+	long size;
+	int count, i, j, l, minimum, maximum;
+	FILE *file;
+
+	file = tmpfile();
+	fail_unless(file != NULL);
+	pillbig_audio_extract(pillbig, 16, file, PillBigAudioFormat_PCM);
+	size = ftell(file);
+	count = size / sizeof(short);
+	full = (short *)malloc(size);
+	rewind(file);
+	fail_unless(fread(full, sizeof(short), count, file) == count);
+	fclose(file);
+
+	waveform = pillbig_audio_get_waveform(pillbig, 16);
+	fail_unless(waveform != NULL);
+	fail_unless(waveform->samples_count == count);
+	fail_unless(waveform->levels[0].points_count == (count + 63) / 64);
+
+	for (i = 0; i < waveform->levels[0].points_count; i++)
+	{
+		minimum = 32767;
+		maximum = -32768;
+		for (j = i * 64; j < (i + 1) * 64 && j < count; j++)
+		{
+			minimum = (full[j] < minimum) ? full[j] : minimum;
+			maximum = (full[j] > maximum) ? full[j] : maximum;
+		}
+		fail_unless(waveform->levels[0].points[i].min == minimum);
+		fail_unless(waveform->levels[0].points[i].max == maximum);
+	}
+
+	/* Every level summarizes the finer one, the coarsest is a single point */
+	for (l = 1; l < waveform->levels_count; l++)
+	{
+		level = &waveform->levels[l];
+		fail_unless(level->samples_per_point == waveform->levels[l - 1].samples_per_point * 4);
+		fail_unless(level->points[0].min <= waveform->levels[l - 1].points[0].min);
+		fail_unless(level->points[0].max >= waveform->levels[l - 1].points[0].max);
+	}
+	fail_unless(waveform->levels[waveform->levels_count - 1].points_count == 1);
+
+	/* Cached waveforms are the same */
+	fail_unless(mkdtemp(directory) != NULL);
+	pillbig_audio_set_waveform_cache(pillbig, directory);
+	pillbig_audio_waveform_free(pillbig_audio_get_waveform(pillbig, 16));
+	snprintf(filename, 256, "%s/%08X-%d.wfm", directory,
+		pillbig_get_entry(pillbig, 16)->hash, pillbig_get_entry(pillbig, 16)->size);
+	file = fopen(filename, "rb");
+	fail_unless(file != NULL);
+	fclose(file);
+
+	cached = pillbig_audio_get_waveform(pillbig, 16);
+	fail_unless(cached != NULL);
+	fail_unless(cached->samples_count == waveform->samples_count);
+	fail_unless(cached->levels_count == waveform->levels_count);
+	for (l = 0; l < waveform->levels_count; l++)
+	{
+		fail_unless(cached->levels[l].points_count == waveform->levels[l].points_count);
+		fail_unless(memcmp(cached->levels[l].points, waveform->levels[l].points,
+			waveform->levels[l].points_count * sizeof(PillBigAudioWaveformPoint)) == 0);
+	}
+
+	remove(filename);
+	rmdir(directory);
+	pillbig_audio_waveform_free(cached);
+	pillbig_audio_waveform_free(waveform);
+	free(full);
+}
+END_TEST
+
 
 
 
@@ -77,5 +799,23 @@ pillbig_audio_test_get_suite(void)
 	tcase_add_test(test_case, get_format);
 	suite_add_tcase(suite, test_case);
 
+	test_case = tcase_create("Conversion");
+	tcase_add_checked_fixture(test_case, setup, teardown);
+	tcase_add_test(test_case, extract_vag_wave_sizes);
+	tcase_add_test(test_case, trust_database);
+	tcase_add_test(test_case, extract_batch);
+	tcase_add_test(test_case, extract_batch_results);
+	tcase_add_test(test_case, extract_to_sinks);
+	tcase_add_test(test_case, codec_variants);
+	tcase_add_test(test_case, decode_range);
+	tcase_add_test(test_case, stream_read);
+	tcase_add_test(test_case, get_waveform);
+	tcase_add_test(test_case, analyze);
+	tcase_add_test(test_case, fingerprint_match);
+	tcase_add_test(test_case, resample_sine);
+	tcase_add_test(test_case, extract_resampled_wave);
+	tcase_add_test(test_case, extract_preview);
+	suite_add_tcase(suite, test_case);
+
 	return suite;
 }
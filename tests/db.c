@@ -16,6 +16,7 @@
 #include <pillbig/pillbig.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #ifdef HAVE_CONFIG_H
 #	include <config.h>
@@ -38,6 +39,12 @@ teardown()
 	pillbig_db_close(db);
 }
 
+static int
+same_string(const char *a, const char *b)
+{
+	return (a == NULL || b == NULL) ? a == b : strcmp(a, b) == 0;
+}
+
 
 
 START_TEST(get_files_count)
@@ -110,6 +117,418 @@ START_TEST(get_entry_index_by_hash)
 }
 END_TEST
 
+START_TEST(get_entry_indices)
+{
+	PillBigFileHash hashes[4];
+	int positions[4] = {0, 16, -1, 0};
+	int indices[4];
+	int i;
+
+	positions[3] = pillbig_db_get_files_count(db);
+	for (i = 0; i < 2; i++)
+	{
+		hashes[i] = pillbig_db_get_entry(db, pillbig_db_get_entry_index_by_position(db, positions[i]))->hash;
+	}
+	hashes[2] = 0x12345678;
+	/* Hashes below 0x10000000 have no leading zero in the database */
+	hashes[3] = 0x0D1F7A28;
+
+	fail_unless(pillbig_db_get_entry_indices_by_position(db, positions, 4, indices) == PillBigError_Success);
+	fail_unless(indices[0] == pillbig_db_get_entry_index_by_position(db, 0));
+	fail_unless(indices[1] == pillbig_db_get_entry_index_by_position(db, 16));
+	fail_unless(indices[2] == -1);
+	fail_unless(indices[3] == -1);
+
+	fail_unless(pillbig_db_get_entry_indices_by_hash(db, hashes, 4, indices) == PillBigError_Success);
+	fail_unless(indices[0] == pillbig_db_get_entry_index_by_position(db, 0));
+	fail_unless(indices[1] == pillbig_db_get_entry_index_by_position(db, 16));
+	fail_unless(indices[2] == -1);
+	fail_unless(indices[3] == 0);
+}
+END_TEST
+
+START_TEST(find_by_filename)
+{
+	const PillBigDBEntry *entry;
+	PillBigIndexSet set;
+	int i, count, length;
+
+	fail_unless(pillbig_db_get_entry_index_by_filename(db, "GAME\\AV0001.FAG") == 16);
+	fail_unless(pillbig_db_get_entry_index_by_filename(db, "game\\av0001.fag") == 16);
+	fail_unless(pillbig_db_get_entry_index_by_filename(db, "GAME\\AV0001.FA") == -1);
+
+	/* Prefix and pattern queries give what a scan would */
+	set = pillbig_db_find_by_prefix(db, "game\\av");
+	fail_unless(set != NULL);
+	count = 0;
+	for (i = 0; i < pillbig_db_get_files_count(db); i++)
+	{
+		entry = pillbig_db_get_entry(db, i);
+		if (entry->filename != NULL && strncmp(entry->filename, "GAME\\AV", 7) == 0)
+		{
+			fail_unless(pillbig_index_set_contains(set, i));
+			count++;
+		}
+	}
+	fail_unless(count > 0);
+	fail_unless(pillbig_index_set_get_count(set) == count);
+	pillbig_index_set_free(set);
+
+	set = pillbig_db_find_by_pattern(db, "*.fag");
+	fail_unless(set != NULL);
+	count = 0;
+	for (i = 0; i < pillbig_db_get_files_count(db); i++)
+	{
+		entry = pillbig_db_get_entry(db, i);
+		length = (entry->filename != NULL) ? strlen(entry->filename) : 0;
+		if (length >= 4 && strcmp(&entry->filename[length - 4], ".FAG") == 0)
+		{
+			fail_unless(pillbig_index_set_contains(set, i));
+			count++;
+		}
+	}
+	fail_unless(count > 0);
+	fail_unless(pillbig_index_set_get_count(set) == count);
+	pillbig_index_set_free(set);
+
+	set = pillbig_db_find_by_pattern(db, "GAME\\AV000?.*");
+	fail_unless(set != NULL);
+	fail_unless(pillbig_index_set_next(set, 0) == 16);
+	for (i = pillbig_index_set_next(set, 0); i != -1; i = pillbig_index_set_next(set, i + 1))
+	{
+		fail_unless(strncmp(pillbig_db_get_entry(db, i)->filename, "GAME\\AV000", 10) == 0);
+	}
+	pillbig_index_set_free(set);
+}
+END_TEST
+
+START_TEST(get_audio_entry)
+{
+	const PillBigDBEntry *dbentry;
+	int i;
+
+	dbentry = pillbig_db_get_entry(db, 16);
+	fail_unless(dbentry != NULL);
+	fail_unless(dbentry->hash == 0x5B6D710B);
+	fail_unless(dbentry->filetype == PillBigFileType_Audio);
+	fail_unless(dbentry->used == 0);
+	fail_unless(strcmp(dbentry->filename, "GAME\\AV0001.FAG") == 0);
+
+	fail_unless(dbentry->audio != NULL);
+	fail_unless(strcmp(dbentry->audio->character, "Ariel") == 0);
+	fail_unless(dbentry->audio->speeches_count == 2);
+	fail_unless(strcmp(dbentry->audio->speeches[0].language, "en") == 0);
+	fail_unless(strcmp(dbentry->audio->speeches[1].language, "es") == 0);
+	fail_unless(strncmp(dbentry->audio->speeches[0].speech, "The Circle of Nine", 18) == 0);
+
+	/* Character names are stored once */
+	fail_unless(dbentry->audio->character == pillbig_db_get_entry(db, 17)->audio->character);
+
+	/* Entries come in index order */
+	for (i = 0; i < pillbig_db_get_files_count(db); i++)
+	{
+		fail_unless(pillbig_db_get_entry_index_by_position(db, i) == i);
+	}
+}
+END_TEST
+
+START_TEST(get_speech)
+{
+	const PillBigDBAudioSpeech *speech;
+	int en, es;
+
+	fail_unless(pillbig_db_get_languages_count(db) == 2);
+	en = pillbig_db_get_language_id(db, "en");
+	es = pillbig_db_get_language_id(db, "es");
+	fail_unless(en != -1 && es != -1 && en != es);
+	fail_unless(strcmp(pillbig_db_get_language(db, es), "es") == 0);
+	fail_unless(pillbig_db_get_language_id(db, "fr") == -1);
+
+	speech = pillbig_db_get_speech(db, 16, es);
+	fail_unless(speech != NULL);
+	fail_unless(speech == &pillbig_db_get_entry(db, 16)->audio->speeches[1]);
+	fail_unless(pillbig_db_get_speech(db, 0, en) == NULL);
+
+	/* Locales by preference, the territory and codeset ignored */
+	fail_unless(pillbig_db_set_locale(db, "es_ES.UTF-8") == PillBigError_Success);
+	fail_unless(pillbig_db_get_speech(db, 16, DB_LANGUAGE_PREFERRED) == speech);
+	fail_unless(pillbig_db_set_locale(db, "fr_FR:EN") == PillBigError_Success);
+	fail_unless(pillbig_db_get_speech(db, 16, DB_LANGUAGE_PREFERRED) == pillbig_db_get_speech(db, 16, en));
+	fail_unless(pillbig_db_set_locale(db, "esperanto") == PillBigError_Success);
+	fail_unless(pillbig_db_get_speech(db, 16, DB_LANGUAGE_PREFERRED) == &pillbig_db_get_entry(db, 16)->audio->speeches[0]);
+	fail_unless(pillbig_db_set_locale(db, "C") == PillBigError_Success);
+	fail_unless(pillbig_db_get_speech(db, 0, DB_LANGUAGE_PREFERRED) == NULL);
+}
+END_TEST
+
+START_TEST(search_speeches)
+{
+	const PillBigDBEntry *entry;
+	int indices[64], others[64];
+	int count, i, s, found;
+
+	/* Diacritics and case are ignored */
+	count = pillbig_db_search_speeches(db, "circulo", "es", NULL, indices, 64);
+	fail_unless(count > 0 && count <= 64);
+	fail_unless(pillbig_db_search_speeches(db, "CÍRCULO", "es", NULL, others, 64) == count);
+	fail_unless(memcmp(indices, others, count * sizeof(int)) == 0);
+	for (i = 0, found = 0; i < count; i++)
+	{
+		found |= (indices[i] == 16);
+	}
+	fail_unless(found);
+	fail_unless(pillbig_db_search_speeches(db, "circulo", "en", NULL, indices, 64) == 0);
+
+	count = pillbig_db_search_speeches(db, "vorador", "en", "Kain", indices, 64);
+	fail_unless(count > 0 && count <= 64);
+	for (i = 0; i < count; i++)
+	{
+		entry = pillbig_db_get_entry(db, indices[i]);
+		fail_unless(strcmp(entry->audio->character, "Kain") == 0);
+		for (s = 0, found = 0; s < entry->audio->speeches_count; s++)
+		{
+			found |= (strcmp(entry->audio->speeches[s].language, "en") == 0
+				&& strstr(entry->audio->speeches[s].speech, "Vorador") != NULL);
+		}
+		fail_unless(found);
+	}
+
+	/* Every term must be found */
+	count = pillbig_db_search_speeches(db, "Vorador, sur", NULL, NULL, indices, 64);
+	fail_unless(count > 0 && count <= 64);
+	for (i = 0; i < count; i++)
+	{
+		entry = pillbig_db_get_entry(db, indices[i]);
+		for (s = 0, found = 0; s < entry->audio->speeches_count; s++)
+		{
+			found |= (strstr(entry->audio->speeches[s].speech, "Vorador") != NULL
+				&& strstr(entry->audio->speeches[s].speech, "sur") != NULL);
+		}
+		fail_unless(found);
+	}
+
+	fail_unless(pillbig_db_search_speeches(db, "vorador", NULL, NULL, NULL, 0) > count);
+	fail_unless(pillbig_db_search_speeches(db, "vorador zzzz", NULL, NULL, indices, 64) == 0);
+}
+END_TEST
+
+START_TEST(filter_entries)
+{
+	const PillBigDBEntry *entry;
+	PillBigIndexSet set, other;
+	int kain, count, large, high, i;
+	int indices[4];
+
+	kain = pillbig_db_get_character_id(db, "Kain");
+	fail_unless(kain != -1);
+	fail_unless(pillbig_db_get_character_id(db, "Nobody") == -1);
+	fail_unless(pillbig_db_get_column(db, PillBigDBColumn_Size)[16] == pillbig_db_get_entry(db, 16)->size);
+
+	set = pillbig_db_filter(db, PillBigDBColumn_Size, PillBigDBCompare_Greater, 102400);
+	other = pillbig_db_filter(db, PillBigDBColumn_Character, PillBigDBCompare_Equal, kain);
+	fail_unless(set != NULL && other != NULL);
+	fail_unless(pillbig_index_set_and(set, other) == PillBigError_Success);
+	pillbig_index_set_free(other);
+
+	count = large = high = 0;
+	for (i = 0; i < pillbig_db_get_files_count(db); i++)
+	{
+		entry = pillbig_db_get_entry(db, i);
+		if (entry->size > 102400 && entry->filetype == PillBigFileType_Audio
+			&& entry->audio->character != NULL && strcmp(entry->audio->character, "Kain") == 0)
+		{
+			fail_unless(pillbig_index_set_contains(set, i));
+			count++;
+		}
+		large += (entry->size <= 102400);
+		high += (entry->hash >= 0x80000000);
+	}
+	fail_unless(count > 0);
+	fail_unless(pillbig_index_set_get_count(set) == count);
+	fail_unless(pillbig_index_set_get_indices(set, indices, 4) == ((count < 4) ? count : 4));
+	fail_unless(indices[0] == pillbig_index_set_next(set, 0));
+	pillbig_index_set_free(set);
+
+	/* Complements and unions */
+	set = pillbig_db_filter(db, PillBigDBColumn_Size, PillBigDBCompare_LessEqual, 102400);
+	fail_unless(pillbig_index_set_get_count(set) == large);
+	pillbig_index_set_not(set);
+	fail_unless(pillbig_index_set_get_count(set) == pillbig_db_get_files_count(db) - large);
+	other = pillbig_db_filter(db, PillBigDBColumn_Size, PillBigDBCompare_LessEqual, 102400);
+	pillbig_index_set_or(set, other);
+	fail_unless(pillbig_index_set_get_count(set) == pillbig_db_get_files_count(db));
+	pillbig_index_set_free(other);
+	pillbig_index_set_free(set);
+
+	/* Hashes are unsigned */
+	set = pillbig_db_filter(db, PillBigDBColumn_Hash, PillBigDBCompare_GreaterEqual, (int)0x80000000);
+	fail_unless(pillbig_index_set_get_count(set) == high);
+	pillbig_index_set_free(set);
+}
+END_TEST
+
+START_TEST(compile_database)
+{
+	const PillBigDBEntry *entry, *image_entry;
+	PillBigDB image;
+	int i, j;
+
+	fail_unless(pillbig_db_compile(db, "pillbig-test.bin") == PillBigError_Success);
+	image = pillbig_db_open("pillbig-test.bin");
+	fail_unless(image != NULL);
+	fail_unless(pillbig_db_get_files_count(image) == pillbig_db_get_files_count(db));
+
+	for (i = 0; i < pillbig_db_get_files_count(db); i++)
+	{
+		fail_unless(pillbig_db_get_entry_index_by_position(image, i) ==
+			pillbig_db_get_entry_index_by_position(db, i));
+
+		entry = pillbig_db_get_entry(db, pillbig_db_get_entry_index_by_position(db, i));
+		image_entry = pillbig_db_get_entry(image, pillbig_db_get_entry_index_by_position(db, i));
+		fail_unless(image_entry != NULL);
+		fail_unless(image_entry->hash == entry->hash);
+		fail_unless(image_entry->offset == entry->offset);
+		fail_unless(image_entry->size == entry->size);
+		fail_unless(image_entry->used == entry->used);
+		fail_unless(image_entry->filetype == entry->filetype);
+		fail_unless(same_string(image_entry->filename, entry->filename));
+		fail_unless(pillbig_db_get_entry_index_by_hash(image, entry->hash) ==
+			pillbig_db_get_entry_index_by_hash(db, entry->hash));
+
+		if (entry->filetype == PillBigFileType_Audio)
+		{
+			fail_unless(image_entry->audio->samples_count == entry->audio->samples_count);
+			fail_unless(image_entry->audio->header_size == entry->audio->header_size);
+			fail_unless(image_entry->audio->checksum == entry->audio->checksum);
+			fail_unless(image_entry->audio->speeches_count == entry->audio->speeches_count);
+			for (j = 0; j < entry->audio->speeches_count; j++)
+			{
+				fail_unless(same_string(image_entry->audio->speeches[j].language,
+					entry->audio->speeches[j].language));
+				fail_unless(same_string(image_entry->audio->speeches[j].speech,
+					entry->audio->speeches[j].speech));
+			}
+		}
+	}
+	fail_unless(pillbig_db_get_entry_index_by_hash(image, 0x12345678) == -1);
+
+	pillbig_db_close(image);
+	remove("pillbig-test.bin");
+}
+END_TEST
+
+START_TEST(generate_database)
+{
+	const char *names[] = { "GAME\\AV0001.FAG", "NOT\\A\\FILE.BIN" };
+	const PillBigDBEntry *entry, *saved_entry;
+	PillBig pillbig, serial;
+	PillBigDB generated, saved;
+	int i, named;
+
+	pillbig = pillbig_open_from_filename("pill.big");
+	serial = pillbig_open_from_filename("pill.big");
+	fail_unless(pillbig != NULL && serial != NULL);
+
+	generated = pillbig_db_generate(pillbig, names, 2, 4);
+	fail_unless(generated != NULL);
+	fail_unless(pillbig_db_get_files_count(generated) == pillbig_get_files_count(pillbig));
+
+	fail_unless(pillbig_db_save(generated, "pillbig-test.xml") == PillBigError_Success);
+	saved = pillbig_db_open("pillbig-test.xml");
+	fail_unless(saved != NULL);
+
+	/* Probed by four threads, the same as probed by one */
+	for (i = 0; i < pillbig_get_files_count(pillbig); i++)
+	{
+		entry = pillbig_db_get_entry(generated, i);
+		fail_unless(entry != NULL);
+		fail_unless(entry->hash == pillbig_get_entry(pillbig, i)->hash);
+		fail_unless(entry->offset == pillbig_get_entry(pillbig, i)->offset);
+		fail_unless(entry->size == pillbig_get_entry(pillbig, i)->size);
+		fail_unless(entry->filetype == pillbig_file_get_type(serial, i));
+		fail_unless(pillbig_db_get_entry_index_by_position(generated, i) == i);
+
+		if (entry->filetype == PillBigFileType_Audio)
+		{
+			fail_unless(entry->audio->format == pillbig_audio_get_format(serial, i));
+			fail_unless(pillbig_audio_get_duration(pillbig, i) == pillbig_audio_get_duration(serial, i));
+			fail_unless(entry->audio->checksum != 0);
+		}
+
+		saved_entry = pillbig_db_get_entry(saved, i);
+		fail_unless(saved_entry != NULL);
+		fail_unless(saved_entry->hash == entry->hash);
+		fail_unless(saved_entry->offset == entry->offset);
+		fail_unless(saved_entry->size == entry->size);
+		fail_unless(saved_entry->filetype == entry->filetype);
+		fail_unless(same_string(saved_entry->filename, entry->filename));
+		if (entry->filetype == PillBigFileType_Audio)
+		{
+			fail_unless(saved_entry->audio->format == entry->audio->format);
+			fail_unless(saved_entry->audio->rate == entry->audio->rate);
+			fail_unless(saved_entry->audio->samples_count == entry->audio->samples_count);
+			fail_unless(saved_entry->audio->header_size == entry->audio->header_size);
+			fail_unless(saved_entry->audio->checksum == entry->audio->checksum);
+		}
+	}
+
+	/* Only candidates hashing like a file name it */
+	named = pillbig_get_entry_index_by_hash(pillbig, pillbig_get_hash_by_filename(names[0]));
+	for (i = 0; i < pillbig_get_files_count(pillbig); i++)
+	{
+		entry = pillbig_db_get_entry(generated, i);
+		fail_unless(same_string(entry->filename, (i == named) ? names[0] : NULL));
+	}
+
+	pillbig_db_close(saved);
+	pillbig_db_close(generated);
+	pillbig_close(serial);
+	pillbig_close(pillbig);
+	remove("pillbig-test.xml");
+}
+END_TEST
+
+START_TEST(load_malformed_database)
+{
+	const char *repeated =
+		"<pillbig platform=\"pc\">"
+		"<file index=\"3\"><hash>1</hash></file>"
+		"<file index=\"3\"><hash>2</hash></file>"
+		"</pillbig>";
+	const char *out_of_range =
+		"<pillbig platform=\"pc\"><file index=\"100000000\"/></pillbig>";
+	PillBigDB loaded, saved;
+	FILE *file;
+
+	/* A repeated index replaces the entry and is saved once */
+	file = fopen("pillbig-test.xml", "w");
+	fail_unless(file != NULL);
+	fputs(repeated, file);
+	fclose(file);
+	loaded = pillbig_db_open("pillbig-test.xml");
+	fail_unless(loaded != NULL);
+	fail_unless(pillbig_db_get_files_count(loaded) == 1);
+	fail_unless(pillbig_db_get_entry(loaded, 3)->hash == 2);
+
+	fail_unless(pillbig_db_save(loaded, "pillbig-test.xml") == PillBigError_Success);
+	saved = pillbig_db_open("pillbig-test.xml");
+	fail_unless(saved != NULL);
+	fail_unless(pillbig_db_get_files_count(saved) == 1);
+	pillbig_db_close(saved);
+	pillbig_db_close(loaded);
+
+	/* Indices past any archive are rejected before growing the entries */
+	file = fopen("pillbig-test.xml", "w");
+	fail_unless(file != NULL);
+	fputs(out_of_range, file);
+	fclose(file);
+	fail_unless(pillbig_db_open("pillbig-test.xml") == NULL);
+	fail_unless(pillbig_error_get() == PillBigError_FileIndexOutOfRange);
+
+	remove("pillbig-test.xml");
+}
+END_TEST
+
 START_TEST(validate_database)
 {
 	int result = system("xmllint --noout --dtdvalid pillbig.dtd pillbig.xml 2>/dev/null");
@@ -143,6 +562,15 @@ pillbig_db_test_get_suite(void)
 	tcase_add_test(test_case, get_first_entry);
 	tcase_add_test(test_case, get_last_entry);
 	tcase_add_test(test_case, get_entry_index_by_hash);
+	tcase_add_test(test_case, get_entry_indices);
+	tcase_add_test(test_case, find_by_filename);
+	tcase_add_test(test_case, get_audio_entry);
+	tcase_add_test(test_case, get_speech);
+	tcase_add_test(test_case, search_speeches);
+	tcase_add_test(test_case, filter_entries);
+	tcase_add_test(test_case, compile_database);
+	tcase_add_test(test_case, generate_database);
+	tcase_add_test(test_case, load_malformed_database);
 	suite_add_tcase(suite, test_case);
 
 	test_case = tcase_create("Integration");
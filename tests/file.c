@@ -16,6 +16,9 @@
 #include <pillbig/pillbig.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #ifdef HAVE_CONFIG_H
 #	include <config.h>
@@ -163,6 +166,231 @@ START_TEST(get_index_by_hash)
 }
 END_TEST
 
+START_TEST(probe_entries)
+{
+	PillBig unprobed = pillbig_open_from_filename(TEST_PILLBIG_FILENAME);
+	fail_unless(unprobed != NULL);
+
+	pillbig_probe_entries(pillbig, 1);
+	fail_unless(pillbig_error_get() == PillBigError_Success);
+
+	int i;
+	for (i = 0; i < pillbig_get_files_count(pillbig); i++)
+	{
+		fail_unless(pillbig_file_get_type(pillbig, i) ==
+		            pillbig_file_get_type(unprobed, i));
+	}
+
+	pillbig_close(unprobed);
+}
+END_TEST
+
+
+
+START_TEST(get_types)
+{
+	PillBigFileType *filetypes;
+	int i;
+
+	filetypes = (PillBigFileType *)calloc(pillbig_get_files_count(pillbig),
+		sizeof(PillBigFileType));
+	fail_unless(filetypes != NULL);
+
+	pillbig_file_get_types(pillbig, filetypes);
+	fail_unless(pillbig_error_get() == PillBigError_Success);
+
+	for (i = 0; i < pillbig_get_files_count(pillbig); i++)
+	{
+		fail_unless(filetypes[i] == pillbig_file_get_type(pillbig, i));
+	}
+
+	switch (pillbig_get_platform(pillbig))
+	{
+		case PillBigPlatform_PC:
+			fail_unless(filetypes[16]   == PillBigFileType_Audio);
+			fail_unless(filetypes[327]  == PillBigFileType_Bitmap);
+			fail_unless(filetypes[2294] == PillBigFileType_Bitmap);
+			break;
+		default:
+			break;
+	}
+
+	free(filetypes);
+}
+END_TEST
+
+START_TEST(get_types_match_database)
+{
+	const PillBigFileEntry *entry;
+	const PillBigDBEntry *dbentry;
+	PillBigFileType *filetypes;
+	PillBigDB db;
+	int i, index;
+
+	db = pillbig_db_open("pillbig.xml");
+	fail_unless(db != NULL);
+
+	filetypes = (PillBigFileType *)calloc(pillbig_get_files_count(pillbig),
+		sizeof(PillBigFileType));
+	fail_unless(filetypes != NULL);
+
+	/* Classified without the database, checked against its labels */
+	pillbig_file_get_types(pillbig, filetypes);
+	fail_unless(pillbig_error_get() == PillBigError_Success);
+
+	for (i = 0; i < pillbig_get_files_count(pillbig); i++)
+	{
+		entry = pillbig_get_entry(pillbig, i);
+		index = pillbig_db_get_entry_index_by_hash(db, entry->hash);
+		dbentry = (index != -1) ? pillbig_db_get_entry(db, index) : NULL;
+		if (dbentry == NULL)
+		{
+			continue;
+		}
+
+		/* Every audio file is typed, untyped files are never audio */
+		if (dbentry->filetype == PillBigFileType_Unknown)
+		{
+			fail_unless(filetypes[i] != PillBigFileType_Audio);
+		}
+		else if (filetypes[i] != PillBigFileType_Unknown)
+		{
+			fail_unless(filetypes[i] == dbentry->filetype);
+		}
+	}
+
+	/* With a database, its types are used even if unknown */
+	pillbig_set_db(pillbig, db);
+	for (i = 0; i < pillbig_get_files_count(pillbig); i++)
+	{
+		dbentry = pillbig_db_get_entry(db, i);
+		if (dbentry != NULL)
+		{
+			fail_unless(pillbig_file_get_type(pillbig, i) == dbentry->filetype);
+		}
+	}
+	pillbig_set_db(pillbig, NULL);
+
+	free(filetypes);
+	pillbig_db_close(db);
+}
+END_TEST
+
+/**
+ *  Classifies a file of the test pill.big replacing its first bytes and size.
+ */
+static PillBigFileType
+get_patched_type(char *data, long data_size, int index,
+	const unsigned char *header, int header_size, int size)
+{
+	unsigned int *table = (unsigned int *)(data + 4 + index * 12);
+	unsigned int saved_size = table[1];
+	unsigned char saved[64];
+	PillBigFileType filetype;
+	PillBigSource source;
+	PillBig patched;
+
+	memcpy(saved, data + table[2], header_size);
+	memcpy(data + table[2], header, header_size);
+	table[1] = size;
+
+	source = pillbig_source_new_from_memory(data, data_size);
+	fail_unless(source != NULL);
+	patched = pillbig_open_from_source(source);
+	fail_unless(patched != NULL);
+	filetype = pillbig_file_get_type(patched, index);
+	fail_unless(pillbig_error_get() == PillBigError_Success);
+	pillbig_close(patched);
+	pillbig_source_free(source);
+
+	memcpy(data + table[2], saved, header_size);
+	table[1] = saved_size;
+
+	return filetype;
+}
+
+START_TEST(classify_signatures)
+{
+	const PillBigFileEntry *entry;
+	unsigned char header[64];
+	char *data;
+	long data_size;
+	int i, index, size;
+
+	fail_unless(fseek(pillbig_file, 0, SEEK_END) == 0);
+	data_size = ftell(pillbig_file);
+	data = (char *)malloc(data_size);
+	fail_unless(data != NULL);
+	rewind(pillbig_file);
+	fail_unless(fread(data, 1, data_size, pillbig_file) == data_size);
+
+	/* Any file large enough to hold every signature */
+	for (index = 0; index < pillbig_get_files_count(pillbig); index++)
+	{
+		entry = pillbig_get_entry(pillbig, index);
+		if (entry->size >= 4096)
+		{
+			break;
+		}
+	}
+	fail_unless(index < pillbig_get_files_count(pillbig));
+	size = entry->size;
+
+	/* TIM, 16 bits without CLUT */
+	memset(header, 0, sizeof(header));
+	header[0] = 0x10;
+	header[4] = 0x02;
+	header[8] = (size - 8) & 0xff;
+	header[9] = ((size - 8) >> 8) & 0xff;
+	fail_unless(get_patched_type(data, data_size, index, header, 64, size) ==
+		PillBigFileType_Bitmap);
+	header[4] = 0x12;
+	fail_unless(get_patched_type(data, data_size, index, header, 64, size) ==
+		PillBigFileType_Unknown);
+
+	/* Headerless VAG, every block checked */
+	memset(header, 0x55, sizeof(header));
+	for (i = 0; i < 64; i += 16)
+	{
+		header[i] = 0x2c;
+		header[i + 1] = 0x00;
+	}
+	header[0] = 0x00;
+	header[1] = 0x02;
+	fail_unless(get_patched_type(data, data_size, index, header, 64, size) ==
+		PillBigFileType_Audio);
+	header[33] = 0x80;
+	fail_unless(get_patched_type(data, data_size, index, header, 64, size) ==
+		PillBigFileType_Unknown);
+	header[33] = 0x00;
+	header[48] = 0x5c;
+	fail_unless(get_patched_type(data, data_size, index, header, 64, size) ==
+		PillBigFileType_Unknown);
+
+	/* VAG with header, at least a block after it */
+	memset(header, 0, sizeof(header));
+	memcpy(header, "VAGp", 4);
+	fail_unless(get_patched_type(data, data_size, index, header, 64, size) ==
+		PillBigFileType_Audio);
+	fail_unless(get_patched_type(data, data_size, index, header, 64, 64) ==
+		PillBigFileType_Unknown);
+
+	/* Headerless IMA ADPCM, only told by its leading zeros and size */
+	if (pillbig_get_platform(pillbig) == PillBigPlatform_PC)
+	{
+		memset(header, 0x37, sizeof(header));
+		header[0] = 0x00;
+		header[1] = 0x00;
+		fail_unless(get_patched_type(data, data_size, index, header, 64, size) ==
+			PillBigFileType_Audio);
+		fail_unless(get_patched_type(data, data_size, index, header, 64, 512) ==
+			PillBigFileType_Unknown);
+	}
+
+	free(data);
+}
+END_TEST
+
 
 
 START_TEST(open_from_filename)
@@ -198,6 +426,165 @@ START_TEST(file_extract)
 }
 END_TEST
 
+static char *memory_data;
+static long  memory_size;
+
+static int
+read_callback(void *buffer, int size, long offset, void *user_data)
+{
+	if (offset >= memory_size)
+	{
+		return 0;
+	}
+
+	/* Short reads must be completed by the library */
+	size = (size < 1000) ? size : 1000;
+	size = (offset + size <= memory_size) ? size : memory_size - offset;
+	memcpy(buffer, memory_data + offset, size);
+
+	return size;
+}
+
+START_TEST(open_from_source)
+{
+	int indices[] = { 16, 300, 303, 327, 2294 };
+	const void *expected, *data;
+	int expected_size, size;
+	PillBigSource source;
+	PillBigSink sinks[2];
+	PillBig opened;
+	int i, j, fd;
+
+	fail_unless(fseek(pillbig_file, 0, SEEK_END) == 0);
+	memory_size = ftell(pillbig_file);
+	memory_data = (char *)malloc(memory_size);
+	fail_unless(memory_data != NULL);
+	rewind(pillbig_file);
+	fail_unless(fread(memory_data, 1, memory_size, pillbig_file) == memory_size);
+
+	fd = open(TEST_PILLBIG_FILENAME, O_RDONLY);
+	fail_unless(fd != -1);
+
+	for (i = 0; i < 4; i++)
+	{
+		switch (i)
+		{
+			case 0:  source = pillbig_source_new_from_memory(memory_data, memory_size); break;
+			case 1:  source = pillbig_source_new_from_fd(fd); break;
+			case 2:  source = pillbig_source_new_mapped(fd); break;
+			default: source = pillbig_source_new_from_callback(read_callback, -1, NULL); break;
+		}
+		fail_unless(source != NULL);
+
+		opened = pillbig_open_from_source(source);
+		fail_unless(opened != NULL);
+		fail_unless(pillbig_get_files_count(opened) == pillbig_get_files_count(pillbig));
+
+		for (j = 0; j < 5; j++)
+		{
+			sinks[0] = pillbig_sink_new_memory();
+			sinks[1] = pillbig_sink_new_memory();
+			pillbig_audio_extract_to_sink(pillbig, indices[j], sinks[0], PillBigAudioFormat_WAVE);
+			pillbig_audio_extract_to_sink(opened, indices[j], sinks[1], PillBigAudioFormat_WAVE);
+			fail_unless(pillbig_error_get() == PillBigError_Success ||
+				pillbig_error_get() == PillBigError_NotImplemented);
+
+			expected = pillbig_sink_get_data(sinks[0], &expected_size);
+			data = pillbig_sink_get_data(sinks[1], &size);
+			fail_unless(size == expected_size);
+			fail_unless(memcmp(data, expected, size) == 0);
+			pillbig_sink_free(sinks[0]);
+			pillbig_sink_free(sinks[1]);
+		}
+
+		pillbig_close(opened);
+		pillbig_source_free(source);
+	}
+
+	close(fd);
+	free(memory_data);
+}
+END_TEST
+
+/**
+ *  Local file standing in for a remote store reachable through byte
+ *  range reads.
+ */
+typedef struct
+{
+	int    fd;          /**< Local file. */
+	int    requests;    /**< Count of range requests. */
+	long   bytes;       /**< Bytes requested. */
+}
+RangeStore;
+
+static int
+range_callback(void *buffer, int size, long offset, void *user_data)
+{
+	RangeStore *store = (RangeStore *)user_data;
+
+	store->requests++;
+	store->bytes += size;
+
+	return pread(store->fd, buffer, size, offset);
+}
+
+START_TEST(open_from_ranged_source)
+{
+	int indices[] = { 16, 17, 18, 300, 2294 };
+	const void *expected, *data;
+	int expected_size, size, entries_size = 0;
+	PillBigSource source;
+	PillBigSink sinks[2];
+	RangeStore store;
+	PillBig opened;
+	int i, requests;
+
+	store.fd = open(TEST_PILLBIG_FILENAME, O_RDONLY);
+	store.requests = 0;
+	store.bytes = 0;
+	fail_unless(store.fd != -1);
+
+	source = pillbig_source_new_ranged(range_callback, -1, 4096, 16, &store);
+	fail_unless(source != NULL);
+
+	/* The entries table comes in a single request */
+	opened = pillbig_open_from_source(source);
+	fail_unless(opened != NULL);
+	fail_unless(store.requests == 1);
+	fail_unless(pillbig_get_files_count(opened) == pillbig_get_files_count(pillbig));
+
+	for (i = 0; i < 5; i++)
+	{
+		requests = store.requests;
+		sinks[0] = pillbig_sink_new_memory();
+		sinks[1] = pillbig_sink_new_memory();
+		pillbig_file_extract_to_sink(pillbig, indices[i], sinks[0]);
+		pillbig_file_extract_to_sink(opened, indices[i], sinks[1]);
+		fail_unless(pillbig_error_get() == PillBigError_Success);
+
+		expected = pillbig_sink_get_data(sinks[0], &expected_size);
+		data = pillbig_sink_get_data(sinks[1], &size);
+		fail_unless(size == expected_size);
+		fail_unless(memcmp(data, expected, size) == 0);
+		pillbig_sink_free(sinks[0]);
+		pillbig_sink_free(sinks[1]);
+
+		/* Adjacent blocks come together, as many as half the cache */
+		fail_unless(store.requests - requests <=
+			1 + pillbig_get_entry(pillbig, indices[i])->size / (8 * 4096));
+		entries_size += pillbig_get_entry(pillbig, indices[i])->size;
+	}
+
+	/* Only the table and the entries blocks were fetched */
+	fail_unless(store.bytes <= 4 + FILES_COUNT_PC * 12 + 4096 + entries_size + 5 * 2 * 4096);
+
+	pillbig_close(opened);
+	pillbig_source_free(source);
+	close(store.fd);
+}
+END_TEST
+
 START_TEST(file_extract_to_filename)
 {
 	pillbig_file_extract_to_filename(pillbig, 0, "test");
@@ -240,6 +627,10 @@ pillbig_file_test_get_suite(void)
 	tcase_add_test(test_case, get_last_entry);
 	tcase_add_test(test_case, get_unexistent_entry);
 	tcase_add_test(test_case, get_index_by_hash);
+	tcase_add_test(test_case, probe_entries);
+	tcase_add_test(test_case, get_types);
+	tcase_add_test(test_case, get_types_match_database);
+	tcase_add_test(test_case, classify_signatures);
 	suite_add_tcase(suite, test_case);
 
 	test_case = tcase_create("IO");
@@ -248,6 +639,8 @@ pillbig_file_test_get_suite(void)
 	tcase_add_test(test_case, open_from_filename_fail);
 	tcase_add_test(test_case, file_extract);
 	tcase_add_test(test_case, file_extract_to_filename);
+	tcase_add_test(test_case, open_from_source);
+	tcase_add_test(test_case, open_from_ranged_source);
 	suite_add_tcase(suite, test_case);
 
 	return suite;